@@ -0,0 +1,72 @@
+# See ../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Google Benchmark, for textsearch_bench: an installed one if there is one,
+# otherwise it is downloaded.
+function(download_benchmark)
+  if(CMAKE_VERSION VERSION_LESS 3.11)
+    list(APPEND CMAKE_MODULE_PATH ${CMAKE_SOURCE_DIR}/cmake/Modules)
+  endif()
+
+  include(FetchContent)
+
+  set(benchmark_URL  "https://github.com/google/benchmark/archive/refs/tags/v1.8.3.tar.gz")
+  set(benchmark_URL2 "https://huggingface.co/csukuangfj/k2-cmake-deps/resolve/main/benchmark-1.8.3.tar.gz")
+  set(benchmark_HASH "SHA256=6bc180a57d23d4d9515519f92b0c83d61b05b5bab188961f36ac7b06b0d9e9ce")
+
+  # If you don't have access to the Internet,
+  # please pre-download benchmark
+  set(possible_file_locations
+    $ENV{HOME}/Downloads/benchmark-1.8.3.tar.gz
+    ${PROJECT_SOURCE_DIR}/benchmark-1.8.3.tar.gz
+    ${PROJECT_BINARY_DIR}/benchmark-1.8.3.tar.gz
+    /tmp/benchmark-1.8.3.tar.gz
+  )
+
+  foreach(f IN LISTS possible_file_locations)
+    if(EXISTS ${f})
+      set(benchmark_URL  "${f}")
+      file(TO_CMAKE_PATH "${benchmark_URL}" benchmark_URL)
+      set(benchmark_URL2)
+      break()
+    endif()
+  endforeach()
+
+  set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+  set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+  set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+
+  FetchContent_Declare(benchmark
+    URL
+      ${benchmark_URL}
+      ${benchmark_URL2}
+    URL_HASH          ${benchmark_HASH}
+  )
+
+  FetchContent_GetProperties(benchmark)
+  if(NOT benchmark_POPULATED)
+    message(STATUS "Downloading benchmark from ${benchmark_URL}")
+    FetchContent_Populate(benchmark)
+  endif()
+  message(STATUS "benchmark is downloaded to ${benchmark_SOURCE_DIR}")
+
+  add_subdirectory(${benchmark_SOURCE_DIR} ${benchmark_BINARY_DIR} EXCLUDE_FROM_ALL)
+endfunction()
+
+find_package(benchmark QUIET)
+if(benchmark_FOUND)
+  message(STATUS "Found benchmark ${benchmark_VERSION}")
+else()
+  download_benchmark()
+endif()
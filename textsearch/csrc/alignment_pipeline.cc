@@ -0,0 +1,226 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/alignment_pipeline.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+#include "textsearch/csrc/close_matches.h"
+#include "textsearch/csrc/reference_index.h"
+
+namespace fasttextsearch {
+
+template <typename SymbolT, typename IndexT>
+AlignmentPipeline<SymbolT, IndexT>::AlignmentPipeline(
+    const SymbolT *text, IndexT seq_len, const IndexT *suffix_array,
+    const IndexT *lcp, const int64_t *row_splits, int64_t num_docs,
+    const AlignmentPipelineOptions &options)
+    : text_(text), seq_len_(seq_len), suffix_array_(suffix_array), lcp_(lcp),
+      options_(options), input_(options.queue_capacity),
+      tasks_(options.queue_capacity), output_(options.queue_capacity) {
+  assert(seq_len >= 2);
+  assert(options.num_close_matches > 0 && options.num_candidates > 0);
+  assert(options.num_close_matches == 1 || lcp != nullptr);
+  if (row_splits != nullptr) {
+    assert(num_docs >= 0 && row_splits[0] == 0);
+    row_splits_.assign(row_splits, row_splits + num_docs + 1);
+  } else {
+    row_splits_ = {0, static_cast<int64_t>(seq_len) - 1};
+  }
+
+  int32_t num_seed_threads = GetNumThreads(options.num_seed_threads),
+          num_align_threads = GetNumThreads(options.num_align_threads);
+  num_seeding_ = num_seed_threads;
+  num_aligning_ = num_align_threads;
+  for (int32_t i = 0; i < num_seed_threads; i++)
+    threads_.emplace_back(&AlignmentPipeline::SeedLoop, this);
+  for (int32_t i = 0; i < num_align_threads; i++)
+    threads_.emplace_back(&AlignmentPipeline::AlignLoop, this);
+}
+
+template <typename SymbolT, typename IndexT>
+AlignmentPipeline<SymbolT, IndexT>::~AlignmentPipeline() {
+  input_.Close();
+  tasks_.Close();
+  output_.Close();
+  // Pop() still returns the items left after Close(): drop them so that the
+  // threads stop after the ones they are working on.
+  input_.Clear();
+  tasks_.Clear();
+  output_.Clear();
+  for (auto &t : threads_)
+    t.join();
+}
+
+template <typename SymbolT, typename IndexT>
+bool AlignmentPipeline<SymbolT, IndexT>::Push(AlignmentQuery<SymbolT> query) {
+  assert(query.times.empty() || query.times.size() == query.symbols.size());
+  return input_.Push(std::move(query));
+}
+
+template <typename SymbolT, typename IndexT>
+void AlignmentPipeline<SymbolT, IndexT>::Close() {
+  input_.Close();
+}
+
+template <typename SymbolT, typename IndexT>
+bool AlignmentPipeline<SymbolT, IndexT>::Pop(AlignmentResult *result) {
+  return output_.Pop(result);
+}
+
+template <typename SymbolT, typename IndexT>
+void AlignmentPipeline<SymbolT, IndexT>::SeedLoop() {
+  AlignmentQuery<SymbolT> query;
+  std::vector<int64_t> spans;
+  while (input_.Pop(&query)) {
+    auto shared_query =
+        std::make_shared<const AlignmentQuery<SymbolT>>(std::move(query));
+    FindSpans(*shared_query, &spans);
+    int32_t num_candidates = static_cast<int32_t>(spans.size() / 2);
+    if (num_candidates == 0) {
+      AlignmentResult result;
+      result.query_id = shared_query->id;
+      output_.Push(std::move(result));
+      continue;
+    }
+    for (int32_t k = 0; k < num_candidates; k++) {
+      Task task{shared_query, k, num_candidates, spans[2 * k],
+                spans[2 * k + 1]};
+      if (!tasks_.Push(std::move(task)))
+        break;
+    }
+  }
+  if (--num_seeding_ == 0)
+    tasks_.Close();
+}
+
+template <typename SymbolT, typename IndexT>
+void AlignmentPipeline<SymbolT, IndexT>::AlignLoop() {
+  BacktraceArena arena;
+  Task task;
+  while (tasks_.Pop(&task)) {
+    AlignmentResult result;
+    Align(task, &arena, &result);
+    // So that the query is freed after its last task.
+    task.query.reset();
+    if (!output_.Push(std::move(result)))
+      break;
+  }
+  if (--num_aligning_ == 0)
+    output_.Close();
+}
+
+template <typename SymbolT, typename IndexT>
+void AlignmentPipeline<SymbolT, IndexT>::FindSpans(
+    const AlignmentQuery<SymbolT> &query, std::vector<int64_t> *spans) const {
+  spans->clear();
+  IndexT query_len = static_cast<IndexT>(query.symbols.size());
+  if (query_len == 0)
+    return;
+  int32_t num_close_matches = options_.num_close_matches,
+          num_candidates = options_.num_candidates;
+  size_t size = 2 * static_cast<size_t>(num_close_matches) * query_len;
+  std::vector<IndexT> close_matches(size), match_lengths(size);
+  FindCloseMatchesInReference(
+      text_, seq_len_, suffix_array_, lcp_, query.symbols.data(), query_len,
+      num_close_matches, static_cast<IndexT>(options_.min_match_length),
+      close_matches.data(), match_lengths.data());
+
+  // As in Python, the query goes first in the text of
+  // FindCandidateMatchesWithLengths(), before the reference.
+  int64_t num_ref_docs = static_cast<int64_t>(row_splits_.size()) - 1;
+  std::vector<IndexT> row_splits(num_ref_docs + 2);
+  row_splits[0] = 0;
+  for (int64_t d = 0; d <= num_ref_docs; d++)
+    row_splits[d + 1] = static_cast<IndexT>(row_splits_[d] + query_len);
+  for (IndexT &m : close_matches)
+    m += query_len;
+  std::vector<int64_t> candidates(2 * num_candidates);
+  FindCandidateMatchesWithLengths(
+      close_matches.data(), match_lengths.data(), num_close_matches,
+      row_splits.data(), static_cast<int32_t>(num_ref_docs + 1), 1,
+      options_.length_ratio, num_candidates, candidates.data());
+
+  int64_t extension =
+      static_cast<int64_t>(std::ceil(options_.span_extension * query_len));
+  for (int32_t k = 0; k < num_candidates; k++) {
+    int64_t begin = candidates[2 * k], end = candidates[2 * k + 1];
+    if (begin < 0)
+      continue;
+    begin -= query_len;
+    end -= query_len;
+    // The reference document of the region.
+    int64_t d = std::upper_bound(row_splits_.begin(), row_splits_.end(),
+                                 begin) -
+                row_splits_.begin() - 1;
+    assert(d >= 0 && d < num_ref_docs && end <= row_splits_[d + 1]);
+    spans->push_back(std::max(begin - extension, row_splits_[d]));
+    spans->push_back(std::min(end + extension, row_splits_[d + 1]));
+  }
+}
+
+template <typename SymbolT, typename IndexT>
+void AlignmentPipeline<SymbolT, IndexT>::Align(const Task &task,
+                                               BacktraceArena *arena,
+                                               AlignmentResult *result) const {
+  const AlignmentQuery<SymbolT> &query = *task.query;
+  result->query_id = query.id;
+  result->candidate = task.candidate;
+  result->num_candidates = task.num_candidates;
+  result->ref_begin = task.ref_begin;
+  result->ref_end = task.ref_end;
+
+  const SymbolT *target = text_ + task.ref_begin;
+  size_t target_length = static_cast<size_t>(task.ref_end - task.ref_begin);
+  std::vector<LevenshteinElement> alignments;
+  result->distance = LevenshteinDistance(
+      query.symbols.data(), query.symbols.size(), target, target_length,
+      &alignments, arena, options_.insert_cost, options_.delete_cost,
+      options_.replace_cost, options_.engine, options_.max_distance);
+  if (result->distance == -1 || alignments.empty())
+    return;
+  GetAlignment(query.symbols.data(), target, alignments.front(), *arena,
+               &result->ops, &result->query_positions, &result->ref_positions);
+
+  if (query.times.empty())
+    return;
+  std::vector<int32_t> ref_text(target, target + target_length);
+  SegmenterInput input;
+  input.ops = result->ops.data();
+  input.num_ops = static_cast<int32_t>(result->ops.size());
+  input.query_positions = result->query_positions.data();
+  input.target_positions = result->ref_positions.data();
+  input.times = query.times.data();
+  input.query_len = static_cast<int32_t>(query.times.size());
+  input.ref_text = ref_text.data();
+  input.ref_len = static_cast<int32_t>(target_length);
+  FindSegments(input, options_.segmenter_options, &result->segments);
+}
+
+template class AlignmentPipeline<uint8_t, int32_t>;
+template class AlignmentPipeline<uint8_t, int64_t>;
+template class AlignmentPipeline<uint16_t, int32_t>;
+template class AlignmentPipeline<uint16_t, int64_t>;
+template class AlignmentPipeline<int32_t, int32_t>;
+template class AlignmentPipeline<int32_t, int64_t>;
+template class AlignmentPipeline<int64_t, int64_t>;
+
+} // namespace fasttextsearch
@@ -0,0 +1,210 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_ALIGNMENT_PIPELINE_H_
+#define TEXTSEARCH_CSRC_ALIGNMENT_PIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/segmenter.h"
+
+namespace fasttextsearch {
+
+struct AlignmentPipelineOptions {
+  // The close matches of each query position, see
+  // FindCloseMatchesInReference(); num_close_matches > 1 needs the LCP array.
+  int32_t num_close_matches = 1;
+  int64_t min_match_length = 0;
+
+  // The candidate regions of each query, see
+  // FindCandidateMatchesWithLengths().
+  float length_ratio = 2.0f;
+  int32_t num_candidates = 1;
+
+  // Each candidate region is extended by span_extension times the length of
+  // the query on both sides (within its reference document) before it is
+  // aligned with the query, as its ends are those of the close matches.
+  float span_extension = 0.1f;
+
+  // The alignment, see LevenshteinDistance().
+  int32_t insert_cost = 1;
+  int32_t delete_cost = 1;
+  int32_t replace_cost = 1;
+  LevenshteinEngine engine = LevenshteinEngine::kAuto;
+  int32_t max_distance = -1;
+
+  // The segmentation of the alignments of the queries that have times, see
+  // FindSegments().
+  SegmenterOptions segmenter_options;
+
+  // The threads that find the candidates of the queries and those that align
+  // them; <= 0 means to use all hardware threads.
+  int32_t num_seed_threads = 1;
+  int32_t num_align_threads = 1;
+
+  // The capacity of each of the queues between the stages (in queries for
+  // the input, in candidates for the others).
+  int32_t queue_capacity = 16;
+};
+
+// A query document, e.g. an automatic transcript of a recording.
+template <typename SymbolT> struct AlignmentQuery {
+  // Any number that identifies it in the results.
+  int64_t id = 0;
+  // Its symbols, which must be less than the termination symbol of the
+  // reference text.
+  std::vector<SymbolT> symbols;
+  // Optional: the time of each symbol, non-decreasing; if given the
+  // alignments are split into segments.
+  std::vector<float> times;
+};
+
+// The alignment of a query with one of its candidate regions.
+struct AlignmentResult {
+  int64_t query_id = 0;
+  // The rank of the candidate region, 0 for the best one, and the number of
+  // candidate regions of the query, i.e. of its results.  A query without
+  // candidates has one result with candidate == -1 and num_candidates == 0.
+  int32_t candidate = -1;
+  int32_t num_candidates = 0;
+  // The span [ref_begin, ref_end) of the reference text that the query was
+  // aligned with: the candidate region, extended.
+  int64_t ref_begin = -1;
+  int64_t ref_end = -1;
+  // The Levenshtein distance, or -1 if there was no match within
+  // max_distance (or no candidate); the alignment is empty then.
+  int32_t distance = -1;
+  // The alignment, as from GetAlignment(), with the reference positions
+  // relative to ref_begin.
+  std::vector<AlignmentOp> ops;
+  std::vector<int32_t> query_positions;
+  std::vector<int32_t> ref_positions;
+  // The segments of the alignment if the query has times, with their
+  // reference positions also relative to ref_begin.
+  std::vector<Segment> segments;
+};
+
+/*
+  Aligns a stream of query documents with a reference text that has a suffix
+  array, as the Python code does stage by stage (close matches, candidate
+  regions, Levenshtein alignment, segments), but with the stages running
+  concurrently: seeding threads take queries from a bounded input queue and
+  find their candidate regions, and put one task per candidate into a bounded
+  queue that alignment threads take from, which put their results into a
+  bounded output queue.  So while a long query is being aligned, the
+  candidates of the next ones are found and more queries can be pushed, and
+  the memory used is bounded by the capacities of the queues.  Each stage is
+  single-threaded per item; the parallelism is across items.
+
+  Push() and Pop() block while the input queue is full and while the output
+  queue is empty, so they must be called from different threads if more
+  queries are pushed than the queues can hold without popping results.
+
+  Template args: SymbolT and IndexT are as for CreateSuffixArray(), with the
+  same instantiations.
+ */
+template <typename SymbolT, typename IndexT> class AlignmentPipeline {
+public:
+  /*
+    Starts the threads.
+
+      @param [in] text  The reference text, as passed to CreateSuffixArray(),
+               i.e. ending with the termination symbol and 3 zeros.
+      @param [in] seq_len  The length of the reference text including the
+               termination symbol; require seq_len >= 2.
+      @param [in] suffix_array  The suffix array of `text`.
+      @param [in] lcp  The LCP array of `suffix_array`, or nullptr if
+               options.num_close_matches == 1.
+      @param [in] row_splits  The documents of the reference text, as for
+               ReferenceIndex in Python, of num_docs + 1 elements; or nullptr
+               for one document [0, seq_len - 1).
+      @param [in] num_docs  The number of documents if row_splits is given.
+      @param [in] options  The options.
+
+    The arrays must outlive the pipeline.
+   */
+  AlignmentPipeline(const SymbolT *text, IndexT seq_len,
+                    const IndexT *suffix_array, const IndexT *lcp,
+                    const int64_t *row_splits, int64_t num_docs,
+                    const AlignmentPipelineOptions &options);
+
+  // Stops the threads, dropping the queries and results that are left.
+  ~AlignmentPipeline();
+
+  AlignmentPipeline(const AlignmentPipeline &) = delete;
+  AlignmentPipeline &operator=(const AlignmentPipeline &) = delete;
+
+  // Adds a query, waiting while the input queue is full.  Returns false
+  // (without adding it) after Close().
+  bool Push(AlignmentQuery<SymbolT> query);
+
+  // Ends the input; the queries that were pushed are still processed.
+  void Close();
+
+  // Gets the next result to complete, waiting while there is none.  Returns
+  // false when all the results of the queries pushed before Close() were
+  // returned.  The order of the results is not deterministic.
+  bool Pop(AlignmentResult *result);
+
+private:
+  struct Task {
+    std::shared_ptr<const AlignmentQuery<SymbolT>> query;
+    int32_t candidate;
+    int32_t num_candidates;
+    int64_t ref_begin;
+    int64_t ref_end;
+  };
+
+  void SeedLoop();
+  void AlignLoop();
+
+  // Writes the candidate regions of `query` to `spans`, extended, as pairs
+  // (begin, end).
+  void FindSpans(const AlignmentQuery<SymbolT> &query,
+                 std::vector<int64_t> *spans) const;
+
+  void Align(const Task &task, BacktraceArena *arena,
+             AlignmentResult *result) const;
+
+  const SymbolT *text_;
+  IndexT seq_len_;
+  const IndexT *suffix_array_;
+  const IndexT *lcp_;
+  std::vector<int64_t> row_splits_;
+  AlignmentPipelineOptions options_;
+
+  BoundedQueue<AlignmentQuery<SymbolT>> input_;
+  BoundedQueue<Task> tasks_;
+  BoundedQueue<AlignmentResult> output_;
+
+  // The seeding and alignment threads that have not finished; the last one
+  // of each closes the queue after it.
+  std::atomic<int32_t> num_seeding_;
+  std::atomic<int32_t> num_aligning_;
+  std::vector<std::thread> threads_;
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_ALIGNMENT_PIPELINE_H_
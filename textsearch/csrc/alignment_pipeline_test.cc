@@ -0,0 +1,154 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "textsearch/csrc/alignment_pipeline.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+TEST(AlignmentPipelineTest, TestBasic) {
+  // A reference of two documents; each query is a piece of it with a few
+  // replacements, and must be aligned with a span that contains the piece.
+  std::mt19937 rng(0);
+  int32_t doc_len = 3000, seq_len = 2 * doc_len + 1;
+  std::vector<int32_t> text(seq_len + 3, 0);
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text[i] = 1 + rng() % 20;
+  text[seq_len - 1] = 21;
+  std::vector<int32_t> suffix_array(seq_len);
+  CreateSuffixArray(text.data(), seq_len, 21, suffix_array.data());
+  std::vector<int64_t> row_splits = {0, doc_len, 2 * doc_len};
+
+  for (int32_t num_threads : {1, 3}) {
+    AlignmentPipelineOptions options;
+    options.num_candidates = 2;
+    options.num_seed_threads = num_threads;
+    options.num_align_threads = num_threads;
+    options.queue_capacity = 2;
+    options.segmenter_options.min_duration = 0.5f;
+    AlignmentPipeline<int32_t, int32_t> pipeline(
+        text.data(), seq_len, suffix_array.data(), nullptr, row_splits.data(),
+        2, options);
+
+    int32_t num_queries = 20, query_len = 200;
+    std::vector<int64_t> begins(num_queries);
+    std::thread producer([&]() {
+      std::mt19937 rng(1);
+      for (int32_t q = 0; q < num_queries; q++) {
+        AlignmentQuery<int32_t> query;
+        query.id = q;
+        begins[q] = rng() % (doc_len - query_len) + (q % 2) * doc_len;
+        query.symbols.assign(text.begin() + begins[q],
+                             text.begin() + begins[q] + query_len);
+        for (int32_t e = 0; e < 3; e++)
+          query.symbols[rng() % query_len] = 1 + rng() % 20;
+        if (q % 2 == 0) {
+          for (int32_t i = 0; i < query_len; i++)
+            query.times.push_back(0.05f * i);
+        }
+        EXPECT_TRUE(pipeline.Push(std::move(query)));
+      }
+      // The last query has no candidates, as none of its symbols is in the
+      // reference.
+      AlignmentQuery<int32_t> query;
+      query.id = num_queries;
+      query.symbols.assign(10, 0);
+      EXPECT_TRUE(pipeline.Push(std::move(query)));
+      pipeline.Close();
+    });
+
+    std::map<int64_t, int32_t> num_results;
+    AlignmentResult result;
+    while (pipeline.Pop(&result)) {
+      num_results[result.query_id]++;
+      if (result.query_id == num_queries) {
+        EXPECT_EQ(result.candidate, -1);
+        EXPECT_EQ(result.num_candidates, 0);
+        continue;
+      }
+      EXPECT_GE(result.num_candidates, 1);
+      EXPECT_LE(result.num_candidates, 2);
+      EXPECT_EQ(result.ops.size(), result.query_positions.size());
+      EXPECT_EQ(result.ops.size(), result.ref_positions.size());
+      if (result.candidate != 0)
+        continue;
+      int64_t begin = begins[result.query_id];
+      EXPECT_LE(result.ref_begin, begin);
+      EXPECT_GE(result.ref_end, begin + query_len);
+      EXPECT_LE(result.distance, 3);
+      int32_t first_ref = -1;
+      for (int32_t p : result.ref_positions) {
+        if (p != -1) {
+          first_ref = p;
+          break;
+        }
+      }
+      // The edits may move the start of the alignment a little.
+      EXPECT_LE(std::abs(result.ref_begin + first_ref - begin), 3);
+      EXPECT_EQ(result.segments.empty(), result.query_id % 2 != 0);
+    }
+    producer.join();
+
+    EXPECT_EQ(num_results.size(), num_queries + 1);
+    EXPECT_EQ(num_results[num_queries], 1);
+  }
+}
+
+TEST(AlignmentPipelineTest, TestDestroyWithPendingQueries) {
+  // Destroying the pipeline without popping the results must not hang.
+  std::vector<int32_t> text = {1, 2, 3, 1, 2, 4, 5, 0, 0, 0};
+  int32_t seq_len = 7;
+  std::vector<int32_t> suffix_array(seq_len);
+  CreateSuffixArray(text.data(), seq_len, 5, suffix_array.data());
+  AlignmentPipelineOptions options;
+  options.queue_capacity = 1;
+  AlignmentPipeline<int32_t, int32_t> pipeline(text.data(), seq_len,
+                                               suffix_array.data(), nullptr,
+                                               nullptr, 0, options);
+  for (int32_t q = 0; q < 3; q++) {
+    AlignmentQuery<int32_t> query;
+    query.id = q;
+    query.symbols = {1, 2, 4};
+    EXPECT_TRUE(pipeline.Push(std::move(query)));
+  }
+}
+
+TEST(AlignmentPipelineTest, TestBoundedQueueClear) {
+  BoundedQueue<int32_t> queue(4);
+  for (int32_t i = 0; i < 3; i++)
+    EXPECT_TRUE(queue.Push(i));
+  queue.Close();
+  int32_t item = -1;
+  EXPECT_TRUE(queue.Pop(&item));
+  EXPECT_EQ(item, 0);
+  // The items left after Close() are popped unless they are cleared.
+  queue.Clear();
+  EXPECT_FALSE(queue.Pop(&item));
+  EXPECT_FALSE(queue.Push(3));
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,398 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/close_matches.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace fasttextsearch {
+
+// Suffix arrays shorter than this many elements per thread are not split
+// across threads.
+static constexpr int64_t kMinChunkSize = 1 << 16;
+
+template <typename IndexT>
+void FindCloseMatches(const IndexT *suffix_array, IndexT seq_len,
+                      IndexT query_len, IndexT *output, int32_t num_threads) {
+  assert(query_len >= 0 && query_len < seq_len);
+  FTS_STATS_SCOPE(Stage::kCloseMatches);
+  int32_t num_chunks = NumChunks(seq_len, num_threads, kMinChunkSize);
+
+  // first_ref[c] and last_ref[c] are the first and last reference positions
+  // in chunk c of the suffix array, or -1 if it has none.
+  std::vector<IndexT> first_ref(num_chunks, -1), last_ref(num_chunks, -1);
+  if (num_chunks > 1) {
+    ParallelFor(seq_len, num_chunks,
+                [&](int32_t c, int64_t begin, int64_t end) {
+                  for (IndexT i = begin; i < end; i++) {
+                    if (suffix_array[i] >= query_len) {
+                      if (first_ref[c] == -1)
+                        first_ref[c] = suffix_array[i];
+                      last_ref[c] = suffix_array[i];
+                    }
+                  }
+                });
+  }
+  // Fix-up at the chunk boundaries: prev_ref[c] is the last reference
+  // position before chunk c and next_ref[c] the first one after it.
+  std::vector<IndexT> prev_ref(num_chunks, -1), next_ref(num_chunks, -1);
+  for (int32_t c = 1; c < num_chunks; c++)
+    prev_ref[c] = last_ref[c - 1] != -1 ? last_ref[c - 1] : prev_ref[c - 1];
+  for (int32_t c = num_chunks - 2; c >= 0; c--)
+    next_ref[c] = first_ref[c + 1] != -1 ? first_ref[c + 1] : next_ref[c + 1];
+
+  IndexT eos_pos = seq_len - 1, no_match = seq_len - 2;
+  ParallelFor(seq_len, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    IndexT ref = prev_ref[c];
+    for (IndexT i = begin; i < end; i++) {
+      IndexT text_pos = suffix_array[i];
+      if (text_pos >= query_len)
+        ref = text_pos;
+      else
+        output[2 * text_pos] = ref == -1 ? no_match : ref;
+    }
+    ref = next_ref[c];
+    for (IndexT i = end - 1; i >= static_cast<IndexT>(begin); i--) {
+      IndexT text_pos = suffix_array[i];
+      if (text_pos >= query_len)
+        ref = text_pos;
+      else
+        output[2 * text_pos + 1] =
+            (ref == -1 || ref == eos_pos) ? no_match : ref;
+    }
+  });
+}
+
+namespace {
+
+/*
+  The up-to-`max_size` reference positions nearest to the current position of
+  a scan of the suffix array, nearest first, with their match lengths (the
+  minimum of the LCPs between them and the current position), which are
+  non-increasing.
+ */
+template <typename IndexT> class NearestRefs {
+public:
+  NearestRefs(int32_t max_size, IndexT min_match_length)
+      : max_size_(max_size), min_match_length_(min_match_length) {}
+
+  void Clear() { refs_.clear(); }
+
+  // Adds `pos` as the nearest position (at the current position of the
+  // scan, so its match length is not known yet).
+  void Push(IndexT pos) {
+    if (static_cast<int32_t>(refs_.size()) == max_size_)
+      refs_.pop_back();
+    refs_.insert(refs_.begin(), {pos, std::numeric_limits<IndexT>::max()});
+  }
+
+  // Adds `pos` as the farthest position, with a match length of `length`;
+  // used to set up the state at the start of a chunk.
+  void PushFarthest(IndexT pos, IndexT length) {
+    refs_.emplace_back(pos, length);
+  }
+
+  // Called when the scan moves past an LCP value of `lcp`.
+  void Update(IndexT lcp) {
+    for (auto &r : refs_) {
+      if (r.second <= lcp)
+        break; // the rest are shorter anyway.
+      r.second = lcp;
+    }
+    while (!refs_.empty() && refs_.back().second < min_match_length_)
+      refs_.pop_back();
+  }
+
+  int32_t Size() const { return static_cast<int32_t>(refs_.size()); }
+
+  // Writes the positions and lengths and pads them to max_size_.
+  void Write(IndexT no_match, IndexT *output, IndexT *output_lengths) const {
+    for (int32_t j = 0; j < max_size_; j++) {
+      bool have = j < Size();
+      output[j] = have ? refs_[j].first : no_match;
+      output_lengths[j] = have ? refs_[j].second : 0;
+    }
+  }
+
+private:
+  int32_t max_size_;
+  IndexT min_match_length_;
+  std::vector<std::pair<IndexT, IndexT>> refs_;
+};
+
+} // namespace
+
+template <typename IndexT>
+void FindCloseMatchesWithLengths(const IndexT *suffix_array, const IndexT *lcp,
+                                 IndexT seq_len, IndexT query_len,
+                                 int32_t num_close_matches,
+                                 IndexT min_match_length, IndexT *output,
+                                 IndexT *output_lengths, int32_t num_threads) {
+  assert(query_len >= 0 && query_len < seq_len);
+  assert(num_close_matches > 0);
+  FTS_STATS_SCOPE(Stage::kCloseMatches);
+  int32_t num_chunks = NumChunks(seq_len, num_threads, kMinChunkSize);
+  IndexT eos_pos = seq_len - 1, no_match = seq_len - 2,
+         infinity = std::numeric_limits<IndexT>::max();
+  int64_t stride = 2 * static_cast<int64_t>(num_close_matches);
+
+  ParallelFor(seq_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    NearestRefs<IndexT> refs(num_close_matches, min_match_length);
+    // The matches that precede each query position: first find the ones
+    // before this chunk.
+    IndexT m = infinity;
+    for (IndexT i = begin - 1; i >= 0 && m >= min_match_length; i--) {
+      if (suffix_array[i] >= query_len) {
+        refs.PushFarthest(suffix_array[i], m);
+        if (refs.Size() == num_close_matches)
+          break;
+      }
+      m = std::min(m, lcp[i]);
+    }
+    for (IndexT i = begin; i < end; i++) {
+      if (i > 0)
+        refs.Update(lcp[i]);
+      IndexT text_pos = suffix_array[i];
+      if (text_pos >= query_len)
+        refs.Push(text_pos);
+      else
+        refs.Write(no_match, output + stride * text_pos,
+                   output_lengths + stride * text_pos);
+    }
+
+    // The matches that follow each query position, likewise.
+    refs.Clear();
+    m = infinity;
+    for (IndexT i = end; i < seq_len && m >= min_match_length; i++) {
+      if (suffix_array[i] >= query_len && suffix_array[i] != eos_pos) {
+        refs.PushFarthest(suffix_array[i], m);
+        if (refs.Size() == num_close_matches)
+          break;
+      }
+      if (i + 1 < seq_len)
+        m = std::min(m, lcp[i + 1]);
+    }
+    for (IndexT i = end - 1; i >= static_cast<IndexT>(begin); i--) {
+      if (i + 1 < seq_len)
+        refs.Update(lcp[i + 1]);
+      IndexT text_pos = suffix_array[i];
+      if (text_pos >= query_len) {
+        if (text_pos != eos_pos)
+          refs.Push(text_pos);
+      } else {
+        refs.Write(no_match, output + stride * text_pos + num_close_matches,
+                   output_lengths + stride * text_pos + num_close_matches);
+      }
+    }
+  });
+}
+
+namespace {
+
+// A candidate region [begin, end) of the text, with the number (or total
+// length) of the close matches in it.
+struct Candidate {
+  int64_t begin;
+  int64_t end;
+  int64_t score;
+};
+
+/*
+  Adds `c` to `best`, which contains up to `num_candidates` non-overlapping
+  candidates.  If `c` overlaps with any of them it replaces them only if it has
+  a higher score than all of them; otherwise it is added if there is room or if
+  it has a higher score than the worst one, which it then replaces.
+ */
+void AddCandidate(const Candidate &c, int32_t num_candidates,
+                  std::vector<Candidate> *best) {
+  bool overlaps = false;
+  for (const Candidate &b : *best) {
+    if (b.begin < c.end && c.begin < b.end) {
+      if (b.score >= c.score)
+        return;
+      overlaps = true;
+    }
+  }
+  if (overlaps) {
+    best->erase(std::remove_if(best->begin(), best->end(),
+                               [&c](const Candidate &b) {
+                                 return b.begin < c.end && c.begin < b.end;
+                               }),
+                best->end());
+  } else if (static_cast<int32_t>(best->size()) == num_candidates) {
+    auto worst = std::min_element(best->begin(), best->end(),
+                                  [](const Candidate &a, const Candidate &b) {
+                                    return a.score < b.score;
+                                  });
+    if (worst->score >= c.score)
+      return;
+    best->erase(worst);
+  }
+  best->push_back(c);
+}
+
+/*
+  Implements FindCandidateMatches() (if match_lengths == nullptr, when each
+  close match scores 1) and FindCandidateMatchesWithLengths().
+ */
+template <typename IndexT>
+void FindCandidateMatchesImpl(const IndexT *close_matches,
+                              const IndexT *match_lengths,
+                              int32_t num_close_matches,
+                              const IndexT *row_splits, int32_t num_docs,
+                              int32_t num_query_docs, float length_ratio,
+                              int32_t num_candidates, int64_t *candidates,
+                              int32_t num_threads) {
+  assert(num_query_docs >= 0 && num_query_docs <= num_docs);
+  assert(num_candidates > 0 && length_ratio > 0 && num_close_matches > 0);
+  assert(row_splits[0] == 0);
+  FTS_STATS_SCOPE(Stage::kCandidateMatches);
+  const IndexT *ref_splits_begin = row_splits + num_query_docs,
+               *ref_splits_end = row_splits + num_docs + 1;
+  IndexT ref_begin = row_splits[num_query_docs];
+  int64_t stride = 2 * static_cast<int64_t>(num_close_matches);
+
+  int32_t num_chunks = NumChunks(num_query_docs, num_threads);
+  ParallelFor(num_query_docs, num_chunks, [&](int32_t, int64_t begin,
+                                              int64_t end) {
+    // The close matches, as (position, score).
+    std::vector<std::pair<IndexT, IndexT>> matches;
+    std::vector<IndexT> match_docs;
+    // score_sums[i] is the total score of matches[0..i-1].
+    std::vector<int64_t> score_sums;
+    std::vector<Candidate> best;
+    for (int64_t q = begin; q < end; q++) {
+      IndexT query_begin = row_splits[q], query_end = row_splits[q + 1];
+
+      // Only matches within the reference documents are meaningful; there
+      // may be others if the reference text is empty (see FindCloseMatches()).
+      matches.clear();
+      for (int64_t i = stride * query_begin; i < stride * query_end; i++) {
+        IndexT score = match_lengths != nullptr ? match_lengths[i] : 1;
+        if (close_matches[i] >= ref_begin && score > 0)
+          matches.emplace_back(close_matches[i], score);
+      }
+      std::sort(matches.begin(), matches.end());
+      int64_t num_matches = matches.size();
+      // match_docs[i] is the document that matches[i] is in.
+      match_docs.resize(num_matches);
+      score_sums.resize(num_matches + 1);
+      score_sums[0] = 0;
+      for (int64_t i = 0; i < num_matches; i++) {
+        match_docs[i] = std::upper_bound(ref_splits_begin, ref_splits_end,
+                                         matches[i].first) -
+                        row_splits - 1;
+        score_sums[i + 1] = score_sums[i] + matches[i].second;
+      }
+
+      // A region [matches[i], matches[j-1] + 1) is allowed if its length is
+      // at most max_len.
+      int64_t max_len = std::max<int64_t>(
+          static_cast<int64_t>((query_end - query_begin) * length_ratio), 1);
+      best.clear();
+      for (int64_t i = 0, j = 0; i < num_matches; i++) {
+        j = std::max(j, i + 1);
+        while (j < num_matches && match_docs[j] == match_docs[i] &&
+               matches[j].first - matches[i].first < max_len)
+          j++;
+        AddCandidate({matches[i].first, matches[j - 1].first + 1,
+                      score_sums[j] - score_sums[i]},
+                     num_candidates, &best);
+      }
+      std::stable_sort(best.begin(), best.end(),
+                       [](const Candidate &a, const Candidate &b) {
+                         return a.score > b.score;
+                       });
+
+      int64_t *this_candidates = candidates + 2 * q * num_candidates;
+      for (int32_t k = 0; k < num_candidates; k++) {
+        bool have = k < static_cast<int32_t>(best.size());
+        this_candidates[2 * k] = have ? best[k].begin : -1;
+        this_candidates[2 * k + 1] = have ? best[k].end : -1;
+      }
+    }
+  });
+}
+
+} // namespace
+
+template <typename IndexT>
+void FindCandidateMatches(const IndexT *close_matches, const IndexT *row_splits,
+                          int32_t num_docs, int32_t num_query_docs,
+                          float length_ratio, int32_t num_candidates,
+                          int64_t *candidates, int32_t num_threads) {
+  FindCandidateMatchesImpl<IndexT>(close_matches, nullptr, 1, row_splits,
+                                   num_docs, num_query_docs, length_ratio,
+                                   num_candidates, candidates, num_threads);
+}
+
+template <typename IndexT>
+void FindCandidateMatchesWithLengths(
+    const IndexT *close_matches, const IndexT *match_lengths,
+    int32_t num_close_matches, const IndexT *row_splits, int32_t num_docs,
+    int32_t num_query_docs, float length_ratio, int32_t num_candidates,
+    int64_t *candidates, int32_t num_threads) {
+  assert(match_lengths != nullptr);
+  FindCandidateMatchesImpl(close_matches, match_lengths, num_close_matches,
+                           row_splits, num_docs, num_query_docs, length_ratio,
+                           num_candidates, candidates, num_threads);
+}
+
+template void FindCloseMatches(const int32_t *suffix_array, int32_t seq_len,
+                               int32_t query_len, int32_t *output,
+                               int32_t num_threads);
+template void FindCloseMatches(const int64_t *suffix_array, int64_t seq_len,
+                               int64_t query_len, int64_t *output,
+                               int32_t num_threads);
+
+template void FindCandidateMatches(const int32_t *close_matches,
+                                   const int32_t *row_splits, int32_t num_docs,
+                                   int32_t num_query_docs, float length_ratio,
+                                   int32_t num_candidates, int64_t *candidates,
+                                   int32_t num_threads);
+template void FindCandidateMatches(const int64_t *close_matches,
+                                   const int64_t *row_splits, int32_t num_docs,
+                                   int32_t num_query_docs, float length_ratio,
+                                   int32_t num_candidates, int64_t *candidates,
+                                   int32_t num_threads);
+
+template void FindCloseMatchesWithLengths(
+    const int32_t *suffix_array, const int32_t *lcp, int32_t seq_len,
+    int32_t query_len, int32_t num_close_matches, int32_t min_match_length,
+    int32_t *output, int32_t *output_lengths, int32_t num_threads);
+template void FindCloseMatchesWithLengths(
+    const int64_t *suffix_array, const int64_t *lcp, int64_t seq_len,
+    int64_t query_len, int32_t num_close_matches, int64_t min_match_length,
+    int64_t *output, int64_t *output_lengths, int32_t num_threads);
+
+template void FindCandidateMatchesWithLengths(
+    const int32_t *close_matches, const int32_t *match_lengths,
+    int32_t num_close_matches, const int32_t *row_splits, int32_t num_docs,
+    int32_t num_query_docs, float length_ratio, int32_t num_candidates,
+    int64_t *candidates, int32_t num_threads);
+template void FindCandidateMatchesWithLengths(
+    const int64_t *close_matches, const int64_t *match_lengths,
+    int32_t num_close_matches, const int64_t *row_splits, int32_t num_docs,
+    int32_t num_query_docs, float length_ratio, int32_t num_candidates,
+    int64_t *candidates, int32_t num_threads);
+} // namespace fasttextsearch
@@ -0,0 +1,173 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_CLOSE_MATCHES_H_
+#define TEXTSEARCH_CSRC_CLOSE_MATCHES_H_
+
+#include <cstdint>
+
+namespace fasttextsearch {
+
+/*
+  Assuming the suffix array was created from a text where the first
+  `query_len` positions represent the query text and the remaining positions
+  represent the reference text, find, for each position in the query text,
+  the two positions in the reference text whose suffixes immediately precede
+  and follow it in the suffix array (i.e. that are lexicographically close to
+  it).
+
+  Template args: IndexT is the index type of the suffix array, int32_t or
+  int64_t.
+
+    @param [in] suffix_array  The suffix array as created by
+             CreateSuffixArray(), of length `seq_len`.
+    @param [in] seq_len  The length of the suffix array, including the
+             termination symbol.
+    @param [in] query_len  The length of the query part of the text;
+             require 0 <= query_len < seq_len.
+    @param [out] output  A pre-allocated array of length 2 * query_len.
+             At exit, output[2*i] and output[2*i+1] are the reference positions
+             that immediately precede and follow query position i in the
+             suffix array.  If there is no preceding reference position, or if
+             the following one would be the termination symbol (position
+             seq_len - 1), seq_len - 2 is written instead.
+    @param [in] num_threads  The number of threads to use; the suffix array
+             is split into chunks which are processed in parallel, after a
+             pass that finds the reference positions nearest to each chunk
+             boundary.  <= 0 means to use all hardware threads.
+ */
+template <typename IndexT>
+void FindCloseMatches(const IndexT *suffix_array, IndexT seq_len,
+                      IndexT query_len, IndexT *output,
+                      int32_t num_threads = 1);
+
+/*
+  Like FindCloseMatches(), but finds up to `num_close_matches` reference
+  positions on each side of each query position in the suffix array (not just
+  the nearest one), together with the lengths of the matches, i.e. the
+  longest common prefixes of their suffixes with the query suffix, which are
+  obtained from the LCP array.  A reference position is only output if its
+  match length is at least `min_match_length`; since the match lengths can
+  only decrease as we move away from the query position in the suffix array,
+  the search on each side stops at the first one that is too short.
+
+  Template args: IndexT is the index type of the suffix array, int32_t or
+  int64_t.
+
+    @param [in] suffix_array  The suffix array as created by
+             CreateSuffixArray(), of length `seq_len`.
+    @param [in] lcp  The LCP array of `suffix_array`, as created by
+             CreateLcpArray().
+    @param [in] seq_len  The length of the suffix array, including the
+             termination symbol.
+    @param [in] query_len  The length of the query part of the text;
+             require 0 <= query_len < seq_len.
+    @param [in] num_close_matches  The maximum number of matches on each side
+             of a query position; must be > 0.
+    @param [in] min_match_length  The minimum length of a match; with
+             num_close_matches == 1 and min_match_length == 0, `output` is
+             the same as for FindCloseMatches().
+    @param [out] output  A pre-allocated array of length
+             2 * num_close_matches * query_len.  At exit, with
+             k = num_close_matches, output[2*k*i + j] and
+             output[2*k*i + k + j] for 0 <= j < k are the j'th nearest
+             reference positions that precede and follow query position i in
+             the suffix array.  Unused elements are set to seq_len - 2, as for
+             FindCloseMatches(); the termination symbol is never output.
+    @param [out] output_lengths  A pre-allocated array of the same length as
+             `output`.  At exit it contains the match lengths of the positions
+             in `output`, or 0 for its unused elements.
+    @param [in] num_threads  The number of threads to use; the suffix array
+             is split into chunks which are processed in parallel, each
+             starting with a search for the matches before (and after) it.
+             <= 0 means to use all hardware threads.  The result does not
+             depend on it.
+ */
+template <typename IndexT>
+void FindCloseMatchesWithLengths(const IndexT *suffix_array, const IndexT *lcp,
+                                 IndexT seq_len, IndexT query_len,
+                                 int32_t num_close_matches,
+                                 IndexT min_match_length, IndexT *output,
+                                 IndexT *output_lengths,
+                                 int32_t num_threads = 1);
+
+/*
+  Finds candidate regions of the reference text that could be good matches for
+  each query document, using the output of FindCloseMatches().  For each query
+  document we look for up to `num_candidates` non-overlapping regions of one
+  reference document, each of length at most query_doc_len * length_ratio,
+  that contain the largest numbers of close matches of that query document.
+  This is done with a sliding window over the sorted close matches; the
+  non-overlapping constraint is enforced greedily (of two overlapping windows
+  we keep the one with more matches), so the result is approximate.
+
+  Template args: IndexT is the index type of the close matches, int32_t or
+  int64_t.
+
+    @param [in] close_matches  The output of FindCloseMatches(), of length
+             2 * row_splits[num_query_docs].
+    @param [in] row_splits  An array of length num_docs + 1 (like the
+             row_splits of a ragged tensor) such that document d occupies the
+             positions row_splits[d] <= pos < row_splits[d+1] of the text.
+             The query documents must come first, i.e. they are documents
+             0 .. num_query_docs - 1.  Must start with 0 and be non-decreasing.
+    @param [in] num_docs  The total number of documents, query and reference.
+    @param [in] num_query_docs  The number of query documents.
+    @param [in] length_ratio  The maximum length of a candidate region, as a
+             multiple of the length of the query document.
+    @param [in] num_candidates  The maximum number of candidate regions per
+             query document; must be > 0.
+    @param [out] candidates  A pre-allocated array of shape
+             (num_query_docs, num_candidates, 2).  At exit, candidates[q][k]
+             contains (begin, end), the positions in the text of the first
+             and one-past-the-last close matches of the k'th best region for
+             query document q, with the best region first; unused slots are
+             set to (-1, -1).
+    @param [in] num_threads  The number of threads to use; query documents are
+             processed in parallel, and the result does not depend on it.
+             <= 0 means to use all hardware threads.
+ */
+template <typename IndexT>
+void FindCandidateMatches(const IndexT *close_matches, const IndexT *row_splits,
+                          int32_t num_docs, int32_t num_query_docs,
+                          float length_ratio, int32_t num_candidates,
+                          int64_t *candidates, int32_t num_threads = 1);
+
+/*
+  Like FindCandidateMatches(), but for the output of
+  FindCloseMatchesWithLengths(): the regions are scored by the sum of the
+  lengths of the close matches in them rather than by their number, so that
+  long matches count for more than short (probably spurious) ones.  Close
+  matches of length 0, which include the unused elements, are ignored.
+
+    @param [in] close_matches  The output of FindCloseMatchesWithLengths(),
+             of length 2 * num_close_matches * row_splits[num_query_docs].
+    @param [in] match_lengths  Its output_lengths.
+    @param [in] num_close_matches  The num_close_matches it was called with.
+
+  The other args are as for FindCandidateMatches().
+ */
+template <typename IndexT>
+void FindCandidateMatchesWithLengths(
+    const IndexT *close_matches, const IndexT *match_lengths,
+    int32_t num_close_matches, const IndexT *row_splits, int32_t num_docs,
+    int32_t num_query_docs, float length_ratio, int32_t num_candidates,
+    int64_t *candidates, int32_t num_threads = 1);
+
+} // namespace fasttextsearch
+#endif // TEXTSEARCH_CSRC_CLOSE_MATCHES_H_
@@ -0,0 +1,292 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/close_matches.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+// A simple serial version of FindCloseMatches(), for comparison.
+template <typename IndexT>
+static std::vector<IndexT>
+FindCloseMatchesSimple(const std::vector<IndexT> &suffix_array,
+                       IndexT query_len) {
+  IndexT seq_len = suffix_array.size();
+  std::vector<IndexT> output(2 * query_len);
+  IndexT prev_ref = seq_len - 2;
+  for (IndexT i = 0; i < seq_len; i++) {
+    if (suffix_array[i] >= query_len)
+      prev_ref = suffix_array[i];
+    else
+      output[2 * suffix_array[i]] = prev_ref;
+  }
+  IndexT next_ref = seq_len - 2;
+  for (IndexT i = seq_len - 1; i >= 0; i--) {
+    if (suffix_array[i] >= query_len)
+      next_ref = suffix_array[i] == seq_len - 1 ? seq_len - 2 : suffix_array[i];
+    else
+      output[2 * suffix_array[i] + 1] = next_ref;
+  }
+  return output;
+}
+
+// A simple serial version of FindCloseMatchesWithLengths(), for comparison,
+// which compares the suffixes directly.
+static void FindCloseMatchesWithLengthsSimple(
+    const std::vector<int32_t> &text, const std::vector<int32_t> &suffix_array,
+    int32_t query_len, int32_t num_close_matches, int32_t min_match_length,
+    std::vector<int32_t> *output, std::vector<int32_t> *output_lengths) {
+  int32_t seq_len = suffix_array.size(), k = num_close_matches;
+  output->assign(2 * k * query_len, seq_len - 2);
+  output_lengths->assign(2 * k * query_len, 0);
+  for (int32_t r = 0; r < seq_len; r++) {
+    int32_t q = suffix_array[r];
+    if (q >= query_len)
+      continue;
+    for (int32_t side = 0; side < 2; side++) {
+      int32_t n = 0;
+      for (int32_t i = side == 0 ? r - 1 : r + 1;
+           i >= 0 && i < seq_len && n < k; i += side == 0 ? -1 : 1) {
+        int32_t pos = suffix_array[i], h = 0;
+        while (text[pos + h] == text[q + h])
+          h++;
+        if (h < min_match_length)
+          break;
+        if (pos < query_len || pos == seq_len - 1)
+          continue;
+        (*output)[2 * k * q + side * k + n] = pos;
+        (*output_lengths)[2 * k * q + side * k + n] = h;
+        n++;
+      }
+    }
+  }
+}
+
+TEST(CloseMatchesTest, TestBasic) {
+  // See also test_find_close_matches() in test_suffix_array.py.
+  std::string query = "hellohallo", reference = "iholloyouyouhellome";
+  std::string text = query + reference;
+  int32_t seq_len = text.size() + 1;
+  std::vector<int32_t> text_array(seq_len + 3, 0);
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text_array[i] = static_cast<unsigned char>(text[i]);
+  text_array[seq_len - 1] = 255;
+
+  std::vector<int32_t> suffix_array(seq_len);
+  CreateSuffixArray(text_array.data(), seq_len, 255, suffix_array.data());
+
+  int32_t query_len = query.size();
+  std::vector<int32_t> output(2 * query_len);
+  FindCloseMatches(suffix_array.data(), seq_len, query_len, output.data());
+  std::vector<int32_t> expected = {28, 22, 28, 23, 10, 24, 13, 25, 27, 12,
+                                   28, 22, 28, 23, 10, 24, 13, 25, 27, 12};
+  EXPECT_EQ(output, expected);
+}
+
+TEST(CloseMatchesTest, TestNumThreads) {
+  std::mt19937 rng(1234);
+  for (int32_t iter = 0; iter < 10; iter++) {
+    int64_t seq_len = std::uniform_int_distribution<int64_t>(1, 300000)(rng);
+    if (iter == 0)
+      seq_len = 1;
+    int64_t query_len =
+        std::uniform_int_distribution<int64_t>(0, seq_len - 1)(rng);
+    if (iter == 1)
+      query_len = seq_len - 1; // reference is only the termination symbol.
+
+    // The close matches only depend on the order of the suffixes, so any
+    // permutation that ends with the termination symbol will do.
+    std::vector<int64_t> suffix_array(seq_len);
+    for (int64_t i = 0; i < seq_len; i++)
+      suffix_array[i] = i;
+    std::shuffle(suffix_array.begin(), suffix_array.end() - 1, rng);
+    std::vector<int64_t> expected =
+        FindCloseMatchesSimple(suffix_array, query_len);
+
+    for (int32_t num_threads : {1, 2, 3, 8}) {
+      std::vector<int64_t> output(2 * query_len + 1, -10);
+      FindCloseMatches(suffix_array.data(), seq_len, query_len, output.data(),
+                       num_threads);
+      EXPECT_EQ(output.back(), -10); // should not write past the end.
+      output.pop_back();
+      EXPECT_EQ(output, expected);
+    }
+  }
+}
+
+TEST(CloseMatchesTest, TestWithLengths) {
+  std::mt19937 rng(2345);
+  for (int32_t iter = 0; iter < 8; iter++) {
+    // Long enough to be split across threads in the later iterations.
+    int32_t seq_len = std::uniform_int_distribution<int32_t>(
+        1, iter < 4 ? 2000 : 200000)(rng);
+    int32_t query_len =
+        std::uniform_int_distribution<int32_t>(0, seq_len - 1)(rng);
+    std::uniform_int_distribution<int32_t> uni(1, 3);
+    std::vector<int32_t> text(seq_len + 3, 0);
+    for (int32_t i = 0; i + 1 < seq_len; i++)
+      text[i] = uni(rng);
+    text[seq_len - 1] = 4; // Termination symbol
+
+    std::vector<int32_t> suffix_array(seq_len), lcp(seq_len);
+    CreateSuffixArray(text.data(), seq_len, 4, suffix_array.data());
+    CreateLcpArray(text.data(), seq_len, suffix_array.data(), lcp.data());
+
+    // With one match per side and no minimum length, the matches are those of
+    // FindCloseMatches().
+    std::vector<int32_t> close_matches(2 * query_len);
+    FindCloseMatches(suffix_array.data(), seq_len, query_len,
+                     close_matches.data());
+    std::vector<int32_t> output(2 * query_len), lengths(2 * query_len);
+    FindCloseMatchesWithLengths(suffix_array.data(), lcp.data(), seq_len,
+                                query_len, 1, 0, output.data(),
+                                lengths.data());
+    EXPECT_EQ(output, close_matches);
+
+    for (int32_t num_close_matches : {1, 3}) {
+      for (int32_t min_match_length : {0, 6}) {
+        std::vector<int32_t> expected, expected_lengths;
+        FindCloseMatchesWithLengthsSimple(text, suffix_array, query_len,
+                                          num_close_matches, min_match_length,
+                                          &expected, &expected_lengths);
+        output.resize(expected.size());
+        lengths.resize(expected.size());
+        for (int32_t num_threads : {1, 2, 3}) {
+          FindCloseMatchesWithLengths(suffix_array.data(), lcp.data(),
+                                      seq_len, query_len, num_close_matches,
+                                      min_match_length, output.data(),
+                                      lengths.data(), num_threads);
+          EXPECT_EQ(output, expected);
+          EXPECT_EQ(lengths, expected_lengths);
+        }
+      }
+    }
+  }
+}
+
+TEST(CloseMatchesTest, TestCandidateMatchesBasic) {
+  // Query documents 0 and 1, reference documents 2 and 3.
+  std::vector<int32_t> row_splits = {0, 4, 6, 106, 156};
+  std::vector<int32_t> close_matches = {
+      13, 50, 10, 121, 12, 11, 51, 120, // query document 0
+      106, 104, 107, 105                // query document 1
+  };
+  int32_t num_candidates = 3;
+  std::vector<int64_t> candidates(2 * 2 * num_candidates);
+  FindCandidateMatches(close_matches.data(), row_splits.data(), 4, 2, 2.0f,
+                       num_candidates, candidates.data());
+  // The region [10, 14) has the most matches; [11, 14) overlaps with it.
+  // [50, 52) and [120, 122) have the same number of matches and don't
+  // overlap.  For query document 1 (max length 4) the matches 104..107 are
+  // split into two regions as they are in different documents.
+  std::vector<int64_t> expected = {10,  14,  50,  52,  120, 122,
+                                   104, 106, 106, 108, -1,  -1};
+  EXPECT_EQ(candidates, expected);
+
+  num_candidates = 1;
+  candidates.resize(2 * 2 * num_candidates);
+  FindCandidateMatches(close_matches.data(), row_splits.data(), 4, 2, 2.0f,
+                       num_candidates, candidates.data());
+  expected = {10, 14, 104, 106};
+  EXPECT_EQ(candidates, expected);
+}
+
+TEST(CloseMatchesTest, TestCandidateMatchesNumThreads) {
+  std::mt19937 rng(4321);
+  int32_t num_query_docs = 200, num_docs = 210;
+  std::vector<int64_t> row_splits(num_docs + 1, 0);
+  for (int32_t d = 0; d < num_docs; d++)
+    row_splits[d + 1] =
+        row_splits[d] + std::uniform_int_distribution<int64_t>(0, 1000)(rng);
+  int64_t query_len = row_splits[num_query_docs],
+          seq_len = row_splits[num_docs] + 1;
+
+  std::vector<int64_t> close_matches(2 * query_len);
+  std::uniform_int_distribution<int64_t> ref_pos(query_len, seq_len - 2);
+  for (auto &m : close_matches)
+    m = ref_pos(rng);
+
+  int32_t num_candidates = 5;
+  std::vector<int64_t> expected(num_query_docs * num_candidates * 2);
+  FindCandidateMatches(close_matches.data(), row_splits.data(), num_docs,
+                       num_query_docs, 1.5f, num_candidates, expected.data());
+  for (int32_t q = 0; q < num_query_docs; q++) {
+    for (int32_t k = 0; k < num_candidates; k++) {
+      int64_t begin = expected[2 * (q * num_candidates + k)],
+              end = expected[2 * (q * num_candidates + k) + 1];
+      if (begin == -1) {
+        EXPECT_EQ(end, -1);
+        continue;
+      }
+      EXPECT_LT(begin, end);
+      EXPECT_LE(end - begin, std::max<int64_t>(
+                                 1.5f * (row_splits[q + 1] - row_splits[q]), 1));
+    }
+  }
+
+  for (int32_t num_threads : {2, 3, 8}) {
+    std::vector<int64_t> candidates(expected.size());
+    FindCandidateMatches(close_matches.data(), row_splits.data(), num_docs,
+                         num_query_docs, 1.5f, num_candidates,
+                         candidates.data(), num_threads);
+    EXPECT_EQ(candidates, expected);
+  }
+}
+
+TEST(CloseMatchesTest, TestCandidateMatchesWithLengths) {
+  // One query document, reference documents 1 and 2; two close matches on
+  // each side of each query position.
+  std::vector<int32_t> row_splits = {0, 3, 50, 100};
+  std::vector<int32_t> close_matches = {
+      10, 11, 60, 98, // query position 0
+      12, 98, 61, 98, // query position 1
+      13, 98, 62, 98, // query position 2
+  };
+  std::vector<int32_t> lengths = {1, 1, 9, 0, 1, 0, 8, 0, 1, 0, 7, 0};
+  int32_t num_candidates = 2;
+  std::vector<int64_t> candidates(2 * num_candidates);
+  FindCandidateMatchesWithLengths(close_matches.data(), lengths.data(), 2,
+                                  row_splits.data(), 3, 1, 2.0f,
+                                  num_candidates, candidates.data());
+  // [10, 14) has more matches but [60, 63) has longer ones; the matches of
+  // length 0 are ignored.
+  std::vector<int64_t> expected = {60, 63, 10, 14};
+  EXPECT_EQ(candidates, expected);
+
+  // With unit lengths the result is that of FindCandidateMatches() for the
+  // same matches.
+  std::vector<int32_t> unit_lengths(lengths.size(), 1);
+  FindCandidateMatchesWithLengths(close_matches.data(), unit_lengths.data(), 2,
+                                  row_splits.data(), 3, 1, 2.0f,
+                                  num_candidates, candidates.data());
+  std::vector<int64_t> unweighted(2 * num_candidates);
+  std::vector<int32_t> row_splits2 = {0, 6, 50, 100};
+  FindCandidateMatches(close_matches.data(), row_splits2.data(), 3, 1, 1.0f,
+                       num_candidates, unweighted.data());
+  EXPECT_EQ(candidates, unweighted);
+}
+
+} // namespace fasttextsearch
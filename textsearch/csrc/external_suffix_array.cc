@@ -0,0 +1,509 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/external_suffix_array.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/parallel.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// The size of the buffers of the sequential readers and writers, in bytes.
+constexpr size_t kIoBufferSize = 1 << 20;
+
+// The minimum number of records read at a time from each run when merging;
+// it limits the number of runs merged at once.
+constexpr int64_t kMinMergeBufferRecords = 1 << 10;
+
+bool SeekFile(FILE *file, int64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// A temporary file, removed when it is destroyed.
+class TempFile {
+public:
+  explicit TempFile(const std::string &prefix) {
+    static std::atomic<int64_t> counter(0);
+    filename_ = prefix + "." + std::to_string(counter++) + ".tmp";
+  }
+  ~TempFile() { std::remove(filename_.c_str()); }
+
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+
+  const std::string &Filename() const { return filename_; }
+
+private:
+  std::string filename_;
+};
+
+// Writes records of type T to a file through a buffer.
+template <typename T> class RecordWriter {
+public:
+  explicit RecordWriter(const std::string &filename)
+      : filename_(filename), file_(std::fopen(filename.c_str(), "wb")) {
+    if (file_ == nullptr)
+      throw std::runtime_error("Could not open " + filename + " for writing");
+    buffer_.reserve(std::max<size_t>(kIoBufferSize / sizeof(T), 1));
+  }
+  ~RecordWriter() {
+    if (file_ != nullptr)
+      std::fclose(file_);
+  }
+
+  void Write(const T &record) {
+    buffer_.push_back(record);
+    if (buffer_.size() == buffer_.capacity())
+      Flush();
+  }
+
+  void Write(const T *records, size_t n) {
+    Flush();
+    WriteRaw(records, n);
+  }
+
+  void Close() {
+    Flush();
+    FILE *file = file_;
+    file_ = nullptr;
+    if (std::fclose(file) != 0)
+      throw std::runtime_error("Error writing " + filename_);
+  }
+
+private:
+  void Flush() {
+    WriteRaw(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+  void WriteRaw(const T *records, size_t n) {
+    if (n != 0 && std::fwrite(records, sizeof(T), n, file_) != n)
+      throw std::runtime_error("Error writing " + filename_);
+  }
+
+  std::string filename_;
+  FILE *file_;
+  std::vector<T> buffer_;
+};
+
+// Reads records of type T from a file through a buffer, starting at the
+// `begin`'th one.
+template <typename T> class RecordReader {
+public:
+  RecordReader(const std::string &filename, int64_t begin = 0,
+               size_t buffer_records = kIoBufferSize / sizeof(T))
+      : filename_(filename), file_(std::fopen(filename.c_str(), "rb")),
+        buffer_(std::max<size_t>(buffer_records, 1)) {
+    if (file_ == nullptr)
+      throw std::runtime_error("Could not open " + filename + " for reading");
+    if (!SeekFile(file_, begin * static_cast<int64_t>(sizeof(T))))
+      throw std::runtime_error("Error seeking in " + filename);
+  }
+  ~RecordReader() { std::fclose(file_); }
+
+  RecordReader(const RecordReader &) = delete;
+  RecordReader &operator=(const RecordReader &) = delete;
+
+  // Sets *record to the next record and returns true, or returns false at
+  // the end of the file.
+  bool Next(T *record) {
+    if (pos_ == size_ && !Fill())
+      return false;
+    *record = buffer_[pos_++];
+    return true;
+  }
+
+  // Reads up to `n` records; returns the number read, less than n only at the
+  // end of the file.
+  size_t Read(T *records, size_t n) {
+    size_t done = 0;
+    while (done < n && (pos_ < size_ || Fill())) {
+      size_t m = std::min(n - done, size_ - pos_);
+      std::copy(buffer_.begin() + pos_, buffer_.begin() + pos_ + m,
+                records + done);
+      pos_ += m;
+      done += m;
+    }
+    return done;
+  }
+
+  // Like Next(), but throws if the file ends.
+  T Get() {
+    T record;
+    if (!Next(&record))
+      throw std::runtime_error(filename_ + " is too short");
+    return record;
+  }
+
+private:
+  bool Fill() {
+    size_ = std::fread(buffer_.data(), sizeof(T), buffer_.size(), file_);
+    pos_ = 0;
+    if (size_ == 0 && std::ferror(file_))
+      throw std::runtime_error("Error reading " + filename_);
+    return size_ != 0;
+  }
+
+  std::string filename_;
+  FILE *file_;
+  std::vector<T> buffer_;
+  size_t pos_ = 0, size_ = 0;
+};
+
+/*
+  Sorts records of type T by `Less` using at most about `memory_budget`
+  bytes: the records added with Add() are sorted in memory, in runs that are
+  written to temporary files when the memory is full, and then merged by
+  Next(), after merging groups of runs into longer ones first if there are
+  too many to merge at once.
+ */
+template <typename T, typename Less> class ExternalSorter {
+public:
+  ExternalSorter(int64_t memory_budget, const std::string &temp_prefix,
+                 int32_t num_threads)
+      : memory_budget_(memory_budget), temp_prefix_(temp_prefix),
+        num_threads_(num_threads) {
+    buffer_.reserve(std::max<int64_t>(memory_budget / sizeof(T), 2));
+  }
+
+  void Add(const T &record) {
+    buffer_.push_back(record);
+    if (buffer_.size() == buffer_.capacity())
+      WriteRuns();
+  }
+
+  // Must be called after the last Add() and before Next().
+  void Finish() {
+    if (runs_.empty()) {
+      std::sort(buffer_.begin(), buffer_.end(), Less());
+      return;
+    }
+    WriteRuns();
+    std::vector<T>().swap(buffer_);
+
+    int64_t fan_in = std::max<int64_t>(
+        memory_budget_ / (sizeof(T) * kMinMergeBufferRecords), 2);
+    while (static_cast<int64_t>(runs_.size()) > fan_in) {
+      std::vector<std::unique_ptr<TempFile>> runs;
+      for (size_t begin = 0; begin < runs_.size(); begin += fan_in) {
+        size_t end = std::min(runs_.size(), begin + fan_in);
+        if (end - begin == 1) {
+          runs.push_back(std::move(runs_[begin]));
+          continue;
+        }
+        OpenReaders(begin, end);
+        runs.emplace_back(new TempFile(temp_prefix_));
+        RecordWriter<T> writer(runs.back()->Filename());
+        T record;
+        while (Next(&record))
+          writer.Write(record);
+        writer.Close();
+        readers_.clear();
+        for (size_t r = begin; r < end; r++)
+          runs_[r].reset();
+      }
+      runs_ = std::move(runs);
+    }
+    OpenReaders(0, runs_.size());
+  }
+
+  // Sets *record to the next record in sorted order and returns true, or
+  // returns false if there are none left.
+  bool Next(T *record) {
+    if (readers_.empty()) {
+      if (next_ == buffer_.size())
+        return false;
+      *record = buffer_[next_++];
+      return true;
+    }
+    if (heap_.empty())
+      return false;
+    size_t r = heap_.top();
+    heap_.pop();
+    *record = heads_[r];
+    if (readers_[r]->Next(&heads_[r]))
+      heap_.push(r);
+    return true;
+  }
+
+private:
+  // Sorts the buffered records and writes them as runs, one per thread.
+  void WriteRuns() {
+    int64_t n = buffer_.size();
+    if (n == 0)
+      return;
+    int32_t num_chunks = NumChunks(n, num_threads_, 1 << 16);
+    std::vector<int64_t> begins(num_chunks + 1, n);
+    ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+      begins[c] = begin;
+      std::sort(buffer_.begin() + begin, buffer_.begin() + end, Less());
+    });
+    for (int32_t c = 0; c < num_chunks; c++) {
+      runs_.emplace_back(new TempFile(temp_prefix_));
+      RecordWriter<T> writer(runs_.back()->Filename());
+      writer.Write(buffer_.data() + begins[c], begins[c + 1] - begins[c]);
+      writer.Close();
+    }
+    buffer_.clear();
+  }
+
+  // Prepares Next() to merge runs_[begin:end].
+  void OpenReaders(size_t begin, size_t end) {
+    size_t buffer_records = memory_budget_ / (sizeof(T) * (end - begin));
+    readers_.clear();
+    heads_.resize(end - begin);
+    heap_ = Heap(HeadGreater{this});
+    for (size_t r = begin; r < end; r++) {
+      readers_.emplace_back(
+          new RecordReader<T>(runs_[r]->Filename(), 0, buffer_records));
+      if (readers_.back()->Next(&heads_[r - begin]))
+        heap_.push(r - begin);
+    }
+  }
+
+  struct HeadGreater {
+    const ExternalSorter *sorter;
+    bool operator()(size_t a, size_t b) const {
+      // Equal records come from the earlier run first.
+      const T &x = sorter->heads_[a], &y = sorter->heads_[b];
+      return Less()(y, x) || (!Less()(x, y) && a > b);
+    }
+  };
+  using Heap = std::priority_queue<size_t, std::vector<size_t>, HeadGreater>;
+
+  int64_t memory_budget_;
+  std::string temp_prefix_;
+  int32_t num_threads_;
+  std::vector<T> buffer_;
+  size_t next_ = 0; // The next record of buffer_, if there are no runs.
+  std::vector<std::unique_ptr<TempFile>> runs_;
+  std::vector<std::unique_ptr<RecordReader<T>>> readers_;
+  std::vector<T> heads_; // The next record of each reader.
+  Heap heap_{HeadGreater{this}};
+};
+
+// A suffix with the ranks of its first h symbols and of the h symbols after
+// them (-1 past the end of the text).
+struct RankPair {
+  int64_t rank;
+  int64_t next_rank;
+  int64_t pos;
+};
+
+struct RankPairLess {
+  bool operator()(const RankPair &a, const RankPair &b) const {
+    if (a.rank != b.rank)
+      return a.rank < b.rank;
+    if (a.next_rank != b.next_rank)
+      return a.next_rank < b.next_rank;
+    return a.pos < b.pos;
+  }
+};
+
+struct PosRank {
+  int64_t pos;
+  int64_t rank;
+};
+
+struct PosLess {
+  bool operator()(const PosRank &a, const PosRank &b) const {
+    return a.pos < b.pos;
+  }
+};
+
+/*
+  Checks the text in `text_filename` and writes the initial ranks of its
+  suffixes to `ranks_filename`: their first symbols packed into an int64
+  (as many as fit in 63 bits).  Returns the number of symbols in each rank.
+ */
+template <typename SymbolT>
+int64_t WriteInitialRanks(const std::string &text_filename, int64_t seq_len,
+                          int32_t bits, const std::string &ranks_filename) {
+  int64_t symbols_per_rank = std::max(63 / bits, 1);
+  // The bits of symbols_per_rank symbols.
+  uint64_t mask = (uint64_t(1) << (symbols_per_rank * bits)) - 1;
+
+  int64_t eos;
+  {
+    RecordReader<SymbolT> reader(text_filename, seq_len - 1);
+    eos = reader.Get();
+    for (int32_t i = 0; i < 3; i++)
+      if (reader.Get() != 0)
+        throw std::runtime_error(text_filename +
+                                 ": the text MUST end with 3 zeros");
+  }
+
+  RecordReader<SymbolT> reader(text_filename);
+  RecordWriter<int64_t> writer(ranks_filename);
+  uint64_t rank = 0;
+  for (int64_t p = 0; p < seq_len + symbols_per_rank - 1; p++) {
+    // Past the termination symbol the symbols don't matter, as it is unique.
+    int64_t symbol = p < seq_len ? static_cast<int64_t>(reader.Get()) : 0;
+    if (symbol < 0 || (p < seq_len - 1 && symbol >= eos))
+      throw std::runtime_error(
+          text_filename + ": the symbols MUST be >= 0 and less than the "
+                          "termination symbol");
+    rank = ((rank << bits) | static_cast<uint64_t>(symbol)) & mask;
+    if (p >= symbols_per_rank - 1)
+      writer.Write(static_cast<int64_t>(rank));
+  }
+  writer.Close();
+  return symbols_per_rank;
+}
+
+} // namespace
+
+void CreateSuffixArrayIndexExternal(const std::string &text_filename,
+                                    IndexDtype text_dtype,
+                                    const std::string &output_filename,
+                                    const ExternalSuffixArrayOptions &options) {
+  size_t symbol_size = DtypeSize(text_dtype);
+  int64_t text_length;
+  {
+    FILE *file = std::fopen(text_filename.c_str(), "rb");
+    if (file == nullptr)
+      throw std::runtime_error("Could not open " + text_filename);
+#ifdef _WIN32
+    bool ok = _fseeki64(file, 0, SEEK_END) == 0;
+    int64_t size = _ftelli64(file);
+#else
+    bool ok = fseeko(file, 0, SEEK_END) == 0;
+    int64_t size = ftello(file);
+#endif
+    std::fclose(file);
+    if (!ok || size < 0)
+      throw std::runtime_error("Error reading " + text_filename);
+    if (size % symbol_size != 0 ||
+        size / static_cast<int64_t>(symbol_size) < 4)
+      throw std::runtime_error(text_filename +
+                               " MUST contain at least 4 symbols");
+    text_length = size / symbol_size;
+  }
+  int64_t seq_len = text_length - 3;
+
+  std::string temp_prefix = options.temp_dir;
+  if (temp_prefix.empty()) {
+    temp_prefix = output_filename;
+  } else {
+    std::string::size_type slash = output_filename.find_last_of("/\\");
+    temp_prefix += "/" + (slash == std::string::npos
+                              ? output_filename
+                              : output_filename.substr(slash + 1));
+  }
+  TempFile ranks_a(temp_prefix), ranks_b(temp_prefix), sa_file(temp_prefix);
+  TempFile *ranks_file = &ranks_a, *next_ranks_file = &ranks_b;
+  // Two sorters are in use at a time.
+  int64_t budget = options.memory_budget / 2;
+
+  int64_t h = 0;
+  switch (text_dtype) {
+  case IndexDtype::kUint8:
+  case IndexDtype::kInt8:
+    h = WriteInitialRanks<uint8_t>(text_filename, seq_len, 8,
+                                   ranks_file->Filename());
+    break;
+  case IndexDtype::kUint16:
+  case IndexDtype::kInt16:
+    h = WriteInitialRanks<uint16_t>(text_filename, seq_len, 16,
+                                    ranks_file->Filename());
+    break;
+  case IndexDtype::kInt32:
+    h = WriteInitialRanks<int32_t>(text_filename, seq_len, 31,
+                                   ranks_file->Filename());
+    break;
+  case IndexDtype::kInt64:
+    h = WriteInitialRanks<int64_t>(text_filename, seq_len, 63,
+                                   ranks_file->Filename());
+    break;
+  }
+
+  // Invariant: ranks_file has, for each suffix, a rank that orders the
+  // suffixes by their first h symbols.
+  for (;; h *= 2) {
+    ExternalSorter<RankPair, RankPairLess> pair_sorter(budget, temp_prefix,
+                                                       options.num_threads);
+    {
+      RecordReader<int64_t> ranks(ranks_file->Filename()),
+          next_ranks(ranks_file->Filename(), std::min(h, seq_len));
+      for (int64_t i = 0; i < seq_len; i++)
+        pair_sorter.Add(
+            {ranks.Get(), i + h < seq_len ? next_ranks.Get() : -1, i});
+    }
+    pair_sorter.Finish();
+
+    // The suffixes in the order of their first 2h symbols; it is the suffix
+    // array once they all differ.
+    ExternalSorter<PosRank, PosLess> pos_sorter(budget, temp_prefix,
+                                                options.num_threads);
+    RecordWriter<int64_t> sa_writer(sa_file.Filename());
+    RankPair pair, prev = {-1, -1, -1};
+    int64_t num_ranks = 0, rank = 0;
+    for (int64_t r = 0; pair_sorter.Next(&pair); r++) {
+      if (pair.rank != prev.rank || pair.next_rank != prev.next_rank) {
+        rank = r;
+        num_ranks++;
+      }
+      pos_sorter.Add({pair.pos, rank});
+      sa_writer.Write(pair.pos);
+      prev = pair;
+    }
+    sa_writer.Close();
+    if (num_ranks == seq_len)
+      break;
+
+    pos_sorter.Finish();
+    RecordWriter<int64_t> ranks_writer(next_ranks_file->Filename());
+    PosRank pos_rank;
+    while (pos_sorter.Next(&pos_rank))
+      ranks_writer.Write(pos_rank.rank);
+    ranks_writer.Close();
+    std::swap(ranks_file, next_ranks_file);
+  }
+
+  SuffixArrayIndexWriter writer(output_filename, text_dtype, text_length);
+  {
+    RecordReader<char> text(text_filename);
+    std::vector<char> buffer(kIoBufferSize / symbol_size * symbol_size);
+    size_t size;
+    while ((size = text.Read(buffer.data(), buffer.size())) != 0)
+      writer.AddText(buffer.data(), size / symbol_size);
+  }
+  {
+    RecordReader<int64_t> sa(sa_file.Filename());
+    std::vector<int64_t> buffer(kIoBufferSize / sizeof(int64_t));
+    size_t n;
+    while ((n = sa.Read(buffer.data(), buffer.size())) != 0)
+      writer.AddSuffixArray(buffer.data(), n);
+  }
+  writer.Close();
+}
+
+} // namespace fasttextsearch
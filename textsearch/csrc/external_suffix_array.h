@@ -0,0 +1,77 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_EXTERNAL_SUFFIX_ARRAY_H_
+#define TEXTSEARCH_CSRC_EXTERNAL_SUFFIX_ARRAY_H_
+
+#include <cstdint>
+#include <string>
+
+#include "textsearch/csrc/suffix_array_index.h"
+
+namespace fasttextsearch {
+
+struct ExternalSuffixArrayOptions {
+  // The memory to use for sorting, in bytes; the I/O buffers take a few MB
+  // more.  A smaller budget means more temporary files and merge passes.
+  int64_t memory_budget = int64_t(1) << 30;
+
+  // The directory of the temporary files; if empty, that of the output file.
+  // It needs room for about 64 bytes per symbol of the text.
+  std::string temp_dir;
+
+  // The number of threads used to sort in memory; <= 0 means to use all
+  // hardware threads.
+  int32_t num_threads = 1;
+};
+
+/*
+  Creates the suffix array of a text that is read from a file, for texts whose
+  suffix array doesn't fit in memory, and writes it as a suffix array index
+  file (see SuffixArrayIndex) without an LCP array.  The result is the same as
+  with CreateSuffixArray().
+
+  It uses prefix doubling with external merge sorts: the suffixes are ranked
+  by their first h symbols for h = 1, 2, 4, ... (after packing several small
+  symbols into each initial rank), each round sorting (rank[i], rank[i + h])
+  pairs into sorted runs on disk and merging them, until all ranks differ.
+  So the memory used is bounded by options.memory_budget whatever the size of
+  the text, at the cost of O(seq_len * log(max_lcp)) sequential I/O, where
+  max_lcp is the length of the longest repeat in the text.
+
+    @param [in] text_filename  A file with the text in the format of the input
+             of CreateSuffixArray(): text_length = seq_len + 3 raw
+             little-endian symbols of type `text_dtype` (e.g. written with
+             numpy's tofile()), the termination symbol at seq_len - 1
+             (larger than all the symbols before it) followed by 3 zeros.
+             The symbols must not be negative.
+    @param [in] text_dtype  The type of the symbols.
+    @param [in] output_filename  The suffix array index file to write.
+    @param [in] options  See ExternalSuffixArrayOptions.
+
+  Throws std::runtime_error if a file can't be read or written or the text
+  is not in the expected format.
+ */
+void CreateSuffixArrayIndexExternal(
+    const std::string &text_filename, IndexDtype text_dtype,
+    const std::string &output_filename,
+    const ExternalSuffixArrayOptions &options = ExternalSuffixArrayOptions());
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_EXTERNAL_SUFFIX_ARRAY_H_
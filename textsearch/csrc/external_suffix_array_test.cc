@@ -0,0 +1,119 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/external_suffix_array.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+template <typename SymbolT>
+static void WriteText(const std::string &filename,
+                      const std::vector<SymbolT> &text) {
+  FILE *f = std::fopen(filename.c_str(), "wb");
+  ASSERT_NE(f, nullptr);
+  std::fwrite(text.data(), sizeof(SymbolT), text.size(), f);
+  std::fclose(f);
+}
+
+template <typename SymbolT>
+static void TestExternalSuffixArray(IndexDtype dtype, SymbolT max_symbol) {
+  std::mt19937 rng(0);
+  std::string dir = testing::TempDir();
+  std::string text_filename = dir + "external_suffix_array_test.txt",
+              filename = dir + "external_suffix_array_test.idx";
+  for (int32_t seq_len : {1, 2, 10, 1000, 5000}) {
+    for (int32_t num_symbols : {1, 3, 200}) {
+      std::uniform_int_distribution<int32_t> uni(1, num_symbols);
+      std::vector<SymbolT> text(seq_len + 3, 0);
+      for (int32_t i = 0; i + 1 < seq_len; i++)
+        text[i] = static_cast<SymbolT>(uni(rng));
+      text[seq_len - 1] = max_symbol;
+      WriteText(text_filename, text);
+
+      std::vector<int64_t> expected(seq_len);
+      CreateSuffixArray(text.data(), static_cast<int64_t>(seq_len),
+                        max_symbol, expected.data());
+
+      ExternalSuffixArrayOptions options;
+      // Small enough for many runs and several merge passes.
+      options.memory_budget = 1 << 12;
+      options.temp_dir = dir;
+      options.num_threads = 2;
+      CreateSuffixArrayIndexExternal(text_filename, dtype, filename, options);
+
+      SuffixArrayIndex index(filename, true);
+      ASSERT_EQ(index.TextDtype(), dtype);
+      ASSERT_EQ(index.SeqLen(), seq_len);
+      EXPECT_EQ(std::vector<SymbolT>(
+                    static_cast<const SymbolT *>(index.Text()),
+                    static_cast<const SymbolT *>(index.Text()) + seq_len + 3),
+                text);
+      ASSERT_EQ(index.IndexType(), IndexDtype::kInt32);
+      const int32_t *sa = static_cast<const int32_t *>(index.SuffixArray());
+      EXPECT_EQ(std::vector<int64_t>(sa, sa + seq_len), expected);
+      EXPECT_EQ(index.Lcp(), nullptr);
+    }
+  }
+  std::remove(text_filename.c_str());
+  std::remove(filename.c_str());
+}
+
+TEST(ExternalSuffixArrayTest, TestUint8) {
+  TestExternalSuffixArray<uint8_t>(IndexDtype::kUint8, 254);
+}
+
+TEST(ExternalSuffixArrayTest, TestUint16) {
+  TestExternalSuffixArray<uint16_t>(IndexDtype::kUint16, 65534);
+}
+
+TEST(ExternalSuffixArrayTest, TestInt32) {
+  TestExternalSuffixArray<int32_t>(IndexDtype::kInt32, 100000);
+}
+
+TEST(ExternalSuffixArrayTest, TestInvalidText) {
+  std::string dir = testing::TempDir();
+  std::string text_filename = dir + "external_suffix_array_test2.txt",
+              filename = dir + "external_suffix_array_test2.idx";
+  ExternalSuffixArrayOptions options;
+  options.temp_dir = dir;
+  // The termination symbol is not the largest one.
+  WriteText<uint8_t>(text_filename, {5, 3, 0, 0, 0});
+  EXPECT_THROW(CreateSuffixArrayIndexExternal(text_filename, IndexDtype::kUint8,
+                                              filename, options),
+               std::runtime_error);
+  // No 3 zeros at the end.
+  WriteText<uint8_t>(text_filename, {1, 3, 0, 1, 0});
+  EXPECT_THROW(CreateSuffixArrayIndexExternal(text_filename, IndexDtype::kUint8,
+                                              filename, options),
+               std::runtime_error);
+  std::remove(text_filename.c_str());
+  EXPECT_THROW(CreateSuffixArrayIndexExternal(text_filename, IndexDtype::kUint8,
+                                              filename, options),
+               std::runtime_error);
+  std::remove(filename.c_str());
+}
+
+} // namespace fasttextsearch
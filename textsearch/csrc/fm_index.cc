@@ -0,0 +1,364 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/fm_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// Bit vectors are split into chunks of at least this many words for the
+// threads, and queries into chunks of at least this many symbols.
+constexpr int64_t kMinChunkWords = 1 << 12;
+constexpr int64_t kMinChunkSize = 1 << 10;
+
+// The ones before each block of this many words are stored.
+constexpr int64_t kWordsPerBlock = 8;
+
+// Symbols are numbered with a table if they are all in [0, kMaxTableSymbol].
+constexpr int64_t kMaxTableSymbol = 1 << 20;
+
+int64_t PopCount(uint64_t x) { return __builtin_popcountll(x); }
+
+} // namespace
+
+void RankBitVector::Resize(int64_t num_bits) {
+  num_bits_ = num_bits;
+  words_.assign((num_bits + 63) / 64, 0);
+  blocks_.clear();
+}
+
+void RankBitVector::BuildRank() {
+  int64_t num_words = NumWords(),
+          num_blocks = (num_words + kWordsPerBlock - 1) / kWordsPerBlock;
+  // One more block, so that Rank1(num_bits_) works when the last block is
+  // full.
+  blocks_.assign(num_blocks + 1, 0);
+  int64_t ones = 0;
+  for (int64_t w = 0; w < num_words; w++) {
+    if (w % kWordsPerBlock == 0)
+      blocks_[w / kWordsPerBlock] = ones;
+    ones += PopCount(words_[w]);
+  }
+  blocks_[num_blocks] = ones;
+}
+
+int64_t RankBitVector::Rank1(int64_t i) const {
+  int64_t w = i >> 6, block = w / kWordsPerBlock;
+  int64_t ones = blocks_[block];
+  for (int64_t k = block * kWordsPerBlock; k < w; k++)
+    ones += PopCount(words_[k]);
+  if (i & 63)
+    ones += PopCount(words_[w] & ((uint64_t(1) << (i & 63)) - 1));
+  return ones;
+}
+
+int64_t RankBitVector::NumBytes() const {
+  return static_cast<int64_t>(words_.size() * sizeof(uint64_t) +
+                              blocks_.size() * sizeof(int64_t));
+}
+
+void WaveletMatrix::Build(const uint32_t *values, int64_t size,
+                          uint32_t num_values, int32_t num_threads) {
+  assert(num_values >= 1);
+  int32_t num_bits = 1;
+  while (num_bits < 32 && (num_values - 1) >> num_bits != 0)
+    num_bits++;
+  levels_.assign(num_bits, RankBitVector());
+  zeros_.assign(num_bits, 0);
+
+  std::vector<uint32_t> cur(values, values + size), next(size);
+  for (int32_t l = 0; l < num_bits; l++) {
+    int32_t shift = num_bits - 1 - l;
+    RankBitVector &level = levels_[l];
+    level.Resize(size);
+    uint64_t *words = level.Words();
+    int64_t num_words = level.NumWords();
+    int32_t num_chunks = NumChunks(num_words, num_threads, kMinChunkWords);
+    // The zeros before each chunk.
+    std::vector<int64_t> chunk_zeros(num_chunks + 1, 0);
+    ParallelFor(num_words, num_chunks,
+                [&](int32_t c, int64_t begin, int64_t end) {
+                  int64_t zeros = 0;
+                  for (int64_t w = begin; w < end; w++) {
+                    uint64_t word = 0;
+                    int64_t n = std::min<int64_t>(64, size - w * 64);
+                    for (int64_t b = 0; b < n; b++)
+                      word |= uint64_t((cur[w * 64 + b] >> shift) & 1) << b;
+                    words[w] = word;
+                    zeros += n - PopCount(word);
+                  }
+                  chunk_zeros[c + 1] = zeros;
+                });
+    for (int32_t c = 0; c < num_chunks; c++)
+      chunk_zeros[c + 1] += chunk_zeros[c];
+    int64_t num_zeros = chunk_zeros.back();
+    level.BuildRank();
+    zeros_[l] = num_zeros;
+    if (l + 1 == num_bits)
+      break;
+
+    // Stably partition the values by their bit for the next level.
+    ParallelFor(num_words, num_chunks,
+                [&](int32_t c, int64_t begin, int64_t end) {
+                  int64_t zero = chunk_zeros[c],
+                          one = num_zeros + begin * 64 - chunk_zeros[c];
+                  int64_t i_end = std::min(end * 64, size);
+                  for (int64_t i = begin * 64; i < i_end; i++) {
+                    if ((cur[i] >> shift) & 1)
+                      next[one++] = cur[i];
+                    else
+                      next[zero++] = cur[i];
+                  }
+                });
+    cur.swap(next);
+  }
+
+  starts_.resize(num_values);
+  for (uint32_t v = 0; v < num_values; v++) {
+    int64_t s = 0;
+    for (int32_t l = 0; l < num_bits; l++) {
+      if ((v >> (num_bits - 1 - l)) & 1)
+        s = zeros_[l] + levels_[l].Rank1(s);
+      else
+        s = levels_[l].Rank0(s);
+    }
+    starts_[v] = s;
+  }
+}
+
+uint32_t WaveletMatrix::AccessAndRank(int64_t i, int64_t *rank) const {
+  uint32_t value = 0;
+  for (size_t l = 0; l < levels_.size(); l++) {
+    const RankBitVector &level = levels_[l];
+    bool bit = level.Get(i);
+    value = (value << 1) | bit;
+    i = bit ? zeros_[l] + level.Rank1(i) : level.Rank0(i);
+  }
+  *rank = i - starts_[value];
+  return value;
+}
+
+int64_t WaveletMatrix::Rank(uint32_t value, int64_t i) const {
+  int32_t num_bits = static_cast<int32_t>(levels_.size());
+  for (int32_t l = 0; l < num_bits; l++) {
+    const RankBitVector &level = levels_[l];
+    if ((value >> (num_bits - 1 - l)) & 1)
+      i = zeros_[l] + level.Rank1(i);
+    else
+      i = level.Rank0(i);
+  }
+  return i - starts_[value];
+}
+
+int64_t WaveletMatrix::NumBytes() const {
+  int64_t bytes = static_cast<int64_t>((zeros_.size() + starts_.size()) *
+                                       sizeof(int64_t));
+  for (const RankBitVector &level : levels_)
+    bytes += level.NumBytes();
+  return bytes;
+}
+
+template <typename SymbolT, typename IndexT>
+FmIndex<SymbolT, IndexT>::FmIndex(const SymbolT *text, IndexT seq_len,
+                                  const IndexT *suffix_array,
+                                  int32_t sample_rate, int32_t num_threads)
+    : text_(text), seq_len_(seq_len), sample_rate_(sample_rate) {
+  assert(seq_len >= 1 && sample_rate > 0);
+  SymbolT min_symbol = *std::min_element(text, text + seq_len),
+          max_symbol = *std::max_element(text, text + seq_len);
+  if (min_symbol >= 0 && static_cast<int64_t>(max_symbol) <= kMaxTableSymbol) {
+    std::vector<char> present(static_cast<int64_t>(max_symbol) + 1, 0);
+    for (IndexT i = 0; i < seq_len; i++)
+      present[text[i]] = 1;
+    symbol_numbers_.resize(present.size());
+    for (size_t s = 0; s < present.size(); s++) {
+      symbol_numbers_[s] = static_cast<uint32_t>(symbols_.size());
+      if (present[s])
+        symbols_.push_back(static_cast<SymbolT>(s));
+    }
+  } else {
+    symbols_.assign(text, text + seq_len);
+    std::sort(symbols_.begin(), symbols_.end());
+    symbols_.erase(std::unique(symbols_.begin(), symbols_.end()),
+                   symbols_.end());
+  }
+  assert(symbols_.size() < std::numeric_limits<uint32_t>::max());
+  uint32_t num_symbols = static_cast<uint32_t>(symbols_.size());
+
+  // The transform, with the termination symbol before position 0.
+  SymbolT eos = text[seq_len - 1];
+  std::vector<uint32_t> bwt(seq_len);
+  int32_t num_chunks = NumChunks(seq_len, num_threads, kMinChunkWords * 64);
+  ParallelFor(seq_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; r++) {
+      IndexT pos = suffix_array[r];
+      bwt[r] = SymbolNumber(pos == 0 ? eos : text[pos - 1]);
+    }
+  });
+  // Each symbol occurs as often in the transform as in the text.
+  symbol_starts_.assign(num_symbols + 1, 0);
+  for (IndexT r = 0; r < seq_len; r++)
+    symbol_starts_[bwt[r] + 1]++;
+  for (uint32_t c = 0; c < num_symbols; c++)
+    symbol_starts_[c + 1] += symbol_starts_[c];
+  bwt_.Build(bwt.data(), seq_len, num_symbols, num_threads);
+  bwt = std::vector<uint32_t>();
+
+  // LfMapping() is never applied to the suffixes after a termination
+  // symbol, whose order may not be that of their rotations in a text with
+  // more than one (they are compared up to the end of their shard).
+  sampled_.Resize(seq_len);
+  uint64_t *words = sampled_.Words();
+  int64_t num_words = sampled_.NumWords();
+  num_chunks = NumChunks(num_words, num_threads, kMinChunkWords);
+  ParallelFor(num_words, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (int64_t w = begin; w < end; w++) {
+      uint64_t word = 0;
+      int64_t n = std::min<int64_t>(64, seq_len - w * 64);
+      for (int64_t b = 0; b < n; b++) {
+        IndexT pos = suffix_array[w * 64 + b];
+        if (pos % sample_rate == 0 || text[pos - 1] == eos)
+          word |= uint64_t(1) << b;
+      }
+      words[w] = word;
+    }
+  });
+  sampled_.BuildRank();
+  samples_.resize(sampled_.Rank1(seq_len));
+  ParallelFor(num_words, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    int64_t s = sampled_.Rank1(begin * 64),
+            r_end = std::min<int64_t>(end * 64, seq_len);
+    for (int64_t r = begin * 64; r < r_end; r++)
+      if (sampled_.Get(r))
+        samples_[s++] = suffix_array[r];
+  });
+}
+
+template <typename SymbolT, typename IndexT>
+uint32_t FmIndex<SymbolT, IndexT>::SymbolNumber(SymbolT symbol) const {
+  if (symbol >= 0 &&
+      static_cast<int64_t>(symbol) <
+          static_cast<int64_t>(symbol_numbers_.size()))
+    return symbol_numbers_[symbol];
+  return static_cast<uint32_t>(
+      std::lower_bound(symbols_.begin(), symbols_.end(), symbol) -
+      symbols_.begin());
+}
+
+template <typename SymbolT, typename IndexT>
+IndexT FmIndex<SymbolT, IndexT>::LfMapping(IndexT rank) const {
+  int64_t symbol_rank;
+  uint32_t c = bwt_.AccessAndRank(rank, &symbol_rank);
+  return symbol_starts_[c] + static_cast<IndexT>(symbol_rank);
+}
+
+template <typename SymbolT, typename IndexT>
+IndexT FmIndex<SymbolT, IndexT>::Locate(IndexT rank) const {
+  IndexT steps = 0;
+  while (!sampled_.Get(rank)) {
+    rank = LfMapping(rank);
+    steps++;
+  }
+  return samples_[sampled_.Rank1(rank)] + steps;
+}
+
+template <typename SymbolT, typename IndexT>
+void FmIndex<SymbolT, IndexT>::FindCloseMatches(
+    const SymbolT *query, IndexT query_len, int32_t num_close_matches,
+    IndexT min_match_length, IndexT *output, IndexT *output_lengths,
+    int32_t num_threads) const {
+  assert(query_len >= 0 && num_close_matches > 0);
+  FTS_STATS_SCOPE(Stage::kCloseMatches);
+  IndexT eos_pos = seq_len_ - 1, no_match = seq_len_ - 2;
+  int64_t stride = 2 * static_cast<int64_t>(num_close_matches);
+  uint32_t num_symbols = static_cast<uint32_t>(symbols_.size());
+
+  // ranks[i] is the number of reference suffixes less than the query suffix
+  // at i (which is less than those it is a prefix of): those that start
+  // with a smaller symbol, and those that start with query[i] followed by a
+  // suffix less than the query suffix at i + 1.
+  std::vector<IndexT> ranks(query_len);
+  IndexT rank = 0;
+  for (IndexT i = query_len - 1; i >= 0; i--) {
+    uint32_t c = SymbolNumber(query[i]);
+    IndexT start = symbol_starts_[c];
+    if (c < num_symbols && symbols_[c] == query[i])
+      start += static_cast<IndexT>(bwt_.Rank(c, rank));
+    rank = ranks[i] = start;
+  }
+
+  int32_t num_chunks = NumChunks(query_len, num_threads, kMinChunkSize);
+  ParallelFor(query_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (IndexT i = begin; i < end; i++) {
+      const SymbolT *q = query + i;
+      IndexT q_len = query_len - i;
+      IndexT *this_output = output + stride * i,
+             *this_lengths = output_lengths + stride * i;
+      // The preceding matches, then the following ones, as in
+      // FindCloseMatchesInReference(); the match lengths are measured on the
+      // text, so no LCP array is needed.
+      for (int32_t side = 0; side < 2; side++) {
+        IndexT r = side == 0 ? ranks[i] - 1 : ranks[i];
+        IndexT step = side == 0 ? -1 : 1;
+        for (int32_t j = 0; j < num_close_matches; j++) {
+          bool have = r >= 0 && r < seq_len_;
+          IndexT pos = 0, len = 0;
+          if (have) {
+            pos = Locate(r);
+            while (len < q_len && pos + len < eos_pos &&
+                   q[len] == text_[pos + len])
+              len++;
+            have = text_[pos] != text_[eos_pos] && len >= min_match_length;
+          }
+          this_output[j] = have ? pos : no_match;
+          this_lengths[j] = have ? len : 0;
+          r = have ? r + step : -1;
+        }
+        this_output += num_close_matches;
+        this_lengths += num_close_matches;
+      }
+    }
+  });
+}
+
+template <typename SymbolT, typename IndexT>
+int64_t FmIndex<SymbolT, IndexT>::NumBytes() const {
+  return static_cast<int64_t>(symbols_.size() * sizeof(SymbolT) +
+                              symbol_starts_.size() * sizeof(IndexT) +
+                              symbol_numbers_.size() * sizeof(uint32_t) +
+                              samples_.size() * sizeof(IndexT)) +
+         bwt_.NumBytes() + sampled_.NumBytes();
+}
+
+template class FmIndex<uint8_t, int32_t>;
+template class FmIndex<uint8_t, int64_t>;
+template class FmIndex<uint16_t, int32_t>;
+template class FmIndex<uint16_t, int64_t>;
+template class FmIndex<int32_t, int32_t>;
+template class FmIndex<int32_t, int64_t>;
+template class FmIndex<int64_t, int64_t>;
+
+} // namespace fasttextsearch
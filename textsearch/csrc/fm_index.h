@@ -0,0 +1,187 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_FM_INDEX_H_
+#define TEXTSEARCH_CSRC_FM_INDEX_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  A bit vector with constant-time rank: the number of ones before each block
+  of 512 bits is stored, i.e. 1/8 of the size of the bits.
+ */
+class RankBitVector {
+public:
+  // Sets the size; the bits are all zero.
+  void Resize(int64_t num_bits);
+
+  // The bits, 64 per word, least significant first; BuildRank() must be
+  // called after they are changed.
+  uint64_t *Words() { return words_.data(); }
+  int64_t NumWords() const { return static_cast<int64_t>(words_.size()); }
+
+  void BuildRank();
+
+  bool Get(int64_t i) const { return (words_[i >> 6] >> (i & 63)) & 1; }
+
+  // The number of ones (zeros) in [0, i), for 0 <= i <= NumBits().
+  int64_t Rank1(int64_t i) const;
+  int64_t Rank0(int64_t i) const { return i - Rank1(i); }
+
+  int64_t NumBits() const { return num_bits_; }
+  int64_t NumBytes() const;
+
+private:
+  int64_t num_bits_ = 0;
+  std::vector<uint64_t> words_;
+  std::vector<int64_t> blocks_;
+};
+
+/*
+  A wavelet matrix: a sequence of integers in [0, 2^num_bits) stored in
+  num_bits bit vectors, one per bit from the most significant one, with the
+  values stably partitioned by their previous bits.  Access and rank take
+  O(num_bits) time.
+ */
+class WaveletMatrix {
+public:
+  /*
+    Builds the matrix of `values[0:size]`, which must be in
+    [0, num_values), with num_values >= 1.  The levels are built in
+    parallel chunks.
+   */
+  void Build(const uint32_t *values, int64_t size, uint32_t num_values,
+             int32_t num_threads = 1);
+
+  // Returns values[i] and sets *rank to the number of times it occurs in
+  // values[0:i].
+  uint32_t AccessAndRank(int64_t i, int64_t *rank) const;
+
+  // The number of times `value` occurs in values[0:i], for i <= size.
+  int64_t Rank(uint32_t value, int64_t i) const;
+
+  int64_t NumBytes() const;
+
+private:
+  std::vector<RankBitVector> levels_;
+  // The number of zeros of each level.
+  std::vector<int64_t> zeros_;
+  // The position of each value in the order of the last level, i.e. where
+  // its rank starts.
+  std::vector<int64_t> starts_;
+};
+
+/*
+  A compressed replacement for the suffix array of a reference text, for
+  serving FindCloseMatchesInReference() lookups with much less memory: the
+  Burrows-Wheeler transform of the text (the symbol before each suffix in
+  suffix array order) in a wavelet matrix, with the symbols numbered by
+  rank so that it takes ceil(log2(num_symbols)) bits per symbol plus 1/8 for
+  rank, and the suffix array sampled at the text positions that are
+  multiples of sample_rate (plus those after a termination symbol, as a text
+  from MergeSuffixArrayIndexes() has one per shard), with a bit vector of
+  the sampled ranks.  The text itself is still needed, to measure the
+  matches, and is not copied.
+
+  A query suffix is located by backward search, i.e. its rank among the
+  reference suffixes is found from that of the query suffix after it with one
+  LF-mapping of the transform, so all the ranks of a query take
+  O(query_len * log2(num_symbols)) time; the matches are then located with
+  at most sample_rate - 1 LF-mappings each and measured on the text.  So
+  sample_rate trades speed for memory: for uint8_t symbols the index takes
+  about 1.3 + sizeof(IndexT) / sample_rate bytes per symbol, e.g. 1.5 for a
+  sample_rate of 32 and int64_t, instead of sizeof(IndexT) for the suffix
+  array and as much again for its LCP array.
+
+  Template args: SymbolT and IndexT are as for CreateSuffixArray(), with the
+  same instantiations.
+ */
+template <typename SymbolT, typename IndexT> class FmIndex {
+public:
+  /*
+    Builds the index; suffix_array is not needed after this returns.
+
+      @param [in] text  The reference text, as passed to CreateSuffixArray(),
+               i.e. ending with the termination symbol and 3 zeros; it must
+               outlive the index.
+      @param [in] seq_len  The length of the reference text including the
+               termination symbol; require seq_len >= 1.
+      @param [in] suffix_array  The suffix array of `text`, of length seq_len,
+               e.g. from CreateSuffixArray() or MergeSuffixArrayIndexes().
+      @param [in] sample_rate  The suffix array is sampled at the positions
+               that are multiples of it; must be > 0.
+      @param [in] num_threads  The number of threads to use; <= 0 means to
+               use all hardware threads.
+   */
+  FmIndex(const SymbolT *text, IndexT seq_len, const IndexT *suffix_array,
+          int32_t sample_rate = 32, int32_t num_threads = 1);
+
+  IndexT SeqLen() const { return seq_len_; }
+  int32_t SampleRate() const { return sample_rate_; }
+
+  // Returns the position in the text of the suffix at rank `rank` of the
+  // suffix array, 0 <= rank < seq_len.
+  IndexT Locate(IndexT rank) const;
+
+  /*
+    Finds the close matches of a query text in the reference text, with
+    the same arguments and output as FindCloseMatchesInReference(), except
+    that num_close_matches > 1 doesn't need an LCP array.  The ranks of the
+    query suffixes are found in one pass from the end of the query, and the
+    matches of the query positions are located and measured in parallel.
+   */
+  void FindCloseMatches(const SymbolT *query, IndexT query_len,
+                        int32_t num_close_matches, IndexT min_match_length,
+                        IndexT *output, IndexT *output_lengths,
+                        int32_t num_threads = 1) const;
+
+  // The memory used by the index, not counting the text.
+  int64_t NumBytes() const;
+
+private:
+  // The rank of the suffix that starts one symbol before the suffix at
+  // `rank`, which must not be sampled.
+  IndexT LfMapping(IndexT rank) const;
+
+  // The number of the symbol `symbol` in symbols_, or that of the next
+  // symbol if it does not occur in the text.
+  uint32_t SymbolNumber(SymbolT symbol) const;
+
+  const SymbolT *text_;
+  IndexT seq_len_;
+  int32_t sample_rate_;
+
+  // The distinct symbols of the text, sorted, and for each of them the
+  // number of suffixes that start with a smaller symbol, plus seq_len.
+  std::vector<SymbolT> symbols_;
+  std::vector<IndexT> symbol_starts_;
+  // If not empty, the number of each symbol value, for small alphabets.
+  std::vector<uint32_t> symbol_numbers_;
+
+  WaveletMatrix bwt_;
+  RankBitVector sampled_;
+  // The suffix array at the ranks in `sampled_`.
+  std::vector<IndexT> samples_;
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_FM_INDEX_H_
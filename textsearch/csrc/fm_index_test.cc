@@ -0,0 +1,145 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/fm_index.h"
+#include "textsearch/csrc/reference_index.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+TEST(FmIndexTest, TestRankBitVector) {
+  std::mt19937 rng(0);
+  for (int64_t num_bits : {0, 1, 64, 511, 512, 513, 5000}) {
+    RankBitVector bits;
+    bits.Resize(num_bits);
+    std::vector<char> expected(num_bits);
+    for (int64_t i = 0; i < num_bits; i++) {
+      expected[i] = rng() % 3 == 0;
+      if (expected[i])
+        bits.Words()[i / 64] |= uint64_t(1) << (i % 64);
+    }
+    bits.BuildRank();
+    int64_t ones = 0;
+    for (int64_t i = 0; i <= num_bits; i++) {
+      EXPECT_EQ(bits.Rank1(i), ones);
+      if (i < num_bits) {
+        EXPECT_EQ(bits.Get(i), expected[i] != 0);
+        ones += expected[i];
+      }
+    }
+  }
+}
+
+TEST(FmIndexTest, TestWaveletMatrix) {
+  std::mt19937 rng(1);
+  for (uint32_t num_values : {1, 2, 5, 300}) {
+    // Large enough for the levels to be built in more than one chunk.
+    std::vector<uint32_t> values(600000);
+    for (auto &v : values)
+      v = rng() % num_values;
+    for (int32_t num_threads : {1, 3}) {
+      WaveletMatrix matrix;
+      matrix.Build(values.data(), values.size(), num_values, num_threads);
+      std::vector<int64_t> counts(num_values, 0);
+      for (size_t i = 0; i < values.size(); i++) {
+        int64_t rank = -1;
+        EXPECT_EQ(matrix.AccessAndRank(i, &rank), values[i]);
+        EXPECT_EQ(rank, counts[values[i]]);
+        EXPECT_EQ(matrix.Rank(values[i], i), counts[values[i]]);
+        counts[values[i]]++;
+      }
+      for (uint32_t v = 0; v < num_values; v++)
+        EXPECT_EQ(matrix.Rank(v, values.size()), counts[v]);
+    }
+  }
+}
+
+// Checks FmIndex against the suffix array for a random text whose symbols
+// are `alphabet` (the termination symbol being the last), with its
+// termination symbol also at `num_eos` random positions, as in a text from
+// MergeSuffixArrayIndexes().
+template <typename SymbolT, typename IndexT>
+static void TestRandomText(const std::vector<SymbolT> &alphabet,
+                           int32_t num_eos, std::mt19937 *rng) {
+  IndexT seq_len = std::uniform_int_distribution<IndexT>(1, 3000)(*rng),
+         query_len = std::uniform_int_distribution<IndexT>(0, 3000)(*rng);
+  SymbolT eos = alphabet.back();
+  int32_t num_symbols = static_cast<int32_t>(alphabet.size()) - 1;
+  std::vector<SymbolT> text(seq_len + 3, 0), query(query_len);
+  for (IndexT i = 0; i + 1 < seq_len; i++)
+    text[i] = alphabet[(*rng)() % num_symbols];
+  text[seq_len - 1] = eos;
+  for (int32_t e = 0; e < num_eos && seq_len > 1; e++)
+    text[(*rng)() % (seq_len - 1)] = eos;
+  // The query may have symbols that the text doesn't, and parts of the text
+  // for long matches.
+  for (auto &q : query)
+    q = alphabet[(*rng)() % num_symbols] + (*rng)() % 2;
+  if (seq_len > 100 && query_len > 100)
+    for (int32_t i = 0; i < 80; i++)
+      query[10 + i] = text[i] == eos ? alphabet[0] : text[i];
+
+  std::vector<IndexT> suffix_array(seq_len), lcp(seq_len);
+  CreateSuffixArray(text.data(), seq_len, eos, suffix_array.data());
+  CreateLcpArray(text.data(), seq_len, suffix_array.data(), lcp.data());
+
+  for (int32_t sample_rate : {1, 4, 32}) {
+    FmIndex<SymbolT, IndexT> index(text.data(), seq_len, suffix_array.data(),
+                                   sample_rate, 2);
+    for (IndexT r = 0; r < seq_len; r++)
+      EXPECT_EQ(index.Locate(r), suffix_array[r]);
+    for (int32_t num_close_matches : {1, 3}) {
+      for (IndexT min_match_length : {0, 5}) {
+        IndexT size = 2 * num_close_matches * query_len;
+        std::vector<IndexT> expected(size), expected_lengths(size);
+        FindCloseMatchesInReference(
+            text.data(), seq_len, suffix_array.data(), lcp.data(),
+            query.data(), query_len, num_close_matches, min_match_length,
+            expected.data(), expected_lengths.data());
+        for (int32_t num_threads : {1, 3}) {
+          std::vector<IndexT> output(size), lengths(size);
+          index.FindCloseMatches(query.data(), query_len, num_close_matches,
+                                 min_match_length, output.data(),
+                                 lengths.data(), num_threads);
+          EXPECT_EQ(output, expected);
+          EXPECT_EQ(lengths, expected_lengths);
+        }
+      }
+    }
+  }
+}
+
+TEST(FmIndexTest, TestRandom) {
+  std::mt19937 rng(2);
+  for (int32_t iter = 0; iter < 10; iter++) {
+    TestRandomText<uint8_t, int32_t>({1, 2, 3, 255}, iter % 3, &rng);
+    TestRandomText<uint16_t, int64_t>({10, 70, 1000, 1001, 60000}, 0, &rng);
+    // A large alphabet, numbered by binary search.
+    TestRandomText<int32_t, int32_t>({5, 1 << 22, 1 << 25, (1 << 25) + 1,
+                                      1 << 30},
+                                     iter % 2, &rng);
+    TestRandomText<int64_t, int64_t>({1, 2, int64_t(1) << 40}, 0, &rng);
+  }
+}
+
+} // namespace fasttextsearch
@@ -20,50 +20,66 @@
 #define TEXTSEARCH_CSRC_LEVENSHTEIN_H_
 
 #include <algorithm>
-#include <bitset>
 #include <cassert>
-#include <memory>
-#include <sstream>
+#include <limits>
 #include <string>
 #include <vector>
 
+#include "textsearch/csrc/levenshtein_myers.h"
+#include "textsearch/csrc/levenshtein_simd.h"
+#include "textsearch/csrc/stats.h"
+
 namespace fasttextsearch {
 
 // See docs in Backtrace below, it is a segment of backtrace containing 64 bits
 // of path trace.
-struct DynamicBacktrace {
-  int64_t bitmap;
-  std::shared_ptr<DynamicBacktrace> prev;
+struct BacktraceSegment {
+  uint64_t bitmap;
+  int64_t prev; // Index of the previous segment in the BacktraceArena, or -1.
+};
 
-  DynamicBacktrace(int64_t bitmap, std::shared_ptr<DynamicBacktrace> prev)
-      : bitmap(bitmap), prev(prev) {}
+/*
+ * The storage of the BacktraceSegment objects of the Backtrace objects of one
+ * or more LevenshteinDistance() calls.  Segments are only ever appended, and
+ * never changed once they are, so the copies of a Backtrace can share them
+ * and copying a Backtrace is just copying 24 bytes.  The arena can be reused
+ * (after Clear()) to avoid allocating memory again.  The segment indexes are
+ * 64-bit: the arena of one long alignment can have more than 2^31 segments.
+ */
+class BacktraceArena {
+public:
+  // Appends a segment and returns its index.
+  int64_t Append(uint64_t bitmap, int64_t prev) {
+    segments_.push_back({bitmap, prev});
+    return static_cast<int64_t>(segments_.size() - 1);
+  }
 
-  explicit DynamicBacktrace(int64_t bitmap) : bitmap(bitmap) {}
+  const BacktraceSegment &operator[](int64_t i) const { return segments_[i]; }
 
-  DynamicBacktrace &operator=(const DynamicBacktrace &src) = default;
-  DynamicBacktrace(const DynamicBacktrace &src) = default;
-  // Move constructor
-  DynamicBacktrace(DynamicBacktrace &&src) = default;
-  DynamicBacktrace &operator=(DynamicBacktrace &&src) = default;
+  size_t Size() const { return segments_.size(); }
+
+  // Removes all the segments, invalidating the Backtrace objects using them,
+  // but keeps the memory.
+  void Clear() { segments_.clear(); }
+
+  void Reserve(size_t size) { segments_.reserve(size); }
+
+private:
+  std::vector<BacktraceSegment> segments_;
 };
 
 struct Backtrace {
-  int64_t bitmap; // bitmap records shape of most recent backtrace, where every
-                  // time we consume a query symbol we do: bitmap |= (1 <<
-                  // (num_bits++));   and every time we consume a reference
-                  // symbol we do: bitmap  |= (0 << (num_bits++));  which
-                  // can be optimized to: num_bits++;  When num_bits reaches 64
-                  // we allocate a DynamicBacktrace object and reset it to 0.
+  uint64_t bitmap; // bitmap records shape of most recent backtrace, where every
+                   // time we consume a query symbol we do: bitmap |= (1 <<
+                   // (num_bits++));   and every time we consume a reference
+                   // symbol we do: bitmap  |= (0 << (num_bits++));  which
+                   // can be optimized to: num_bits++;  When num_bits reaches
+                   // 64 we append a BacktraceSegment to the arena and reset it
+                   // to 0.
   int32_t num_bits;
-  std::shared_ptr<DynamicBacktrace> prev;
+  int64_t prev; // Index of the most recent BacktraceSegment, or -1.
 
-  Backtrace() : bitmap(0), num_bits(0), prev(nullptr){};
-
-  Backtrace &operator=(const Backtrace &src) = default;
-  Backtrace(const Backtrace &src) = default;
-  // Move constructor
-  Backtrace(Backtrace &&src) = default;
-  Backtrace &operator=(Backtrace &&src) = default;
+  Backtrace() : bitmap(0), num_bits(0), prev(-1){};
 
   /*
    * Update the Backtrace by increasing the num_bits with 1.
@@ -71,24 +87,30 @@ struct Backtrace {
    * param [in] update_bitmap If true, bitmap will be updated, it means we are
    *                          consuming a query symbol. See the docs of bitmap
    *                          for more details.
+   * param [in,out] arena  The arena to append a segment to when the bitmap is
+   *                       full.
    */
-  void Update(bool update_bitmap) {
+  void Update(bool update_bitmap, BacktraceArena *arena) {
     if (update_bitmap)
-      bitmap |= 1 << num_bits;
+      bitmap |= static_cast<uint64_t>(1) << num_bits;
 
     num_bits++;
 
     if (num_bits == 64) {
-      if (prev == nullptr) {
-        prev = std::make_shared<DynamicBacktrace>(bitmap);
-      } else {
-        prev = std::make_shared<DynamicBacktrace>(bitmap, prev->prev);
-      }
+      prev = arena->Append(bitmap, prev);
       bitmap = 0;
       num_bits = 0;
     }
   }
 
+  // Returns the total number of bits, i.e. the length of ToString().
+  size_t NumBits(const BacktraceArena &arena) const {
+    size_t n = num_bits;
+    for (int64_t s = prev; s != -1; s = arena[s].prev)
+      n += 64;
+    return n;
+  }
+
   /*
    * Convert the bitmap backtrace to string (i.e. the bit string like '011001').
    *
@@ -96,20 +118,20 @@ struct Backtrace {
    * we update bitmap with `bitmap |= 1 << num_bits`), but in the return string
    * the latest bits are on the right side. For example, the original bitmap is
    * `0b110110`, the returned string will be `011011`.
+   *
+   * @param [in] arena  The arena that has the segments of this backtrace.
    */
-  std::string ToString() const {
-    std::ostringstream oss;
-    if (num_bits != 0) {
-      auto str = std::bitset<64>(bitmap).to_string().substr(64 - num_bits);
-      oss << str.substr(0, num_bits);
+  std::string ToString(const BacktraceArena &arena) const {
+    std::string str(NumBits(arena), '0');
+    // Fill it in from the end, i.e. from the latest bit.
+    size_t pos = str.size();
+    for (int32_t b = num_bits - 1; b >= 0; b--)
+      str[--pos] = '0' + ((bitmap >> b) & 1);
+    for (int64_t s = prev; s != -1; s = arena[s].prev) {
+      uint64_t segment = arena[s].bitmap;
+      for (int32_t b = 63; b >= 0; b--)
+        str[--pos] = '0' + ((segment >> b) & 1);
     }
-    auto trace = prev;
-    while (trace != nullptr) {
-      oss << std::bitset<64>(trace->bitmap);
-      trace = trace->prev;
-    }
-    auto str = oss.str();
-    std::reverse(str.begin(), str.end());
     return str;
   }
 };
@@ -128,7 +150,7 @@ struct LevenshteinElement {
 
   explicit LevenshteinElement(int32_t cost) : cost(cost) {}
 
-  LevenshteinElement(int32_t cost, Backtrace backtrace)
+  LevenshteinElement(int32_t cost, const Backtrace &backtrace)
       : cost(cost), backtrace(backtrace) {}
 
   LevenshteinElement() = default;
@@ -143,13 +165,14 @@ struct LevenshteinElement {
    * Handle deletion error given current element.
    *
    * @param [in] c The deletion cost.
+   * @param [in,out] arena The arena of the backtrace.
    *
    * @return Return a new LevenshteinElement object with cost and
    *         backtrace updated based on current element.
    */
-  LevenshteinElement Delete(int32_t c) const {
+  LevenshteinElement Delete(int32_t c, BacktraceArena *arena) const {
     auto res = LevenshteinElement(cost + c, backtrace);
-    res.backtrace.Update(false); // consuming target symbol
+    res.backtrace.Update(false, arena); // consuming target symbol
     return res;
   }
 
@@ -157,13 +180,14 @@ struct LevenshteinElement {
    * Handle insertion error given current element.
    *
    * @param [in] c The insertion cost.
+   * @param [in,out] arena The arena of the backtrace.
    *
    * @return Return a new LevenshteinElement object with cost and
    *         backtrace updated based on current element.
    */
-  LevenshteinElement Insert(int32_t c) const {
+  LevenshteinElement Insert(int32_t c, BacktraceArena *arena) const {
     auto res = LevenshteinElement(cost + c, backtrace);
-    res.backtrace.Update(true); // consuming query symbol
+    res.backtrace.Update(true, arena); // consuming query symbol
     return res;
   }
 
@@ -171,17 +195,18 @@ struct LevenshteinElement {
    * Handle replacement error given current element.
    *
    * @param [in] c The replacement cost.
+   * @param [in,out] arena The arena of the backtrace.
    *
    * @return Return a new LevenshteinElement object with cost and
    *         backtrace updated based on current element.
    */
-  LevenshteinElement Replace(int32_t c) const {
+  LevenshteinElement Replace(int32_t c, BacktraceArena *arena) const {
     auto res = LevenshteinElement(cost + c, backtrace);
     // Consuming both query and target symbols
     // Caution: DO NOT change the order of following two lines, it determines
     // how we recover the alignment.
-    res.backtrace.Update(false);
-    res.backtrace.Update(true);
+    res.backtrace.Update(false, arena);
+    res.backtrace.Update(true, arena);
     return res;
   }
 
@@ -190,104 +215,591 @@ struct LevenshteinElement {
    *
    * Note: Only the backtrace will be updated.
    *
+   * @param [in,out] arena The arena of the backtrace.
+   *
    * @return Return a new LevenshteinElement object with
    *         backtrace updated based on current element.
    */
-  LevenshteinElement Equal() const {
+  LevenshteinElement Equal(BacktraceArena *arena) const {
     auto res = LevenshteinElement(cost, backtrace);
     // Consuming both query and target symbols
     // Caution: DO NOT change the order of following two lines, it determines
     // how we recover the alignment.
-    res.backtrace.Update(false);
-    res.backtrace.Update(true);
+    res.backtrace.Update(false, arena);
+    res.backtrace.Update(true, arena);
     return res;
   }
 };
 
 /*
- * Calculate the levenshtein distance between query and target and also return
- * the alignments (can be constructed from backtrace in LevenshteinElement).
- *
- * Note: We are doing the infix search, gaps at query end and start are not
- * penalized. What that means is that deleting elements from the start and end
- * of target is "free"! For example, if we had ACT and CGACTGAC, the levenshtein
- * distance would be 0, because removing CG from the start and GAC from the end
- * of target is "free" and does not count into total levenshtein distance.
- *
- * @param [in] query The pointer to the query sequence.
- * @param [in] query_length The length of the query sequence.
- * @param [in] target The pointer to the target sequence.
- * @param [in] target_length The length of the target sequence.
- * @param [in,out] alignments  The container that alignments info will write to.
- *                             Because we are doing infix search, so there might
- *                             be multiple matches in target sequence with the
- *                             same levenshtein distance. `alignments` will be
- *                             reallocated in this function, it's size will be
- *                             the number of matching segments.
- * @param [in] insert_cost  The cost of insertion.
- * @param [in] delete_cost  The cost of deletion.
- * @param [in] replace_cost  The cost of replacement.
+ * The algorithms that LevenshteinDistance() can use.
+ */
+enum class LevenshteinEngine {
+  // kBitParallel if all the costs are 1; else kSimd, or kScalar if
+  // max_distance or band_width is given.
+  kAuto = 0,
+  // The dp over the whole (query_length + 1) x (target_length + 1) matrix,
+  // keeping a backtrace for every cell; works for any costs.
+  kScalar = 1,
+  // The bit-parallel algorithm of Myers / Hyyro (see levenshtein_myers.h),
+  // with the alignments recovered afterwards only around the best end
+  // positions.  Requires all the costs to be 1.
+  kBitParallel = 2,
+  // The same dp as kScalar, vectorized with the best instruction set the cpu
+  // supports (see levenshtein_simd.h); works for any costs, but does not
+  // support band_width and always computes the whole matrix.
+  kSimd = 3,
+};
+
+namespace internal {
+
+/*
+ * Recover the alignments of LevenshteinDistance() with unit costs for the
+ * given end positions (in increasing order), all of which have the distance
+ * `distance`, without running the scalar dp: we rerun the bit-parallel dp on
+ * a window of the target before each of them, keep its columns, and trace
+ * back through them making the same choices as the scalar dp would.
  *
- * @return  Returns the levenshtein distance between query and target.
+ * The path of the alignment ending at j consumes at most
+ * reach = query_length + distance target symbols.  The choices along it only
+ * depend on which of the cells around it have the smallest value, and those
+ * cells (value <= distance, at most one column before the path) are the end
+ * of matches starting no earlier than j - 2 * reach; so the window only
+ * needs to start there, and its columns only need to be kept from j - reach.
+ * End positions close to each other share a window.
  */
 template <typename T>
-int32_t LevenshteinDistance(const T *query, size_t query_length,
-                            const T *target, size_t target_length,
-                            std::vector<LevenshteinElement> *alignments,
-                            int32_t insert_cost = 1, int32_t delete_cost = 1,
-                            int32_t replace_cost = 1) {
+void RecoverAlignments(const T *query, size_t query_length, const T *target,
+                       const std::vector<size_t> &ends, int32_t distance,
+                       std::vector<LevenshteinElement> *alignments,
+                       BacktraceArena *arena) {
+  MyersPattern<T> pattern(query, query_length);
+  size_t num_blocks = pattern.NumBlocks();
+  size_t reach = query_length + static_cast<size_t>(distance);
+  // The columns [first_column, last_column] of the dp matrix, where column c
+  // is the one after consuming c target symbols.
+  std::vector<uint64_t> pv, mv;
+  enum class Op { kEqual, kReplace, kDelete, kInsert };
+  std::vector<Op> ops;
+
+  size_t e = 0;
+  while (e < ends.size()) {
+    size_t last = e;
+    while (last + 1 < ends.size() && ends[last + 1] - ends[e] <= reach)
+      last++;
+    size_t begin = ends[e] > 2 * reach ? ends[e] - 2 * reach : 0,
+           first_column = ends[e] > reach ? ends[e] - reach : 0,
+           last_column = ends[last] + 1;
+    pv.resize((last_column - first_column + 1) * num_blocks);
+    mv.resize(pv.size());
+    if (first_column == 0) {
+      // Column 0 is 0, 1, 2, ..., query_length.
+      std::fill(pv.begin(), pv.begin() + num_blocks, ~static_cast<uint64_t>(0));
+      std::fill(mv.begin(), mv.begin() + num_blocks, 0);
+    }
+    MyersColumns(pattern, query_length, target, begin, last_column,
+                 [&](size_t j, int32_t, const uint64_t *column_pv,
+                     const uint64_t *column_mv) {
+                   if (j + 1 < first_column)
+                     return;
+                   size_t offset = (j + 1 - first_column) * num_blocks;
+                   std::copy(column_pv, column_pv + num_blocks, &pv[offset]);
+                   std::copy(column_mv, column_mv + num_blocks, &mv[offset]);
+                 });
+    auto value = [&](size_t k, size_t c) {
+      assert(c >= first_column && c <= last_column);
+      size_t offset = (c - first_column) * num_blocks;
+      return MyersValue(&pv[offset], &mv[offset], k);
+    };
+
+    for (size_t n = e; n <= last; n++) {
+      ops.clear();
+      size_t k = query_length, c = ends[n] + 1;
+      while (k > 0) {
+        if (c == 0) { // column 0 only has insertions
+          ops.push_back(Op::kInsert);
+          k--;
+        } else if (query[k - 1] == target[c - 1]) {
+          ops.push_back(Op::kEqual);
+          k--, c--;
+        } else {
+          int32_t del = value(k, c - 1), ins = value(k - 1, c),
+                  diag = value(k - 1, c - 1);
+          if (del <= ins && del <= diag) {
+            ops.push_back(Op::kDelete);
+            c--;
+          } else if (ins <= del && ins <= diag) {
+            ops.push_back(Op::kInsert);
+            k--;
+          } else {
+            ops.push_back(Op::kReplace);
+            k--, c--;
+          }
+        }
+      }
 
-  LevenshteinElement best_score = LevenshteinElement(-1);
+      LevenshteinElement element(0);
+      for (auto it = ops.rbegin(); it != ops.rend(); ++it) {
+        if (*it == Op::kDelete) {
+          element = element.Delete(1, arena);
+        } else if (*it == Op::kInsert) {
+          element = element.Insert(1, arena);
+        } else if (*it == Op::kEqual) {
+          element = element.Equal(arena);
+        } else {
+          element = element.Replace(1, arena);
+        }
+      }
+      assert(element.cost == distance);
+      element.position = ends[n];
+      alignments->push_back(element);
+    }
+    e = last + 1;
+  }
+}
 
-  assert(target_length != 0);
-  if (query_length == 0) {
-    return 0;
+/*
+ * Sets *query_data and *target_data to the query and target as int32_t
+ * symbols, for the kernels that compare int32_t: the pointers themselves if T
+ * is int32_t, else the converted symbols in the buffers.  If some 64-bit
+ * symbols don't fit in int32_t, the query symbols are renumbered 0, 1, ...
+ * and the target symbols not in the query become -1, which keeps which query
+ * and target symbols are equal.
+ */
+inline void ToInt32Symbols(const int32_t *query, size_t, const int32_t *target,
+                           size_t, std::vector<int32_t> *,
+                           std::vector<int32_t> *, const int32_t **query_data,
+                           const int32_t **target_data) {
+  *query_data = query;
+  *target_data = target;
+}
+
+template <typename T>
+void ToInt32Symbols(const T *query, size_t query_length, const T *target,
+                    size_t target_length, std::vector<int32_t> *query_buffer,
+                    std::vector<int32_t> *target_buffer,
+                    const int32_t **query_data, const int32_t **target_data) {
+  auto fits = [](T symbol) {
+    return static_cast<T>(static_cast<int32_t>(symbol)) == symbol;
+  };
+  bool all_fit = sizeof(T) < sizeof(int32_t) ||
+                 (std::all_of(query, query + query_length, fits) &&
+                  std::all_of(target, target + target_length, fits));
+  query_buffer->resize(query_length);
+  target_buffer->resize(target_length);
+  if (all_fit) {
+    std::copy(query, query + query_length, query_buffer->begin());
+    std::copy(target, target + target_length, target_buffer->begin());
+  } else {
+    std::vector<T> symbols(query, query + query_length);
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    auto id = [&symbols](T symbol) -> int32_t {
+      auto it = std::lower_bound(symbols.begin(), symbols.end(), symbol);
+      return it != symbols.end() && *it == symbol
+                 ? static_cast<int32_t>(it - symbols.begin())
+                 : -1;
+    };
+    std::transform(query, query + query_length, query_buffer->begin(), id);
+    std::transform(target, target + target_length, target_buffer->begin(), id);
   }
+  *query_data = query_buffer->data();
+  *target_data = target_buffer->data();
+}
+
+/*
+ * The costs of the edits, as a policy of the dp kernels: EditCosts has them
+ * at run time, and UnitCosts has them all 1 at compile time, so that the
+ * kernels instantiated with it (for the common case) have no costs to load
+ * and only increment the costs of the cells.
+ */
+struct EditCosts {
+  int32_t insert_cost;
+  int32_t delete_cost;
+  int32_t replace_cost;
+};
+
+struct UnitCosts {
+  static constexpr int32_t insert_cost = 1;
+  static constexpr int32_t delete_cost = 1;
+  static constexpr int32_t replace_cost = 1;
+};
+
+/*
+ * The scalar dp of LevenshteinDistance() (see there for the arguments, which
+ * are already checked), with the costs of the edits given by the policy
+ * `Costs` (UnitCosts or EditCosts).  Without alignments no backtraces are
+ * built.
+ */
+template <typename T, typename Costs>
+int32_t LevenshteinDistanceScalar(const T *query, size_t query_length,
+                                  const T *target, size_t target_length,
+                                  std::vector<LevenshteinElement> *alignments,
+                                  BacktraceArena *arena, const Costs &costs,
+                                  int32_t max_distance, int32_t band_width,
+                                  int64_t *end_position) {
+  // The cost of the cells that can't lead to a match within the bound: as
+  // the costs are nondecreasing along any path, those are the ones whose
+  // cost is above it, and also the ones outside the band.  The rows after
+  // `last_row` are all infinite.
+  const int32_t kInfinity = std::numeric_limits<int32_t>::max() / 2;
+  int32_t bound = max_distance >= 0 ? max_distance : kInfinity - 1;
+  auto band_begin = [&](size_t j) -> size_t {
+    if (band_width < 0 || j <= static_cast<size_t>(band_width))
+      return 0;
+    return ((j - band_width) * query_length + target_length - 1) /
+           target_length;
+  };
+  auto band_end = [&](size_t j) -> size_t { // inclusive
+    if (band_width < 0)
+      return query_length;
+    return std::min(query_length,
+                    (j + band_width) * query_length / target_length);
+  };
+
+  // The backtraces are not needed if there are no alignments to return, only
+  // the costs.
+  bool backtraces = alignments != nullptr;
+  auto equal = [&](const LevenshteinElement &e) {
+    return backtraces ? e.Equal(arena) : LevenshteinElement(e.cost);
+  };
+  auto insert = [&](const LevenshteinElement &e) {
+    return backtraces ? e.Insert(costs.insert_cost, arena)
+                      : LevenshteinElement(e.cost + costs.insert_cost);
+  };
+  auto del = [&](const LevenshteinElement &e) {
+    return backtraces ? e.Delete(costs.delete_cost, arena)
+                      : LevenshteinElement(e.cost + costs.delete_cost);
+  };
+  auto replace = [&](const LevenshteinElement &e) {
+    return backtraces ? e.Replace(costs.replace_cost, arena)
+                      : LevenshteinElement(e.cost + costs.replace_cost);
+  };
+
+  LevenshteinElement best_score = LevenshteinElement(-1);
 
   auto scores = std::vector<LevenshteinElement>(query_length + 1);
 
   scores[0] = LevenshteinElement(0);
+  size_t last_row = 0;
   for (size_t i = 1; i <= query_length; i++) {
-    scores[i] = scores[i - 1].Insert(insert_cost);
+    scores[i] = insert(scores[i - 1]);
+    if (i <= band_end(0) && scores[i].cost <= bound)
+      last_row = i;
+  }
+  for (size_t i = last_row + 1; i <= query_length; i++) {
+    scores[i] = LevenshteinElement(kInfinity);
   }
 
+  size_t prev_begin = 0;
+  int64_t num_cells = 0;
   for (size_t j = 1; j <= target_length; j++) {
-    LevenshteinElement prev_diag = scores[0], prev_diag_cache;
+    size_t begin = band_begin(j), end = band_end(j);
+    size_t start = std::max<size_t>(begin, 1);
+    LevenshteinElement prev_diag = scores[start - 1], prev_diag_cache;
+
+    // The rows before the band are infinite.
+    for (size_t i = prev_begin; i < begin; i++) {
+      scores[i] = LevenshteinElement(kInfinity);
+    }
+    prev_begin = begin;
 
     // we are doing infix search, the cost of the beginning symbol will always
     // be 0.
-    scores[0] = LevenshteinElement(0);
+    if (begin == 0) {
+      scores[0] = LevenshteinElement(0);
+    }
 
-    for (size_t k = 1; k <= query_length; k++) {
+    size_t k = start;
+    for (; k <= end && (k <= last_row + 1 || scores[k - 1].cost <= bound);
+         k++) {
       prev_diag_cache = scores[k];
       if (query[k - 1] == target[j - 1]) {
-        scores[k] = prev_diag.Equal(); // equal
+        scores[k] = equal(prev_diag); // equal
       } else {
         if (scores[k].cost <= scores[k - 1].cost &&
             scores[k].cost <= prev_diag.cost) { // deletion
-          scores[k] = scores[k].Delete(delete_cost);
+          scores[k] = del(scores[k]);
         } else if (scores[k - 1].cost <= scores[k].cost &&
                    scores[k - 1].cost <= prev_diag.cost) { // insertion
-          scores[k] = scores[k - 1].Insert(insert_cost);
+          scores[k] = insert(scores[k - 1]);
         } else { // replacement
-          scores[k] = prev_diag.Replace(replace_cost);
+          scores[k] = replace(prev_diag);
         }
       }
+      if (scores[k].cost > bound) {
+        scores[k].cost = kInfinity; // so that it can't overflow
+      }
       prev_diag = prev_diag_cache;
     }
+    num_cells += k - start;
+    // Ukkonen's cut-off: drop the last rows if they are above the bound.
+    last_row = k - 1;
+    while (last_row >= start && scores[last_row].cost > bound) {
+      scores[last_row] = LevenshteinElement(kInfinity);
+      last_row--;
+    }
 
+    if (last_row != query_length) {
+      continue;
+    }
     auto score = scores[query_length];
     if (best_score.cost == -1 || score.cost <= best_score.cost) {
-      if (score.cost < best_score.cost) {
+      if (score.cost < best_score.cost && alignments != nullptr) {
         alignments->clear();
       }
+      if (end_position != nullptr &&
+          (best_score.cost == -1 || score.cost < best_score.cost)) {
+        *end_position = j - 1;
+      }
       best_score = score;
+      // Only matches at least as good as this one matter from now on.
+      bound = score.cost;
       score.position = j - 1;
-      alignments->push_back(score);
+      if (alignments != nullptr) {
+        alignments->push_back(score);
+      }
     }
   }
+  FTS_STATS_DP_CELLS(Stage::kLevenshtein, num_cells);
   return best_score.cost;
 }
+
+} // namespace internal
+
+/*
+ * Calculate the levenshtein distance between query and target and also return
+ * the alignments (can be constructed from backtrace in LevenshteinElement).
+ *
+ * Note: We are doing the infix search, gaps at query end and start are not
+ * penalized. What that means is that deleting elements from the start and end
+ * of target is "free"! For example, if we had ACT and CGACTGAC, the levenshtein
+ * distance would be 0, because removing CG from the start and GAC from the end
+ * of target is "free" and does not count into total levenshtein distance.
+ *
+ * @param [in] query The pointer to the query sequence.
+ * @param [in] query_length The length of the query sequence.
+ * @param [in] target The pointer to the target sequence.
+ * @param [in] target_length The length of the target sequence.
+ * @param [in,out] alignments  The container that alignments info will write to.
+ *                             Because we are doing infix search, so there might
+ *                             be multiple matches in target sequence with the
+ *                             same levenshtein distance. `alignments` will be
+ *                             reallocated in this function, it's size will be
+ *                             the number of matching segments.  If it is
+ *                             nullptr, only the distance is computed.
+ * @param [in,out] arena  The arena that the backtraces of `alignments` are
+ *                        stored in, needed to use them (e.g. ToString()).  It
+ *                        is cleared first; reusing it across calls avoids
+ *                        allocating its memory again.  Must not be nullptr if
+ *                        `alignments` is not.
+ * @param [in] insert_cost  The cost of insertion, must be >= 0.
+ * @param [in] delete_cost  The cost of deletion, must be >= 0.
+ * @param [in] replace_cost  The cost of replacement, must be >= 0.
+ * @param [in] engine  The algorithm to use, see LevenshteinEngine; all of them
+ *                     give the same result.  kBitParallel requires all the
+ *                     costs to be 1.
+ * @param [in] max_distance  If >= 0, we are not interested in matches with a
+ *                           larger distance: the dp stops at the rows that
+ *                           can't be within this distance any more (Ukkonen's
+ *                           cut-off), and if there is no match within it we
+ *                           return -1 with no alignments.  Otherwise the
+ *                           result is the same as without it.
+ * @param [in] band_width  If >= 0, only the cells of the dp matrix within
+ *                         this many target positions of the straight line from
+ *                         (query start, target start) to (query end, target
+ *                         end) are computed, for when the query and target are
+ *                         known to roughly correspond to each other.  This
+ *                         may give a larger distance than the full dp, or -1
+ *                         if the band has no path through it.  Always uses
+ *                         the scalar dp, so `engine` must not be kBitParallel
+ *                         or kSimd.
+ * @param [out] end_position  If not nullptr, at exit the position in target
+ *                            of the first best match (the position of the
+ *                            first of `alignments`), or -1 if there is no
+ *                            match (or the query is empty).  It does not need
+ *                            `alignments`, so with those nullptr no
+ *                            backtraces are computed at all.
+ *
+ * @return  Returns the levenshtein distance between query and target, or -1
+ *          if there was no match within `max_distance` or `band_width`.
+ */
+template <typename T>
+int32_t LevenshteinDistance(const T *query, size_t query_length,
+                            const T *target, size_t target_length,
+                            std::vector<LevenshteinElement> *alignments,
+                            BacktraceArena *arena, int32_t insert_cost = 1,
+                            int32_t delete_cost = 1, int32_t replace_cost = 1,
+                            LevenshteinEngine engine = LevenshteinEngine::kAuto,
+                            int32_t max_distance = -1,
+                            int32_t band_width = -1,
+                            int64_t *end_position = nullptr) {
+  assert(target_length != 0);
+  assert(insert_cost >= 0 && delete_cost >= 0 && replace_cost >= 0);
+  assert(alignments == nullptr || arena != nullptr);
+  FTS_STATS_SCOPE(Stage::kLevenshtein);
+  if (alignments != nullptr) {
+    alignments->clear();
+    arena->Clear();
+  }
+  if (end_position != nullptr) {
+    *end_position = -1;
+  }
+  if (query_length == 0) {
+    return 0;
+  }
+
+  bool unit_costs = insert_cost == 1 && delete_cost == 1 && replace_cost == 1;
+  if (engine == LevenshteinEngine::kAuto) {
+    if (band_width >= 0)
+      engine = LevenshteinEngine::kScalar;
+    else if (unit_costs)
+      engine = LevenshteinEngine::kBitParallel;
+    else
+      engine = max_distance >= 0 ? LevenshteinEngine::kScalar
+                                 : LevenshteinEngine::kSimd;
+  }
+
+  if (engine == LevenshteinEngine::kSimd) {
+    // The SIMD engine evaluates the whole matrix.
+    FTS_STATS_DP_CELLS(Stage::kLevenshtein,
+                       static_cast<int64_t>(query_length) * target_length);
+    assert(band_width < 0);
+    // The kernels compare int32_t symbols.
+    std::vector<int32_t> query_symbols, target_symbols;
+    const int32_t *query_data, *target_data;
+    internal::ToInt32Symbols(query, query_length, target, target_length,
+                             &query_symbols, &target_symbols, &query_data,
+                             &target_data);
+    return LevenshteinDistanceSimd(query_data, query_length, target_data,
+                                   target_length, alignments, arena,
+                                   insert_cost, delete_cost, replace_cost,
+                                   max_distance, 0, end_position);
+  }
+
+  if (engine == LevenshteinEngine::kBitParallel) {
+    assert(unit_costs && band_width < 0);
+    int32_t best_cost = -1;
+    std::vector<size_t> ends;
+    MyersLevenshtein(query, query_length, target, target_length, max_distance,
+                     [&](size_t j, int32_t cost) {
+                       if (best_cost == -1 || cost < best_cost)
+                         ends.clear();
+                       best_cost = cost;
+                       ends.push_back(j);
+                     });
+    if (end_position != nullptr && best_cost != -1) {
+      *end_position = static_cast<int64_t>(ends.front());
+    }
+    if (alignments != nullptr && best_cost != -1) {
+      internal::RecoverAlignments(query, query_length, target, ends, best_cost,
+                                  alignments, arena);
+    }
+    return best_cost;
+  }
+
+  if (unit_costs) {
+    return internal::LevenshteinDistanceScalar(
+        query, query_length, target, target_length, alignments, arena,
+        internal::UnitCosts(), max_distance, band_width, end_position);
+  }
+  internal::EditCosts costs = {insert_cost, delete_cost, replace_cost};
+  return internal::LevenshteinDistanceScalar(
+      query, query_length, target, target_length, alignments, arena, costs,
+      max_distance, band_width, end_position);
+}
+
+/*
+ * The edit operations of an alignment, see GetAlignment().
+ */
+enum class AlignmentOp : int8_t {
+  kEqual = 0,   // A query symbol aligned with an equal target symbol.
+  kReplace = 1, // A query symbol aligned with a different target symbol.
+  kInsert = 2,  // A query symbol that is not in the target.
+  kDelete = 3,  // A target symbol that is not in the query.
+};
+
+/*
+ * Decode the backtrace of an alignment returned by LevenshteinDistance() (or
+ * LevenshteinDistanceLinearMemory()) into its edit operations, reading the
+ * bits from the arena segments without going through Backtrace::ToString().
+ *
+ * As for the '0'/'1' strings, a target symbol followed by a query symbol is
+ * read as one aligned pair (an equal or replaced symbol).
+ *
+ * @param [in] query  The query sequence the alignment is for.
+ * @param [in] target  The target sequence the alignment is for.
+ * @param [in] alignment  The alignment; alignment.position is its end
+ *                        position in the target.
+ * @param [in] arena  The arena that has the backtrace of `alignment`.
+ * @param [out] ops  At exit, the edit operations, from the start of the
+ *                   matched segment of the target to its end.
+ * @param [out] query_positions  If not nullptr, at exit has the same size as
+ *                               `ops`: the index of the query symbol of each
+ *                               operation, or -1 for kDelete.
+ * @param [out] target_positions  If not nullptr, at exit has the same size as
+ *                                `ops`: the index of the target symbol of
+ *                                each operation, or -1 for kInsert.  The
+ *                                positions must fit in P, e.g. a target of up
+ *                                to 2^31 symbols for the default int32_t.
+ */
+template <typename T, typename P = int32_t>
+void GetAlignment(const T *query, const T *target,
+                  const LevenshteinElement &alignment,
+                  const BacktraceArena &arena, std::vector<AlignmentOp> *ops,
+                  std::vector<P> *query_positions = nullptr,
+                  std::vector<P> *target_positions = nullptr) {
+  // The full segments of the backtrace, from the oldest one, then the bits
+  // that are not in a segment yet.
+  const Backtrace &backtrace = alignment.backtrace;
+  std::vector<uint64_t> words;
+  for (int64_t s = backtrace.prev; s != -1; s = arena[s].prev)
+    words.push_back(arena[s].bitmap);
+  std::reverse(words.begin(), words.end());
+  words.push_back(backtrace.bitmap);
+  int64_t num_bits = 64 * static_cast<int64_t>(words.size() - 1) +
+                     backtrace.num_bits;
+  auto bit = [&](int64_t k) { return (words[k >> 6] >> (k & 63)) & 1; };
+
+  int64_t num_target = num_bits;
+  for (uint64_t word : words)
+    num_target -= __builtin_popcountll(word);
+  int64_t q = 0, t = alignment.position + 1 - num_target;
+  assert(t >= 0);
+  assert(query_positions == nullptr ||
+         num_bits - num_target <= std::numeric_limits<P>::max());
+  assert(target_positions == nullptr ||
+         alignment.position <= std::numeric_limits<P>::max());
+
+  ops->clear();
+  if (query_positions != nullptr)
+    query_positions->clear();
+  if (target_positions != nullptr)
+    target_positions->clear();
+  for (int64_t k = 0; k < num_bits; k++) {
+    AlignmentOp op;
+    int64_t query_position = -1, target_position = -1;
+    if (bit(k) == 0 && k + 1 < num_bits && bit(k + 1) == 1) {
+      op = query[q] == target[t] ? AlignmentOp::kEqual : AlignmentOp::kReplace;
+      query_position = q++;
+      target_position = t++;
+      k++;
+    } else if (bit(k) == 0) {
+      op = AlignmentOp::kDelete;
+      target_position = t++;
+    } else {
+      op = AlignmentOp::kInsert;
+      query_position = q++;
+    }
+    ops->push_back(op);
+    if (query_positions != nullptr)
+      query_positions->push_back(static_cast<P>(query_position));
+    if (target_positions != nullptr)
+      target_positions->push_back(static_cast<P>(target_position));
+  }
+  assert(t == alignment.position + 1);
+}
+
 } // namespace fasttextsearch
 
 #endif // TEXTSEARCH_CSRC_LEVENSHTEIN_H_
@@ -0,0 +1,176 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_LEVENSHTEIN_BATCH_H_
+#define TEXTSEARCH_CSRC_LEVENSHTEIN_BATCH_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/levenshtein_myers.h"
+#include "textsearch/csrc/parallel.h"
+
+namespace fasttextsearch {
+
+/*
+ * Calculate the levenshtein distance between one query and each of many
+ * segments ("spans") of a reference sequence, as LevenshteinDistance() would,
+ * e.g. for the candidate regions found by FindCandidateMatches().  The spans
+ * are processed in parallel, each thread taking the next span when it is done
+ * with its previous one.
+ *
+ * @param [in] query The pointer to the query sequence.
+ * @param [in] query_length The length of the query sequence.
+ * @param [in] reference The pointer to the reference sequence.
+ * @param [in] reference_length The length of the reference sequence.
+ * @param [in] spans  The spans, 2 * num_spans elements: span i is
+ *                    reference[spans[2*i], spans[2*i+1]).  A span with a
+ *                    negative begin (like the unused candidates of
+ *                    FindCandidateMatches()) is skipped; otherwise require
+ *                    0 <= begin < end <= reference_length.
+ * @param [in] num_spans  The number of spans.
+ * @param [in] insert_cost  The cost of insertion, must be >= 0.
+ * @param [in] delete_cost  The cost of deletion, must be >= 0.
+ * @param [in] replace_cost  The cost of replacement, must be >= 0.
+ * @param [in] engine  The algorithm to use, see LevenshteinDistance().
+ * @param [in] max_distance  See LevenshteinDistance().
+ * @param [out] distances  An array of num_spans elements; at exit
+ *                         distances[i] is the distance for span i, or -1 if
+ *                         it was skipped or had no match within max_distance.
+ * @param [out] end_positions  An array of num_spans elements; at exit
+ *                             end_positions[i] is the first best end position
+ *                             in span i, as an index into `reference`, or -1
+ *                             where distances[i] is -1 (or if the query is
+ *                             empty).
+ * @param [in] num_threads  The number of threads to use; <= 0 means to use all
+ *                          hardware threads.
+ */
+template <typename T>
+void LevenshteinDistanceBatch(
+    const T *query, size_t query_length, const T *reference,
+    size_t reference_length, const int64_t *spans, int64_t num_spans,
+    int32_t insert_cost, int32_t delete_cost, int32_t replace_cost,
+    LevenshteinEngine engine, int32_t max_distance, int32_t *distances,
+    int64_t *end_positions, int32_t num_threads = 1) {
+  bool unit_costs = insert_cost == 1 && delete_cost == 1 && replace_cost == 1;
+  bool bit_parallel = engine == LevenshteinEngine::kBitParallel ||
+                      (engine == LevenshteinEngine::kAuto && unit_costs);
+
+  ParallelForEach(num_spans, num_threads, [&](int32_t, int64_t i) {
+    int64_t begin = spans[2 * i], end = spans[2 * i + 1];
+    distances[i] = -1;
+    end_positions[i] = -1;
+    if (begin < 0)
+      return;
+    assert(begin < end && end <= static_cast<int64_t>(reference_length));
+    const T *target = reference + begin;
+    size_t target_length = static_cast<size_t>(end - begin);
+    if (query_length == 0) {
+      distances[i] = 0;
+      return;
+    }
+    if (bit_parallel) {
+      assert(unit_costs);
+      int32_t best = -1;
+      int64_t best_end = -1;
+      MyersLevenshtein(query, query_length, target, target_length,
+                       max_distance, [&](size_t j, int32_t cost) {
+                         if (best == -1 || cost < best) {
+                           best = cost;
+                           best_end = begin + static_cast<int64_t>(j);
+                         }
+                       });
+      distances[i] = best;
+      end_positions[i] = best_end;
+      return;
+    }
+    // Only the distance and the end position, without any backtraces: the
+    // alignment of the best span is recovered afterwards.
+    int64_t end_position;
+    distances[i] = LevenshteinDistance(
+        query, query_length, target, target_length, nullptr, nullptr,
+        insert_cost, delete_cost, replace_cost, engine, max_distance, -1,
+        &end_position);
+    if (distances[i] != -1)
+      end_positions[i] = begin + end_position;
+  });
+}
+
+/*
+ * Recover the alignment of the query with the best span of a batch, from the
+ * distances and end positions of LevenshteinDistanceBatch(), without running
+ * the dp over the other spans.  With unit costs only a window of the best
+ * span before its end position is searched again (see
+ * internal::RecoverAlignments()); otherwise the dp runs on the best span up
+ * to its end position.
+ *
+ * @param [in] query, query_length, reference, spans, num_spans  As given to
+ *                   LevenshteinDistanceBatch().
+ * @param [in] distances, end_positions  As returned by
+ *                   LevenshteinDistanceBatch().
+ * @param [out] alignment  At exit, if the return value is not -1, the
+ *                   alignment with the best span, with its position an index
+ *                   into `reference`.
+ * @param [in] arena  The arena for the backtrace of `alignment`.
+ * @param [in] insert_cost, delete_cost, replace_cost  As given to
+ *                   LevenshteinDistanceBatch().
+ *
+ * @return The index of the best span, i.e. the first one with the smallest
+ *         distance, or -1 if all the distances are -1 or the query is empty.
+ */
+template <typename T>
+int64_t LevenshteinBatchBestAlignment(
+    const T *query, size_t query_length, const T *reference,
+    const int64_t *spans, int64_t num_spans, const int32_t *distances,
+    const int64_t *end_positions, LevenshteinElement *alignment,
+    BacktraceArena *arena, int32_t insert_cost = 1, int32_t delete_cost = 1,
+    int32_t replace_cost = 1) {
+  int64_t best = -1;
+  for (int64_t i = 0; i < num_spans; i++) {
+    if (distances[i] != -1 && (best == -1 || distances[i] < distances[best]))
+      best = i;
+  }
+  if (best == -1 || query_length == 0)
+    return -1;
+  int64_t begin = spans[2 * best];
+  size_t end = static_cast<size_t>(end_positions[best] - begin);
+  std::vector<LevenshteinElement> alignments;
+  if (insert_cost == 1 && delete_cost == 1 && replace_cost == 1) {
+    std::vector<size_t> ends = {end};
+    internal::RecoverAlignments(query, query_length, reference + begin, ends,
+                                distances[best], &alignments, arena);
+  } else {
+    // As `end` is the first best end position, it is the only one with the
+    // best distance in the span cut after it.
+    LevenshteinDistance(query, query_length, reference + begin, end + 1,
+                        &alignments, arena, insert_cost, delete_cost,
+                        replace_cost);
+    assert(alignments.size() == 1 && alignments.front().position ==
+                                         static_cast<int64_t>(end));
+  }
+  *alignment = alignments.front();
+  alignment->position += begin;
+  return best;
+}
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_LEVENSHTEIN_BATCH_H_
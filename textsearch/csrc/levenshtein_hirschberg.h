@@ -0,0 +1,359 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_LEVENSHTEIN_HIRSCHBERG_H_
+#define TEXTSEARCH_CSRC_LEVENSHTEIN_HIRSCHBERG_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/levenshtein_myers.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+namespace internal {
+
+// Sub-problems with no more than this many cells are aligned with the full
+// dp matrix.
+constexpr int64_t kHirschbergMaxBaseCells = 1 << 16;
+
+// Sub-problems with fewer cells than this are not split across threads.
+constexpr int64_t kHirschbergMinParallelCells = 1 << 22;
+
+enum class AlignOp : int8_t { kEqual, kReplace, kDelete, kInsert };
+
+/*
+ * Compute the last row of the dp of aligning the whole of `query` with each
+ * prefix of `target` (or, if kReverse, the whole of the reversed query with
+ * each prefix of the reversed target, i.e. suffixes).  On exit (*row)[x] is
+ * the cost of the best alignment with the first (last, if kReverse) x target
+ * symbols, for x = 0 .. target_length.  If free_start, skipping target
+ * symbols before the alignment costs nothing (infix search), else it is
+ * a global alignment.  Uses O(query_length) memory besides `row`.
+ */
+template <bool kReverse, typename T, typename Costs>
+void DpLastRow(const T *query, size_t query_length, const T *target,
+               size_t target_length, const Costs &costs, bool free_start,
+               std::vector<int32_t> *row) {
+  auto q = [&](size_t i) {
+    return kReverse ? query[query_length - 1 - i] : query[i];
+  };
+  auto t = [&](size_t j) {
+    return kReverse ? target[target_length - 1 - j] : target[j];
+  };
+  std::vector<int32_t> column(query_length + 1);
+  for (size_t i = 0; i <= query_length; i++)
+    column[i] = static_cast<int32_t>(i) * costs.insert_cost;
+  row->resize(target_length + 1);
+  (*row)[0] = column[query_length];
+  for (size_t j = 1; j <= target_length; j++) {
+    int32_t prev_diag = column[0];
+    column[0] = free_start ? 0 : static_cast<int32_t>(j) * costs.delete_cost;
+    const T &symbol = t(j - 1);
+    for (size_t i = 1; i <= query_length; i++) {
+      int32_t cost = std::min(
+          {column[i] + costs.delete_cost, column[i - 1] + costs.insert_cost,
+           prev_diag + (q(i - 1) == symbol ? 0 : costs.replace_cost)});
+      prev_diag = column[i];
+      column[i] = cost;
+    }
+    (*row)[j] = column[query_length];
+  }
+  FTS_STATS_DP_CELLS(Stage::kLevenshtein,
+                     static_cast<int64_t>(query_length) * target_length);
+}
+
+/*
+ * Append to `ops` the operations of a best global alignment of `query` with
+ * `target`, using the full dp matrix; only for small problems.
+ */
+template <typename T, typename Costs>
+void AlignFull(const T *query, size_t query_length, const T *target,
+               size_t target_length, const Costs &costs,
+               std::vector<AlignOp> *ops) {
+  size_t num_cols = target_length + 1;
+  std::vector<int32_t> dp((query_length + 1) * num_cols);
+  FTS_STATS_SCRATCH(Stage::kLevenshtein, dp.size() * sizeof(int32_t));
+  FTS_STATS_DP_CELLS(Stage::kLevenshtein,
+                     static_cast<int64_t>(query_length) * target_length);
+  auto at = [&](size_t i, size_t j) -> int32_t & {
+    return dp[i * num_cols + j];
+  };
+  for (size_t j = 0; j <= target_length; j++)
+    at(0, j) = static_cast<int32_t>(j) * costs.delete_cost;
+  for (size_t i = 1; i <= query_length; i++) {
+    at(i, 0) = static_cast<int32_t>(i) * costs.insert_cost;
+    for (size_t j = 1; j <= target_length; j++)
+      at(i, j) = std::min(
+          {at(i, j - 1) + costs.delete_cost, at(i - 1, j) + costs.insert_cost,
+           at(i - 1, j - 1) +
+               (query[i - 1] == target[j - 1] ? 0 : costs.replace_cost)});
+  }
+
+  size_t begin = ops->size();
+  size_t i = query_length, j = target_length;
+  while (i > 0 || j > 0) {
+    if (i > 0 && j > 0 && query[i - 1] == target[j - 1] &&
+        at(i, j) == at(i - 1, j - 1)) {
+      ops->push_back(AlignOp::kEqual);
+      i--, j--;
+    } else if (j > 0 && at(i, j) == at(i, j - 1) + costs.delete_cost) {
+      ops->push_back(AlignOp::kDelete);
+      j--;
+    } else if (i > 0 && at(i, j) == at(i - 1, j) + costs.insert_cost) {
+      ops->push_back(AlignOp::kInsert);
+      i--;
+    } else {
+      assert(i > 0 && j > 0);
+      ops->push_back(AlignOp::kReplace);
+      i--, j--;
+    }
+  }
+  std::reverse(ops->begin() + begin, ops->end());
+}
+
+/*
+ * Append to `ops` the operations of a best global alignment of `query` with
+ * `target`, with Hirschberg's divide and conquer algorithm: the best path
+ * crosses the middle row of the query at the column that minimizes the sum
+ * of the forward cost to it and the backward cost from it, and the two
+ * halves are then aligned independently (in parallel if num_threads > 1).
+ */
+template <typename T, typename Costs>
+void AlignHirschberg(const T *query, size_t query_length, const T *target,
+                     size_t target_length, const Costs &costs,
+                     int32_t num_threads, std::vector<AlignOp> *ops) {
+  if (query_length == 0) {
+    ops->insert(ops->end(), target_length, AlignOp::kDelete);
+    return;
+  }
+  if (target_length == 0) {
+    ops->insert(ops->end(), query_length, AlignOp::kInsert);
+    return;
+  }
+  int64_t num_cells = static_cast<int64_t>(query_length) * target_length;
+  if (query_length == 1 || num_cells <= kHirschbergMaxBaseCells) {
+    AlignFull(query, query_length, target, target_length, costs, ops);
+    return;
+  }
+
+  bool parallel = num_threads > 1 && num_cells >= kHirschbergMinParallelCells;
+  size_t mid = query_length / 2;
+  std::vector<int32_t> forward, backward;
+  auto backward_pass = [&]() {
+    DpLastRow<true>(query + mid, query_length - mid, target, target_length,
+                    costs, false, &backward);
+  };
+  std::thread backward_thread;
+  if (parallel)
+    backward_thread = std::thread(backward_pass);
+  else
+    backward_pass();
+  DpLastRow<false>(query, mid, target, target_length, costs, false, &forward);
+  if (parallel)
+    backward_thread.join();
+
+  size_t split = 0;
+  for (size_t x = 1; x <= target_length; x++)
+    if (forward[x] + backward[target_length - x] <
+        forward[split] + backward[target_length - split])
+      split = x;
+
+  if (!parallel) {
+    AlignHirschberg(query, mid, target, split, costs, 1, ops);
+    AlignHirschberg(query + mid, query_length - mid, target + split,
+                    target_length - split, costs, 1, ops);
+    return;
+  }
+  std::vector<AlignOp> right_ops;
+  int32_t right_threads = num_threads / 2;
+  std::thread right_thread([&]() {
+    AlignHirschberg(query + mid, query_length - mid, target + split,
+                    target_length - split, costs, right_threads, &right_ops);
+  });
+  AlignHirschberg(query, mid, target, split, costs, num_threads - right_threads,
+                  ops);
+  right_thread.join();
+  ops->insert(ops->end(), right_ops.begin(), right_ops.end());
+}
+
+/*
+ * Append to `ops` the operations of an alignment of `query` with the match
+ * that ends at target[end] with the best distance, `distance`: its start is
+ * found with a pass backwards from the end, and then it is aligned with
+ * AlignHirschberg().
+ */
+template <typename T, typename Costs>
+void AlignMatch(const T *query, size_t query_length, const T *target,
+                size_t end, int32_t distance, const Costs &costs,
+                int32_t num_threads, std::vector<AlignOp> *ops) {
+  // The start of the match: the alignment of the whole query with the last
+  // `length` symbols of target[0, end] that has the best distance.  With unit
+  // costs it can't be longer than query_length + distance.
+  size_t max_length = end + 1;
+  if (costs.insert_cost == 1 && costs.delete_cost == 1 &&
+      costs.replace_cost == 1)
+    max_length = std::min(max_length, query_length + distance);
+  std::vector<int32_t> row;
+  DpLastRow<true>(query, query_length, target + end + 1 - max_length,
+                  max_length, costs, false, &row);
+  size_t length = 0;
+  while (row[length] != distance) {
+    length++;
+    assert(length <= max_length);
+  }
+  size_t begin = end + 1 - length;
+
+  ops->reserve(query_length + length);
+  AlignHirschberg(query, query_length, target + begin, length, costs,
+                  num_threads, ops);
+}
+
+} // namespace internal
+
+/*
+ * Like LevenshteinDistance(), but returns only one alignment, of the first
+ * best end position, using O(query_length + target_length) memory besides
+ * that of the alignment itself, so it can be used for very long sequences
+ * (e.g. whole chapters of audiobooks).
+ *
+ * We first find the best distance and its end position with one pass over the
+ * target that only keeps one column of the dp (the bit-parallel engine for
+ * unit costs), then the start of the match with a pass backwards from the
+ * end, and then the alignment of the query with target[start, end] with
+ * Hirschberg's algorithm.
+ *
+ * Note: the alignment has the best distance but, if there are several of them,
+ * not necessarily the one LevenshteinDistance() would return.  Also, with
+ * costs other than 1 the distance here is the true minimum of the sum of the
+ * costs, which may be smaller than that of LevenshteinDistance() (whose dp
+ * picks the cheapest predecessor before adding the cost of the edit).
+ *
+ * @param [in] query The pointer to the query sequence.
+ * @param [in] query_length The length of the query sequence.
+ * @param [in] target The pointer to the target sequence.
+ * @param [in] target_length The length of the target sequence.
+ * @param [out] alignment  If not nullptr, the alignment of the match is
+ *                         written to it (its `position` is the end position).
+ *                         It is not changed if the query is empty or there is
+ *                         no match within max_distance.
+ * @param [in,out] arena  The arena that the backtrace of `alignment` is stored
+ *                        in; it is cleared first.  Must not be nullptr if
+ *                        `alignment` is not.
+ * @param [in] insert_cost  The cost of insertion, must be >= 0.
+ * @param [in] delete_cost  The cost of deletion, must be >= 0.
+ * @param [in] replace_cost  The cost of replacement, must be >= 0.
+ * @param [in] max_distance  If >= 0 and there is no match within this
+ *                           distance, -1 is returned.
+ * @param [in] num_threads  The number of threads to use for the two halves of
+ *                          each (large enough) Hirschberg step; <= 0 means to
+ *                          use all hardware threads.
+ *
+ * @return  Returns the levenshtein distance between query and target, or -1
+ *          if there was no match within `max_distance`.
+ */
+template <typename T>
+int32_t LevenshteinDistanceLinearMemory(
+    const T *query, size_t query_length, const T *target, size_t target_length,
+    LevenshteinElement *alignment, BacktraceArena *arena,
+    int32_t insert_cost = 1, int32_t delete_cost = 1, int32_t replace_cost = 1,
+    int32_t max_distance = -1, int32_t num_threads = 1) {
+  assert(target_length != 0);
+  assert(insert_cost >= 0 && delete_cost >= 0 && replace_cost >= 0);
+  assert(alignment == nullptr || arena != nullptr);
+  FTS_STATS_SCOPE(Stage::kLevenshtein);
+  if (alignment != nullptr) {
+    arena->Clear();
+  }
+  if (query_length == 0) {
+    return 0;
+  }
+  internal::EditCosts costs = {insert_cost, delete_cost, replace_cost};
+  bool unit_costs = insert_cost == 1 && delete_cost == 1 && replace_cost == 1;
+
+  // The best distance and its first end position.
+  int32_t distance = -1;
+  size_t end = 0;
+  if (unit_costs) {
+    MyersLevenshtein(query, query_length, target, target_length, max_distance,
+                     [&](size_t j, int32_t cost) {
+                       if (distance == -1 || cost < distance) {
+                         distance = cost;
+                         end = j;
+                       }
+                     });
+  } else {
+    std::vector<int32_t> row;
+    internal::DpLastRow<false>(query, query_length, target, target_length,
+                               costs, true, &row);
+    for (size_t j = 1; j <= target_length; j++) {
+      if (distance == -1 || row[j] < distance) {
+        distance = row[j];
+        end = j - 1;
+      }
+    }
+    if (max_distance >= 0 && distance > max_distance)
+      distance = -1;
+  }
+  if (distance == -1 || alignment == nullptr) {
+    return distance;
+  }
+
+  std::vector<internal::AlignOp> ops;
+  if (unit_costs) {
+    internal::AlignMatch(query, query_length, target, end, distance,
+                         internal::UnitCosts(), GetNumThreads(num_threads),
+                         &ops);
+  } else {
+    internal::AlignMatch(query, query_length, target, end, distance, costs,
+                         GetNumThreads(num_threads), &ops);
+  }
+
+  arena->Reserve(2 * ops.size() / 64 + 1);
+  LevenshteinElement element(0);
+  for (auto op : ops) {
+    switch (op) {
+    case internal::AlignOp::kEqual:
+      element = element.Equal(arena);
+      break;
+    case internal::AlignOp::kReplace:
+      element = element.Replace(replace_cost, arena);
+      break;
+    case internal::AlignOp::kDelete:
+      element = element.Delete(delete_cost, arena);
+      break;
+    case internal::AlignOp::kInsert:
+      element = element.Insert(insert_cost, arena);
+      break;
+    }
+  }
+  assert(element.cost == distance);
+  element.position = end;
+  *alignment = element;
+  return distance;
+}
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_LEVENSHTEIN_HIRSCHBERG_H_
@@ -0,0 +1,240 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_LEVENSHTEIN_MYERS_H_
+#define TEXTSEARCH_CSRC_LEVENSHTEIN_MYERS_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+namespace internal {
+
+/*
+ * Advances one 64-row block of the bit-vector dp by one target symbol, see
+ * G. Myers, "A fast bit-vector algorithm for approximate string matching
+ * based on dynamic programming" (1999) and H. Hyyro, "A bit-vector algorithm
+ * for computing Levenshtein and Damerau edit distances" (2003).
+ *
+ * @param [in] eq  The bits of the query positions in this block that equal
+ *                 the current target symbol.
+ * @param [in] hin  The horizontal difference (-1, 0 or 1) entering the top
+ *                  of this block.
+ * @param [in] out_bit  The bit (row) whose horizontal difference is returned.
+ * @param [in,out] pv  The bits of positive vertical differences.
+ * @param [in,out] mv  The bits of negative vertical differences.
+ *
+ * @return Returns the horizontal difference at row `out_bit` of the block.
+ */
+inline int32_t MyersBlock(uint64_t eq, int32_t hin, int32_t out_bit,
+                          uint64_t *pv, uint64_t *mv) {
+  uint64_t hin_neg = hin < 0 ? 1 : 0, hin_pos = hin > 0 ? 1 : 0;
+  uint64_t xv = eq | *mv;
+  eq |= hin_neg;
+  uint64_t xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+  uint64_t ph = *mv | ~(xh | *pv);
+  uint64_t mh = *pv & xh;
+  int32_t hout = static_cast<int32_t>((ph >> out_bit) & 1) -
+                 static_cast<int32_t>((mh >> out_bit) & 1);
+  ph = (ph << 1) | hin_pos;
+  mh = (mh << 1) | hin_neg;
+  *pv = mh | ~(xv | ph);
+  *mv = ph & xv;
+  return hout;
+}
+
+/*
+ * The query of the bit-parallel algorithm, preprocessed: for each distinct
+ * query symbol, the bits of the query positions where it appears, as
+ * (query_length + 63) / 64 blocks of 64 bits.
+ */
+template <typename T> class MyersPattern {
+public:
+  MyersPattern(const T *query, size_t query_length)
+      : symbols_(query, query + query_length),
+        num_blocks_((query_length + 63) / 64) {
+    assert(query_length > 0);
+    std::sort(symbols_.begin(), symbols_.end());
+    symbols_.erase(std::unique(symbols_.begin(), symbols_.end()),
+                   symbols_.end());
+    // The last row (for symbols not in the query) is all zeros.
+    peq_.resize((symbols_.size() + 1) * num_blocks_, 0);
+    for (size_t i = 0; i < query_length; i++) {
+      size_t s = std::lower_bound(symbols_.begin(), symbols_.end(), query[i]) -
+                 symbols_.begin();
+      peq_[s * num_blocks_ + i / 64] |= static_cast<uint64_t>(1) << (i % 64);
+    }
+  }
+
+  size_t NumBlocks() const { return num_blocks_; }
+
+  // Returns the NumBlocks() words of query positions equal to `symbol`.
+  const uint64_t *Eq(const T &symbol) const {
+    auto it = std::lower_bound(symbols_.begin(), symbols_.end(), symbol);
+    size_t s = (it != symbols_.end() && *it == symbol) ? it - symbols_.begin()
+                                                       : symbols_.size();
+    return peq_.data() + s * num_blocks_;
+  }
+
+private:
+  std::vector<T> symbols_;
+  size_t num_blocks_;
+  std::vector<uint64_t> peq_;
+};
+
+/*
+ * Run the bit-parallel dp on the segment [begin, end) of the target, as if
+ * the target started at `begin`, and call f(j, distance, pv, mv) for each j in
+ * [begin, end), in order.  `distance` is the value of the last row after
+ * target position j, and pv and mv point to the NumBlocks() words of
+ * positive and negative vertical differences of that column: bit i says
+ * whether row i + 1 is one more (pv) or one less (mv) than row i.
+ */
+template <typename T, typename F>
+void MyersColumns(const MyersPattern<T> &pattern, size_t query_length,
+                  const T *target, size_t begin, size_t end, F &&f) {
+  size_t num_blocks = pattern.NumBlocks();
+  // The first column of the dp matrix is 0, 1, 2, ..., query_length.
+  std::vector<uint64_t> pv(num_blocks, ~static_cast<uint64_t>(0)),
+      mv(num_blocks, 0);
+  int32_t last_bit = static_cast<int32_t>((query_length - 1) % 64);
+  int32_t score = static_cast<int32_t>(query_length);
+
+  for (size_t j = begin; j < end; j++) {
+    const uint64_t *eq = pattern.Eq(target[j]);
+    // Row 0 is all zeros (infix search), so nothing enters the first block.
+    int32_t hin = 0;
+    for (size_t b = 0; b + 1 < num_blocks; b++)
+      hin = MyersBlock(eq[b], hin, 63, &pv[b], &mv[b]);
+    score += MyersBlock(eq[num_blocks - 1], hin, last_bit,
+                        &pv[num_blocks - 1], &mv[num_blocks - 1]);
+    f(j, score, pv.data(), mv.data());
+  }
+}
+
+/*
+ * Returns row `k` of a column of the bit-parallel dp given its vertical
+ * differences (see MyersColumns()), using that row 0 is 0.
+ */
+inline int32_t MyersValue(const uint64_t *pv, const uint64_t *mv, size_t k) {
+  int32_t value = 0;
+  size_t b = 0;
+  for (; (b + 1) * 64 <= k; b++)
+    value += __builtin_popcountll(pv[b]) - __builtin_popcountll(mv[b]);
+  if (k % 64 != 0) {
+    uint64_t mask = (static_cast<uint64_t>(1) << (k % 64)) - 1;
+    value += __builtin_popcountll(pv[b] & mask) -
+             __builtin_popcountll(mv[b] & mask);
+  }
+  return value;
+}
+
+} // namespace internal
+
+/*
+ * Compute the infix levenshtein distance with unit costs between the query
+ * and every prefix of the target, i.e. the last row of the dp matrix of
+ * LevenshteinDistance(), with the bit-parallel algorithm of Myers / Hyyro.
+ * Queries longer than 64 symbols are split into blocks of 64 rows.
+ *
+ * Only the end positions whose distance is at most `max_distance`, and at most
+ * the best distance reported so far, are reported; this lets us use Ukkonen's
+ * cut-off, i.e. only update the blocks of rows that can still contain values
+ * within that bound (see also H. Hyyro, "A note on bit-parallel alignment
+ * computation", 2004), which makes it much faster when the bound is small
+ * compared to the query length.
+ *
+ * @param [in] query The pointer to the query sequence.
+ * @param [in] query_length The length of the query sequence, must be > 0.
+ * @param [in] target The pointer to the target sequence.
+ * @param [in] target_length The length of the target sequence.
+ * @param [in] max_distance  The largest distance of interest; < 0 means no
+ *                           bound.
+ * @param [in] f  A callable that is called as f(j, distance), in increasing
+ *                order of j, for the target positions j such that the
+ *                distance between the query and the best-matching segment of
+ *                the target ending at j is no more than max_distance and no
+ *                more than the distances of all the previous calls.
+ */
+template <typename T, typename F>
+void MyersLevenshtein(const T *query, size_t query_length, const T *target,
+                      size_t target_length, int32_t max_distance, F &&f) {
+  internal::MyersPattern<T> pattern(query, query_length);
+  int32_t num_blocks = static_cast<int32_t>(pattern.NumBlocks());
+  int32_t m = static_cast<int32_t>(query_length);
+  int32_t k = (max_distance < 0 || max_distance > m) ? m : max_distance;
+  int32_t last_bit = (m - 1) % 64;
+  // The score of block b is the value of its bottom row, Bottom(b).
+  auto bottom = [m](int32_t b) { return std::min(64 * (b + 1), m); };
+
+  // Column 0 of the dp matrix is 0, 1, 2, ..., query_length.
+  std::vector<uint64_t> pv(num_blocks, ~static_cast<uint64_t>(0)),
+      mv(num_blocks, 0);
+  std::vector<int32_t> score(num_blocks);
+  for (int32_t b = 0; b < num_blocks; b++)
+    score[b] = bottom(b);
+  // All the values in the blocks after last_block are known to be > k.
+  int32_t last_block = std::min(num_blocks - 1, k / 64);
+  // The number of dp cells in the blocks evaluated, for the stats.
+  int64_t num_cells = 0;
+
+  for (size_t j = 0; j < target_length; j++) {
+    const uint64_t *eq = pattern.Eq(target[j]);
+    // Row 0 is all zeros (infix search), so nothing enters the first block.
+    int32_t hout = 0;
+    for (int32_t b = 0; b <= last_block; b++) {
+      hout = internal::MyersBlock(eq[b], hout,
+                                  b + 1 == num_blocks ? last_bit : 63, &pv[b],
+                                  &mv[b]);
+      score[b] += hout;
+    }
+
+    // The first row of the next block can only get within the bound through
+    // the bottom row of this one.
+    if (last_block + 1 < num_blocks && score[last_block] - hout <= k &&
+        ((eq[last_block + 1] & 1) || hout < 0)) {
+      int32_t b = ++last_block;
+      pv[b] = ~static_cast<uint64_t>(0);
+      mv[b] = 0;
+      int32_t new_hout = internal::MyersBlock(
+          eq[b], hout, b + 1 == num_blocks ? last_bit : 63, &pv[b], &mv[b]);
+      score[b] = score[b - 1] - hout + bottom(b) - bottom(b - 1) + new_hout;
+    }
+    num_cells += bottom(last_block);
+    // A block whose bottom row is >= k + its number of rows only has values
+    // > k.
+    while (last_block > 0 &&
+           score[last_block] >= k + bottom(last_block) - bottom(last_block - 1))
+      last_block--;
+
+    if (last_block + 1 == num_blocks && score[last_block] <= k) {
+      k = score[last_block];
+      f(j, k);
+    }
+  }
+  FTS_STATS_DP_CELLS(Stage::kLevenshtein, num_cells);
+}
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_LEVENSHTEIN_MYERS_H_
@@ -0,0 +1,371 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/levenshtein_simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+
+#if defined(__GNUC__)
+#define FTS_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define FTS_SIMD_INLINE inline
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FTS_SIMD_X86 1
+#endif
+
+namespace fasttextsearch {
+
+namespace {
+
+/*
+ * The operations on W lanes of int32_t that the kernel needs.  Masks are
+ * vectors whose lanes are all ones (true) or all zeros (false).
+ */
+template <int W> struct Lanes;
+
+template <> struct Lanes<1> {
+  using V = int32_t;
+  using B = uint8_t;
+  static FTS_SIMD_INLINE V Le(V a, V b) { return -static_cast<V>(a <= b); }
+  static FTS_SIMD_INLINE V Eq(V a, V b) { return -static_cast<V>(a == b); }
+  static FTS_SIMD_INLINE V Iota() { return 0; }
+  // Returns the lanes of v moved up by one, with x in lane 0.
+  static FTS_SIMD_INLINE V Shift(V, int32_t x) { return x; }
+  static FTS_SIMD_INLINE int32_t Get(V v, int32_t) { return v; }
+  static FTS_SIMD_INLINE B ToBytes(V v) { return static_cast<B>(v); }
+};
+
+#if defined(__GNUC__)
+
+#if defined(__clang__) || __GNUC__ >= 12
+#define FTS_SHUFFLE(V, a, b, ...) __builtin_shufflevector(a, b, __VA_ARGS__)
+#else
+#define FTS_SHUFFLE(V, a, b, ...) __builtin_shuffle(a, b, V{__VA_ARGS__})
+#endif
+
+typedef int32_t Int32x4 __attribute__((vector_size(16)));
+typedef int32_t Int32x8 __attribute__((vector_size(32)));
+typedef int32_t Int32x16 __attribute__((vector_size(64)));
+typedef uint8_t Uint8x4 __attribute__((vector_size(4)));
+typedef uint8_t Uint8x8 __attribute__((vector_size(8)));
+typedef uint8_t Uint8x16 __attribute__((vector_size(16)));
+
+template <typename VT, typename BT> struct VectorLanes {
+  using V = VT;
+  using B = BT;
+  static FTS_SIMD_INLINE V Le(V a, V b) { return a <= b; }
+  static FTS_SIMD_INLINE V Eq(V a, V b) { return a == b; }
+  static FTS_SIMD_INLINE int32_t Get(V v, int32_t i) { return v[i]; }
+  static FTS_SIMD_INLINE B ToBytes(V v) { return __builtin_convertvector(v, B); }
+};
+
+template <> struct Lanes<4> : VectorLanes<Int32x4, Uint8x4> {
+  static FTS_SIMD_INLINE V Iota() { return V{0, 1, 2, 3}; }
+  static FTS_SIMD_INLINE V Shift(V v, int32_t x) {
+    V b = V{} + x;
+    return FTS_SHUFFLE(V, v, b, 4, 0, 1, 2);
+  }
+};
+
+template <> struct Lanes<8> : VectorLanes<Int32x8, Uint8x8> {
+  static FTS_SIMD_INLINE V Iota() { return V{0, 1, 2, 3, 4, 5, 6, 7}; }
+  static FTS_SIMD_INLINE V Shift(V v, int32_t x) {
+    V b = V{} + x;
+    return FTS_SHUFFLE(V, v, b, 8, 0, 1, 2, 3, 4, 5, 6);
+  }
+};
+
+template <> struct Lanes<16> : VectorLanes<Int32x16, Uint8x16> {
+  static FTS_SIMD_INLINE V Iota() {
+    return V{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  }
+  static FTS_SIMD_INLINE V Shift(V v, int32_t x) {
+    V b = V{} + x;
+    return FTS_SHUFFLE(V, v, b, 16, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                       13, 14);
+  }
+};
+
+#endif // __GNUC__
+
+template <typename V> FTS_SIMD_INLINE V Select(V mask, V a, V b) {
+  return mask ? a : b;
+}
+
+// The choices of the dp, as in the scalar engine of LevenshteinDistance().
+enum Choice : uint8_t { kDiagonal = 0, kDelete = 1, kInsert = 2 };
+
+/*
+ * The dp over stripes of W rows of the query.  In step t of a stripe that
+ * starts after row r0, lane r computes the cell (row r0 + 1 + r, column
+ * t + 1 - r), from the cell to its left in its own lane (previous column,
+ * "deletion"), and the cells above it and diagonally above it, which are
+ * those of lane r - 1 at steps t - 1 and t - 2 (for lane 0, the last row of
+ * the previous stripe).
+ *
+ * On exit last_row[j] is the cost of the cell (query_length, j).  If choices
+ * != nullptr, the choice of every cell is written to it, 2 bits each, 4 steps
+ * of a stripe per byte (see GetChoice()).
+ */
+template <int W>
+FTS_SIMD_INLINE void SimdDp(const int32_t *query, size_t query_length,
+                            const int32_t *target, size_t target_length,
+                            int32_t insert_cost, int32_t delete_cost,
+                            int32_t replace_cost, int32_t *last_row,
+                            uint8_t *choices) {
+  using L = Lanes<W>;
+  using V = typename L::V;
+  using B = typename L::B;
+  size_t n = target_length;
+  size_t num_steps = n + W - 1, num_groups = (num_steps + 3) / 4;
+
+  // The target reversed, so that the symbols of the cells of a step, target[t
+  // - r] for lane r, are contiguous.
+  std::vector<int32_t> reversed(n + 2 * W, 0);
+  for (size_t i = 0; i < n; i++)
+    reversed[W + i] = target[n - 1 - i];
+
+  // The last row of the previous stripe, starting with row 0, which is all
+  // zeros as it is an infix search; padded for the last steps.
+  std::vector<int32_t> prev(n + W + 1, 0), next(n + W + 1, 0);
+  const V iota = L::Iota(), del = V{} + delete_cost, ins = V{} + insert_cost,
+          rep = V{} + replace_cost, one = V{} + 1, two = V{} + 2;
+
+  for (size_t r0 = 0, s = 0; r0 < query_length; r0 += W, s++) {
+    int32_t num_rows = static_cast<int32_t>(
+        std::min<size_t>(W, query_length - r0));
+    int32_t q[W];
+    for (int32_t r = 0; r < W; r++)
+      q[r] = r < num_rows ? query[r0 + r] : query[r0];
+    V qv, boundary = (iota + static_cast<int32_t>(r0 + 1)) * insert_cost;
+    std::memcpy(&qv, q, sizeof(V));
+
+    V cur = boundary, prev_cur = boundary;
+    B acc = B{};
+    uint8_t *stripe_choices =
+        choices == nullptr ? nullptr : choices + s * num_groups * W;
+    for (size_t t = 0; t < num_steps; t++) {
+      V tv;
+      std::memcpy(&tv, reversed.data() + W + n - 1 - t, sizeof(V));
+      V up = L::Shift(cur, prev[t + 1]), diag = L::Shift(prev_cur, prev[t]);
+      V equal = L::Eq(qv, tv);
+      V is_insert = L::Le(up, diag);
+      V is_delete = L::Le(cur, Select(is_insert, up, diag));
+      V value = Select(
+          equal, diag,
+          Select(is_delete, cur + del,
+                 Select(is_insert, up + ins, diag + rep)));
+      if (t + 1 < W) {
+        // The lanes that have not reached column 1 yet stay at column 0.
+        value = Select(L::Le(iota, V{} + static_cast<int32_t>(t)), value,
+                       boundary);
+      }
+      prev_cur = cur;
+      cur = value;
+
+      if (stripe_choices != nullptr) {
+        V choice = ~equal & Select(is_delete, one, is_insert & two);
+        acc = static_cast<B>((acc << 2) | L::ToBytes(choice));
+        if (t % 4 == 3)
+          std::memcpy(stripe_choices + (t / 4) * W, &acc, W);
+      }
+      if (t + 1 >= static_cast<size_t>(num_rows) && t + 1 - num_rows < n)
+        next[t + 2 - num_rows] = L::Get(value, num_rows - 1);
+    }
+    if (stripe_choices != nullptr && num_steps % 4 != 0) {
+      acc = static_cast<B>(acc << (2 * (4 - num_steps % 4)));
+      std::memcpy(stripe_choices + (num_groups - 1) * W, &acc, W);
+    }
+    next[0] = static_cast<int32_t>(r0 + num_rows) * insert_cost;
+    std::swap(prev, next);
+  }
+  std::copy(prev.begin(), prev.begin() + n + 1, last_row);
+}
+
+// Returns the choice of the cell (i, j), i, j >= 1, written by SimdDp<W>().
+inline Choice GetChoice(const uint8_t *choices, size_t target_length,
+                        int32_t width, size_t i, size_t j) {
+  size_t num_groups = (target_length + width - 1 + 3) / 4;
+  size_t s = (i - 1) / width, r = (i - 1) % width, t = j - 1 + r;
+  uint8_t byte = choices[(s * num_groups + t / 4) * width + r];
+  return static_cast<Choice>((byte >> (2 * (3 - t % 4))) & 3);
+}
+
+using SimdDpFunction = void (*)(const int32_t *, size_t, const int32_t *,
+                                size_t, int32_t, int32_t, int32_t, int32_t *,
+                                uint8_t *);
+
+#if defined(FTS_SIMD_X86)
+__attribute__((target("avx512f,avx512bw,avx512dq"))) void
+SimdDpAvx512(const int32_t *query, size_t query_length, const int32_t *target,
+             size_t target_length, int32_t insert_cost, int32_t delete_cost,
+             int32_t replace_cost, int32_t *last_row, uint8_t *choices) {
+  SimdDp<16>(query, query_length, target, target_length, insert_cost,
+             delete_cost, replace_cost, last_row, choices);
+}
+
+__attribute__((target("avx2"))) void
+SimdDpAvx2(const int32_t *query, size_t query_length, const int32_t *target,
+           size_t target_length, int32_t insert_cost, int32_t delete_cost,
+           int32_t replace_cost, int32_t *last_row, uint8_t *choices) {
+  SimdDp<8>(query, query_length, target, target_length, insert_cost,
+            delete_cost, replace_cost, last_row, choices);
+}
+#endif
+
+// SSE2 on x86-64, NEON on aarch64, or whatever the default target has.
+void SimdDpDefault(const int32_t *query, size_t query_length,
+                   const int32_t *target, size_t target_length,
+                   int32_t insert_cost, int32_t delete_cost,
+                   int32_t replace_cost, int32_t *last_row, uint8_t *choices) {
+#if defined(__GNUC__)
+  SimdDp<4>(query, query_length, target, target_length, insert_cost,
+            delete_cost, replace_cost, last_row, choices);
+#else
+  SimdDp<1>(query, query_length, target, target_length, insert_cost,
+            delete_cost, replace_cost, last_row, choices);
+#endif
+}
+
+SimdDpFunction GetSimdDp(int32_t width) {
+#if defined(FTS_SIMD_X86)
+  if (width == 16)
+    return SimdDpAvx512;
+  if (width == 8)
+    return SimdDpAvx2;
+#endif
+  return SimdDpDefault;
+}
+
+} // namespace
+
+namespace internal {
+
+std::vector<int32_t> LevenshteinSimdWidths() {
+  std::vector<int32_t> widths;
+#if defined(FTS_SIMD_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512dq"))
+    widths.push_back(16);
+  if (__builtin_cpu_supports("avx2"))
+    widths.push_back(8);
+#endif
+#if defined(__GNUC__)
+  widths.push_back(4);
+#else
+  widths.push_back(1);
+#endif
+  return widths;
+}
+
+} // namespace internal
+
+int32_t LevenshteinDistanceSimd(const int32_t *query, size_t query_length,
+                                const int32_t *target, size_t target_length,
+                                std::vector<LevenshteinElement> *alignments,
+                                BacktraceArena *arena, int32_t insert_cost,
+                                int32_t delete_cost, int32_t replace_cost,
+                                int32_t max_distance, int32_t width,
+                                int64_t *end_position) {
+  assert(target_length != 0);
+  assert(alignments == nullptr || arena != nullptr);
+  if (alignments != nullptr) {
+    alignments->clear();
+    arena->Clear();
+  }
+  if (end_position != nullptr) {
+    *end_position = -1;
+  }
+  if (query_length == 0) {
+    return 0;
+  }
+  static const std::vector<int32_t> kWidths = internal::LevenshteinSimdWidths();
+  if (width == 0)
+    width = kWidths.front();
+  assert(std::find(kWidths.begin(), kWidths.end(), width) != kWidths.end());
+
+  std::vector<int32_t> last_row(target_length + 1);
+  std::vector<uint8_t> choices;
+  if (alignments != nullptr) {
+    size_t num_stripes = (query_length + width - 1) / width,
+           num_groups = (target_length + width - 1 + 3) / 4;
+    choices.resize(num_stripes * num_groups * width);
+  }
+  GetSimdDp(width)(query, query_length, target, target_length, insert_cost,
+                   delete_cost, replace_cost, last_row.data(),
+                   alignments != nullptr ? choices.data() : nullptr);
+
+  auto best = std::min_element(last_row.begin() + 1, last_row.end());
+  int32_t distance = *best;
+  if (max_distance >= 0 && distance > max_distance) {
+    return -1;
+  }
+  if (end_position != nullptr) {
+    *end_position = best - last_row.begin() - 1;
+  }
+  if (alignments == nullptr) {
+    return distance;
+  }
+
+  // The backtraces of the best end positions, following the choices back
+  // to row 0 and then building them forward as the scalar engine does.
+  std::vector<Choice> ops;
+  for (size_t end = 1; end <= target_length; end++) {
+    if (last_row[end] != distance)
+      continue;
+    ops.clear();
+    size_t i = query_length, j = end;
+    while (i > 0) {
+      Choice c = j == 0 ? kInsert
+                        : GetChoice(choices.data(), target_length, width, i, j);
+      ops.push_back(c);
+      if (c != kDelete)
+        i--;
+      if (c != kInsert)
+        j--;
+    }
+    LevenshteinElement element(0);
+    for (auto it = ops.rbegin(); it != ops.rend(); ++it) {
+      if (*it == kDelete) {
+        element = element.Delete(delete_cost, arena);
+        j++;
+      } else if (*it == kInsert) {
+        element = element.Insert(insert_cost, arena);
+        i++;
+      } else {
+        element = query[i] == target[j] ? element.Equal(arena)
+                                        : element.Replace(replace_cost, arena);
+        i++, j++;
+      }
+    }
+    assert(element.cost == distance);
+    element.position = end - 1;
+    alignments->push_back(element);
+  }
+  return distance;
+}
+
+} // namespace fasttextsearch
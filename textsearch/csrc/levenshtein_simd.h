@@ -0,0 +1,70 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_LEVENSHTEIN_SIMD_H_
+#define TEXTSEARCH_CSRC_LEVENSHTEIN_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fasttextsearch {
+
+class BacktraceArena;
+struct LevenshteinElement;
+
+namespace internal {
+
+/*
+ * Returns the numbers of 32-bit lanes of the kernels of
+ * LevenshteinDistanceSimd() that the cpu we are running on supports, the
+ * fastest first: e.g. {16, 8, 4} with AVX-512, {8, 4} with AVX2 and {4} with
+ * only SSE2 or NEON (or {1} if the compiler has no vector extensions).
+ */
+std::vector<int32_t> LevenshteinSimdWidths();
+
+} // namespace internal
+
+/*
+ * The same dp as the kScalar engine of LevenshteinDistance() (see there for
+ * the arguments), with the same infix semantics and tie handling, so with the
+ * same result for any costs, but vectorized: the query is processed in
+ * stripes of as many rows as there are lanes, and in each stripe the cells of
+ * one anti-diagonal are computed at the same time.  The kernel is chosen at
+ * runtime from the instruction sets the cpu supports (AVX-512, AVX2, else
+ * SSE2/NEON).
+ *
+ * The memory used is O(target_length) without alignments, and
+ * query_length * target_length / 4 bytes (2 bits of choice per cell) with.
+ *
+ * @param [in] width  The number of lanes of the kernel to use, one of
+ *                    internal::LevenshteinSimdWidths(), or 0 for the fastest.
+ * @param [out] end_position  If not nullptr, set as for
+ *                            LevenshteinDistance().
+ */
+int32_t LevenshteinDistanceSimd(const int32_t *query, size_t query_length,
+                                const int32_t *target, size_t target_length,
+                                std::vector<LevenshteinElement> *alignments,
+                                BacktraceArena *arena, int32_t insert_cost,
+                                int32_t delete_cost, int32_t replace_cost,
+                                int32_t max_distance, int32_t width = 0,
+                                int64_t *end_position = nullptr);
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_LEVENSHTEIN_SIMD_H_
@@ -0,0 +1,373 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_LEVENSHTEIN_STREAM_H_
+#define TEXTSEARCH_CSRC_LEVENSHTEIN_STREAM_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+
+namespace fasttextsearch {
+
+struct StreamingAlignerOptions {
+  // The number of query symbols aligned at a time (including the overlap).
+  int32_t chunk_length = 1000;
+
+  // The number of query symbols at the end of a chunk that are aligned again
+  // at the start of the next one, where the two alignments are stitched; must
+  // be less than chunk_length.
+  int32_t overlap = 100;
+
+  // The target window of a chunk after the first starts this many times the
+  // chunk length before the target position reached by the previous chunk at
+  // the start of the overlap, and extends as far beyond the chunk length
+  // after it.
+  float window_slack = 0.2;
+
+  // The number of target symbols, from the start of the target, searched for
+  // the first chunk; <= 0 means the whole target.
+  int64_t first_window = -1;
+
+  int32_t insert_cost = 1;
+  int32_t delete_cost = 1;
+  int32_t replace_cost = 1;
+
+  // The engine of LevenshteinDistance() for each chunk.
+  LevenshteinEngine engine = LevenshteinEngine::kAuto;
+};
+
+/*
+ * Aligns a query that arrives incrementally (e.g. the transcript of a
+ * recording of many hours) with a target, with the edit operations of the
+ * alignment returned as they are known, without ever running the dp over
+ * more than one chunk of the query and a window of the target.
+ *
+ * The query is aligned in chunks of options.chunk_length symbols, each one
+ * starting options.overlap symbols before the end of the previous one, with
+ * LevenshteinDistance() (infix search) on a window of the target around where
+ * the previous chunk got to.  Two consecutive alignments are stitched at an
+ * anchor in their overlap: the query symbol, nearest to the middle of the
+ * overlap, that both of them align with the same equal target symbol; the
+ * operations before it come from the previous chunk and those after it from
+ * the next one.  (If they agree nowhere, which only happens for a very noisy
+ * overlap, the previous alignment is kept to its end and the next one is
+ * clipped to continue it.)  The operations before the overlap of the last
+ * chunk can't change any more and are returned by Pull().
+ *
+ * So the memory and the time to the first operations depend on the chunk
+ * length and not on the query length, while the result is the same as that
+ * of LevenshteinDistance() on the whole query wherever the chunks agree,
+ * which they do unless the target has repeats longer than the window
+ * slack.  The alignment is of the whole query, starting with the first chunk
+ * anywhere in the first window of the target.
+ *
+ * Usage:
+ *
+ *   StreamingAligner<int32_t> aligner(target, target_length, options);
+ *   while (...) {
+ *     aligner.Push(query_part, query_part_length);
+ *     aligner.Pull(&ops, &query_positions, &target_positions);  // appends
+ *   }
+ *   aligner.Finish();
+ *   aligner.Pull(&ops, &query_positions, &target_positions);
+ *
+ * The target must outlive the aligner.  Not thread-safe.
+ */
+template <typename T> class StreamingAligner {
+public:
+  StreamingAligner(const T *target, size_t target_length,
+                   const StreamingAlignerOptions &options)
+      : target_(target), target_length_(static_cast<int64_t>(target_length)),
+        options_(options) {
+    assert(target_length > 0);
+    assert(options.chunk_length > 0 && options.overlap >= 0 &&
+           options.overlap < options.chunk_length);
+    assert(options.window_slack >= 0);
+  }
+
+  /*
+   * Appends `length` symbols to the query, and aligns the chunks that are
+   * complete.  Must not be called after Finish().
+   */
+  void Push(const T *query, size_t length) {
+    assert(!finished_);
+    query_.insert(query_.end(), query, query + length);
+    while (static_cast<int64_t>(query_.size()) >= options_.chunk_length)
+      AlignChunk(options_.chunk_length);
+  }
+
+  // Ends the query, aligning the rest of it; all the operations can then be
+  // pulled.
+  void Finish() {
+    assert(!finished_);
+    finished_ = true;
+    // The last chunk is only the overlap if the query ended with a chunk.
+    if (!query_.empty() &&
+        (num_chunks_ == 0 ||
+         static_cast<int64_t>(query_.size()) > options_.overlap))
+      AlignChunk(static_cast<int32_t>(query_.size()));
+    Emit(held_.size());
+  }
+
+  /*
+   * Appends the operations that are final since the last call to `ops`,
+   * with their positions in the query and target (-1 for the target of
+   * kInsert and the query of kDelete), as GetAlignment() would, in the order
+   * of the alignment.  Any of the outputs but `ops` may be nullptr.
+   *
+   * @return The number of operations appended.
+   */
+  size_t Pull(std::vector<AlignmentOp> *ops,
+              std::vector<int64_t> *query_positions = nullptr,
+              std::vector<int64_t> *target_positions = nullptr) {
+    size_t n = ready_.size();
+    for (const Op &op : ready_) {
+      ops->push_back(op.op);
+      if (query_positions != nullptr)
+        query_positions->push_back(op.query_position);
+      if (target_positions != nullptr)
+        target_positions->push_back(op.target_position);
+    }
+    ready_.clear();
+    return n;
+  }
+
+  // The cost of the operations returned by Pull() or ready to be; after
+  // Finish() this is the distance of the whole alignment.
+  int64_t Cost() const { return cost_; }
+
+  // The number of query symbols pushed so far.
+  int64_t NumQuerySymbols() const {
+    return query_offset_ + static_cast<int64_t>(query_.size());
+  }
+
+private:
+  struct Op {
+    AlignmentOp op;
+    int64_t query_position;
+    int64_t target_position;
+  };
+
+  // Aligns query_[0, length), stitches it to the held operations and drops
+  // the query symbols before the overlap with the next chunk.
+  void AlignChunk(int32_t length) {
+    int64_t chunk_begin = query_offset_;
+    std::vector<Op> ops;
+    AlignWindow(length, &ops);
+
+    if (num_chunks_ == 0) {
+      held_ = std::move(ops);
+    } else {
+      Stitch(chunk_begin, chunk_begin + options_.overlap, &ops);
+    }
+    num_chunks_++;
+    if (finished_) {
+      // Finish() emits all the operations.
+      query_.clear();
+      query_offset_ = chunk_begin + length;
+      return;
+    }
+
+    // The operations before the next overlap are final.
+    int64_t next_begin = chunk_begin + length - options_.overlap;
+    size_t n = 0;
+    while (n < held_.size() && held_[n].query_position < next_begin)
+      n++;
+    // The deletions just before the first operation that is kept belong
+    // with it.
+    while (n > 0 && held_[n - 1].op == AlignmentOp::kDelete)
+      n--;
+    Emit(n);
+
+    query_.erase(query_.begin(), query_.begin() + (length - options_.overlap));
+    query_offset_ = next_begin;
+  }
+
+  // Aligns query_[0, length) with its target window, with the positions of
+  // `ops` relative to the whole query and target.
+  void AlignWindow(int32_t length, std::vector<Op> *ops) {
+    int64_t window_begin = 0, window_end = target_length_;
+    if (num_chunks_ == 0) {
+      if (options_.first_window > 0)
+        window_end = std::min(target_length_, options_.first_window);
+    } else {
+      int64_t slack = static_cast<int64_t>(
+          std::ceil(options_.window_slack * options_.chunk_length));
+      int64_t start = TargetPositionOf(query_offset_);
+      window_begin = std::max<int64_t>(0, start - slack);
+      window_end = std::min(target_length_, start + length + slack);
+    }
+
+    ops->clear();
+    if (window_begin >= window_end) {
+      // The target is used up; the rest of the query is inserted.
+      for (int32_t q = 0; q < length; q++)
+        ops->push_back({AlignmentOp::kInsert, query_offset_ + q, -1});
+      return;
+    }
+
+    int32_t distance = LevenshteinDistance(
+        query_.data(), length, target_ + window_begin,
+        window_end - window_begin, &alignments_, &arena_,
+        options_.insert_cost, options_.delete_cost, options_.replace_cost,
+        options_.engine);
+    (void)distance;
+    assert(distance >= 0);
+    GetAlignment(query_.data(), target_ + window_begin, alignments_.front(),
+                 arena_, &chunk_ops_, &chunk_query_positions_,
+                 &chunk_target_positions_);
+    for (size_t k = 0; k < chunk_ops_.size(); k++) {
+      int64_t q = chunk_query_positions_[k], t = chunk_target_positions_[k];
+      ops->push_back({chunk_ops_[k], q == -1 ? -1 : query_offset_ + q,
+                      t == -1 ? -1 : window_begin + t});
+    }
+  }
+
+  // The target position that the held operations align the query symbol
+  // `q` with, or that comes next after it if q is inserted.
+  int64_t TargetPositionOf(int64_t q) const {
+    int64_t last = last_target_;
+    bool found = false;
+    for (const Op &op : held_) {
+      if (op.query_position == q)
+        found = true;
+      if (found && op.target_position != -1)
+        return op.target_position;
+      if (op.target_position != -1)
+        last = op.target_position;
+    }
+    return last + 1;
+  }
+
+  // Stitches `ops`, the alignment of a chunk starting at query position
+  // `begin`, to the held operations, which end at query position end - 1.
+  void Stitch(int64_t begin, int64_t end, std::vector<Op> *ops) {
+    // The equal target position of each query position of the overlap in
+    // the held operations, or -1.
+    std::vector<int64_t> held_target(end - begin, -1);
+    for (const Op &op : held_) {
+      if (op.op == AlignmentOp::kEqual && op.query_position >= begin)
+        held_target[op.query_position - begin] = op.target_position;
+    }
+    int64_t middle = begin + (end - begin) / 2;
+    int64_t anchor = -1;
+    for (const Op &op : *ops) {
+      int64_t q = op.query_position;
+      if (op.op == AlignmentOp::kEqual && q < end &&
+          held_target[q - begin] == op.target_position &&
+          (anchor == -1 || std::abs(q - middle) < std::abs(anchor - middle)))
+        anchor = q;
+    }
+
+    if (anchor != -1) {
+      auto is_anchor = [anchor](const Op &op) {
+        return op.query_position == anchor;
+      };
+      held_.erase(std::find_if(held_.begin(), held_.end(), is_anchor) + 1,
+                  held_.end());
+      held_.insert(held_.end(),
+                   std::find_if(ops->begin(), ops->end(), is_anchor) + 1,
+                   ops->end());
+      return;
+    }
+
+    // No agreement: keep the held operations, and continue them with those
+    // of the query positions after them, inserting the query symbols whose
+    // target positions were already used and deleting the target symbols
+    // skipped in between.
+    int64_t last_target = last_target_;
+    for (const Op &op : held_) {
+      if (op.target_position != -1)
+        last_target = op.target_position;
+    }
+    for (const Op &op : *ops) {
+      if (op.query_position != -1 && op.query_position < end)
+        continue;
+      if (op.target_position != -1 && op.target_position <= last_target) {
+        if (op.query_position != -1)
+          held_.push_back({AlignmentOp::kInsert, op.query_position, -1});
+        continue;
+      }
+      if (op.target_position != -1) {
+        for (int64_t t = last_target + 1; t < op.target_position; t++)
+          held_.push_back({AlignmentOp::kDelete, -1, t});
+        last_target = op.target_position;
+      }
+      held_.push_back(op);
+    }
+  }
+
+  // Moves the first n held operations to the ready ones.
+  void Emit(size_t n) {
+    for (size_t k = 0; k < n; k++) {
+      const Op &op = held_[k];
+      switch (op.op) {
+      case AlignmentOp::kReplace:
+        cost_ += options_.replace_cost;
+        break;
+      case AlignmentOp::kInsert:
+        cost_ += options_.insert_cost;
+        break;
+      case AlignmentOp::kDelete:
+        cost_ += options_.delete_cost;
+        break;
+      default:
+        break;
+      }
+      if (op.target_position != -1)
+        last_target_ = op.target_position;
+      ready_.push_back(op);
+    }
+    held_.erase(held_.begin(), held_.begin() + n);
+  }
+
+  const T *target_;
+  int64_t target_length_;
+  StreamingAlignerOptions options_;
+
+  // The query symbols from query_offset_ on that are not aligned for good.
+  std::vector<T> query_;
+  int64_t query_offset_ = 0;
+  int64_t num_chunks_ = 0;
+  bool finished_ = false;
+
+  // The operations of the alignment so far that may still change, i.e.
+  // those of the overlap of the last chunk.
+  std::vector<Op> held_;
+  // The final operations that were not pulled yet.
+  std::vector<Op> ready_;
+  int64_t cost_ = 0;
+  // The last target position of the operations moved to ready_, or -1.
+  int64_t last_target_ = -1;
+
+  // Scratch space of AlignWindow(), reused across chunks.
+  std::vector<LevenshteinElement> alignments_;
+  BacktraceArena arena_;
+  std::vector<AlignmentOp> chunk_ops_;
+  std::vector<int64_t> chunk_query_positions_, chunk_target_positions_;
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_LEVENSHTEIN_STREAM_H_
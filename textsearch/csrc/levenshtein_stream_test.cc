@@ -0,0 +1,174 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein_stream.h"
+
+namespace fasttextsearch {
+
+// A query made of target[begin, end) with `num_edits` random edits.
+static std::vector<int32_t> EditedPiece(std::mt19937 *rng,
+                                        const std::vector<int32_t> &target,
+                                        int32_t begin, int32_t end,
+                                        int32_t num_edits) {
+  std::vector<int32_t> query(target.begin() + begin, target.begin() + end);
+  for (int32_t e = 0; e < num_edits; e++) {
+    size_t k = (*rng)() % query.size();
+    switch ((*rng)() % 3) {
+    case 0:
+      query[k] = (*rng)() % 20;
+      break;
+    case 1:
+      query.insert(query.begin() + k, (*rng)() % 20);
+      break;
+    default:
+      query.erase(query.begin() + k);
+    }
+  }
+  return query;
+}
+
+// Checks that the operations are an alignment of the whole query with a
+// segment of the target, and returns its cost.
+static int64_t CheckAlignment(const std::vector<int32_t> &query,
+                              const std::vector<int32_t> &target,
+                              const std::vector<AlignmentOp> &ops,
+                              const std::vector<int64_t> &query_positions,
+                              const std::vector<int64_t> &target_positions,
+                              const StreamingAlignerOptions &options) {
+  EXPECT_EQ(ops.size(), query_positions.size());
+  EXPECT_EQ(ops.size(), target_positions.size());
+  int64_t q = 0, t = -1, cost = 0;
+  for (size_t k = 0; k < ops.size(); k++) {
+    if (ops[k] != AlignmentOp::kDelete) {
+      EXPECT_EQ(query_positions[k], q++);
+    } else {
+      EXPECT_EQ(query_positions[k], -1);
+    }
+    if (ops[k] != AlignmentOp::kInsert) {
+      EXPECT_TRUE(t == -1 || target_positions[k] == t + 1);
+      t = target_positions[k];
+    } else {
+      EXPECT_EQ(target_positions[k], -1);
+    }
+    if (ops[k] == AlignmentOp::kEqual) {
+      EXPECT_EQ(query[query_positions[k]], target[target_positions[k]]);
+    }
+    if (ops[k] == AlignmentOp::kReplace) {
+      EXPECT_NE(query[query_positions[k]], target[target_positions[k]]);
+      cost += options.replace_cost;
+    }
+    if (ops[k] == AlignmentOp::kInsert)
+      cost += options.insert_cost;
+    if (ops[k] == AlignmentOp::kDelete)
+      cost += options.delete_cost;
+  }
+  EXPECT_EQ(q, static_cast<int64_t>(query.size()));
+  return cost;
+}
+
+TEST(StreamingAligner, TestBasic) {
+  std::mt19937 rng(1357);
+  std::vector<int32_t> target(20000);
+  for (auto &t : target)
+    t = rng() % 20;
+
+  for (int32_t costs : {1, 2}) {
+    for (int32_t overlap : {0, 50}) {
+      StreamingAlignerOptions options;
+      options.chunk_length = 300;
+      options.overlap = overlap;
+      options.first_window = 3000;
+      options.delete_cost = costs;
+      options.replace_cost = costs;
+      std::vector<int32_t> query = EditedPiece(&rng, target, 1000, 11000, 40);
+
+      StreamingAligner<int32_t> aligner(target.data(), target.size(), options);
+      std::vector<AlignmentOp> ops;
+      std::vector<int64_t> query_positions, target_positions;
+      size_t pushed = 0;
+      while (pushed < query.size()) {
+        size_t n = std::min<size_t>(1 + rng() % 500, query.size() - pushed);
+        aligner.Push(query.data() + pushed, n);
+        pushed += n;
+        aligner.Pull(&ops, &query_positions, &target_positions);
+        // The operations come long before the end of the query.
+        if (pushed >= 1000) {
+          EXPECT_GT(ops.size(), 0);
+        }
+      }
+      EXPECT_EQ(aligner.NumQuerySymbols(), static_cast<int64_t>(query.size()));
+      aligner.Finish();
+      aligner.Pull(&ops, &query_positions, &target_positions);
+
+      int64_t cost = CheckAlignment(query, target, ops, query_positions,
+                                    target_positions, options);
+      EXPECT_EQ(cost, aligner.Cost());
+      // The edits are sparse, so this is as good as the alignment of the
+      // whole query.
+      std::vector<LevenshteinElement> alignments;
+      BacktraceArena arena;
+      int32_t expected = LevenshteinDistance(
+          query.data(), query.size(), target.data(), target.size(),
+          &alignments, &arena, 1, costs, costs);
+      EXPECT_EQ(cost, expected);
+      EXPECT_EQ(target_positions.back(), alignments.front().position);
+    }
+  }
+}
+
+TEST(StreamingAligner, TestShortQueries) {
+  std::mt19937 rng(2468);
+  std::vector<int32_t> target(2000);
+  for (auto &t : target)
+    t = rng() % 20;
+  StreamingAlignerOptions options;
+  options.chunk_length = 100;
+  options.overlap = 20;
+  // Shorter than the overlap, one chunk, exactly two chunks, and a query
+  // that goes beyond the end of the target.
+  for (int32_t length : {0, 10, 90, 180, 400}) {
+    int32_t begin = target.size() - 300;
+    std::vector<int32_t> query(
+        target.begin() + begin,
+        target.begin() + std::min<int32_t>(begin + length, target.size()));
+    while (static_cast<int32_t>(query.size()) < length)
+      query.push_back(rng() % 20);
+
+    StreamingAligner<int32_t> aligner(target.data(), target.size(), options);
+    aligner.Push(query.data(), query.size());
+    aligner.Finish();
+    std::vector<AlignmentOp> ops;
+    std::vector<int64_t> query_positions, target_positions;
+    aligner.Pull(&ops, &query_positions, &target_positions);
+    EXPECT_EQ(CheckAlignment(query, target, ops, query_positions,
+                             target_positions, options),
+              aligner.Cost());
+    if (length <= 300)
+      EXPECT_EQ(aligner.Cost(), 0);
+    else
+      EXPECT_EQ(aligner.Cost(), length - 300);
+  }
+}
+
+} // namespace fasttextsearch
@@ -18,10 +18,15 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <string>
 #include <vector>
 
 #include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/levenshtein_batch.h"
+#include "textsearch/csrc/levenshtein_hirschberg.h"
 
 namespace fasttextsearch {
 
@@ -31,8 +36,9 @@ TEST(Levenshtein, TestBasic) {
                                       7, 8, 2, 3, 5, 1, 2, 3, 4, 5, 6, 7, 8});
 
   std::vector<LevenshteinElement> alignments;
+  BacktraceArena arena;
   auto result = LevenshteinDistance(query.data(), query.size(), target.data(),
-                                    target.size(), &alignments);
+                                    target.size(), &alignments, &arena);
 
   EXPECT_EQ(result, 2);
   EXPECT_EQ(alignments.size(), 4);
@@ -44,7 +50,683 @@ TEST(Levenshtein, TestBasic) {
     auto align = alignments[i];
     EXPECT_EQ(align.cost, 2);
     EXPECT_EQ(align.position, expected_position[i]);
-    EXPECT_EQ(align.backtrace.ToString(), expected_trace[i]);
+    EXPECT_EQ(align.backtrace.ToString(arena), expected_trace[i]);
+  }
+}
+
+TEST(Levenshtein, TestGetAlignment) {
+  auto query = std::vector<int32_t>({1, 2, 3, 4});
+  auto target = std::vector<int32_t>({1, 5, 3, 4, 6, 7, 1, 2, 4});
+  std::vector<LevenshteinElement> alignments;
+  BacktraceArena arena;
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &alignments, &arena),
+            1);
+  ASSERT_EQ(alignments.size(), 2);
+
+  std::vector<AlignmentOp> ops;
+  std::vector<int32_t> query_positions, target_positions;
+  GetAlignment(query.data(), target.data(), alignments[0], arena, &ops,
+               &query_positions, &target_positions);
+  EXPECT_EQ(ops, std::vector<AlignmentOp>(
+                     {AlignmentOp::kEqual, AlignmentOp::kReplace,
+                      AlignmentOp::kEqual, AlignmentOp::kEqual}));
+  EXPECT_EQ(query_positions, std::vector<int32_t>({0, 1, 2, 3}));
+  EXPECT_EQ(target_positions, std::vector<int32_t>({0, 1, 2, 3}));
+
+  GetAlignment(query.data(), target.data(), alignments[1], arena, &ops,
+               &query_positions, &target_positions);
+  EXPECT_EQ(ops, std::vector<AlignmentOp>(
+                     {AlignmentOp::kEqual, AlignmentOp::kEqual,
+                      AlignmentOp::kInsert, AlignmentOp::kEqual}));
+  EXPECT_EQ(query_positions, std::vector<int32_t>({0, 1, 2, 3}));
+  EXPECT_EQ(target_positions, std::vector<int32_t>({6, 7, -1, 8}));
+
+  // A deletion.
+  target = std::vector<int32_t>({5, 1, 2, 6, 3, 4, 5});
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &alignments, &arena),
+            1);
+  ASSERT_EQ(alignments.size(), 1);
+  GetAlignment(query.data(), target.data(), alignments[0], arena, &ops,
+               &query_positions, &target_positions);
+  EXPECT_EQ(ops, std::vector<AlignmentOp>(
+                     {AlignmentOp::kEqual, AlignmentOp::kEqual,
+                      AlignmentOp::kDelete, AlignmentOp::kEqual,
+                      AlignmentOp::kEqual}));
+  EXPECT_EQ(query_positions, std::vector<int32_t>({0, 1, -1, 2, 3}));
+  EXPECT_EQ(target_positions, std::vector<int32_t>({1, 2, 3, 4, 5}));
+}
+
+TEST(Levenshtein, TestLongBacktrace) {
+  // Backtraces longer than a few segments, reusing the arena.
+  BacktraceArena arena;
+  for (int32_t length : {63, 64, 65, 200, 1000}) {
+    std::vector<int32_t> query(length), target(length + 2, -1);
+    for (int32_t i = 0; i < length; i++)
+      query[i] = target[i + 1] = i % 7;
+    std::string expected_trace;
+    for (int32_t i = 0; i < length; i++)
+      expected_trace += "01";
+    for (auto engine :
+         {LevenshteinEngine::kScalar, LevenshteinEngine::kBitParallel}) {
+      std::vector<LevenshteinElement> alignments;
+      EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                    target.size(), &alignments, &arena, 1, 1,
+                                    1, engine),
+                0);
+      ASSERT_EQ(alignments.size(), 1);
+      EXPECT_EQ(alignments[0].position, length);
+      EXPECT_EQ(alignments[0].backtrace.ToString(arena), expected_trace);
+
+      // Decoded across the segments, into 64-bit positions.
+      std::vector<AlignmentOp> ops;
+      std::vector<int64_t> query_positions, target_positions;
+      GetAlignment(query.data(), target.data(), alignments[0], arena, &ops,
+                   &query_positions, &target_positions);
+      ASSERT_EQ(ops.size(), static_cast<size_t>(length));
+      EXPECT_EQ(std::count(ops.begin(), ops.end(), AlignmentOp::kEqual),
+                length);
+      EXPECT_EQ(query_positions.back(), length - 1);
+      EXPECT_EQ(target_positions.front(), 1);
+      EXPECT_EQ(target_positions.back(), length);
+    }
+  }
+}
+
+// The plain dp over the whole matrix, to compare with.
+static int32_t LevenshteinDistanceSimple(const std::vector<int32_t> &query,
+                                         const std::vector<int32_t> &target,
+                                         int32_t insert_cost,
+                                         int32_t delete_cost,
+                                         int32_t replace_cost,
+                                         std::vector<size_t> *ends) {
+  std::vector<int32_t> scores(query.size() + 1);
+  for (size_t i = 0; i <= query.size(); i++)
+    scores[i] = i * insert_cost;
+  int32_t best = -1;
+  ends->clear();
+  for (size_t j = 1; j <= target.size(); j++) {
+    int32_t prev_diag = scores[0];
+    scores[0] = 0;
+    for (size_t k = 1; k <= query.size(); k++) {
+      int32_t cache = scores[k];
+      if (query[k - 1] == target[j - 1])
+        scores[k] = prev_diag;
+      else if (scores[k] <= scores[k - 1] && scores[k] <= prev_diag)
+        scores[k] += delete_cost;
+      else if (scores[k - 1] <= prev_diag)
+        scores[k] = scores[k - 1] + insert_cost;
+      else
+        scores[k] = prev_diag + replace_cost;
+      prev_diag = cache;
+    }
+    if (best == -1 || scores.back() <= best) {
+      if (scores.back() < best)
+        ends->clear();
+      best = scores.back();
+      ends->push_back(j - 1);
+    }
+  }
+  return best;
+}
+
+static void RandomSequences(std::mt19937 *rng, int32_t max_query_length,
+                            std::vector<int32_t> *query,
+                            std::vector<int32_t> *target) {
+  int32_t query_length =
+              std::uniform_int_distribution<int32_t>(1, max_query_length)(*rng),
+          target_length = std::uniform_int_distribution<int32_t>(
+              1, 3 * max_query_length)(*rng),
+          num_symbols = std::uniform_int_distribution<int32_t>(1, 10)(*rng);
+  std::uniform_int_distribution<int32_t> symbol(0, num_symbols - 1);
+  query->resize(query_length);
+  target->resize(target_length);
+  for (auto &q : *query)
+    q = symbol(*rng);
+  for (auto &t : *target)
+    t = symbol(*rng);
+  if ((*rng)() % 2 == 0 && target_length >= query_length) {
+    // Plant a noisy copy of the query, so that there is a good match.
+    int32_t offset = std::uniform_int_distribution<int32_t>(
+        0, target_length - query_length)(*rng);
+    for (int32_t i = 0; i < query_length; i++)
+      (*target)[offset + i] = (*rng)() % 5 == 0 ? symbol(*rng) : (*query)[i];
+  }
+}
+
+static void ExpectSameAlignments(const std::vector<LevenshteinElement> &a,
+                                 const BacktraceArena &a_arena,
+                                 const std::vector<LevenshteinElement> &b,
+                                 const BacktraceArena &b_arena) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t k = 0; k < a.size(); k++) {
+    EXPECT_EQ(a[k].cost, b[k].cost);
+    EXPECT_EQ(a[k].position, b[k].position);
+    EXPECT_EQ(a[k].backtrace.ToString(a_arena),
+              b[k].backtrace.ToString(b_arena));
+  }
+}
+
+TEST(Levenshtein, TestBitParallel) {
+  std::mt19937 rng(1234);
+  for (int32_t i = 0; i < 300; i++) {
+    // Queries of up to 3 blocks of 64 symbols.
+    int32_t query_length = std::uniform_int_distribution<int32_t>(1, 200)(rng),
+            target_length = std::uniform_int_distribution<int32_t>(1, 500)(rng),
+            num_symbols = std::uniform_int_distribution<int32_t>(1, 10)(rng);
+    std::uniform_int_distribution<int32_t> symbol(0, num_symbols - 1);
+    std::vector<int32_t> query(query_length), target(target_length);
+    for (auto &q : query)
+      q = symbol(rng);
+    for (auto &t : target)
+      t = symbol(rng);
+    if (i % 3 == 0 && target_length >= query_length) {
+      // Plant a copy of the query, so that there is a good match.
+      int32_t offset = std::uniform_int_distribution<int32_t>(
+          0, target_length - query_length)(rng);
+      std::copy(query.begin(), query.end(), target.begin() + offset);
+    }
+
+    std::vector<LevenshteinElement> expected, alignments;
+    BacktraceArena expected_arena, arena;
+    auto expected_distance = LevenshteinDistance(
+        query.data(), query.size(), target.data(), target.size(), &expected, &expected_arena, 1,
+        1, 1, LevenshteinEngine::kScalar);
+    auto distance = LevenshteinDistance(
+        query.data(), query.size(), target.data(), target.size(), &alignments, &arena,
+        1, 1, 1, LevenshteinEngine::kBitParallel);
+    EXPECT_EQ(distance, expected_distance);
+    ASSERT_EQ(alignments.size(), expected.size());
+    for (size_t k = 0; k < alignments.size(); k++) {
+      EXPECT_EQ(alignments[k].cost, expected[k].cost);
+      EXPECT_EQ(alignments[k].position, expected[k].position);
+      EXPECT_EQ(alignments[k].backtrace.ToString(arena),
+                expected[k].backtrace.ToString(expected_arena));
+    }
+
+    EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                  target.size(), nullptr, nullptr),
+              expected_distance);
+  }
+}
+
+TEST(Levenshtein, TestMaxDistance) {
+  std::mt19937 rng(2345);
+  for (int32_t i = 0; i < 300; i++) {
+    std::vector<int32_t> query, target;
+    RandomSequences(&rng, 150, &query, &target);
+    int32_t insert_cost = 1, delete_cost = 1, replace_cost = 1;
+    if (i % 2 == 1) {
+      insert_cost = rng() % 4;
+      delete_cost = rng() % 4;
+      replace_cost = rng() % 4;
+    }
+    std::vector<size_t> expected_ends;
+    int32_t expected_distance =
+        LevenshteinDistanceSimple(query, target, insert_cost, delete_cost,
+                                  replace_cost, &expected_ends);
+
+    std::vector<LevenshteinElement> expected, alignments;
+    BacktraceArena expected_arena, arena;
+    EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                  target.size(), &expected, &expected_arena, insert_cost,
+                                  delete_cost, replace_cost,
+                                  LevenshteinEngine::kScalar),
+              expected_distance);
+    ASSERT_EQ(expected.size(), expected_ends.size());
+    for (size_t k = 0; k < expected.size(); k++)
+      EXPECT_EQ(expected[k].position, expected_ends[k]);
+
+    for (int32_t max_distance :
+         {0, expected_distance - 1, expected_distance, expected_distance + 3}) {
+      if (max_distance < 0)
+        continue;
+      for (auto engine :
+           {LevenshteinEngine::kScalar, LevenshteinEngine::kAuto}) {
+        int32_t distance = LevenshteinDistance(
+            query.data(), query.size(), target.data(), target.size(),
+            &alignments, &arena, insert_cost, delete_cost, replace_cost, engine,
+            max_distance);
+        if (max_distance < expected_distance) {
+          EXPECT_EQ(distance, -1);
+          EXPECT_TRUE(alignments.empty());
+        } else {
+          EXPECT_EQ(distance, expected_distance);
+          ExpectSameAlignments(alignments, arena, expected, expected_arena);
+        }
+      }
+    }
+  }
+}
+
+TEST(Levenshtein, TestSimd) {
+  std::mt19937 rng(5678);
+  for (int32_t width : internal::LevenshteinSimdWidths()) {
+    for (int32_t i = 0; i < 200; i++) {
+      std::vector<int32_t> query, target;
+      RandomSequences(&rng, i < 50 ? 20 : 150, &query, &target);
+      int32_t insert_cost = rng() % 4, delete_cost = rng() % 4,
+              replace_cost = rng() % 4;
+      std::vector<size_t> expected_ends;
+      int32_t expected_distance =
+          LevenshteinDistanceSimple(query, target, insert_cost, delete_cost,
+                                    replace_cost, &expected_ends);
+      std::vector<LevenshteinElement> expected, alignments;
+      BacktraceArena expected_arena, arena;
+      EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                    target.size(), &expected, &expected_arena,
+                                    insert_cost, delete_cost, replace_cost,
+                                    LevenshteinEngine::kScalar),
+                expected_distance);
+
+      EXPECT_EQ(LevenshteinDistanceSimd(query.data(), query.size(),
+                                        target.data(), target.size(),
+                                        &alignments, &arena, insert_cost,
+                                        delete_cost, replace_cost, -1, width),
+                expected_distance);
+      ExpectSameAlignments(alignments, arena, expected, expected_arena);
+      EXPECT_EQ(LevenshteinDistanceSimd(query.data(), query.size(),
+                                        target.data(), target.size(), nullptr,
+                                        nullptr, insert_cost, delete_cost,
+                                        replace_cost, -1, width),
+                expected_distance);
+      if (expected_distance > 0) {
+        EXPECT_EQ(LevenshteinDistanceSimd(
+                      query.data(), query.size(), target.data(), target.size(),
+                      &alignments, &arena, insert_cost, delete_cost,
+                      replace_cost, expected_distance - 1, width),
+                  -1);
+        EXPECT_TRUE(alignments.empty());
+      }
+    }
+  }
+
+  // kAuto uses it for costs other than 1.
+  std::vector<int32_t> query, target;
+  RandomSequences(&rng, 100, &query, &target);
+  std::vector<LevenshteinElement> expected, alignments;
+  BacktraceArena expected_arena, arena;
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &alignments, &arena, 1, 2, 3),
+            LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &expected, &expected_arena, 1, 2,
+                                3, LevenshteinEngine::kScalar));
+  ExpectSameAlignments(alignments, arena, expected, expected_arena);
+}
+
+TEST(Levenshtein, TestSymbolTypes) {
+  // All the engines give the same result for the symbol types of the python
+  // bindings, including 64-bit symbols that don't fit in int32_t (which the
+  // SIMD engine renumbers).
+  std::mt19937 rng(1122);
+  for (int32_t i = 0; i < 50; i++) {
+    std::vector<int32_t> query, target;
+    RandomSequences(&rng, 60, &query, &target);
+    int32_t cost = 1 + i % 2;
+    std::vector<LevenshteinElement> expected;
+    BacktraceArena expected_arena;
+    int32_t expected_distance = LevenshteinDistance(
+        query.data(), query.size(), target.data(), target.size(), &expected,
+        &expected_arena, 1, cost, cost, LevenshteinEngine::kScalar);
+
+    auto check = [&](auto offset) {
+      using T = decltype(offset);
+      std::vector<T> query_t(query.size()), target_t(target.size());
+      for (size_t k = 0; k < query.size(); k++)
+        query_t[k] = static_cast<T>(query[k] + offset);
+      for (size_t k = 0; k < target.size(); k++)
+        target_t[k] = static_cast<T>(target[k] + offset);
+      for (auto engine : {LevenshteinEngine::kAuto, LevenshteinEngine::kScalar,
+                          LevenshteinEngine::kSimd}) {
+        std::vector<LevenshteinElement> alignments;
+        BacktraceArena arena;
+        EXPECT_EQ(LevenshteinDistance(query_t.data(), query_t.size(),
+                                      target_t.data(), target_t.size(),
+                                      &alignments, &arena, 1, cost, cost,
+                                      engine),
+                  expected_distance);
+        ExpectSameAlignments(alignments, arena, expected, expected_arena);
+      }
+    };
+    check(static_cast<uint8_t>(200));
+    check(static_cast<uint16_t>(60000));
+    check(static_cast<int64_t>(-5));
+    check(static_cast<int64_t>(1) << 40);
+  }
+}
+
+TEST(Levenshtein, TestBatch) {
+  std::mt19937 rng(6789);
+  std::vector<int32_t> query, reference;
+  RandomSequences(&rng, 50, &query, &reference);
+  reference.resize(2000);
+  for (auto &r : reference)
+    r = rng() % 10;
+  const int64_t num_spans = 300;
+  std::vector<int64_t> spans(2 * num_spans);
+  for (int64_t i = 0; i < num_spans; i++) {
+    int64_t begin = rng() % reference.size(),
+            end = begin + 1 + rng() % (reference.size() - begin);
+    spans[2 * i] = i % 10 == 0 ? -1 : begin;
+    spans[2 * i + 1] = i % 10 == 0 ? -1 : end;
+  }
+
+  for (int32_t costs : {1, 2}) {
+    for (auto engine : {LevenshteinEngine::kAuto, LevenshteinEngine::kScalar,
+                        LevenshteinEngine::kSimd}) {
+      for (int32_t max_distance : {-1, 10}) {
+        std::vector<int32_t> expected_distances(num_spans);
+        std::vector<int64_t> expected_ends(num_spans);
+        std::vector<LevenshteinElement> alignments;
+        BacktraceArena arena;
+        for (int64_t i = 0; i < num_spans; i++) {
+          expected_distances[i] = expected_ends[i] = -1;
+          if (spans[2 * i] < 0)
+            continue;
+          expected_distances[i] = LevenshteinDistance(
+              query.data(), query.size(), reference.data() + spans[2 * i],
+              spans[2 * i + 1] - spans[2 * i], &alignments, &arena, 1, costs,
+              costs, engine, max_distance);
+          if (expected_distances[i] != -1)
+            expected_ends[i] = spans[2 * i] + alignments.front().position;
+        }
+        for (int32_t num_threads : {1, 4}) {
+          std::vector<int32_t> distances(num_spans);
+          std::vector<int64_t> ends(num_spans);
+          LevenshteinDistanceBatch(query.data(), query.size(),
+                                   reference.data(), reference.size(),
+                                   spans.data(), num_spans, 1, costs, costs,
+                                   engine, max_distance, distances.data(),
+                                   ends.data(), num_threads);
+          EXPECT_EQ(distances, expected_distances);
+          EXPECT_EQ(ends, expected_ends);
+        }
+      }
+    }
+  }
+}
+
+TEST(Levenshtein, TestBatchBestAlignment) {
+  std::mt19937 rng(2468);
+  std::vector<int32_t> query, reference;
+  RandomSequences(&rng, 100, &query, &reference);
+  reference.resize(3000);
+  for (auto &r : reference)
+    r = rng() % 10;
+  const int64_t num_spans = 50;
+  std::vector<int64_t> spans(2 * num_spans);
+  for (int64_t i = 0; i < num_spans; i++) {
+    int64_t begin = rng() % reference.size(),
+            end = begin + 1 + rng() % (reference.size() - begin);
+    spans[2 * i] = i % 10 == 0 ? -1 : begin;
+    spans[2 * i + 1] = i % 10 == 0 ? -1 : end;
+  }
+
+  for (int32_t costs : {1, 2}) {
+    std::vector<int32_t> distances(num_spans);
+    std::vector<int64_t> ends(num_spans);
+    LevenshteinDistanceBatch(query.data(), query.size(), reference.data(),
+                             reference.size(), spans.data(), num_spans, 1,
+                             costs, costs, LevenshteinEngine::kAuto, -1,
+                             distances.data(), ends.data());
+
+    LevenshteinElement alignment(0);
+    BacktraceArena arena;
+    int64_t best = LevenshteinBatchBestAlignment(
+        query.data(), query.size(), reference.data(), spans.data(), num_spans,
+        distances.data(), ends.data(), &alignment, &arena, 1, costs, costs);
+    ASSERT_NE(best, -1);
+    for (int64_t i = 0; i < num_spans; i++) {
+      if (distances[i] != -1) {
+        EXPECT_LE(distances[best], distances[i]);
+        if (i < best) {
+          EXPECT_LT(distances[best], distances[i]);
+        }
+      }
+    }
+
+    // The same as the first alignment of the best span on its own.
+    std::vector<LevenshteinElement> alignments;
+    BacktraceArena expected_arena;
+    int64_t begin = spans[2 * best];
+    EXPECT_EQ(LevenshteinDistance(query.data(), query.size(),
+                                  reference.data() + begin,
+                                  spans[2 * best + 1] - begin, &alignments,
+                                  &expected_arena, 1, costs, costs,
+                                  LevenshteinEngine::kScalar),
+              alignment.cost);
+    EXPECT_EQ(alignment.position, ends[best]);
+    EXPECT_EQ(alignment.position, begin + alignments.front().position);
+    EXPECT_EQ(alignment.backtrace.ToString(arena),
+              alignments.front().backtrace.ToString(expected_arena));
+
+    std::fill(distances.begin(), distances.end(), -1);
+    EXPECT_EQ(LevenshteinBatchBestAlignment(
+                  query.data(), query.size(), reference.data(), spans.data(),
+                  num_spans, distances.data(), ends.data(), &alignment,
+                  &arena, 1, costs, costs),
+              -1);
+  }
+}
+
+TEST(Levenshtein, TestEndPosition) {
+  std::mt19937 rng(1357);
+  for (int32_t iter = 0; iter < 50; iter++) {
+    std::vector<int32_t> query, target;
+    RandomSequences(&rng, 80, &query, &target);
+    for (int32_t costs : {1, 2}) {
+      for (auto engine :
+           {LevenshteinEngine::kAuto, LevenshteinEngine::kScalar,
+            LevenshteinEngine::kSimd, LevenshteinEngine::kBitParallel}) {
+        if (engine == LevenshteinEngine::kBitParallel && costs != 1)
+          continue;
+        for (int32_t max_distance : {-1, 5}) {
+          std::vector<LevenshteinElement> alignments;
+          BacktraceArena arena;
+          int64_t end_position = -2, expected_end = -2;
+          int32_t distance = LevenshteinDistance(
+              query.data(), query.size(), target.data(), target.size(),
+              &alignments, &arena, 1, costs, costs, engine, max_distance, -1,
+              &expected_end);
+          // Without the alignments, hence without any backtraces.
+          EXPECT_EQ(LevenshteinDistance(query.data(), query.size(),
+                                        target.data(), target.size(), nullptr,
+                                        nullptr, 1, costs, costs, engine,
+                                        max_distance, -1, &end_position),
+                    distance);
+          EXPECT_EQ(end_position, expected_end);
+          if (distance == -1) {
+            EXPECT_EQ(end_position, -1);
+          } else {
+            EXPECT_EQ(end_position, alignments.front().position);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Levenshtein, TestBandWidth) {
+  std::mt19937 rng(3456);
+  for (int32_t i = 0; i < 200; i++) {
+    std::vector<int32_t> query, target;
+    RandomSequences(&rng, 100, &query, &target);
+    std::vector<LevenshteinElement> expected, alignments;
+    BacktraceArena expected_arena, arena;
+    int32_t expected_distance =
+        LevenshteinDistance(query.data(), query.size(), target.data(),
+                            target.size(), &expected, &expected_arena);
+
+    // A band that covers the whole matrix changes nothing.
+    int32_t band_width = std::max(query.size(), target.size());
+    EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                  target.size(), &alignments, &arena, 1, 1, 1,
+                                  LevenshteinEngine::kAuto, -1, band_width),
+              expected_distance);
+    ExpectSameAlignments(alignments, arena, expected, expected_arena);
+
+    // A narrower band can only give a worse match, or none.
+    band_width = rng() % 10;
+    int32_t distance =
+        LevenshteinDistance(query.data(), query.size(), target.data(),
+                            target.size(), &alignments, &arena, 1, 1, 1,
+                            LevenshteinEngine::kScalar, -1, band_width);
+    if (distance == -1) {
+      EXPECT_TRUE(alignments.empty());
+    } else {
+      EXPECT_GE(distance, expected_distance);
+      EXPECT_FALSE(alignments.empty());
+    }
+  }
+
+  // The query is the target with a few errors, so the band along the
+  // diagonal contains the best alignment.
+  std::vector<int32_t> target(300), query;
+  for (auto &t : target)
+    t = rng() % 20;
+  query = target;
+  query.erase(query.begin() + 100);
+  query[200] = 20;
+  query.insert(query.begin() + 250, 21);
+  std::vector<LevenshteinElement> expected, alignments;
+  BacktraceArena expected_arena, arena;
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &expected, &expected_arena),
+            3);
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), &alignments, &arena, 1, 1, 1,
+                                LevenshteinEngine::kAuto, -1, 3),
+            3);
+  ExpectSameAlignments(alignments, arena, expected, expected_arena);
+}
+
+// The minimum cost of the alignments of the query with a segment of the
+// target, with the first end position in *end.
+static int32_t MinimumCostSimple(const std::vector<int32_t> &query,
+                                 const std::vector<int32_t> &target,
+                                 int32_t insert_cost, int32_t delete_cost,
+                                 int32_t replace_cost, size_t *end) {
+  std::vector<int32_t> scores(query.size() + 1);
+  for (size_t i = 0; i <= query.size(); i++)
+    scores[i] = i * insert_cost;
+  int32_t best = -1;
+  for (size_t j = 1; j <= target.size(); j++) {
+    int32_t prev_diag = scores[0];
+    scores[0] = 0;
+    for (size_t k = 1; k <= query.size(); k++) {
+      int32_t cache = scores[k];
+      scores[k] = std::min(
+          {scores[k] + delete_cost, scores[k - 1] + insert_cost,
+           prev_diag + (query[k - 1] == target[j - 1] ? 0 : replace_cost)});
+      prev_diag = cache;
+    }
+    if (best == -1 || scores.back() < best) {
+      best = scores.back();
+      *end = j - 1;
+    }
+  }
+  return best;
+}
+
+// Checks that `alignment` aligns the whole query with a segment of the target
+// ending at alignment.position, with cost alignment.cost.
+static void ExpectValidAlignment(const std::vector<int32_t> &query,
+                                 const std::vector<int32_t> &target,
+                                 int32_t insert_cost, int32_t delete_cost,
+                                 int32_t replace_cost,
+                                 const LevenshteinElement &alignment,
+                                 const BacktraceArena &arena) {
+  std::string trace = alignment.backtrace.ToString(arena);
+  // Count the symbols first, to find where the segment starts.
+  int64_t num_target = 0;
+  for (char c : trace)
+    num_target += c == '0';
+  int64_t q = 0, t = alignment.position + 1 - num_target;
+  ASSERT_GE(t, 0);
+  int32_t cost = 0;
+  for (size_t i = 0; i < trace.size(); i++) {
+    if (trace[i] == '0' && i + 1 < trace.size() && trace[i + 1] == '1') {
+      // Either a replacement/match, or a deletion followed by an insertion.
+      cost += std::min(query[q] == target[t] ? 0 : replace_cost,
+                       insert_cost + delete_cost);
+      q++, t++, i++;
+    } else if (trace[i] == '0') {
+      cost += delete_cost;
+      t++;
+    } else {
+      cost += insert_cost;
+      q++;
+    }
+  }
+  EXPECT_EQ(q, static_cast<int64_t>(query.size()));
+  EXPECT_EQ(t, alignment.position + 1);
+  EXPECT_EQ(cost, alignment.cost);
+}
+
+TEST(Levenshtein, TestLinearMemory) {
+  std::mt19937 rng(4567);
+  for (int32_t i = 0; i < 300; i++) {
+    std::vector<int32_t> query, target;
+    RandomSequences(&rng, i < 100 ? 10 : 300, &query, &target);
+    int32_t insert_cost = 1, delete_cost = 1, replace_cost = 1;
+    if (i % 2 == 1) {
+      insert_cost = rng() % 4;
+      delete_cost = rng() % 4;
+      replace_cost = rng() % 4;
+    }
+    size_t expected_end = 0;
+    int32_t expected_distance = MinimumCostSimple(
+        query, target, insert_cost, delete_cost, replace_cost, &expected_end);
+    if (i % 2 == 0) {
+      std::vector<LevenshteinElement> alignments;
+      BacktraceArena arena;
+      EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                    target.size(), &alignments, &arena),
+                expected_distance);
+      EXPECT_EQ(alignments.front().position, expected_end);
+    }
+
+    LevenshteinElement alignment;
+    BacktraceArena arena;
+    int32_t distance = LevenshteinDistanceLinearMemory(
+        query.data(), query.size(), target.data(), target.size(), &alignment,
+        &arena, insert_cost, delete_cost, replace_cost);
+    EXPECT_EQ(distance, expected_distance);
+    EXPECT_EQ(alignment.cost, expected_distance);
+    EXPECT_EQ(alignment.position, expected_end);
+    ExpectValidAlignment(query, target, insert_cost, delete_cost, replace_cost,
+                         alignment, arena);
+
+    EXPECT_EQ(LevenshteinDistanceLinearMemory(
+                  query.data(), query.size(), target.data(), target.size(),
+                  &alignment, &arena, insert_cost, delete_cost, replace_cost,
+                  expected_distance - 1),
+              expected_distance == 0 ? 0 : -1);
+  }
+
+  // Large enough to be split across threads; the result doesn't depend on
+  // the number of threads.
+  std::vector<int32_t> target(6000), query;
+  for (auto &t : target)
+    t = rng() % 4;
+  query.assign(target.begin() + 1000, target.begin() + 5000);
+  for (int32_t i = 0; i < 200; i++)
+    query[rng() % query.size()] = rng() % 4;
+  std::string expected_trace;
+  for (int32_t num_threads : {1, 2, 4}) {
+    LevenshteinElement alignment;
+    BacktraceArena arena;
+    int32_t distance = LevenshteinDistanceLinearMemory(
+        query.data(), query.size(), target.data(), target.size(), &alignment,
+        &arena, 1, 1, 1, -1, num_threads);
+    EXPECT_EQ(distance, LevenshteinDistance(query.data(), query.size(),
+                                            target.data(), target.size(),
+                                            nullptr, nullptr));
+    ExpectValidAlignment(query, target, 1, 1, 1, alignment, arena);
+    if (num_threads == 1)
+      expected_trace = alignment.backtrace.ToString(arena);
+    EXPECT_EQ(alignment.backtrace.ToString(arena), expected_trace);
   }
 }
 
@@ -0,0 +1,309 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/minimizer_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <utility>
+
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// Texts are split into chunks of at least this many windows for the
+// threads.
+constexpr int64_t kMinChunkSize = 1 << 14;
+
+// The k-mers are hashed modulo this prime.
+constexpr uint64_t kPrime = (uint64_t(1) << 61) - 1;
+constexpr uint64_t kBase = 0x2b992ddfa23249d6ull % kPrime;
+
+// The key of the k-mers that are not indexed, and of the empty slots.
+constexpr uint64_t kNoKey = ~uint64_t(0);
+
+uint64_t MulMod(uint64_t a, uint64_t b) {
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  uint64_t r = static_cast<uint64_t>(product & kPrime) +
+               static_cast<uint64_t>(product >> 61);
+  r = (r & kPrime) + (r >> 61);
+  return r >= kPrime ? r - kPrime : r;
+}
+
+uint64_t AddMod(uint64_t a, uint64_t b) {
+  uint64_t r = a + b;
+  return r >= kPrime ? r - kPrime : r;
+}
+
+// The splitmix64 finalizer.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+// The hash of a key in the table (the keys being the smallest hashes of
+// their windows, their high bits are mostly 0).
+uint64_t SlotHash(uint64_t key) { return Mix(key ^ 0x9e3779b97f4a7c15ull); }
+
+template <typename SymbolT> uint64_t SymbolValue(SymbolT symbol) {
+  return static_cast<uint64_t>(symbol) % (kPrime - 1) + 1;
+}
+
+// The number of windows of the k-mers of a text of size `size`, with the
+// number of k-mers in each; a text with fewer than w k-mers has one window.
+int64_t NumWindows(int64_t size, int32_t k, int32_t w, int32_t *window) {
+  int64_t num_kmers = size - k + 1;
+  *window = static_cast<int32_t>(std::min<int64_t>(w, num_kmers));
+  return num_kmers <= 0 ? 0 : num_kmers - *window + 1;
+}
+
+/*
+  Appends the (key, position) of the minimizers of the windows [begin, end)
+  of the k-mers of `text` to *minimizers, in order of position and without
+  repeating the minimizer of consecutive windows; the leftmost k-mer with the
+  smallest key is the minimizer of a window.  The k-mers that contain `eos`
+  have no key, and a window of only such k-mers has no minimizer.
+ */
+template <typename SymbolT, typename IndexT>
+void FindMinimizers(const SymbolT *text, SymbolT eos, int32_t k,
+                    int32_t window, int64_t begin, int64_t end,
+                    std::vector<std::pair<uint64_t, IndexT>> *minimizers) {
+  uint64_t top = 1; // kBase^(k-1), to remove the first symbol of a k-mer.
+  for (int32_t i = 1; i < k; i++)
+    top = MulMod(top, kBase);
+  uint64_t hash = 0;
+  int64_t last_eos = -1;
+  for (int64_t i = begin; i < begin + k - 1; i++) {
+    hash = AddMod(MulMod(hash, kBase), SymbolValue(text[i]));
+    if (text[i] == eos)
+      last_eos = i;
+  }
+
+  // The k-mers that can still be the minimizer of a window, with increasing
+  // keys.
+  std::deque<std::pair<uint64_t, int64_t>> queue;
+  for (int64_t j = begin; j < end + window - 1; j++) {
+    int64_t i = j + k - 1;
+    hash = AddMod(MulMod(hash, kBase), SymbolValue(text[i]));
+    if (text[i] == eos)
+      last_eos = i;
+    uint64_t key = kNoKey;
+    if (last_eos < j)
+      key = std::min(Mix(hash), kNoKey - 1);
+    while (!queue.empty() && queue.back().first > key)
+      queue.pop_back();
+    queue.emplace_back(key, j);
+    hash = AddMod(hash, kPrime - MulMod(SymbolValue(text[j]), top));
+
+    int64_t s = j - window + 1;
+    if (s < begin)
+      continue;
+    while (queue.front().second < s)
+      queue.pop_front();
+    const auto &m = queue.front();
+    if (m.first != kNoKey &&
+        (minimizers->empty() || minimizers->back().second != m.second))
+      minimizers->emplace_back(m.first, static_cast<IndexT>(m.second));
+  }
+}
+
+} // namespace
+
+template <typename SymbolT, typename IndexT>
+MinimizerIndex<SymbolT, IndexT>::MinimizerIndex(const SymbolT *text,
+                                                IndexT seq_len, int32_t k,
+                                                int32_t w, int32_t num_threads)
+    : seq_len_(seq_len), k_(k), w_(w), eos_(text[seq_len - 1]) {
+  assert(seq_len >= 1 && k >= 1 && w >= 1);
+  using Minimizer = std::pair<uint64_t, IndexT>;
+  int32_t window = 0;
+  int64_t num_windows = NumWindows(seq_len, k, w, &window);
+  int32_t num_chunks = NumChunks(num_windows, num_threads, kMinChunkSize);
+  std::vector<std::vector<Minimizer>> chunk_minimizers(num_chunks);
+  ParallelFor(num_windows, num_chunks,
+              [&](int32_t c, int64_t begin, int64_t end) {
+                FindMinimizers(text, eos_, k, window, begin, end,
+                               &chunk_minimizers[c]);
+              });
+
+  // Bucket the minimizers by key, so that the buckets can be sorted in
+  // parallel; a minimizer can be found by two chunks, so it is repeated in
+  // its bucket.
+  int32_t num_buckets = 1;
+  while (num_buckets < 4 * GetNumThreads(num_threads))
+    num_buckets *= 2;
+  auto bucket_of = [num_buckets](uint64_t key) {
+    return static_cast<int32_t>(SlotHash(key) >> 32) & (num_buckets - 1);
+  };
+  // starts[b * num_chunks + c] is where chunk c writes bucket b.
+  std::vector<int64_t> starts(num_buckets * num_chunks + 1, 0);
+  ParallelFor(num_chunks, num_chunks, [&](int32_t c, int64_t, int64_t) {
+    for (const Minimizer &m : chunk_minimizers[c])
+      starts[bucket_of(m.first) * num_chunks + c + 1]++;
+  });
+  for (size_t i = 1; i < starts.size(); i++)
+    starts[i] += starts[i - 1];
+  std::vector<Minimizer> minimizers(starts.back());
+  ParallelFor(num_chunks, num_chunks, [&](int32_t c, int64_t, int64_t) {
+    std::vector<int64_t> next(num_buckets);
+    for (int32_t b = 0; b < num_buckets; b++)
+      next[b] = starts[b * num_chunks + c];
+    for (const Minimizer &m : chunk_minimizers[c])
+      minimizers[next[bucket_of(m.first)]++] = m;
+    chunk_minimizers[c] = std::vector<Minimizer>();
+  });
+
+  // Sort the buckets, and count their positions and distinct minimizers.
+  std::vector<int64_t> num_positions(num_buckets + 1, 0),
+      num_minimizers(num_buckets + 1, 0);
+  ParallelForEach(num_buckets, num_threads, [&](int32_t, int64_t b) {
+    auto begin = minimizers.begin() + starts[b * num_chunks],
+         end = minimizers.begin() + starts[(b + 1) * num_chunks];
+    std::sort(begin, end);
+    end = std::unique(begin, end);
+    num_positions[b + 1] = end - begin;
+    for (auto it = begin; it != end; ++it)
+      num_minimizers[b + 1] += it == begin || it->first != (it - 1)->first;
+  });
+  for (int32_t b = 0; b < num_buckets; b++) {
+    num_positions[b + 1] += num_positions[b];
+    num_minimizers[b + 1] += num_minimizers[b];
+  }
+
+  // The table is at most half full.
+  int64_t capacity = 1;
+  while (capacity < 2 * num_minimizers.back())
+    capacity *= 2;
+  mask_ = static_cast<uint64_t>(capacity - 1);
+  keys_ = std::vector<std::atomic<uint64_t>>(capacity);
+  slot_minimizers_.resize(capacity);
+  ParallelFor(capacity, NumChunks(capacity, num_threads, kMinChunkSize),
+              [&](int32_t, int64_t begin, int64_t end) {
+                for (int64_t s = begin; s < end; s++)
+                  keys_[s].store(kNoKey, std::memory_order_relaxed);
+              });
+  offsets_.resize(num_minimizers.back() + 1);
+  positions_.resize(num_positions.back());
+  offsets_.back() = static_cast<IndexT>(positions_.size());
+  ParallelForEach(num_buckets, num_threads, [&](int32_t, int64_t b) {
+    const Minimizer *m = minimizers.data() + starts[b * num_chunks];
+    int64_t p = num_positions[b], d = num_minimizers[b];
+    for (; p < num_positions[b + 1]; p++, m++) {
+      positions_[p] = m->second;
+      if (p != num_positions[b] && m->first == (m - 1)->first)
+        continue;
+      offsets_[d] = static_cast<IndexT>(p);
+      uint64_t slot = SlotHash(m->first) & mask_, expected = kNoKey;
+      while (!keys_[slot].compare_exchange_strong(expected, m->first)) {
+        slot = (slot + 1) & mask_;
+        expected = kNoKey;
+      }
+      slot_minimizers_[slot] = static_cast<IndexT>(d++);
+    }
+  });
+}
+
+template <typename SymbolT, typename IndexT>
+int64_t MinimizerIndex<SymbolT, IndexT>::Find(uint64_t key) const {
+  for (uint64_t slot = SlotHash(key) & mask_;; slot = (slot + 1) & mask_) {
+    uint64_t k = keys_[slot].load(std::memory_order_relaxed);
+    if (k == key)
+      return static_cast<int64_t>(slot);
+    if (k == kNoKey)
+      return -1;
+  }
+}
+
+template <typename SymbolT, typename IndexT>
+void MinimizerIndex<SymbolT, IndexT>::FindCloseMatches(
+    const SymbolT *query, IndexT query_len, int32_t num_close_matches,
+    IndexT min_match_length, IndexT *output, IndexT *output_lengths,
+    int32_t num_threads) const {
+  assert(query_len >= 0 && num_close_matches > 0);
+  FTS_STATS_SCOPE(Stage::kCloseMatches);
+  using Minimizer = std::pair<uint64_t, IndexT>;
+  int64_t stride = 2 * static_cast<int64_t>(num_close_matches);
+
+  int32_t window = 0;
+  int64_t num_windows = NumWindows(query_len, k_, w_, &window);
+  int32_t num_chunks = NumChunks(num_windows, num_threads, kMinChunkSize);
+  std::vector<std::vector<Minimizer>> chunk_minimizers(num_chunks);
+  ParallelFor(num_windows, num_chunks,
+              [&](int32_t c, int64_t begin, int64_t end) {
+                FindMinimizers(query, eos_, k_, window, begin, end,
+                               &chunk_minimizers[c]);
+              });
+  std::vector<Minimizer> minimizers;
+  for (const auto &m : chunk_minimizers)
+    for (const Minimizer &x : m)
+      if (minimizers.empty() || minimizers.back().second != x.second)
+        minimizers.push_back(x);
+
+  // Each chunk of the output is written by one thread.
+  num_chunks = NumChunks(query_len, num_threads, kMinChunkSize);
+  ParallelFor(query_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    std::fill(output + stride * begin, output + stride * end, seq_len_ - 2);
+    std::fill(output_lengths + stride * begin, output_lengths + stride * end,
+              0);
+    if (min_match_length > k_)
+      return;
+    auto it = std::lower_bound(
+        minimizers.begin(), minimizers.end(), begin,
+        [](const Minimizer &m, int64_t pos) { return m.second < pos; });
+    for (; it != minimizers.end() && it->second < end; ++it) {
+      int64_t slot = Find(it->first);
+      if (slot < 0)
+        continue;
+      IndexT m = slot_minimizers_[slot];
+      const IndexT *pos_begin = positions_.data() + offsets_[m],
+                   *pos_end = positions_.data() + offsets_[m + 1];
+      if (pos_end - pos_begin > stride)
+        continue;
+      int64_t o = stride * it->second;
+      std::copy(pos_begin, pos_end, output + o);
+      std::fill(output_lengths + o, output_lengths + o + (pos_end - pos_begin),
+                static_cast<IndexT>(k_));
+    }
+  });
+}
+
+template <typename SymbolT, typename IndexT>
+int64_t MinimizerIndex<SymbolT, IndexT>::NumBytes() const {
+  return static_cast<int64_t>(keys_.size() * sizeof(uint64_t) +
+                              (slot_minimizers_.size() + offsets_.size() +
+                               positions_.size()) *
+                                  sizeof(IndexT));
+}
+
+template class MinimizerIndex<uint8_t, int32_t>;
+template class MinimizerIndex<uint8_t, int64_t>;
+template class MinimizerIndex<uint16_t, int32_t>;
+template class MinimizerIndex<uint16_t, int64_t>;
+template class MinimizerIndex<int32_t, int32_t>;
+template class MinimizerIndex<int32_t, int64_t>;
+template class MinimizerIndex<int64_t, int64_t>;
+
+} // namespace fasttextsearch
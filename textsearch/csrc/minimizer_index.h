@@ -0,0 +1,135 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_MINIMIZER_INDEX_H_
+#define TEXTSEARCH_CSRC_MINIMIZER_INDEX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  An index of the minimizers of a reference text, as a faster and smaller
+  alternative to its suffix array for finding candidate regions for short
+  queries: of each window of w consecutive k-mers (k consecutive symbols)
+  the k-mer with the smallest hash is a minimizer, and the positions of each
+  minimizer are found with a flat open-addressing hash table.  A query
+  position whose k-mer is a minimizer of the query hits the positions of
+  the same k-mer in the reference, since two texts that share a run of
+  w + k - 1 symbols share a minimizer in it.
+
+  The k-mers are hashed with a polynomial rolling hash modulo 2^61 - 1; two
+  different k-mers with the same hash are taken to be the same, which is
+  unlikely enough not to matter for seeding.
+
+  Template args: SymbolT and IndexT are as for CreateSuffixArray(), with the
+  same instantiations.
+ */
+template <typename SymbolT, typename IndexT> class MinimizerIndex {
+public:
+  /*
+    Builds the index: the minimizers are found in parallel chunks of the
+    text and bucketed by hash, and the buckets are sorted and inserted in
+    the table in parallel.  The text is not needed after this returns.
+
+      @param [in] text  The reference text, as passed to CreateSuffixArray(),
+               i.e. ending with the termination symbol; the k-mers that
+               contain a termination symbol (there is one per shard in a
+               text from MergeSuffixArrayIndexes()) are not indexed.
+      @param [in] seq_len  The length of the reference text including the
+               termination symbol; require seq_len >= 1.
+      @param [in] k  The length of the k-mers, >= 1.
+      @param [in] w  The number of k-mers in a window, >= 1; a text of fewer
+               k-mers has them all in one window.
+      @param [in] num_threads  The number of threads to use; <= 0 means to use
+               all hardware threads.
+   */
+  MinimizerIndex(const SymbolT *text, IndexT seq_len, int32_t k, int32_t w,
+                 int32_t num_threads = 1);
+
+  IndexT SeqLen() const { return seq_len_; }
+  int32_t K() const { return k_; }
+  int32_t W() const { return w_; }
+
+  // The number of distinct minimizers, and the number of their positions.
+  int64_t NumMinimizers() const {
+    return static_cast<int64_t>(offsets_.size()) - 1;
+  }
+  int64_t NumPositions() const {
+    return static_cast<int64_t>(positions_.size());
+  }
+
+  /*
+    Finds the reference positions of the minimizers of a query, in the
+    format of FindCloseMatchesInReference() so that they can be passed to
+    FindCandidateMatchesWithLengths() (with the query positions first).  The
+    minimizers are found in parallel chunks of the query.
+
+      @param [in] query  The query text, of length `query_len`; its symbols
+               must be less than the termination symbol of the reference.
+      @param [in] query_len  The length of the query; require query_len >= 0.
+      @param [in] num_close_matches  There are 2 * num_close_matches output
+               elements per query position; must be > 0.  A minimizer with
+               more positions in the reference is ignored, as a repeat.
+      @param [in] min_match_length  If more than k, there are no hits.
+      @param [out] output  A pre-allocated array of length
+               2 * num_close_matches * query_len.  At exit, for each query
+               position i whose k-mer is a minimizer of the query, the
+               reference positions of that k-mer are at
+               output[2*num_close_matches*i], in increasing order.  Unused
+               elements are set to seq_len - 2.
+      @param [out] output_lengths  A pre-allocated array of the same length as
+               `output`.  At exit it contains k for the positions in
+               `output`, or 0 for its unused elements.
+      @param [in] num_threads  The number of threads to use; <= 0 means to use
+               all hardware threads.  The result does not depend on it.
+   */
+  void FindCloseMatches(const SymbolT *query, IndexT query_len,
+                        int32_t num_close_matches, IndexT min_match_length,
+                        IndexT *output, IndexT *output_lengths,
+                        int32_t num_threads = 1) const;
+
+  // The memory used by the index.
+  int64_t NumBytes() const;
+
+private:
+  // The slot of `key` in the table, or -1 if it is not there.
+  int64_t Find(uint64_t key) const;
+
+  IndexT seq_len_;
+  int32_t k_;
+  int32_t w_;
+  SymbolT eos_;
+
+  // The table: the key of each slot (kEmptyKey if empty) and the number of
+  // its minimizer, in the order of offsets_.
+  std::vector<std::atomic<uint64_t>> keys_;
+  std::vector<IndexT> slot_minimizers_;
+  uint64_t mask_ = 0;
+
+  // The positions of minimizer m are positions_[offsets_[m]:offsets_[m+1]],
+  // in increasing order.
+  std::vector<IndexT> offsets_;
+  std::vector<IndexT> positions_;
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_MINIMIZER_INDEX_H_
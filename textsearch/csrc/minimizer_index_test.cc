@@ -0,0 +1,131 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/minimizer_index.h"
+
+namespace fasttextsearch {
+
+TEST(MinimizerIndexTest, TestUniqueKmers) {
+  // With a large alphabet all the k-mers are different, so searching for the
+  // text itself each minimizer hits only its own position.
+  std::mt19937 rng(0);
+  int32_t seq_len = 100000, k = 3, w = 10;
+  std::vector<int32_t> text(seq_len + 3, 0);
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text[i] = 1 + rng() % 1000000;
+  text[seq_len - 1] = 1000001;
+  MinimizerIndex<int32_t, int32_t> index(text.data(), seq_len, k, w, 4);
+  EXPECT_EQ(index.NumMinimizers(), index.NumPositions());
+
+  int32_t query_len = seq_len - 1;
+  std::vector<int32_t> output(2 * query_len), lengths(2 * query_len);
+  index.FindCloseMatches(text.data(), query_len, 1, 0, output.data(),
+                         lengths.data(), 3);
+  int32_t num_hits = 0, last_hit = -1;
+  for (int32_t i = 0; i < query_len; i++) {
+    if (lengths[2 * i] != 0) {
+      EXPECT_EQ(output[2 * i], i);
+      EXPECT_EQ(lengths[2 * i], k);
+      // Every window of w k-mers has a minimizer.
+      EXPECT_LE(i - last_hit, w);
+      last_hit = i;
+      num_hits++;
+    } else {
+      EXPECT_EQ(output[2 * i], seq_len - 2);
+    }
+    EXPECT_EQ(lengths[2 * i + 1], 0);
+  }
+  // The windows at the end of the text, with k-mers of the termination
+  // symbol, can have more.
+  EXPECT_GE(index.NumMinimizers(), num_hits);
+  EXPECT_LE(index.NumMinimizers(), num_hits + k);
+  // About 2 / (w + 1) of the k-mers are minimizers.
+  EXPECT_GT(num_hits, query_len / w);
+  EXPECT_LT(num_hits, 3 * query_len / w);
+}
+
+TEST(MinimizerIndexTest, TestRandom) {
+  std::mt19937 rng(1);
+  for (int32_t iter = 0; iter < 10; iter++) {
+    int32_t seq_len = 1 + rng() % 200000, query_len = rng() % 40000,
+            k = 1 + rng() % 12, w = 1 + rng() % 10;
+    std::vector<uint8_t> text(seq_len + 3, 0), query(query_len);
+    for (int32_t i = 0; i + 1 < seq_len; i++)
+      text[i] = 'a' + rng() % 4;
+    text[seq_len - 1] = 255;
+    // Termination symbols inside the text, as in merged shards.
+    for (int32_t e = 0; e < 3 && seq_len > 1; e++)
+      text[rng() % (seq_len - 1)] = 255;
+    for (int32_t i = 0; i < query_len; i++)
+      query[i] = i < seq_len - 1 && rng() % 10 != 0 ? text[i] : 'a';
+    for (int32_t i = 0; i < query_len; i++)
+      if (query[i] == 255)
+        query[i] = 'b';
+
+    std::vector<int64_t> expected, expected_lengths;
+    for (int32_t num_threads : {1, 4}) {
+      MinimizerIndex<uint8_t, int64_t> index(text.data(), seq_len, k, w,
+                                             num_threads);
+      for (int32_t num_close_matches : {1, 20}) {
+        int64_t stride = 2 * num_close_matches;
+        std::vector<int64_t> output(stride * query_len + 1, -10),
+            lengths(stride * query_len);
+        index.FindCloseMatches(query.data(), query_len, num_close_matches, 0,
+                               output.data(), lengths.data(), num_threads);
+        EXPECT_EQ(output.back(), -10);
+        output.pop_back();
+        for (int64_t i = 0; i < stride * query_len; i++) {
+          if (lengths[i] == 0) {
+            EXPECT_EQ(output[i], seq_len - 2);
+            continue;
+          }
+          // The hits are of the same k-mer, without termination symbols.
+          int64_t q = i / stride, pos = output[i];
+          EXPECT_EQ(lengths[i], k);
+          ASSERT_LE(pos + k, seq_len - 1);
+          EXPECT_TRUE(std::equal(query.begin() + q, query.begin() + q + k,
+                                 text.begin() + pos));
+          EXPECT_EQ(std::count(text.begin() + pos, text.begin() + pos + k, 255),
+                    0);
+        }
+        if (num_close_matches == 20) {
+          if (num_threads == 1) {
+            expected = output;
+            expected_lengths = lengths;
+          } else {
+            EXPECT_EQ(output, expected);
+            EXPECT_EQ(lengths, expected_lengths);
+          }
+        }
+      }
+      // No match can be longer than k.
+      std::vector<int64_t> output(2 * query_len), lengths(2 * query_len);
+      index.FindCloseMatches(query.data(), query_len, 1, k + 1, output.data(),
+                             lengths.data());
+      EXPECT_EQ(std::count(lengths.begin(), lengths.end(), 0), 2 * query_len);
+    }
+  }
+}
+
+} // namespace fasttextsearch
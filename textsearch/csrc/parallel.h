@@ -0,0 +1,176 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_PARALLEL_H_
+#define TEXTSEARCH_CSRC_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  Returns the number of threads to use when the user asked for
+  `num_threads`: num_threads itself if it is positive, else the number
+  of hardware threads (at least 1).
+ */
+inline int32_t GetNumThreads(int32_t num_threads) {
+  if (num_threads > 0)
+    return num_threads;
+  int32_t n = static_cast<int32_t>(std::thread::hardware_concurrency());
+  return std::max(n, 1);
+}
+
+/*
+  Returns the number of chunks that ParallelFor() should split `n` items
+  into: at most GetNumThreads(num_threads), and such that no chunk has
+  fewer than `min_chunk_size` items (it returns 1 if n is small).
+ */
+inline int32_t NumChunks(int64_t n, int32_t num_threads,
+                         int64_t min_chunk_size = 1) {
+  int64_t max_chunks = n / std::max<int64_t>(min_chunk_size, 1);
+  int64_t num_chunks = std::min<int64_t>(GetNumThreads(num_threads), max_chunks);
+  return static_cast<int32_t>(std::max<int64_t>(num_chunks, 1));
+}
+
+/*
+  Splits [0, n) into `num_chunks` contiguous ranges of nearly equal size
+  and calls f(c, begin, end) for the c'th range [begin, end), each one in
+  its own thread (chunk 0 runs in the calling thread).  Returns when all the
+  calls have finished.  The ranges are deterministic, so callers can
+  e.g. do a per-chunk counting pass followed by a per-chunk writing pass.
+
+  `f` must not throw.
+ */
+template <typename F>
+void ParallelFor(int64_t n, int32_t num_chunks, F &&f) {
+  if (num_chunks <= 1) {
+    f(0, static_cast<int64_t>(0), n);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks - 1);
+  for (int32_t c = 1; c < num_chunks; c++) {
+    int64_t begin = n * c / num_chunks, end = n * (c + 1) / num_chunks;
+    threads.emplace_back([&f, c, begin, end]() { f(c, begin, end); });
+  }
+  f(0, static_cast<int64_t>(0), n / num_chunks);
+  for (auto &t : threads)
+    t.join();
+}
+
+/*
+  Calls f(t, i) for every i in [0, n), from min(GetNumThreads(num_threads), n)
+  threads (thread 0 is the calling thread) that each take the next index that
+  no thread has taken yet until there are none left; t is the index of the
+  thread, e.g. for per-thread buffers.  Unlike ParallelFor() this balances the
+  load when the items take very different times, but the order in which they
+  are processed is not deterministic.  Returns when all the calls have
+  finished.
+
+  `f` must not throw.
+ */
+template <typename F>
+void ParallelForEach(int64_t n, int32_t num_threads, F &&f) {
+  int32_t num_workers = static_cast<int32_t>(
+      std::min<int64_t>(GetNumThreads(num_threads), n));
+  if (num_workers <= 1) {
+    for (int64_t i = 0; i < n; i++)
+      f(0, i);
+    return;
+  }
+  std::atomic<int64_t> next(0);
+  auto work = [&f, &next, n](int32_t t) {
+    for (int64_t i = next++; i < n; i = next++)
+      f(t, i);
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (int32_t t = 1; t < num_workers; t++)
+    threads.emplace_back(work, t);
+  work(0);
+  for (auto &thread : threads)
+    thread.join();
+}
+
+/*
+  A queue of at most `capacity` items between producer and consumer threads:
+  Push() waits while it is full and Pop() while it is empty, so a fast stage
+  can't get ahead of a slow one by more than `capacity` items.  Close() ends
+  the input: Pop() then returns the items left and after that false, and
+  Push() returns false without adding the item.  Clear() drops the items
+  left, for a consumer that stops early.
+ */
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)) {}
+
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock,
+                   [this] { return closed_ || items_.size() < capacity_; });
+    if (closed_)
+      return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool Pop(T *item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty())
+      return false;
+    *item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    items_.clear();
+    not_full_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  bool closed_ = false;
+  std::mutex mutex_;
+  std::condition_variable not_full_, not_empty_;
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_PARALLEL_H_
@@ -0,0 +1,129 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/reference_index.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+#include <algorithm>
+#include <cassert>
+
+namespace fasttextsearch {
+
+// Queries shorter than this many symbols per thread are not split across
+// threads.
+static constexpr int64_t kMinChunkSize = 1 << 12;
+
+namespace {
+
+/*
+  Compares the query suffix `query[0:query_len]` with the reference suffix
+  starting at `pos`, knowing that their first `*length` symbols are equal.
+  At exit, *length is the length of their common prefix.  Returns true if the
+  query suffix is less than the reference suffix.
+ */
+template <typename SymbolT, typename IndexT>
+bool QueryIsLess(const SymbolT *text, IndexT eos_pos, IndexT pos,
+                 const SymbolT *query, IndexT query_len, IndexT *length) {
+  IndexT h = *length;
+  // The termination symbol is larger than all the query symbols, and the
+  // search stops there so we never read past the end of the text.
+  while (h < query_len && pos + h < eos_pos && query[h] == text[pos + h])
+    h++;
+  *length = h;
+  return h == query_len || query[h] < text[pos + h];
+}
+
+} // namespace
+
+template <typename SymbolT, typename IndexT>
+void FindCloseMatchesInReference(const SymbolT *text, IndexT seq_len,
+                                 const IndexT *suffix_array, const IndexT *lcp,
+                                 const SymbolT *query, IndexT query_len,
+                                 int32_t num_close_matches,
+                                 IndexT min_match_length, IndexT *output,
+                                 IndexT *output_lengths, int32_t num_threads) {
+  assert(seq_len >= 1 && query_len >= 0 && num_close_matches > 0);
+  assert(num_close_matches == 1 || lcp != nullptr);
+  FTS_STATS_SCOPE(Stage::kCloseMatches);
+  IndexT eos_pos = seq_len - 1, no_match = seq_len - 2;
+  int64_t stride = 2 * static_cast<int64_t>(num_close_matches);
+
+  int32_t num_chunks = NumChunks(query_len, num_threads, kMinChunkSize);
+  ParallelFor(query_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (IndexT i = begin; i < end; i++) {
+      const SymbolT *q = query + i;
+      IndexT q_len = query_len - i;
+      // Invariant: the suffixes at ranks <= lo are less than the query suffix
+      // and those at ranks >= hi are greater, with common prefixes of
+      // lo_len and hi_len symbols (-1 and seq_len stand for empty suffixes).
+      IndexT lo = -1, hi = seq_len, lo_len = 0, hi_len = 0;
+      while (hi - lo > 1) {
+        IndexT mid = lo + (hi - lo) / 2, len = std::min(lo_len, hi_len);
+        if (QueryIsLess(text, eos_pos, suffix_array[mid], q, q_len, &len)) {
+          hi = mid;
+          hi_len = len;
+        } else {
+          lo = mid;
+          lo_len = len;
+        }
+      }
+
+      IndexT *this_output = output + stride * i,
+             *this_lengths = output_lengths + stride * i;
+      // The preceding matches, then the following ones (the suffixes of the
+      // termination symbol sort last, so they can only follow; there is one
+      // per shard in a text from MergeSuffixArrayIndexes()).
+      for (int32_t side = 0; side < 2; side++) {
+        IndexT rank = side == 0 ? lo : hi, len = side == 0 ? lo_len : hi_len;
+        IndexT step = side == 0 ? -1 : 1;
+        for (int32_t j = 0; j < num_close_matches; j++) {
+          bool have = rank >= 0 && rank < seq_len &&
+                      text[suffix_array[rank]] != text[eos_pos] &&
+                      len >= min_match_length;
+          this_output[j] = have ? suffix_array[rank] : no_match;
+          this_lengths[j] = have ? len : 0;
+          if (have && j + 1 < num_close_matches) {
+            len = std::min(len, lcp[side == 0 ? rank : rank + 1]);
+            rank += step;
+          } else {
+            rank = -1;
+          }
+        }
+        this_output += num_close_matches;
+        this_lengths += num_close_matches;
+      }
+    }
+  });
+}
+
+#define FTS_INSTANTIATE_REFERENCE_INDEX(SymbolT, IndexT)                       \
+  template void FindCloseMatchesInReference(                                   \
+      const SymbolT *text, IndexT seq_len, const IndexT *suffix_array,         \
+      const IndexT *lcp, const SymbolT *query, IndexT query_len,               \
+      int32_t num_close_matches, IndexT min_match_length, IndexT *output,      \
+      IndexT *output_lengths, int32_t num_threads);
+
+FTS_INSTANTIATE_REFERENCE_INDEX(uint8_t, int32_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(uint8_t, int64_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(uint16_t, int32_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(uint16_t, int64_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(int32_t, int32_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(int32_t, int64_t)
+FTS_INSTANTIATE_REFERENCE_INDEX(int64_t, int64_t)
+#undef FTS_INSTANTIATE_REFERENCE_INDEX
+} // namespace fasttextsearch
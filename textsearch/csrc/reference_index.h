@@ -0,0 +1,86 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_REFERENCE_INDEX_H_
+#define TEXTSEARCH_CSRC_REFERENCE_INDEX_H_
+
+#include <cstdint>
+
+namespace fasttextsearch {
+
+/*
+  Finds the close matches of a query text in a reference text that has its own
+  suffix array, so that the suffix array of the (large, unchanging) reference
+  doesn't have to be rebuilt for each new query as with FindCloseMatches().
+  For each query position i we binary-search the suffix array for the suffix
+  query[i:query_len] (a query suffix sorts before the reference suffixes it is
+  a prefix of), skipping the symbols known to match both ends of the search
+  range, and output the reference positions whose suffixes immediately precede
+  and follow it, with the lengths of the matches.  The work is
+  O(query_len * (log(seq_len) + match length)), and the query positions are
+  processed in parallel.
+
+  The output is like that of FindCloseMatchesWithLengths() for the query and
+  reference combined, with reference positions instead of positions in the
+  combined text.  The matches can differ where a query suffix is a prefix of
+  a reference suffix, as here the query suffix ends with the query rather
+  than continuing into the reference text.
+
+  Template args: SymbolT and IndexT are as for CreateSuffixArray(), with the
+  same instantiations.
+
+    @param [in] text  The reference text, as passed to CreateSuffixArray(),
+             i.e. ending with the termination symbol and 3 zeros.
+    @param [in] seq_len  The length of the reference text including the
+             termination symbol; require seq_len >= 1.
+    @param [in] suffix_array  The suffix array of `text`, of length seq_len.
+    @param [in] lcp  The LCP array of `suffix_array` (see CreateLcpArray()),
+             or nullptr; required if num_close_matches > 1.
+    @param [in] query  The query text, of length `query_len`; its symbols
+             must be less than the termination symbol of `text`.
+    @param [in] query_len  The length of the query; require query_len >= 0.
+    @param [in] num_close_matches  The maximum number of matches on each side
+             of a query suffix; must be > 0.
+    @param [in] min_match_length  The minimum length of a match, as for
+             FindCloseMatchesWithLengths().
+    @param [out] output  A pre-allocated array of length
+             2 * num_close_matches * query_len.  At exit, with
+             k = num_close_matches, output[2*k*i + j] and
+             output[2*k*i + k + j] for 0 <= j < k are the j'th nearest
+             positions in `text` whose suffixes precede and follow the query
+             suffix at i in the suffix array.  Unused elements are set to
+             seq_len - 2, as for FindCloseMatches(); the termination symbol
+             (which may occur more than once, as in a text from
+             MergeSuffixArrayIndexes()) is never output.
+    @param [out] output_lengths  A pre-allocated array of the same length as
+             `output`.  At exit it contains the match lengths of the positions
+             in `output`, or 0 for its unused elements.
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.  The result does not depend on it.
+ */
+template <typename SymbolT, typename IndexT>
+void FindCloseMatchesInReference(const SymbolT *text, IndexT seq_len,
+                                 const IndexT *suffix_array, const IndexT *lcp,
+                                 const SymbolT *query, IndexT query_len,
+                                 int32_t num_close_matches,
+                                 IndexT min_match_length, IndexT *output,
+                                 IndexT *output_lengths,
+                                 int32_t num_threads = 1);
+
+} // namespace fasttextsearch
+#endif // TEXTSEARCH_CSRC_REFERENCE_INDEX_H_
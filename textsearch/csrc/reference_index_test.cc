@@ -0,0 +1,149 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/close_matches.h"
+#include "textsearch/csrc/reference_index.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+// A simple version of FindCloseMatchesInReference(), for comparison, which
+// compares the query suffixes with all the reference suffixes.
+static void FindCloseMatchesInReferenceSimple(
+    const std::vector<int32_t> &text, const std::vector<int32_t> &suffix_array,
+    const std::vector<int32_t> &query, int32_t num_close_matches,
+    int32_t min_match_length, std::vector<int32_t> *output,
+    std::vector<int32_t> *output_lengths) {
+  int32_t seq_len = suffix_array.size(), query_len = query.size(),
+          k = num_close_matches;
+  output->assign(2 * k * query_len, seq_len - 2);
+  output_lengths->assign(2 * k * query_len, 0);
+  for (int32_t i = 0; i < query_len; i++) {
+    // lengths[r] is the common prefix of the query suffix and the reference
+    // suffix at rank r; the query suffix goes before rank `rank`.
+    std::vector<int32_t> lengths(seq_len);
+    int32_t rank = 0;
+    for (int32_t r = 0; r < seq_len; r++) {
+      int32_t pos = suffix_array[r], h = 0;
+      while (i + h < query_len && query[i + h] == text[pos + h])
+        h++;
+      lengths[r] = h;
+      if (i + h < query_len && query[i + h] > text[pos + h])
+        rank = r + 1;
+    }
+    for (int32_t side = 0; side < 2; side++) {
+      for (int32_t j = 0; j < k; j++) {
+        int32_t r = side == 0 ? rank - 1 - j : rank + j;
+        if (r < 0 || r >= seq_len - 1)
+          break;
+        int32_t len = lengths[r];
+        if (len < min_match_length)
+          break;
+        (*output)[2 * k * i + side * k + j] = suffix_array[r];
+        (*output_lengths)[2 * k * i + side * k + j] = len;
+      }
+    }
+  }
+}
+
+TEST(ReferenceIndexTest, TestBasic) {
+  // As in CloseMatchesTest.TestBasic, but with the query searched for in the
+  // suffix array of the reference alone.
+  std::string query = "hellohallo", reference = "iholloyouyouhellome";
+  int32_t seq_len = reference.size() + 1;
+  std::vector<int32_t> text(seq_len + 3, 0), query_array(query.size());
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text[i] = static_cast<unsigned char>(reference[i]);
+  text[seq_len - 1] = 255;
+  for (size_t i = 0; i < query.size(); i++)
+    query_array[i] = static_cast<unsigned char>(query[i]);
+
+  std::vector<int32_t> suffix_array(seq_len);
+  CreateSuffixArray(text.data(), seq_len, 255, suffix_array.data());
+
+  int32_t query_len = query.size();
+  std::vector<int32_t> output(2 * query_len), lengths(2 * query_len);
+  FindCloseMatchesInReference<int32_t, int32_t>(
+      text.data(), seq_len, suffix_array.data(), nullptr, query_array.data(),
+      query_len, 1, 0, output.data(), lengths.data());
+  // The matches of CloseMatchesTest.TestBasic, minus query_len.
+  std::vector<int32_t> expected = {18, 12, 18, 13, 0, 14, 3, 15, 17, 2,
+                                   18, 12, 18, 13, 0, 14, 3, 15, 17, 2};
+  // E.g. "hello" matches "hellome" (12) fully and "llohallo" matches "llome"
+  // (14) on "llo".
+  std::vector<int32_t> expected_lengths = {0, 5, 0, 4, 0, 3, 1, 2, 0, 1,
+                                           0, 1, 0, 0, 0, 3, 1, 2, 0, 1};
+  EXPECT_EQ(output, expected);
+  EXPECT_EQ(lengths, expected_lengths);
+}
+
+TEST(ReferenceIndexTest, TestRandom) {
+  std::mt19937 rng(3456);
+  for (int32_t iter = 0; iter < 20; iter++) {
+    int32_t seq_len = std::uniform_int_distribution<int32_t>(1, 2000)(rng),
+            query_len = std::uniform_int_distribution<int32_t>(0, 300)(rng);
+    if (iter < 8)
+      query_len *= 50; // to be split across threads.
+    std::uniform_int_distribution<int32_t> uni(1, 3);
+    std::vector<int32_t> text(seq_len + 3, 0), query(query_len);
+    for (int32_t i = 0; i + 1 < seq_len; i++)
+      text[i] = uni(rng);
+    text[seq_len - 1] = 4; // Termination symbol
+    for (auto &q : query)
+      q = uni(rng);
+    // Copy part of the reference into the query, for long matches.
+    if (seq_len > 100 && query_len > 100)
+      std::copy(text.begin(), text.begin() + 50, query.begin() + 10);
+
+    std::vector<int32_t> suffix_array(seq_len), lcp(seq_len);
+    CreateSuffixArray(text.data(), seq_len, 4, suffix_array.data());
+    CreateLcpArray(text.data(), seq_len, suffix_array.data(), lcp.data());
+
+    for (int32_t num_close_matches : {1, 3}) {
+      for (int32_t min_match_length : {0, 5}) {
+        if (iter < 8 && (num_close_matches != 1 || min_match_length != 0))
+          continue; // the simple version is slow.
+        std::vector<int32_t> expected, expected_lengths;
+        FindCloseMatchesInReferenceSimple(text, suffix_array, query,
+                                          num_close_matches, min_match_length,
+                                          &expected, &expected_lengths);
+        std::vector<int32_t> output(expected.size() + 1, -10),
+            lengths(expected.size());
+        for (int32_t num_threads : {1, 2, 3}) {
+          FindCloseMatchesInReference(
+              text.data(), seq_len, suffix_array.data(), lcp.data(),
+              query.data(), query_len, num_close_matches, min_match_length,
+              output.data(), lengths.data(), num_threads);
+          EXPECT_EQ(output.back(), -10); // should not write past the end.
+          EXPECT_EQ(std::vector<int32_t>(output.begin(), output.end() - 1),
+                    expected);
+          EXPECT_EQ(lengths, expected_lengths);
+        }
+      }
+    }
+  }
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,354 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/segmenter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <utility>
+
+#include "textsearch/csrc/parallel.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// A candidate segment, of the ops [begin, last].
+struct Candidate {
+  float score;
+  int32_t begin;
+  int32_t last;
+};
+
+// Keeps the k best of the candidates it is given.
+class TopCandidates {
+public:
+  explicit TopCandidates(int32_t k) : k_(k) {}
+
+  void Add(const Candidate &c) {
+    if (static_cast<int32_t>(best_.size()) < k_) {
+      best_.push_back(c);
+      return;
+    }
+    auto worst = std::min_element(best_.begin(), best_.end(),
+                                  [](const Candidate &a, const Candidate &b) {
+                                    return a.score < b.score;
+                                  });
+    if (c.score > worst->score)
+      *worst = c;
+  }
+
+  const std::vector<Candidate> &Best() const { return best_; }
+
+private:
+  int32_t k_;
+  std::vector<Candidate> best_;
+};
+
+/*
+  The scores of the split points of one alignment, and the search for its
+  segments.  A segment that begins at op i has its begin split point before
+  op i, and one that ends at op i (inclusive) has its end split point after
+  it.
+ */
+class SegmentFinder {
+public:
+  SegmentFinder(const SegmenterInput &input, const SegmenterOptions &options)
+      : in_(input), opts_(options), whitespace_(options.whitespace),
+        punctuation_(options.punctuation) {
+    std::sort(whitespace_.begin(), whitespace_.end());
+    std::sort(punctuation_.begin(), punctuation_.end());
+  }
+
+  void Find(std::vector<Segment> *segments) {
+    segments->clear();
+    if (in_.num_ops == 0 || in_.query_len == 0)
+      return;
+    ComputePositions();
+    ComputeScores();
+
+    std::vector<Candidate> candidates;
+    for (int32_t b : BestPositions(begin_scores_))
+      AddBeginCandidates(b, &candidates);
+    for (int32_t e : BestPositions(end_scores_))
+      AddEndCandidates(e, &candidates);
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+                if (a.score != b.score)
+                  return a.score > b.score;
+                return a.begin != b.begin ? a.begin < b.begin
+                                          : a.last < b.last;
+              });
+
+    // The chosen segments as (begin, last), which do not overlap.
+    std::set<std::pair<int32_t, int32_t>> chosen;
+    std::vector<Candidate> chosen_candidates;
+    for (const Candidate &c : candidates) {
+      auto it = chosen.upper_bound({c.last, in_.num_ops});
+      if (it != chosen.begin() && std::prev(it)->second >= c.begin)
+        continue;
+      chosen.insert({c.begin, c.last});
+      chosen_candidates.push_back(c);
+    }
+    std::sort(chosen_candidates.begin(), chosen_candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+                return a.begin < b.begin;
+              });
+    for (const Candidate &c : chosen_candidates)
+      segments->push_back(ToSegment(c));
+  }
+
+private:
+  bool IsWhitespace(int32_t symbol) const {
+    return std::binary_search(whitespace_.begin(), whitespace_.end(), symbol);
+  }
+
+  bool IsPunctuation(int32_t symbol) const {
+    return std::binary_search(punctuation_.begin(), punctuation_.end(),
+                              symbol);
+  }
+
+  // Finds the nearest query and reference symbols of each op, and the prefix
+  // sums of the equal ops.
+  void ComputePositions() {
+    int32_t n = in_.num_ops;
+    prev_query_.resize(n);
+    next_query_.resize(n);
+    prev_ref_.resize(n);
+    next_ref_.resize(n);
+    num_equal_.assign(n + 1, 0);
+    for (int32_t i = 0, q = -1, t = -1; i < n; i++) {
+      if (in_.query_positions[i] >= 0)
+        q = in_.query_positions[i];
+      if (in_.target_positions[i] >= 0)
+        t = in_.target_positions[i];
+      prev_query_[i] = q;
+      prev_ref_[i] = t;
+      num_equal_[i + 1] = num_equal_[i] + (in_.ops[i] == AlignmentOp::kEqual);
+    }
+    for (int32_t i = n - 1, q = in_.query_len, t = in_.ref_len; i >= 0; i--) {
+      if (in_.query_positions[i] >= 0)
+        q = in_.query_positions[i];
+      if (in_.target_positions[i] >= 0)
+        t = in_.target_positions[i];
+      next_query_[i] = q;
+      next_ref_[i] = t;
+    }
+  }
+
+  int32_t NumErrors(int32_t begin, int32_t end) const {
+    return (end - begin) - (num_equal_[end] - num_equal_[begin]);
+  }
+
+  // The score of the silence between query symbols q1 and q2 = q1 + 1 (or
+  // the maximum one if either of them doesn't exist).
+  float SilenceScore(int32_t q1, int32_t q2) const {
+    float silence = opts_.max_silence;
+    if (q1 >= 0 && q2 < in_.query_len)
+      silence = std::min(std::max(in_.times[q2] - in_.times[q1], 0.0f),
+                         opts_.max_silence);
+    return opts_.silence_weight * std::log1p(silence / opts_.frame_duration);
+  }
+
+  // The penalty for the errors around the split point before op j.
+  float ErrorDensityPenalty(int32_t j) const {
+    int32_t w = std::max(opts_.error_window, 1),
+            begin = std::max(j - w, 0), end = std::min(j + w, in_.num_ops);
+    return opts_.error_density_weight * NumErrors(begin, end) /
+           static_cast<float>(end - begin);
+  }
+
+  void ComputeScores() {
+    int32_t n = in_.num_ops;
+    const float *times = in_.times;
+    float max_boundary = opts_.max_boundary_silence;
+    begin_scores_.resize(n);
+    end_scores_.resize(n);
+    begin_times_.resize(n);
+    end_times_.resize(n);
+    for (int32_t i = 0; i < n; i++) {
+      // A segment beginning at op i.
+      int32_t q1 = i > 0 ? prev_query_[i - 1] : -1, q2 = next_query_[i];
+      float score = SilenceScore(q1, q2) - ErrorDensityPenalty(i);
+      int32_t t = next_ref_[i];
+      if (t < in_.ref_len) {
+        if (t == 0 || IsWhitespace(in_.ref_text[t - 1]))
+          score += opts_.whitespace_bonus;
+        int32_t k = t - 1;
+        while (k >= 0 && IsWhitespace(in_.ref_text[k]))
+          k--;
+        if (k < 0 || IsPunctuation(in_.ref_text[k]))
+          score += opts_.punctuation_bonus;
+      }
+      begin_scores_[i] = score;
+      float time = times[std::min(q2, in_.query_len - 1)];
+      begin_times_[i] =
+          q1 >= 0 ? std::max(0.5f * (times[q1] + time), time - max_boundary)
+                  : std::max(time - max_boundary, std::min(time, 0.0f));
+
+      // A segment ending at op i.
+      q1 = prev_query_[i];
+      q2 = i + 1 < n ? next_query_[i + 1] : in_.query_len;
+      score = SilenceScore(q1, q2) - ErrorDensityPenalty(i + 1);
+      t = prev_ref_[i];
+      if (t >= 0) {
+        if (t + 1 >= in_.ref_len || IsWhitespace(in_.ref_text[t + 1]))
+          score += opts_.whitespace_bonus;
+        if (IsPunctuation(in_.ref_text[t]))
+          score += opts_.punctuation_bonus;
+      }
+      end_scores_[i] = score;
+      time = times[std::max(q1, 0)];
+      end_times_[i] =
+          q2 < in_.query_len
+              ? std::min(0.5f * (time + times[q2]), time + max_boundary)
+              : time + max_boundary;
+    }
+  }
+
+  // Returns the ops with the best candidate_fraction of the scores.
+  std::vector<int32_t> BestPositions(const std::vector<float> &scores) const {
+    int32_t n = static_cast<int32_t>(scores.size());
+    int32_t k = static_cast<int32_t>(
+        std::ceil(std::min(std::max(opts_.candidate_fraction, 0.0f), 1.0f) *
+                  n));
+    k = std::min(std::max(k, 1), n);
+    std::vector<int32_t> positions(n);
+    std::iota(positions.begin(), positions.end(), 0);
+    std::nth_element(positions.begin(), positions.begin() + (k - 1),
+                     positions.end(), [&scores](int32_t a, int32_t b) {
+                       return scores[a] != scores[b] ? scores[a] > scores[b]
+                                                     : a < b;
+                     });
+    positions.resize(k);
+    return positions;
+  }
+
+  // Returns the score of the segment of ops [begin, last], or -infinity if
+  // its duration is not allowed; `longest_silence` is its longest internal
+  // silence.
+  float SegmentScore(int32_t begin, int32_t last, float longest_silence) const {
+    float duration = end_times_[last] - begin_times_[begin];
+    if (duration < opts_.min_duration || duration > opts_.max_duration)
+      return -std::numeric_limits<float>::infinity();
+    float score = begin_scores_[begin] + end_scores_[last];
+    score -= opts_.duration_weight *
+             (std::max(opts_.preferred_min_duration - duration, 0.0f) +
+              std::max(duration - opts_.preferred_max_duration, 0.0f));
+    score -= opts_.internal_silence_weight *
+             std::max(longest_silence - opts_.max_internal_silence, 0.0f);
+    int32_t num_equal = num_equal_[last + 1] - num_equal_[begin];
+    score += opts_.match_bonus * num_equal -
+             opts_.error_penalty * NumErrors(begin, last + 1);
+    return score;
+  }
+
+  // Adds the best segments that begin at op b to `candidates`.
+  void AddBeginCandidates(int32_t b, std::vector<Candidate> *candidates) const {
+    TopCandidates top(opts_.num_candidates_per_position);
+    float longest_silence = 0;
+    for (int32_t e = b, prev_q = -1; e < in_.num_ops; e++) {
+      if (end_times_[e] - begin_times_[b] > opts_.max_duration)
+        break;
+      int32_t q = in_.query_positions[e];
+      if (q >= 0) {
+        if (prev_q >= 0)
+          longest_silence = std::max(longest_silence,
+                                     in_.times[q] - in_.times[prev_q]);
+        prev_q = q;
+      }
+      float score = SegmentScore(b, e, longest_silence);
+      if (score != -std::numeric_limits<float>::infinity())
+        top.Add({score, b, e});
+    }
+    candidates->insert(candidates->end(), top.Best().begin(),
+                       top.Best().end());
+  }
+
+  // Adds the best segments that end at op e to `candidates`.
+  void AddEndCandidates(int32_t e, std::vector<Candidate> *candidates) const {
+    TopCandidates top(opts_.num_candidates_per_position);
+    float longest_silence = 0;
+    for (int32_t b = e, next_q = -1; b >= 0; b--) {
+      if (end_times_[e] - begin_times_[b] > opts_.max_duration)
+        break;
+      int32_t q = in_.query_positions[b];
+      if (q >= 0) {
+        if (next_q >= 0)
+          longest_silence = std::max(longest_silence,
+                                     in_.times[next_q] - in_.times[q]);
+        next_q = q;
+      }
+      float score = SegmentScore(b, e, longest_silence);
+      if (score != -std::numeric_limits<float>::infinity())
+        top.Add({score, b, e});
+    }
+    candidates->insert(candidates->end(), top.Best().begin(),
+                       top.Best().end());
+  }
+
+  Segment ToSegment(const Candidate &c) const {
+    Segment s;
+    s.begin = c.begin;
+    s.end = c.last + 1;
+    s.query_begin = next_query_[c.begin];
+    s.query_end = std::max(prev_query_[c.last] + 1, s.query_begin);
+    s.ref_begin = next_ref_[c.begin];
+    s.ref_end = std::max(prev_ref_[c.last] + 1, s.ref_begin);
+    s.begin_time = begin_times_[c.begin];
+    s.end_time = end_times_[c.last];
+    s.score = c.score;
+    return s;
+  }
+
+  const SegmenterInput &in_;
+  const SegmenterOptions &opts_;
+  std::vector<int32_t> whitespace_;
+  std::vector<int32_t> punctuation_;
+
+  // The last query (reference) symbol at or before each op, or -1, and the
+  // first one at or after it, or query_len (ref_len).
+  std::vector<int32_t> prev_query_, next_query_, prev_ref_, next_ref_;
+  // num_equal_[i] is the number of kEqual ops before op i.
+  std::vector<int32_t> num_equal_;
+  std::vector<float> begin_scores_, end_scores_, begin_times_, end_times_;
+};
+
+} // namespace
+
+void FindSegments(const SegmenterInput &input, const SegmenterOptions &options,
+                  std::vector<Segment> *segments) {
+  SegmentFinder(input, options).Find(segments);
+}
+
+void FindSegmentsBatch(const std::vector<SegmenterInput> &inputs,
+                       const SegmenterOptions &options,
+                       std::vector<std::vector<Segment>> *segments,
+                       int32_t num_threads) {
+  segments->resize(inputs.size());
+  // Recordings differ a lot in length, so they are taken one by one.
+  ParallelForEach(inputs.size(), num_threads, [&](int32_t, int64_t i) {
+    FindSegments(inputs[i], options, &(*segments)[i]);
+  });
+}
+
+} // namespace fasttextsearch
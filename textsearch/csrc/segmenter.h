@@ -0,0 +1,170 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_SEGMENTER_H_
+#define TEXTSEARCH_CSRC_SEGMENTER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+
+namespace fasttextsearch {
+
+/*
+  The weights and limits of the segmentation of an alignment into segments,
+  see FindSegments().  Times are in seconds.
+ */
+struct SegmenterOptions {
+  // Silences score silence_weight * log(1 + silence / frame_duration), the
+  // silence being at most max_silence; the silence before the first symbol
+  // and after the last one is max_silence.
+  float frame_duration = 0.01f;
+  float max_silence = 4.0f;
+  float silence_weight = 1.0f;
+
+  // The errors (non-equal ops) are counted in the error_window alignment
+  // positions on each side of a split point, and the split is penalized by
+  // error_density_weight times their proportion.
+  int32_t error_window = 8;
+  float error_density_weight = 4.0f;
+
+  // Bonuses for beginning a segment after whitespace or after a punctuation
+  // symbol (the last non-whitespace symbol), and for ending one before
+  // whitespace or on a punctuation symbol, in the reference text.
+  float whitespace_bonus = 2.0f;
+  float punctuation_bonus = 2.0f;
+
+  // The begin (end) time of a segment is the midpoint between its first
+  // (last) query symbol and the previous (next) one, but at most
+  // max_boundary_silence from it.
+  float max_boundary_silence = 1.0f;
+
+  // Segments must last between min_duration and max_duration; they are
+  // penalized by duration_weight per second outside of
+  // [preferred_min_duration, preferred_max_duration].
+  float min_duration = 2.0f;
+  float max_duration = 30.0f;
+  float preferred_min_duration = 5.0f;
+  float preferred_max_duration = 20.0f;
+  float duration_weight = 0.5f;
+
+  // Segments are penalized by internal_silence_weight per second of their
+  // longest internal silence beyond max_internal_silence.
+  float max_internal_silence = 2.0f;
+  float internal_silence_weight = 2.0f;
+
+  // A bonus per equal op and a penalty per error in the segment.
+  float match_bonus = 0.1f;
+  float error_penalty = 0.5f;
+
+  // The search: for each of the best candidate_fraction of the begin
+  // positions, the num_candidates_per_position best segments that begin
+  // there, and likewise for the end positions, are the candidates.
+  float candidate_fraction = 0.1f;
+  int32_t num_candidates_per_position = 4;
+
+  // The whitespace and punctuation symbols of the reference text.
+  std::vector<int32_t> whitespace = {' ', '\t', '\n', '\r', 0x3000};
+  std::vector<int32_t> punctuation = {'.',    ',',    '!',    '?',
+                                      ';',    ':',    0x3001, 0x3002,
+                                      0xFF01, 0xFF0C, 0xFF1F};
+};
+
+/*
+  One alignment of a query (e.g. an automatic transcript of a long
+  recording) with a reference text, as returned by GetAlignment(); the
+  arrays are not owned.
+ */
+struct SegmenterInput {
+  // The edit operations, of size num_ops.
+  const AlignmentOp *ops = nullptr;
+  int32_t num_ops = 0;
+
+  // The query symbol of each op (an index into `times`), -1 for kDelete.
+  const int32_t *query_positions = nullptr;
+
+  // The reference symbol of each op (an index into `ref_text`), -1 for
+  // kInsert.
+  const int32_t *target_positions = nullptr;
+
+  // The time of each query symbol, non-decreasing, of size query_len.
+  const float *times = nullptr;
+  int32_t query_len = 0;
+
+  // The reference text that the query was aligned with.
+  const int32_t *ref_text = nullptr;
+  int32_t ref_len = 0;
+};
+
+// A segment of an alignment; the ranges are [begin, end).
+struct Segment {
+  // The alignment positions, i.e. ops.
+  int32_t begin = 0;
+  int32_t end = 0;
+  // The query symbols, e.g. for the indexes into the Transcript.
+  int32_t query_begin = 0;
+  int32_t query_end = 0;
+  // The reference symbols.
+  int32_t ref_begin = 0;
+  int32_t ref_end = 0;
+  float begin_time = 0;
+  float end_time = 0;
+  float score = 0;
+};
+
+/*
+  Splits an alignment into segments, following the plan in README.txt: each
+  alignment position gets a score as the beginning and as the end of a
+  segment (from the silence before/after it, the density of errors around it
+  and the whitespace and punctuation of the reference text), and the score of
+  a segment adds those of its ends and terms for its duration, longest
+  internal silence and numbers of matches and errors.  The candidate segments
+  of the best begin and end positions (see SegmenterOptions) are then chosen
+  greedily, best first, excluding those that overlap chosen ones.
+
+  The per-position terms are computed with prefix sums in linear time, and
+  each candidate is found with a scan over at most max_duration of the
+  alignment that updates the segment terms incrementally.
+
+    @param [in] input  The alignment.
+    @param [in] options  The options.
+    @param [out] segments  At exit, the chosen segments, in order.
+ */
+void FindSegments(const SegmenterInput &input, const SegmenterOptions &options,
+                  std::vector<Segment> *segments);
+
+/*
+  Calls FindSegments() for each of `inputs`, e.g. for many recordings; the
+  inputs are processed in parallel.
+
+    @param [in] inputs  The alignments.
+    @param [in] options  The options.
+    @param [out] segments  At exit, (*segments)[i] is the output of
+             FindSegments() for inputs[i].
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+ */
+void FindSegmentsBatch(const std::vector<SegmenterInput> &inputs,
+                       const SegmenterOptions &options,
+                       std::vector<std::vector<Segment>> *segments,
+                       int32_t num_threads = 1);
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_SEGMENTER_H_
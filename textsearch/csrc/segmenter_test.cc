@@ -0,0 +1,180 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/segmenter.h"
+
+namespace fasttextsearch {
+
+// A recording of sentences read at 0.06 seconds per symbol, with a pause
+// after each sentence (the space after it has the time of the next word),
+// exactly aligned with its reference text.
+struct Recording {
+  std::vector<int32_t> text;
+  std::vector<float> times;
+  std::vector<AlignmentOp> ops;
+  std::vector<int32_t> positions;
+
+  Recording(int32_t num_sentences, std::mt19937 *rng) {
+    float time = 0;
+    for (int32_t s = 0; s < num_sentences; s++) {
+      if (s > 0) {
+        time += 0.8f + (*rng)() % 10 * 0.05f;
+        Add(' ', &time);
+      }
+      int32_t num_words = 8 + (*rng)() % 8;
+      for (int32_t w = 0; w < num_words; w++) {
+        if (w > 0)
+          Add(' ', &time);
+        int32_t num_letters = 2 + (*rng)() % 6;
+        for (int32_t l = 0; l < num_letters; l++)
+          Add((w == 0 && l == 0 ? 'A' : 'a') + (*rng)() % 26, &time);
+      }
+      Add('.', &time);
+    }
+    ops.assign(text.size(), AlignmentOp::kEqual);
+    for (int32_t i = 0; i < static_cast<int32_t>(text.size()); i++)
+      positions.push_back(i);
+  }
+
+  void Add(int32_t symbol, float *time) {
+    text.push_back(symbol);
+    times.push_back(*time);
+    *time += 0.06f;
+  }
+
+  SegmenterInput Input() const {
+    SegmenterInput input;
+    input.ops = ops.data();
+    input.num_ops = ops.size();
+    input.query_positions = positions.data();
+    input.target_positions = positions.data();
+    input.times = times.data();
+    input.query_len = times.size();
+    input.ref_text = text.data();
+    input.ref_len = text.size();
+    return input;
+  }
+};
+
+TEST(SegmenterTest, TestSentences) {
+  std::mt19937 rng(0);
+  Recording recording(40, &rng);
+  SegmenterOptions options;
+  std::vector<Segment> segments;
+  FindSegments(recording.Input(), options, &segments);
+  ASSERT_FALSE(segments.empty());
+
+  int32_t covered = 0;
+  for (size_t k = 0; k < segments.size(); k++) {
+    const Segment &s = segments[k];
+    if (k > 0) {
+      EXPECT_GE(s.begin, segments[k - 1].end);
+    }
+    float duration = s.end_time - s.begin_time;
+    EXPECT_GE(duration, options.min_duration);
+    EXPECT_LE(duration, options.max_duration);
+    // The alignment is exact, so all the positions are the same.
+    EXPECT_EQ(s.query_begin, s.begin);
+    EXPECT_EQ(s.ref_end, s.end);
+    // Whole sentences, maybe with the space before them.
+    int32_t begin = s.ref_begin;
+    if (recording.text[begin] == ' ')
+      begin++;
+    EXPECT_TRUE(recording.text[begin] >= 'A' && recording.text[begin] <= 'Z')
+        << begin;
+    EXPECT_EQ(recording.text[s.ref_end - 1], '.');
+    covered += s.end - s.begin;
+  }
+  // Most of the recording is in segments.
+  EXPECT_GT(covered, recording.ops.size() * 0.8);
+}
+
+TEST(SegmenterTest, TestErrors) {
+  std::mt19937 rng(1);
+  Recording recording(40, &rng);
+  // Symbols of the reference that are missing from the query, around
+  // position 1000, and a silence that is too long for a segment.
+  int32_t n = recording.ops.size();
+  std::vector<int32_t> query_positions, target_positions;
+  std::vector<AlignmentOp> ops;
+  std::vector<float> times;
+  for (int32_t i = 0; i < n; i++) {
+    if (i >= 1000 && i < 1040) {
+      ops.push_back(AlignmentOp::kDelete);
+      query_positions.push_back(-1);
+    } else {
+      ops.push_back(AlignmentOp::kEqual);
+      query_positions.push_back(times.size());
+      times.push_back(recording.times[i] + (i >= 2000 ? 40.0f : 0.0f));
+    }
+    target_positions.push_back(i);
+  }
+  SegmenterInput input = recording.Input();
+  input.ops = ops.data();
+  input.query_positions = query_positions.data();
+  input.target_positions = target_positions.data();
+  input.times = times.data();
+  input.query_len = times.size();
+
+  SegmenterOptions options;
+  options.error_penalty = 2.0f;
+  std::vector<Segment> segments;
+  FindSegments(input, options, &segments);
+  ASSERT_FALSE(segments.empty());
+  for (const Segment &s : segments) {
+    EXPECT_FALSE(s.begin < 2000 && s.end > 2000);
+    EXPECT_LE(s.end_time - s.begin_time, options.max_duration);
+    EXPECT_FALSE(s.begin <= 1000 && s.end >= 1040);
+  }
+
+  // No segments without a query.
+  input.query_len = 0;
+  FindSegments(input, options, &segments);
+  EXPECT_TRUE(segments.empty());
+}
+
+TEST(SegmenterTest, TestBatch) {
+  std::mt19937 rng(2);
+  std::vector<Recording> recordings;
+  for (int32_t i = 0; i < 10; i++)
+    recordings.emplace_back(1 + rng() % 50, &rng);
+  std::vector<SegmenterInput> inputs;
+  for (const Recording &r : recordings)
+    inputs.push_back(r.Input());
+  SegmenterOptions options;
+  std::vector<std::vector<Segment>> segments;
+  FindSegmentsBatch(inputs, options, &segments, 3);
+  ASSERT_EQ(segments.size(), inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    std::vector<Segment> expected;
+    FindSegments(inputs[i], options, &expected);
+    ASSERT_EQ(segments[i].size(), expected.size());
+    for (size_t k = 0; k < expected.size(); k++) {
+      EXPECT_EQ(segments[i][k].begin, expected[k].begin);
+      EXPECT_EQ(segments[i][k].end, expected[k].end);
+      EXPECT_EQ(segments[i][k].score, expected[k].score);
+    }
+  }
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,524 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_SMITH_WATERMAN_H_
+#define TEXTSEARCH_CSRC_SMITH_WATERMAN_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+/*
+ * Which parts of the sequences SmithWatermanScore() and SmithWatermanAlign()
+ * align.
+ */
+enum class SmithWatermanMode {
+  // All of the query with a segment of the target: the target symbols before
+  // and after it are free, as in the infix search of LevenshteinDistance().
+  kSemiGlobal,
+  // The best scoring pair of segments of the query and the target
+  // (Smith-Waterman); the score is never negative.
+  kLocal,
+};
+
+/*
+ * The scores of an alignment, which is maximized: each aligned pair of
+ * symbols scores match_score or mismatch_score, and each gap (a run of
+ * consecutive insertions or deletions) of length k scores
+ * gap_open + k * gap_extend, so that a long deletion (e.g. a skipped
+ * passage of the reference) is not much worse than a short one.
+ */
+struct SmithWatermanOptions {
+  int32_t match_score = 2;     // Must be > 0.
+  int32_t mismatch_score = -2; // Must be <= match_score.
+  int32_t gap_open = -3;       // Must be <= 0.
+  int32_t gap_extend = -1;     // Must be < 0.
+  SmithWatermanMode mode = SmithWatermanMode::kSemiGlobal;
+};
+
+/*
+ * An alignment found by SmithWatermanAlign(): query[query_begin, query_end)
+ * aligned with target[target_begin, target_end).
+ */
+struct SmithWatermanAlignment {
+  int32_t score = 0;
+  int64_t query_begin = 0;
+  int64_t query_end = 0;
+  int64_t target_begin = 0;
+  int64_t target_end = 0;
+  // The operations, in the '0'/'1' backtrace of LevenshteinDistance(), with
+  // position = target_end - 1 and cost = score; GetAlignment(query +
+  // query_begin, target, element, ...) decodes them (its query positions are
+  // then relative to query_begin).
+  LevenshteinElement element;
+};
+
+// The score of the spans skipped by SmithWatermanBatch().
+constexpr int32_t kSmithWatermanNoScore = std::numeric_limits<int32_t>::min();
+
+namespace internal {
+
+// Below any score, and far enough from overflowing when added to.
+constexpr int32_t kSmithWatermanMinusInf =
+    std::numeric_limits<int32_t>::min() / 2;
+
+inline void CheckSmithWatermanOptions(const SmithWatermanOptions &options) {
+  assert(options.match_score > 0);
+  assert(options.mismatch_score <= options.match_score);
+  assert(options.gap_open <= 0);
+  assert(options.gap_extend < 0);
+  (void)options;
+}
+
+/*
+ * The score-only dp of Gotoh's algorithm, with the column of the best
+ * scores, and that of the best scores ending with a deletion, of the
+ * current target symbol: O(query_length) memory and no backtraces.  If
+ * kReverse, both sequences are read backwards, i.e. the alignments are of
+ * suffixes.
+ *
+ * If free_start, the alignments may start at any target position (and, in
+ * kLocal mode, at any query position, with the scores floored at 0); else
+ * they start at the first symbols of both.  In kSemiGlobal mode they end at
+ * the last query symbol, in kLocal mode anywhere.
+ *
+ * Returns the best score and sets *query_end, *target_end to the numbers of
+ * query and target symbols up to the first end with it, in the order of the
+ * target symbols then of the query symbols.  If stop_score is not
+ * kSmithWatermanMinusInf, returns at the first end whose score is
+ * stop_score instead.
+ */
+template <bool kReverse, typename T>
+int32_t SmithWatermanPass(const T *query, size_t query_length,
+                          const T *target, size_t target_length,
+                          const SmithWatermanOptions &options, bool free_start,
+                          int32_t stop_score, int64_t *query_end,
+                          int64_t *target_end) {
+  auto q = [&](size_t i) {
+    return kReverse ? query[query_length - 1 - i] : query[i];
+  };
+  auto t = [&](size_t j) {
+    return kReverse ? target[target_length - 1 - j] : target[j];
+  };
+  bool local = options.mode == SmithWatermanMode::kLocal;
+  bool floor = local && free_start;
+  int32_t open = options.gap_open + options.gap_extend;
+  int32_t extend = options.gap_extend;
+
+  // h[i] is the best score of the alignments up to query symbol i and the
+  // current target symbol, e[i] that of those ending with a deletion.
+  std::vector<int32_t> h(query_length + 1), e(query_length + 1);
+  h[0] = 0;
+  for (size_t i = 1; i <= query_length; i++) {
+    h[i] = floor ? 0 : options.gap_open + static_cast<int32_t>(i) * extend;
+    e[i] = kSmithWatermanMinusInf;
+  }
+
+  int32_t best = local && free_start ? 0 : kSmithWatermanMinusInf;
+  *query_end = 0;
+  *target_end = 0;
+  // Returns true if (i, j) has stop_score.
+  auto update = [&](size_t i, size_t j, int32_t score) {
+    if (stop_score != kSmithWatermanMinusInf ? score == stop_score
+                                             : score > best) {
+      best = score;
+      *query_end = static_cast<int64_t>(i);
+      *target_end = static_cast<int64_t>(j);
+      return stop_score != kSmithWatermanMinusInf;
+    }
+    return false;
+  };
+
+  bool stopped = false;
+  for (size_t i = local ? 0 : query_length; i <= query_length && !stopped;
+       i++)
+    stopped = update(i, 0, h[i]);
+  size_t j = 1;
+  for (; j <= target_length && !stopped; j++) {
+    const T &symbol = t(j - 1);
+    int32_t diag = h[0];
+    h[0] = free_start ? 0 : options.gap_open + static_cast<int32_t>(j) * extend;
+    stopped = local && update(0, j, h[0]);
+    int32_t f = kSmithWatermanMinusInf; // ending with an insertion
+    for (size_t i = 1; i <= query_length && !stopped; i++) {
+      int32_t ei = std::max(h[i] + open, e[i] + extend);
+      f = std::max(h[i - 1] + open, f + extend);
+      int32_t score =
+          diag + (q(i - 1) == symbol ? options.match_score
+                                     : options.mismatch_score);
+      score = std::max({score, ei, f});
+      if (floor)
+        score = std::max(score, 0);
+      diag = h[i];
+      h[i] = score;
+      e[i] = ei;
+      stopped = local && update(i, j, score);
+    }
+    if (!local && !stopped)
+      stopped = update(query_length, j, h[query_length]);
+  }
+  FTS_STATS_DP_CELLS(Stage::kSmithWaterman,
+                     static_cast<int64_t>(query_length) * (j - 1));
+  return best;
+}
+
+/*
+ * Append to `ops` the operations of a best global alignment of `query` with
+ * `target` with affine gaps, using a matrix of one byte of directions per
+ * cell, and return its score; only for the winning region of the target, as
+ * its memory is query_length * target_length bytes.
+ *
+ * A deletion is never directly followed by an insertion (an insertion run
+ * before the deletion run scores the same), since their '0' and '1' in a
+ * backtrace would read as an aligned pair.
+ */
+template <typename T>
+int32_t SmithWatermanGlobalAlign(const T *query, size_t query_length,
+                                 const T *target, size_t target_length,
+                                 const SmithWatermanOptions &options,
+                                 std::vector<AlignmentOp> *ops) {
+  // The bits of the directions of a cell: where its best score comes from
+  // (kFromDiag, kFromDeletion or kFromInsertion), whether its best score
+  // without deletions comes from an insertion, and whether the best
+  // deletion and insertion extend one.
+  constexpr uint8_t kFromDiag = 0, kFromDeletion = 1, kFromInsertion = 2;
+  constexpr uint8_t kFromMask = 3, kNoDeletionFromInsertion = 4,
+                    kDeletionExtends = 8, kInsertionExtends = 16;
+
+  size_t num_cols = target_length + 1;
+  std::vector<uint8_t> directions((query_length + 1) * num_cols);
+  FTS_STATS_SCRATCH(Stage::kSmithWaterman, directions.size());
+  FTS_STATS_DP_CELLS(Stage::kSmithWaterman,
+                     static_cast<int64_t>(query_length) * target_length);
+  int32_t open = options.gap_open + options.gap_extend;
+  int32_t extend = options.gap_extend;
+
+  // The rows of the previous query symbol: the best scores (h), those
+  // without a deletion at the end (hn) and those with an insertion (f).
+  std::vector<int32_t> h(num_cols), hn(num_cols), f(num_cols);
+  h[0] = hn[0] = 0;
+  f[0] = kSmithWatermanMinusInf;
+  for (size_t j = 1; j <= target_length; j++) {
+    h[j] = options.gap_open + static_cast<int32_t>(j) * extend;
+    hn[j] = f[j] = kSmithWatermanMinusInf;
+    directions[j] = kFromDeletion | (j > 1 ? kDeletionExtends : 0);
+  }
+  for (size_t i = 1; i <= query_length; i++) {
+    uint8_t *row = directions.data() + i * num_cols;
+    int32_t diag = h[0];
+    f[0] = h[0] = hn[0] = options.gap_open + static_cast<int32_t>(i) * extend;
+    row[0] = kFromInsertion | kNoDeletionFromInsertion |
+             (i > 1 ? kInsertionExtends : 0);
+    int32_t e = kSmithWatermanMinusInf; // ending with a deletion
+    for (size_t j = 1; j <= target_length; j++) {
+      uint8_t dir = 0;
+      // h[j - 1] is already of this row.
+      if (e + extend > h[j - 1] + open) {
+        e += extend;
+        dir |= kDeletionExtends;
+      } else {
+        e = h[j - 1] + open;
+      }
+      if (f[j] + extend > hn[j] + open) {
+        f[j] += extend;
+        dir |= kInsertionExtends;
+      } else {
+        f[j] = hn[j] + open;
+      }
+      int32_t score =
+          diag + (query[i - 1] == target[j - 1] ? options.match_score
+                                                : options.mismatch_score);
+      if (f[j] > score) {
+        score = f[j];
+        dir |= kNoDeletionFromInsertion | kFromInsertion;
+      } else {
+        dir |= kFromDiag;
+      }
+      diag = h[j];
+      hn[j] = score;
+      if (e > score) {
+        score = e;
+        dir = (dir & ~kFromMask) | kFromDeletion;
+      }
+      h[j] = score;
+      row[j] = dir;
+    }
+  }
+  int32_t score = h[target_length];
+
+  // The state of the traceback: in the best scores, in those without a
+  // deletion at the end, in a deletion or in an insertion.
+  enum class State { kBest, kNoDeletion, kDeletion, kInsertion };
+  State state = State::kBest;
+  size_t begin = ops->size();
+  size_t i = query_length, j = target_length;
+  while (i > 0 || j > 0) {
+    uint8_t dir = directions[i * num_cols + j];
+    if (state == State::kBest || state == State::kNoDeletion) {
+      uint8_t from = state == State::kBest ? (dir & kFromMask)
+                     : (dir & kNoDeletionFromInsertion) ? kFromInsertion
+                                                        : kFromDiag;
+      if (from == kFromDiag) {
+        assert(i > 0 && j > 0);
+        ops->push_back(query[i - 1] == target[j - 1] ? AlignmentOp::kEqual
+                                                     : AlignmentOp::kReplace);
+        i--, j--;
+        state = State::kBest;
+      } else {
+        state = from == kFromDeletion ? State::kDeletion : State::kInsertion;
+      }
+    } else if (state == State::kDeletion) {
+      assert(j > 0);
+      ops->push_back(AlignmentOp::kDelete);
+      j--;
+      state = (dir & kDeletionExtends) ? State::kDeletion : State::kBest;
+    } else {
+      assert(i > 0);
+      ops->push_back(AlignmentOp::kInsert);
+      i--;
+      state = (dir & kInsertionExtends) ? State::kInsertion
+                                        : State::kNoDeletion;
+    }
+  }
+  std::reverse(ops->begin() + begin, ops->end());
+  return score;
+}
+
+} // namespace internal
+
+/*
+ * Calculate the best score of aligning `query` with `target` with affine
+ * gap penalties (Gotoh's algorithm), without backtraces: O(query_length)
+ * memory, for scoring many candidate regions cheaply (see
+ * SmithWatermanBatch()) before aligning only the best one with
+ * SmithWatermanAlign().
+ *
+ * @param [in] query The pointer to the query sequence.
+ * @param [in] query_length The length of the query sequence.
+ * @param [in] target The pointer to the target sequence.
+ * @param [in] target_length The length of the target sequence.
+ * @param [in] options  The scores and the mode.
+ * @param [out] query_end  If not nullptr, at exit the end (one past the last
+ *                         aligned symbol) in the query of the first best
+ *                         alignment, i.e. query_length in kSemiGlobal mode.
+ * @param [out] target_end  If not nullptr, at exit its end in the target.
+ *                          The first best alignment is the one with the
+ *                          smallest target_end, then query_end.  In kLocal
+ *                          mode, both are 0 if the score is 0.
+ *
+ * @return The best score.
+ */
+template <typename T>
+int32_t SmithWatermanScore(const T *query, size_t query_length,
+                           const T *target, size_t target_length,
+                           const SmithWatermanOptions &options,
+                           int64_t *query_end = nullptr,
+                           int64_t *target_end = nullptr) {
+  FTS_STATS_SCOPE(Stage::kSmithWaterman);
+  internal::CheckSmithWatermanOptions(options);
+  int64_t qend, tend;
+  int32_t score = internal::SmithWatermanPass<false>(
+      query, query_length, target, target_length, options,
+      /*free_start*/ true, internal::kSmithWatermanMinusInf, &qend, &tend);
+  if (query_end != nullptr)
+    *query_end = qend;
+  if (target_end != nullptr)
+    *target_end = tend;
+  return score;
+}
+
+/*
+ * Find the first best alignment of SmithWatermanScore() and its operations.
+ * After the score-only pass finds its end, a second one over the reversed
+ * sequences from that end finds its start (within the distance that the
+ * score allows), and only the rectangle between them is aligned with
+ * backtraces.
+ *
+ * @param [in] query, query_length, target, target_length, options  As for
+ *                   SmithWatermanScore().
+ * @param [out] alignment  At exit, the alignment.  In kLocal mode, if the
+ *                   score is 0 it is empty, with its begins and ends 0.
+ * @param [in] arena  The arena for the backtrace of alignment->element.
+ *
+ * @return The score of the alignment.
+ */
+template <typename T>
+int32_t SmithWatermanAlign(const T *query, size_t query_length,
+                           const T *target, size_t target_length,
+                           const SmithWatermanOptions &options,
+                           SmithWatermanAlignment *alignment,
+                           BacktraceArena *arena) {
+  FTS_STATS_SCOPE(Stage::kSmithWaterman);
+  internal::CheckSmithWatermanOptions(options);
+  int64_t query_end, target_end;
+  int32_t score = internal::SmithWatermanPass<false>(
+      query, query_length, target, target_length, options,
+      /*free_start*/ true, internal::kSmithWatermanMinusInf, &query_end,
+      &target_end);
+
+  int64_t query_begin = query_end, target_begin = target_end;
+  if (options.mode == SmithWatermanMode::kSemiGlobal || score > 0) {
+    // With k deleted symbols the score is at most
+    // query_end * match_score + gap_open + k * gap_extend.
+    int64_t max_deletions = std::max<int64_t>(
+        0, (query_end * options.match_score + options.gap_open - score) /
+               -options.gap_extend);
+    int64_t window = std::min(target_end, query_end + max_deletions);
+    int64_t num_query, num_target;
+    int32_t found = internal::SmithWatermanPass<true>(
+        query, static_cast<size_t>(query_end),
+        target + target_end - window, static_cast<size_t>(window), options,
+        /*free_start*/ false, score, &num_query, &num_target);
+    assert(found == score);
+    (void)found;
+    query_begin = query_end - num_query;
+    target_begin = target_end - num_target;
+  }
+
+  std::vector<AlignmentOp> ops;
+  int32_t aligned_score = internal::SmithWatermanGlobalAlign(
+      query + query_begin, static_cast<size_t>(query_end - query_begin),
+      target + target_begin, static_cast<size_t>(target_end - target_begin),
+      options, &ops);
+  assert(aligned_score == score);
+  (void)aligned_score;
+
+  LevenshteinElement element(0);
+  for (AlignmentOp op : ops) {
+    if (op == AlignmentOp::kEqual)
+      element = element.Equal(arena);
+    else if (op == AlignmentOp::kReplace)
+      element = element.Replace(0, arena);
+    else if (op == AlignmentOp::kInsert)
+      element = element.Insert(0, arena);
+    else
+      element = element.Delete(0, arena);
+  }
+  element.cost = score;
+  element.position = target_end - 1;
+
+  alignment->score = score;
+  alignment->query_begin = query_begin;
+  alignment->query_end = query_end;
+  alignment->target_begin = target_begin;
+  alignment->target_end = target_end;
+  alignment->element = element;
+  return score;
+}
+
+/*
+ * Calculate the scores of SmithWatermanScore() between one query and each
+ * of many segments ("spans") of a reference sequence, e.g. the candidate
+ * regions found by FindCandidateMatches(), in parallel as
+ * LevenshteinDistanceBatch() does.  No backtraces are computed; see
+ * SmithWatermanBatchBestAlignment() for the alignment with the best span.
+ *
+ * @param [in] query, query_length, reference, reference_length, spans,
+ *             num_spans  As for LevenshteinDistanceBatch().
+ * @param [in] options  The scores and the mode.
+ * @param [out] scores  An array of num_spans elements; at exit scores[i] is
+ *                      the score for span i, or kSmithWatermanNoScore if it
+ *                      was skipped.
+ * @param [out] end_positions  An array of num_spans elements; at exit
+ *                             end_positions[i] is the position of the last
+ *                             target symbol of the first best alignment
+ *                             with span i, as an index into `reference`, or
+ *                             -1 if it was skipped or has no target symbol.
+ * @param [in] num_threads  The number of threads to use; <= 0 means to use all
+ *                          hardware threads.
+ */
+template <typename T>
+void SmithWatermanBatch(const T *query, size_t query_length,
+                        const T *reference, size_t reference_length,
+                        const int64_t *spans, int64_t num_spans,
+                        const SmithWatermanOptions &options, int32_t *scores,
+                        int64_t *end_positions, int32_t num_threads = 1) {
+  int32_t num_workers = static_cast<int32_t>(
+      std::max<int64_t>(std::min<int64_t>(GetNumThreads(num_threads),
+                                          num_spans),
+                        1));
+  ParallelForEach(num_spans, num_workers, [&](int32_t, int64_t i) {
+    int64_t begin = spans[2 * i], end = spans[2 * i + 1];
+    scores[i] = kSmithWatermanNoScore;
+    end_positions[i] = -1;
+    if (begin < 0)
+      return;
+    assert(begin < end && end <= static_cast<int64_t>(reference_length));
+    (void)reference_length;
+    int64_t target_end;
+    scores[i] = SmithWatermanScore(query, query_length, reference + begin,
+                                   static_cast<size_t>(end - begin), options,
+                                   nullptr, &target_end);
+    if (target_end > 0)
+      end_positions[i] = begin + target_end - 1;
+  });
+}
+
+/*
+ * Align the query with the best span of a SmithWatermanBatch(), i.e. the
+ * first one with the largest score, without computing the backtraces of the
+ * others.
+ *
+ * @param [in] query, query_length, reference, spans, num_spans, options  As
+ *                   given to SmithWatermanBatch().
+ * @param [in] scores  As returned by SmithWatermanBatch().
+ * @param [out] alignment  At exit, if the return value is not -1, the
+ *                   alignment with the best span, with its target positions
+ *                   indexes into `reference`.
+ * @param [in] arena  The arena for the backtrace of alignment->element.
+ *
+ * @return The index of the best span, or -1 if all the spans were skipped.
+ */
+template <typename T>
+int64_t SmithWatermanBatchBestAlignment(const T *query, size_t query_length,
+                                        const T *reference,
+                                        const int64_t *spans, int64_t num_spans,
+                                        const SmithWatermanOptions &options,
+                                        const int32_t *scores,
+                                        SmithWatermanAlignment *alignment,
+                                        BacktraceArena *arena) {
+  int64_t best = -1;
+  for (int64_t i = 0; i < num_spans; i++) {
+    if (scores[i] != kSmithWatermanNoScore &&
+        (best == -1 || scores[i] > scores[best]))
+      best = i;
+  }
+  if (best == -1)
+    return -1;
+  int64_t begin = spans[2 * best], end = spans[2 * best + 1];
+  SmithWatermanAlign(query, query_length, reference + begin,
+                     static_cast<size_t>(end - begin), options, alignment,
+                     arena);
+  assert(alignment->score == scores[best]);
+  alignment->target_begin += begin;
+  alignment->target_end += begin;
+  alignment->element.position += begin;
+  return best;
+}
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_SMITH_WATERMAN_H_
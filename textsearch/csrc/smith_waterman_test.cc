@@ -0,0 +1,286 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/smith_waterman.h"
+
+namespace fasttextsearch {
+
+// The best score with the three full matrices of Gotoh's algorithm.
+static int32_t ReferenceScore(const std::vector<int32_t> &query,
+                              const std::vector<int32_t> &target,
+                              const SmithWatermanOptions &options) {
+  const int32_t kMinusInf = -(1 << 28);
+  bool local = options.mode == SmithWatermanMode::kLocal;
+  size_t m = query.size(), n = target.size();
+  std::vector<std::vector<int32_t>> h(m + 1, std::vector<int32_t>(n + 1)),
+      e = h, f = h;
+  int32_t open = options.gap_open + options.gap_extend;
+  int32_t best = local ? 0 : kMinusInf;
+  for (size_t i = 0; i <= m; i++) {
+    for (size_t j = 0; j <= n; j++) {
+      e[i][j] = f[i][j] = kMinusInf;
+      if (i == 0) {
+        h[i][j] = 0;
+      } else if (j == 0) {
+        h[i][j] =
+            local ? 0 : options.gap_open + int32_t(i) * options.gap_extend;
+      } else {
+        e[i][j] =
+            std::max(h[i][j - 1] + open, e[i][j - 1] + options.gap_extend);
+        f[i][j] =
+            std::max(h[i - 1][j] + open, f[i - 1][j] + options.gap_extend);
+        h[i][j] = std::max(
+            {h[i - 1][j - 1] + (query[i - 1] == target[j - 1]
+                                    ? options.match_score
+                                    : options.mismatch_score),
+             e[i][j], f[i][j]});
+        if (local)
+          h[i][j] = std::max(h[i][j], 0);
+      }
+      if (local || i == m)
+        best = std::max(best, h[i][j]);
+    }
+  }
+  return best;
+}
+
+// Checks that the element of `alignment` decodes to an alignment of
+// query[query_begin, query_end) with target[target_begin, target_end) that
+// has its score.
+static void CheckAlignment(const std::vector<int32_t> &query,
+                           const std::vector<int32_t> &target,
+                           const SmithWatermanAlignment &alignment,
+                           const BacktraceArena &arena,
+                           const SmithWatermanOptions &options) {
+  std::vector<AlignmentOp> ops;
+  std::vector<int32_t> query_positions, target_positions;
+  GetAlignment(query.data() + alignment.query_begin, target.data(),
+               alignment.element, arena, &ops, &query_positions,
+               &target_positions);
+  EXPECT_EQ(alignment.element.position, alignment.target_end - 1);
+  int64_t q = alignment.query_begin, t = alignment.target_begin;
+  int32_t score = 0;
+  for (size_t k = 0; k < ops.size(); k++) {
+    if (ops[k] == AlignmentOp::kInsert || ops[k] == AlignmentOp::kDelete) {
+      if (k == 0 || ops[k - 1] != ops[k])
+        score += options.gap_open;
+      score += options.gap_extend;
+    }
+    if (ops[k] == AlignmentOp::kEqual)
+      score += options.match_score;
+    if (ops[k] == AlignmentOp::kReplace)
+      score += options.mismatch_score;
+    if (ops[k] != AlignmentOp::kDelete) {
+      EXPECT_EQ(alignment.query_begin + query_positions[k], q++);
+    }
+    if (ops[k] != AlignmentOp::kInsert) {
+      EXPECT_EQ(target_positions[k], t++);
+    }
+  }
+  EXPECT_EQ(q, alignment.query_end);
+  EXPECT_EQ(t, alignment.target_end);
+  EXPECT_EQ(score, alignment.score);
+}
+
+TEST(SmithWaterman, TestBasic) {
+  std::vector<int32_t> query = {1, 2, 3, 4};
+  std::vector<int32_t> target = {5, 1, 2, 6, 3, 4, 7};
+  SmithWatermanOptions options;
+  BacktraceArena arena;
+  SmithWatermanAlignment alignment;
+  // 1 2 - 3 4 against 1 2 6 3 4: 4 matches and a deletion.
+  int32_t score = SmithWatermanAlign(query.data(), query.size(),
+                                     target.data(), target.size(), options,
+                                     &alignment, &arena);
+  EXPECT_EQ(score, 4 * 2 - 3 - 1);
+  EXPECT_EQ(alignment.query_begin, 0);
+  EXPECT_EQ(alignment.query_end, 4);
+  EXPECT_EQ(alignment.target_begin, 1);
+  EXPECT_EQ(alignment.target_end, 6);
+  EXPECT_EQ(alignment.element.backtrace.ToString(arena), "010100101");
+  CheckAlignment(query, target, alignment, arena, options);
+
+  // A local alignment of 1 2 alone scores the same as the whole query.
+  options.mode = SmithWatermanMode::kLocal;
+  options.gap_open = -10;
+  score = SmithWatermanAlign(query.data(), query.size(), target.data(),
+                             target.size(), options, &alignment, &arena);
+  EXPECT_EQ(score, 4);
+  EXPECT_EQ(alignment.query_begin, 0);
+  EXPECT_EQ(alignment.query_end, 2);
+  EXPECT_EQ(alignment.target_begin, 1);
+  EXPECT_EQ(alignment.target_end, 3);
+  CheckAlignment(query, target, alignment, arena, options);
+
+  // Nothing in common.
+  std::vector<int32_t> other = {8, 9};
+  score = SmithWatermanAlign(other.data(), other.size(), target.data(),
+                             target.size(), options, &alignment, &arena);
+  EXPECT_EQ(score, 0);
+  EXPECT_EQ(alignment.query_end, 0);
+  EXPECT_EQ(alignment.target_end, 0);
+  EXPECT_EQ(alignment.element.backtrace.ToString(arena), "");
+}
+
+TEST(SmithWaterman, TestLongDeletion) {
+  std::mt19937 rng(1357);
+  std::vector<int32_t> target(1000);
+  for (auto &s : target)
+    s = rng() % 50;
+  // A query that skips target[300, 500), e.g. a passage the speaker left out.
+  std::vector<int32_t> query(target.begin() + 100, target.begin() + 300);
+  query.insert(query.end(), target.begin() + 500, target.begin() + 700);
+
+  SmithWatermanOptions options;
+  BacktraceArena arena;
+  SmithWatermanAlignment alignment;
+  int32_t score = SmithWatermanAlign(query.data(), query.size(),
+                                     target.data(), target.size(), options,
+                                     &alignment, &arena);
+  EXPECT_EQ(score, 400 * 2 - 3 - 200);
+  EXPECT_EQ(alignment.target_begin, 100);
+  EXPECT_EQ(alignment.target_end, 700);
+  CheckAlignment(query, target, alignment, arena, options);
+
+  std::vector<AlignmentOp> ops;
+  GetAlignment(query.data(), target.data(), alignment.element, arena, &ops);
+  EXPECT_EQ(std::count(ops.begin(), ops.end(), AlignmentOp::kEqual), 400);
+  EXPECT_EQ(std::count(ops.begin(), ops.end(), AlignmentOp::kDelete), 200);
+}
+
+TEST(SmithWaterman, TestRandom) {
+  std::mt19937 rng(2468);
+  for (int32_t iter = 0; iter < 400; iter++) {
+    // Small alphabets, so that there are many equally good alignments.
+    int32_t num_symbols = 2 + rng() % 4;
+    std::vector<int32_t> query(rng() % 20), target(rng() % 30);
+    for (auto &s : query)
+      s = rng() % num_symbols;
+    for (auto &s : target)
+      s = rng() % num_symbols;
+    SmithWatermanOptions options;
+    options.match_score = 1 + rng() % 3;
+    options.mismatch_score = -static_cast<int32_t>(rng() % 4);
+    options.gap_open = -static_cast<int32_t>(rng() % 5);
+    options.gap_extend = -1 - static_cast<int32_t>(rng() % 2);
+    options.mode = rng() % 2 ? SmithWatermanMode::kLocal
+                             : SmithWatermanMode::kSemiGlobal;
+
+    int32_t expected = ReferenceScore(query, target, options);
+    int64_t query_end, target_end;
+    EXPECT_EQ(SmithWatermanScore(query.data(), query.size(), target.data(),
+                                 target.size(), options, &query_end,
+                                 &target_end),
+              expected);
+    if (options.mode == SmithWatermanMode::kSemiGlobal) {
+      EXPECT_EQ(query_end, static_cast<int64_t>(query.size()));
+    }
+
+    BacktraceArena arena;
+    SmithWatermanAlignment alignment;
+    EXPECT_EQ(SmithWatermanAlign(query.data(), query.size(), target.data(),
+                                 target.size(), options, &alignment, &arena),
+              expected);
+    EXPECT_EQ(alignment.query_end, query_end);
+    EXPECT_EQ(alignment.target_end, target_end);
+    if (options.mode == SmithWatermanMode::kSemiGlobal) {
+      EXPECT_EQ(alignment.query_begin, 0);
+    }
+    CheckAlignment(query, target, alignment, arena, options);
+  }
+}
+
+TEST(SmithWaterman, TestBatch) {
+  std::mt19937 rng(3579);
+  std::vector<int32_t> reference(2000);
+  for (auto &s : reference)
+    s = rng() % 30;
+  std::vector<int32_t> query(reference.begin() + 1200,
+                             reference.begin() + 1300);
+  query.erase(query.begin() + 40, query.begin() + 45);
+  query[70] = 31;
+
+  std::vector<int64_t> spans;
+  for (int32_t i = 0; i < 30; i++) {
+    int64_t begin = rng() % 1800;
+    spans.push_back(begin);
+    spans.push_back(begin + 1 + rng() % 200);
+  }
+  spans.push_back(-1);
+  spans.push_back(-1);
+  spans.push_back(1150);
+  spans.push_back(1350);
+  int64_t num_spans = spans.size() / 2;
+
+  for (auto mode :
+       {SmithWatermanMode::kSemiGlobal, SmithWatermanMode::kLocal}) {
+    SmithWatermanOptions options;
+    options.mode = mode;
+    std::vector<int32_t> scores(num_spans);
+    std::vector<int64_t> end_positions(num_spans);
+    SmithWatermanBatch(query.data(), query.size(), reference.data(),
+                       reference.size(), spans.data(), num_spans, options,
+                       scores.data(), end_positions.data(), 4);
+    EXPECT_EQ(scores[num_spans - 2], kSmithWatermanNoScore);
+    EXPECT_EQ(end_positions[num_spans - 2], -1);
+    for (int64_t i = 0; i < num_spans; i++) {
+      int64_t begin = spans[2 * i], end = spans[2 * i + 1];
+      if (begin < 0)
+        continue;
+      int64_t target_end;
+      int32_t score = SmithWatermanScore(query.data(), query.size(),
+                                         reference.data() + begin, end - begin,
+                                         options, nullptr, &target_end);
+      EXPECT_EQ(scores[i], score);
+      EXPECT_EQ(end_positions[i], target_end > 0 ? begin + target_end - 1 : -1);
+    }
+
+    BacktraceArena arena;
+    SmithWatermanAlignment alignment;
+    int64_t best = SmithWatermanBatchBestAlignment(
+        query.data(), query.size(), reference.data(), spans.data(), num_spans,
+        options, scores.data(), &alignment, &arena);
+    // The first span with the largest score.
+    ASSERT_EQ(best, std::max_element(scores.begin(), scores.end()) -
+                        scores.begin());
+    EXPECT_EQ(alignment.score, scores[best]);
+    EXPECT_EQ(alignment.target_end - 1, end_positions[best]);
+    CheckAlignment(query, reference, alignment, arena, options);
+    if (mode == SmithWatermanMode::kSemiGlobal) {
+      EXPECT_EQ(alignment.target_begin, 1200);
+      EXPECT_EQ(alignment.target_end, 1300);
+      EXPECT_EQ(alignment.score, 94 * 2 - 2 - 3 - 5);
+    }
+  }
+
+  SmithWatermanAlignment alignment;
+  BacktraceArena arena;
+  EXPECT_EQ(SmithWatermanBatchBestAlignment(
+                query.data(), query.size(), reference.data(),
+                spans.data() + 2 * (num_spans - 2), 1, SmithWatermanOptions(),
+                &kSmithWatermanNoScore, &alignment, &arena),
+            -1);
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,164 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/sourced_text.h"
+
+#include <algorithm>
+
+#include "textsearch/csrc/parallel.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// Texts are split into chunks of at least this many symbols for the threads.
+constexpr int64_t kMinChunkSize = 1 << 16;
+
+template <typename SymbolT>
+void AppendEos(SymbolT eos, SymbolT *text_end) {
+  text_end[0] = eos;
+  text_end[1] = 0;
+  text_end[2] = 0;
+  text_end[3] = 0;
+}
+
+/*
+  Writes the row_splits of the documents `doc[0:size]` to doc_splits, see
+  ConcatenateTexts().  Returns false if `doc` decreases somewhere or has
+  elements >= num_docs.
+ */
+bool WriteDocSplits(const uint32_t *doc, int64_t size, int64_t num_docs,
+                    int64_t *doc_splits, int32_t num_threads) {
+  int32_t num_chunks = NumChunks(size, num_threads, kMinChunkSize);
+  std::vector<char> ok(num_chunks, 1);
+  // Each split is written by the symbol where the document ids reach it.
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    int64_t prev = begin == 0 ? -1 : static_cast<int64_t>(doc[begin - 1]);
+    for (int64_t i = begin; i < end; i++) {
+      int64_t d = doc[i];
+      if (d < prev || d >= num_docs) {
+        ok[c] = 0;
+        return;
+      }
+      for (int64_t k = prev + 1; k <= d; k++)
+        doc_splits[k] = i;
+      prev = d;
+    }
+  });
+  if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+    return false;
+  int64_t last = size == 0 ? -1 : static_cast<int64_t>(doc[size - 1]);
+  for (int64_t k = last + 1; k <= num_docs; k++)
+    doc_splits[k] = size;
+  return true;
+}
+
+} // namespace
+
+template <typename SymbolT>
+bool ConcatenateTexts(const std::vector<TextPiece<SymbolT>> &pieces,
+                      SymbolT eos, bool add_eos, int64_t num_docs,
+                      SymbolT *text, uint32_t *pos, uint32_t *doc,
+                      int64_t *doc_splits, int32_t num_threads) {
+  int32_t num_pieces = static_cast<int32_t>(pieces.size());
+  // The position of each piece in the output.
+  std::vector<int64_t> offsets(num_pieces + 1, 0);
+  for (int32_t p = 0; p < num_pieces; p++)
+    offsets[p + 1] = offsets[p] + pieces[p].size;
+  int64_t total_size = offsets.back();
+
+  int32_t num_chunks = NumChunks(total_size, num_threads, kMinChunkSize);
+  ParallelFor(total_size, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    // The last piece that starts at or before `begin`.
+    int32_t p = static_cast<int32_t>(
+        std::upper_bound(offsets.begin(), offsets.end(), begin) -
+        offsets.begin() - 1);
+    for (int64_t i = begin; i < end; p++) {
+      const TextPiece<SymbolT> &piece = pieces[p];
+      int64_t piece_begin = i - offsets[p],
+              piece_end = std::min(end, offsets[p + 1]) - offsets[p];
+      std::copy(piece.text + piece_begin, piece.text + piece_end, text + i);
+      if (piece.pos != nullptr) {
+        std::copy(piece.pos + piece_begin, piece.pos + piece_end, pos + i);
+      } else {
+        for (int64_t j = piece_begin; j < piece_end; j++)
+          pos[i + j - piece_begin] = static_cast<uint32_t>(j);
+      }
+      if (piece.doc != nullptr)
+        std::copy(piece.doc + piece_begin, piece.doc + piece_end, doc + i);
+      else
+        std::fill(doc + i, doc + i + (piece_end - piece_begin), piece.doc_id);
+      i += piece_end - piece_begin;
+    }
+  });
+  if (add_eos)
+    AppendEos(eos, text + total_size);
+  return WriteDocSplits(doc, total_size, num_docs, doc_splits, num_threads);
+}
+
+template <typename SymbolT>
+int64_t RemoveFromText(const SymbolT *text, const uint32_t *pos,
+                       const uint32_t *doc, int64_t size, const bool *keep,
+                       SymbolT eos, bool add_eos, int64_t num_docs,
+                       SymbolT *text_out, uint32_t *pos_out, uint32_t *doc_out,
+                       int64_t *doc_splits, int32_t num_threads) {
+  int32_t num_chunks = NumChunks(size, num_threads, kMinChunkSize);
+  // The output position of each chunk.
+  std::vector<int64_t> offsets(num_chunks + 1, 0);
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    offsets[c + 1] = std::count(keep + begin, keep + end, true);
+  });
+  for (int32_t c = 0; c < num_chunks; c++)
+    offsets[c + 1] += offsets[c];
+
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    int64_t o = offsets[c];
+    for (int64_t i = begin; i < end; i++) {
+      if (!keep[i])
+        continue;
+      text_out[o] = text[i];
+      pos_out[o] = pos[i];
+      doc_out[o] = doc[i];
+      o++;
+    }
+  });
+  int64_t num_kept = offsets.back();
+  if (add_eos)
+    AppendEos(eos, text_out + num_kept);
+  if (!WriteDocSplits(doc_out, num_kept, num_docs, doc_splits, num_threads))
+    return -1;
+  return num_kept;
+}
+
+#define FTS_INSTANTIATE_SOURCED_TEXT(SymbolT)                                  \
+  template bool ConcatenateTexts(                                              \
+      const std::vector<TextPiece<SymbolT>> &pieces, SymbolT eos,              \
+      bool add_eos, int64_t num_docs, SymbolT *text, uint32_t *pos,            \
+      uint32_t *doc, int64_t *doc_splits, int32_t num_threads);                \
+  template int64_t RemoveFromText(                                             \
+      const SymbolT *text, const uint32_t *pos, const uint32_t *doc,           \
+      int64_t size, const bool *keep, SymbolT eos, bool add_eos,               \
+      int64_t num_docs, SymbolT *text_out, uint32_t *pos_out,                  \
+      uint32_t *doc_out, int64_t *doc_splits, int32_t num_threads);
+
+FTS_INSTANTIATE_SOURCED_TEXT(uint8_t)
+FTS_INSTANTIATE_SOURCED_TEXT(uint16_t)
+FTS_INSTANTIATE_SOURCED_TEXT(int32_t)
+#undef FTS_INSTANTIATE_SOURCED_TEXT
+
+} // namespace fasttextsearch
@@ -0,0 +1,119 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_SOURCED_TEXT_H_
+#define TEXTSEARCH_CSRC_SOURCED_TEXT_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  A piece of text to concatenate with ConcatenateTexts(), e.g. a text source
+  or a SourcedText; the arrays are not owned.
+ */
+template <typename SymbolT> struct TextPiece {
+  const SymbolT *text = nullptr;
+  int64_t size = 0;
+
+  // The position of each symbol in its source, or nullptr for
+  // 0, 1, ..., size - 1.
+  const uint32_t *pos = nullptr;
+
+  // The document of each symbol, or nullptr if they are all in document
+  // `doc_id`.
+  const uint32_t *doc = nullptr;
+  uint32_t doc_id = 0;
+};
+
+/*
+  Concatenates `pieces` into preallocated arrays: the text, the position and
+  the document of each symbol and the row_splits of the documents (as for a
+  SourcedText), and optionally appends the termination symbol and 3 zeros, so
+  that `text` is ready for CreateSuffixArray().  The output is split into
+  ranges of symbols that are written in parallel, so each array is written
+  once whatever the sizes of the pieces.
+
+  Template args: SymbolT is uint8_t, uint16_t or int32_t.
+
+    @param [in] pieces  The pieces of text; their document ids must be
+             non-decreasing over the concatenation, and less than num_docs.
+    @param [in] eos  If add_eos, the termination symbol to append.
+    @param [in] add_eos  True to append eos and 3 zeros to `text`.
+    @param [in] num_docs  The number of documents.
+    @param [out] text  An array of size total_size (the sum of the sizes of
+             the pieces), plus 4 if add_eos.
+    @param [out] pos  An array of size total_size.
+    @param [out] doc  An array of size total_size.
+    @param [out] doc_splits  An array of size num_docs + 1; at exit
+             doc_splits[d] is the position of the first symbol of document d
+             (for an empty document, that of the next document), and
+             doc_splits[num_docs] == total_size.
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+
+    @return  False if the document ids decrease somewhere or are not less
+             than num_docs, in which case doc_splits is not valid.
+ */
+template <typename SymbolT>
+bool ConcatenateTexts(const std::vector<TextPiece<SymbolT>> &pieces,
+                      SymbolT eos, bool add_eos, int64_t num_docs,
+                      SymbolT *text, uint32_t *pos, uint32_t *doc,
+                      int64_t *doc_splits, int32_t num_threads = 1);
+
+/*
+  Removes the symbols of a text for which keep[i] is false, from the text
+  and from the positions and documents of its symbols (as for a SourcedText),
+  writing the documents' new row_splits.  The kept symbols are counted in
+  parallel chunks, then written in the same chunks.
+
+  Template args: SymbolT is uint8_t, uint16_t or int32_t.
+
+    @param [in] text  The text, of size `size`.
+    @param [in] pos  The position of each symbol, of size `size`.
+    @param [in] doc  The document of each symbol, of size `size`; must be
+             non-decreasing and less than num_docs.
+    @param [in] size  The size of the text.
+    @param [in] keep  An array of size `size`, true for the symbols to keep.
+    @param [in] eos  If add_eos, the termination symbol to append.
+    @param [in] add_eos  True to append eos and 3 zeros to `text_out`.
+    @param [in] num_docs  The number of documents.
+    @param [out] text_out  An array of size num_kept (the number of true
+             elements of `keep`), plus 4 if add_eos.
+    @param [out] pos_out  An array of size num_kept.
+    @param [out] doc_out  An array of size num_kept.
+    @param [out] doc_splits  An array of size num_docs + 1, as for
+             ConcatenateTexts().
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+
+    @return  The number of symbols kept, or -1 if the document ids of the
+             kept symbols decrease somewhere or are not less than num_docs,
+             in which case doc_splits is not valid.
+ */
+template <typename SymbolT>
+int64_t RemoveFromText(const SymbolT *text, const uint32_t *pos,
+                       const uint32_t *doc, int64_t size, const bool *keep,
+                       SymbolT eos, bool add_eos, int64_t num_docs,
+                       SymbolT *text_out, uint32_t *pos_out, uint32_t *doc_out,
+                       int64_t *doc_splits, int32_t num_threads = 1);
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_SOURCED_TEXT_H_
@@ -0,0 +1,166 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/sourced_text.h"
+
+namespace fasttextsearch {
+
+TEST(SourcedTextTest, TestConcatenate) {
+  std::vector<uint8_t> a = {'a', 'b', 'c'}, b = {'d', 'e'};
+  std::vector<uint32_t> b_pos = {7, 9}, b_doc = {2, 4};
+  std::vector<TextPiece<uint8_t>> pieces(4);
+  pieces[0].text = a.data();
+  pieces[0].size = a.size();
+  pieces[0].doc_id = 1;
+  // pieces[1] is empty.
+  pieces[1].doc_id = 1;
+  pieces[2].text = b.data();
+  pieces[2].size = b.size();
+  pieces[2].pos = b_pos.data();
+  pieces[2].doc = b_doc.data();
+  pieces[3].text = a.data() + 1;
+  pieces[3].size = 2;
+  pieces[3].doc_id = 4;
+
+  int64_t num_docs = 6;
+  std::vector<uint8_t> text(7 + 4);
+  std::vector<uint32_t> pos(7), doc(7);
+  std::vector<int64_t> doc_splits(num_docs + 1);
+  EXPECT_TRUE(ConcatenateTexts<uint8_t>(pieces, '$', true, num_docs,
+                                        text.data(), pos.data(), doc.data(),
+                                        doc_splits.data()));
+  EXPECT_EQ(text, (std::vector<uint8_t>{'a', 'b', 'c', 'd', 'e', 'b', 'c', '$',
+                                        0, 0, 0}));
+  EXPECT_EQ(pos, (std::vector<uint32_t>{0, 1, 2, 7, 9, 0, 1}));
+  EXPECT_EQ(doc, (std::vector<uint32_t>{1, 1, 1, 2, 4, 4, 4}));
+  EXPECT_EQ(doc_splits, (std::vector<int64_t>{0, 0, 3, 4, 4, 7, 7}));
+
+  // The document ids must not decrease, and must be less than num_docs.
+  pieces[3].doc_id = 3;
+  EXPECT_FALSE(ConcatenateTexts<uint8_t>(pieces, '$', false, num_docs,
+                                         text.data(), pos.data(), doc.data(),
+                                         doc_splits.data()));
+  pieces[3].doc_id = 6;
+  EXPECT_FALSE(ConcatenateTexts<uint8_t>(pieces, '$', false, num_docs,
+                                         text.data(), pos.data(), doc.data(),
+                                         doc_splits.data()));
+
+  // No pieces at all.
+  pieces.clear();
+  EXPECT_TRUE(ConcatenateTexts<uint8_t>(pieces, '$', true, 2, text.data(),
+                                        pos.data(), doc.data(),
+                                        doc_splits.data()));
+  EXPECT_EQ(text[0], '$');
+  EXPECT_EQ(doc_splits[0], 0);
+  EXPECT_EQ(doc_splits[1], 0);
+  EXPECT_EQ(doc_splits[2], 0);
+}
+
+TEST(SourcedTextTest, TestRandom) {
+  std::mt19937 rng(0);
+  for (int32_t num_pieces : {1, 5, 100}) {
+    int64_t num_docs = 2 * num_pieces + 3;
+    std::vector<std::vector<int32_t>> texts(num_pieces);
+    std::vector<std::vector<uint32_t>> docs(num_pieces);
+    std::vector<TextPiece<int32_t>> pieces(num_pieces);
+    std::vector<int32_t> expected_text;
+    std::vector<uint32_t> expected_pos, expected_doc;
+    uint32_t doc_id = 0;
+    for (int32_t p = 0; p < num_pieces; p++) {
+      int32_t size = rng() % 3 == 0 ? 0 : rng() % 200000;
+      for (int32_t i = 0; i < size; i++)
+        texts[p].push_back(rng() % 1000);
+      pieces[p].text = texts[p].data();
+      pieces[p].size = size;
+      doc_id += rng() % 2;
+      if (p % 2 == 0) {
+        pieces[p].doc_id = doc_id;
+        docs[p].assign(size, doc_id);
+      } else {
+        // A piece that spans two documents, e.g. a SourcedText.
+        for (int32_t i = 0; i < size; i++)
+          docs[p].push_back(doc_id + (i >= size / 2));
+        doc_id++;
+        pieces[p].doc = docs[p].data();
+      }
+      expected_text.insert(expected_text.end(), texts[p].begin(),
+                           texts[p].end());
+      expected_doc.insert(expected_doc.end(), docs[p].begin(), docs[p].end());
+      for (int32_t i = 0; i < size; i++)
+        expected_pos.push_back(i);
+    }
+    int64_t total_size = expected_text.size();
+    std::vector<int64_t> expected_splits(num_docs + 1, total_size);
+    for (int64_t i = total_size - 1; i >= 0; i--)
+      for (int64_t d = expected_doc[i]; d >= 0 && expected_splits[d] > i; d--)
+        expected_splits[d] = i;
+
+    for (int32_t num_threads : {1, 4}) {
+      std::vector<int32_t> text(total_size);
+      std::vector<uint32_t> pos(total_size), doc(total_size);
+      std::vector<int64_t> doc_splits(num_docs + 1);
+      EXPECT_TRUE(ConcatenateTexts<int32_t>(pieces, 0, false, num_docs,
+                                            text.data(), pos.data(),
+                                            doc.data(), doc_splits.data(),
+                                            num_threads));
+      EXPECT_EQ(text, expected_text);
+      EXPECT_EQ(pos, expected_pos);
+      EXPECT_EQ(doc, expected_doc);
+      EXPECT_EQ(doc_splits, expected_splits);
+
+      // Keep about half of the symbols.
+      std::vector<char> keep(total_size);
+      std::vector<int32_t> kept_text;
+      std::vector<uint32_t> kept_pos, kept_doc;
+      for (int64_t i = 0; i < total_size; i++) {
+        keep[i] = rng() % 2;
+        if (keep[i]) {
+          kept_text.push_back(text[i]);
+          kept_pos.push_back(pos[i]);
+          kept_doc.push_back(doc[i]);
+        }
+      }
+      int64_t num_kept = kept_text.size();
+      std::vector<int32_t> text_out(num_kept + 4);
+      std::vector<uint32_t> pos_out(num_kept), doc_out(num_kept);
+      EXPECT_EQ(RemoveFromText<int32_t>(
+                    text.data(), pos.data(), doc.data(), total_size,
+                    reinterpret_cast<const bool *>(keep.data()), -1, true,
+                    num_docs, text_out.data(), pos_out.data(), doc_out.data(),
+                    doc_splits.data(), num_threads),
+                num_kept);
+      EXPECT_EQ(text_out[num_kept], -1);
+      text_out.resize(num_kept);
+      EXPECT_EQ(text_out, kept_text);
+      EXPECT_EQ(pos_out, kept_pos);
+      EXPECT_EQ(doc_out, kept_doc);
+      for (int64_t d = 0; d <= num_docs; d++) {
+        int64_t split = doc_splits[d];
+        EXPECT_TRUE(split == num_kept || kept_doc[split] >= d);
+        EXPECT_TRUE(split == 0 || kept_doc[split - 1] < d);
+      }
+    }
+  }
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,166 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/stats.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace fasttextsearch {
+
+namespace {
+
+constexpr int32_t kNumStages = static_cast<int32_t>(Stage::kNumStages);
+
+// The counters of one stage, on their own cache lines so that the stages
+// don't slow each other down.
+struct alignas(64) StageCounters {
+  std::atomic<int64_t> calls{0};
+  std::atomic<int64_t> wall_ns{0};
+  std::atomic<int64_t> bytes_allocated{0};
+  std::atomic<int64_t> peak_scratch_bytes{0};
+  std::atomic<int64_t> dp_cells{0};
+  std::atomic<int64_t> max_depth{0};
+  std::atomic<int64_t> wall_ns_by_depth[kMaxStatsDepth];
+
+  StageCounters() {
+    for (auto &t : wall_ns_by_depth)
+      t = 0;
+  }
+};
+
+StageCounters g_counters[kNumStages];
+
+// The StatsScope depth and the live scratch bytes of each stage in this
+// thread.
+thread_local int32_t t_depth[kNumStages] = {};
+thread_local int64_t t_scratch_bytes[kNumStages] = {};
+
+StageCounters &Counters(Stage stage) {
+  return g_counters[static_cast<int32_t>(stage)];
+}
+
+void UpdateMax(std::atomic<int64_t> *x, int64_t value) {
+  int64_t cur = x->load(std::memory_order_relaxed);
+  while (cur < value &&
+         !x->compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace
+
+const char *StageName(Stage stage) {
+  switch (stage) {
+  case Stage::kUtf8:
+    return "utf8";
+  case Stage::kSuffixArray:
+    return "suffix_array";
+  case Stage::kLcpArray:
+    return "lcp_array";
+  case Stage::kCloseMatches:
+    return "close_matches";
+  case Stage::kCandidateMatches:
+    return "candidate_matches";
+  case Stage::kLevenshtein:
+    return "levenshtein";
+  case Stage::kSmithWaterman:
+    return "smith_waterman";
+  default:
+    return "unknown";
+  }
+}
+
+bool StatsEnabled() {
+#ifdef FTS_ENABLE_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+StageStats GetStats(Stage stage) {
+  const StageCounters &c = Counters(stage);
+  StageStats stats;
+  stats.calls = c.calls.load(std::memory_order_relaxed);
+  stats.wall_ns = c.wall_ns.load(std::memory_order_relaxed);
+  stats.bytes_allocated = c.bytes_allocated.load(std::memory_order_relaxed);
+  stats.peak_scratch_bytes =
+      c.peak_scratch_bytes.load(std::memory_order_relaxed);
+  stats.dp_cells = c.dp_cells.load(std::memory_order_relaxed);
+  stats.max_depth =
+      static_cast<int32_t>(c.max_depth.load(std::memory_order_relaxed));
+  for (const auto &t : c.wall_ns_by_depth)
+    stats.wall_ns_by_depth.push_back(t.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void ResetStats() {
+  for (StageCounters &c : g_counters) {
+    c.calls = 0;
+    c.wall_ns = 0;
+    c.bytes_allocated = 0;
+    c.peak_scratch_bytes = 0;
+    c.dp_cells = 0;
+    c.max_depth = 0;
+    for (auto &t : c.wall_ns_by_depth)
+      t = 0;
+  }
+}
+
+namespace internal {
+
+StatsScope::StatsScope(Stage stage)
+    : stage_(stage), depth_(t_depth[static_cast<int32_t>(stage)]++),
+      start_(std::chrono::steady_clock::now()) {}
+
+StatsScope::~StatsScope() {
+  int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start_)
+                   .count();
+  StageCounters &c = Counters(stage_);
+  t_depth[static_cast<int32_t>(stage_)]--;
+  c.wall_ns_by_depth[std::min(depth_, kMaxStatsDepth - 1)].fetch_add(
+      ns, std::memory_order_relaxed);
+  if (depth_ == 0) {
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    c.wall_ns.fetch_add(ns, std::memory_order_relaxed);
+  } else {
+    UpdateMax(&c.max_depth, depth_);
+  }
+}
+
+StatsScratch::StatsScratch(Stage stage, int64_t num_bytes)
+    : stage_(stage), num_bytes_(num_bytes) {
+  StageCounters &c = Counters(stage);
+  int64_t &live = t_scratch_bytes[static_cast<int32_t>(stage)];
+  live += num_bytes;
+  c.bytes_allocated.fetch_add(num_bytes, std::memory_order_relaxed);
+  UpdateMax(&c.peak_scratch_bytes, live);
+}
+
+StatsScratch::~StatsScratch() {
+  t_scratch_bytes[static_cast<int32_t>(stage_)] -= num_bytes_;
+}
+
+void AddDpCells(Stage stage, int64_t num_cells) {
+  Counters(stage).dp_cells.fetch_add(num_cells, std::memory_order_relaxed);
+}
+
+} // namespace internal
+
+} // namespace fasttextsearch
@@ -0,0 +1,149 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_STATS_H_
+#define TEXTSEARCH_CSRC_STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  The instrumented stages of the core, for capacity planning: each keeps
+  process-wide counters of its calls, wall time, scratch memory and work,
+  which GetStats() returns.  The instrumentation is compiled in if
+  FTS_ENABLE_STATS is defined (the CMake option of the same name, ON by
+  default); otherwise the FTS_STATS_* macros expand to nothing and the
+  counters stay 0.
+ */
+enum class Stage : int32_t {
+  kUtf8 = 0,         // ValidateUtf8(), DecodeUtf8()
+  kSuffixArray,      // CreateSuffixArray()
+  kLcpArray,         // CreateLcpArray()
+  kCloseMatches,     // FindCloseMatches*()
+  kCandidateMatches, // FindCandidateMatches*()
+  kLevenshtein,      // LevenshteinDistance() and its engines
+  kSmithWaterman,    // SmithWatermanScore(), SmithWatermanAlign()
+  kNumStages
+};
+
+// The recursion depths whose wall time is kept separately; deeper levels
+// are added to the last one.
+constexpr int32_t kMaxStatsDepth = 8;
+
+struct StageStats {
+  // The number of calls, and their total wall time in nanoseconds;
+  // recursive calls (depth > 0) are not counted, as their time is part of
+  // that of their caller.
+  int64_t calls = 0;
+  int64_t wall_ns = 0;
+
+  // The total size of the scratch buffers the calls allocated, and the
+  // largest size of those that were live at the same time in one call.
+  int64_t bytes_allocated = 0;
+  int64_t peak_scratch_bytes = 0;
+
+  // The number of dynamic programming cells evaluated (for kLevenshtein and
+  // kSmithWaterman).
+  int64_t dp_cells = 0;
+
+  // The deepest recursion seen (0 if there was none), and the total wall
+  // time of the calls at each depth, of size kMaxStatsDepth.  For
+  // kSuffixArray, depth 0 is the whole call (including the compaction of
+  // the alphabet) and depth d >= 1 is level d of the recursion of the
+  // algorithm, 1 being the input text.
+  int32_t max_depth = 0;
+  std::vector<int64_t> wall_ns_by_depth;
+};
+
+// Returns e.g. "suffix_array" for Stage::kSuffixArray.
+const char *StageName(Stage stage);
+
+// True if the instrumentation is compiled in.
+bool StatsEnabled();
+
+// Returns the counters of `stage` since the start or the last ResetStats().
+StageStats GetStats(Stage stage);
+
+// Sets all counters to 0; must not be called while a stage is running.
+void ResetStats();
+
+namespace internal {
+
+/*
+  Times a call of `stage` from construction to destruction.  The depth of
+  the recursion is the number of enclosing StatsScopes of the same stage in
+  this thread.
+ */
+class StatsScope {
+ public:
+  explicit StatsScope(Stage stage);
+  ~StatsScope();
+  StatsScope(const StatsScope &) = delete;
+  StatsScope &operator=(const StatsScope &) = delete;
+
+ private:
+  Stage stage_;
+  int32_t depth_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/*
+  Accounts for a scratch buffer of `num_bytes` of `stage` that lives from
+  construction to destruction, e.g. next to a std::vector with the same
+  lifetime.
+ */
+class StatsScratch {
+ public:
+  StatsScratch(Stage stage, int64_t num_bytes);
+  ~StatsScratch();
+  StatsScratch(const StatsScratch &) = delete;
+  StatsScratch &operator=(const StatsScratch &) = delete;
+
+ private:
+  Stage stage_;
+  int64_t num_bytes_;
+};
+
+void AddDpCells(Stage stage, int64_t num_cells);
+
+} // namespace internal
+
+} // namespace fasttextsearch
+
+#define FTS_STATS_CONCAT_(a, b) a##b
+#define FTS_STATS_CONCAT(a, b) FTS_STATS_CONCAT_(a, b)
+
+#ifdef FTS_ENABLE_STATS
+#define FTS_STATS_SCOPE(stage)                                                 \
+  ::fasttextsearch::internal::StatsScope FTS_STATS_CONCAT(                     \
+      fts_stats_scope_, __LINE__)(stage)
+#define FTS_STATS_SCRATCH(stage, num_bytes)                                    \
+  ::fasttextsearch::internal::StatsScratch FTS_STATS_CONCAT(                   \
+      fts_stats_scratch_, __LINE__)(stage, num_bytes)
+#define FTS_STATS_DP_CELLS(stage, num_cells)                                   \
+  ::fasttextsearch::internal::AddDpCells(stage, num_cells)
+#else
+#define FTS_STATS_SCOPE(stage)
+#define FTS_STATS_SCRATCH(stage, num_bytes)
+#define FTS_STATS_DP_CELLS(stage, num_cells)
+#endif
+
+#endif // TEXTSEARCH_CSRC_STATS_H_
@@ -0,0 +1,114 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/stats.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+TEST(StatsTest, TestSuffixArray) {
+  if (!StatsEnabled())
+    GTEST_SKIP() << "FTS_ENABLE_STATS is not defined";
+  ResetStats();
+  std::mt19937 rng(0);
+  int32_t seq_len = 10000;
+  std::vector<int32_t> text(seq_len + 3, 0);
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text[i] = 1 + rng() % 3;
+  text[seq_len - 1] = 4;
+  std::vector<int32_t> suffix_array(seq_len);
+  for (auto algorithm :
+       {SuffixArrayAlgorithm::kDc3, SuffixArrayAlgorithm::kSais}) {
+    CreateSuffixArray(text.data(), seq_len, 4, suffix_array.data(),
+                      algorithm);
+  }
+  StageStats stats = GetStats(Stage::kSuffixArray);
+  EXPECT_EQ(stats.calls, 2);
+  EXPECT_GT(stats.wall_ns, 0);
+  // Both algorithms recurse on a text with 3 symbols.
+  EXPECT_GE(stats.max_depth, 2);
+  EXPECT_EQ(stats.wall_ns_by_depth.size(), kMaxStatsDepth);
+  EXPECT_EQ(stats.wall_ns_by_depth[0], stats.wall_ns);
+  EXPECT_GT(stats.wall_ns_by_depth[1], 0);
+  EXPECT_LE(stats.wall_ns_by_depth[1], stats.wall_ns);
+  // DC3 allocates at least 4 arrays of about seq_len / 3 at the top level.
+  EXPECT_GE(stats.peak_scratch_bytes, 4 * (seq_len / 3) * 4);
+  EXPECT_GE(stats.bytes_allocated, stats.peak_scratch_bytes);
+  EXPECT_EQ(GetStats(Stage::kLcpArray).calls, 0);
+
+  ResetStats();
+  stats = GetStats(Stage::kSuffixArray);
+  EXPECT_EQ(stats.calls, 0);
+  EXPECT_EQ(stats.peak_scratch_bytes, 0);
+  EXPECT_EQ(stats.max_depth, 0);
+}
+
+TEST(StatsTest, TestLevenshtein) {
+  if (!StatsEnabled())
+    GTEST_SKIP() << "FTS_ENABLE_STATS is not defined";
+  ResetStats();
+  std::vector<int32_t> query = {1, 2, 3, 4}, target = {5, 1, 2, 4, 6, 7};
+  BacktraceArena arena;
+  std::vector<LevenshteinElement> alignments;
+  for (auto engine :
+       {LevenshteinEngine::kScalar, LevenshteinEngine::kBitParallel,
+        LevenshteinEngine::kSimd}) {
+    EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                  target.size(), &alignments, &arena, 1, 1, 1,
+                                  engine),
+              1);
+  }
+  StageStats stats = GetStats(Stage::kLevenshtein);
+  EXPECT_EQ(stats.calls, 3);
+  // The other engines evaluate the whole matrix; the scalar one skips the
+  // cells above the best cost found so far.
+  EXPECT_GT(stats.dp_cells, 2 * 4 * 6);
+  EXPECT_LT(stats.dp_cells, 3 * 4 * 6);
+  EXPECT_EQ(stats.max_depth, 0);
+  EXPECT_STREQ(StageName(Stage::kLevenshtein), "levenshtein");
+}
+
+TEST(StatsTest, TestLevenshteinBitParallelCutoff) {
+  if (!StatsEnabled())
+    GTEST_SKIP() << "FTS_ENABLE_STATS is not defined";
+  ResetStats();
+  std::vector<int32_t> query(640), target(1000);
+  for (size_t i = 0; i < query.size(); i++)
+    query[i] = static_cast<int32_t>(i);
+  for (size_t j = 0; j < target.size(); j++)
+    target[j] = static_cast<int32_t>(j) + 10000;
+  std::copy(query.begin(), query.end(), target.begin() + 200);
+  EXPECT_EQ(LevenshteinDistance(query.data(), query.size(), target.data(),
+                                target.size(), nullptr, nullptr, 1, 1, 1,
+                                LevenshteinEngine::kBitParallel, 3),
+            0);
+  // Only the blocks of rows that can be within max_distance are evaluated.
+  StageStats stats = GetStats(Stage::kLevenshtein);
+  EXPECT_GT(stats.dp_cells, 0);
+  EXPECT_LT(stats.dp_cells, static_cast<int64_t>(query.size()) *
+                                target.size() / 2);
+}
+
+} // namespace fasttextsearch
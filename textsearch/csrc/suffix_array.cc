@@ -18,6 +18,10 @@
  */
 
 #include "textsearch/csrc/suffix_array.h"
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <vector>
 
@@ -37,9 +41,10 @@ template <typename T> inline bool Leq(T a1, T a2, T a3, T b1, T b2, T b3) {
   i.e. the values in a are interpreted as indexes into the array
   `r` and the values in `r` are used for comparison, so that
   at exit, r[b[i]] <= r[b[i+1]].
+  S is the symbol type (the type of the keys), T is the index type.
 */
-template <typename T>
-static void RadixPass(const T *a, T *b, const T *r, T n, T K) {
+template <typename S, typename T>
+static void RadixPass(const T *a, T *b, const S *r, T n, T K) {
   std::vector<T> c(K + 1, 0); // counter array
   for (T i = 0; i < n; i++)
     c[r[a[i]]]++;                       // count occurrences
@@ -52,10 +57,109 @@ static void RadixPass(const T *a, T *b, const T *r, T n, T K) {
     b[c[r[a[i]]]++] = a[i]; // sort
 }
 
-// See documentation in suffix_array.h, where we use different names
-// for the arguments (here, we leave the names the same as in
+// Problems smaller than this many elements per thread are not split
+// across threads in the DC3 code.
+static constexpr int64_t kMinChunkSize = 1 << 16;
+
+// Number of bits per digit in ParallelRadixPass(); it bounds the size of the
+// per-thread counter arrays.
+static constexpr int32_t kRadixBits = 16;
+
+/*
+  Multi-threaded version of RadixPass(), with the same interface and
+  result.  Each thread counts the keys of its own contiguous chunk of `a`
+  and then scatters that chunk, which keeps the sort stable.  If K is
+  large, the keys are sorted by digits of kRadixBits bits (least significant
+  first) so the counter arrays stay small.
+*/
+template <typename S, typename T>
+static void ParallelRadixPass(const T *a, T *b, const S *r, T n, T K,
+                              int32_t num_threads) {
+  int32_t num_chunks = NumChunks(n, num_threads, kMinChunkSize);
+  if (num_chunks <= 1) {
+    RadixPass(a, b, r, n, K);
+    return;
+  }
+  int32_t num_bits = 1;
+  while (num_bits < 63 && (static_cast<uint64_t>(K) >> num_bits) != 0)
+    num_bits++;
+  int32_t num_passes = (num_bits + kRadixBits - 1) / kRadixBits;
+  // with a single pass the digit is the key itself.
+  int64_t num_buckets =
+      num_passes == 1 ? static_cast<int64_t>(K) + 1
+                      : (static_cast<int64_t>(1) << kRadixBits);
+  uint64_t mask = num_passes == 1
+                      ? ~static_cast<uint64_t>(0)
+                      : (static_cast<uint64_t>(1) << kRadixBits) - 1;
+
+  std::vector<T> tmp(num_passes > 1 ? n : 0);
+  std::vector<T> counts(num_chunks * num_buckets);
+  const T *src = a;
+  for (int32_t p = 0; p < num_passes; p++) {
+    // alternate between b and tmp so that the last pass writes to b.
+    T *dst = ((num_passes - 1 - p) % 2 == 0) ? b : tmp.data();
+    int32_t shift = p * kRadixBits;
+    std::fill(counts.begin(), counts.end(), 0);
+    ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+      T *count = counts.data() + c * num_buckets;
+      for (T i = begin; i < end; i++)
+        count[(static_cast<uint64_t>(r[src[i]]) >> shift) & mask]++;
+    });
+    // exclusive prefix sums, in the order (digit, chunk).
+    T sum = 0;
+    for (int64_t d = 0; d < num_buckets; d++) {
+      for (int32_t c = 0; c < num_chunks; c++) {
+        T t = counts[c * num_buckets + d];
+        counts[c * num_buckets + d] = sum;
+        sum += t;
+      }
+    }
+    ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+      T *count = counts.data() + c * num_buckets;
+      for (T i = begin; i < end; i++)
+        dst[count[(static_cast<uint64_t>(r[src[i]]) >> shift) & mask]++] =
+            src[i];
+    });
+    src = dst;
+  }
+}
+
+/*
+  Helper function for CreateSuffixArrayDc3().
+  Sets out[j++] = f(i) for each i in [0, n) with keep(i) true, in order,
+  using `num_chunks` threads.  Returns the number of items written.
+*/
+template <typename T, typename Keep, typename F>
+static T ParallelFilter(T n, int32_t num_chunks, Keep keep, F f, T *out) {
+  std::vector<T> offsets(num_chunks + 1, 0);
+  ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    T count = 0;
+    for (T i = begin; i < end; i++)
+      count += keep(i) ? 1 : 0;
+    offsets[c + 1] = count;
+  });
+  for (int32_t c = 0; c < num_chunks; c++)
+    offsets[c + 1] += offsets[c];
+  ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    T j = offsets[c];
+    for (T i = begin; i < end; i++)
+      if (keep(i))
+        out[j++] = f(i);
+  });
+  return offsets[num_chunks];
+}
+
+// The DC3 algorithm, see documentation in suffix_array.h, where we use
+// different names for the arguments (here, we leave the names the same as in
 // https://algo2.iti.kit.edu/documents/jacm05-revised.pdf.
-template <typename T> void CreateSuffixArray(const T *text, T n, T K, T *SA) {
+// Each step is split across up to `num_threads` threads if n is large
+// enough; the result does not depend on num_threads.
+// S is the symbol type and T the index type; the recursion is on names,
+// which are of type T.
+template <typename S, typename T>
+static void CreateSuffixArrayDc3(const S *text, T n, T K, T *SA,
+                                 int32_t num_threads) {
+  FTS_STATS_SCOPE(Stage::kSuffixArray);
   if (n == 1) { // The paper's code didn't seem to handle n == 1 correctly.
     SA[0] = 0;
     return;
@@ -65,81 +169,468 @@ template <typename T> void CreateSuffixArray(const T *text, T n, T K, T *SA) {
   std::vector<T> SA12(n02 + 3, 0);
   std::vector<T> R0(n0, 0);
   std::vector<T> SA0(n0, 0);
+  FTS_STATS_SCRATCH(Stage::kSuffixArray,
+                    (2 * (static_cast<int64_t>(n02) + 3) + 2 * n0) * sizeof(T));
+  int32_t num_chunks = NumChunks(n, num_threads, kMinChunkSize);
 
   //******* Step 0: Construct sample ********
-  // generate positions of mod 1 and mod 2 suffixes
-  // the "+(n0-n1)" adds a dummy mod 1 suffix if n%3 == 1
-  for (T i = 0, j = 0; i < n + (n0 - n1); i++)
-    if (i % 3 != 0)
-      R[j++] = i;
+  // generate positions of mod 1 and mod 2 suffixes, i.e. 1, 2, 4, 5, 7, ...
+  // n02 positions in total, which adds a dummy mod 1 suffix if n%3 == 1
+  ParallelFor(n02, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (T j = begin; j < end; j++)
+      R[j] = 3 * (j / 2) + 1 + j % 2;
+  });
   //******* Step 1: Sort sample suffixes ********
   // lsb radix sort the mod 1 and mod 2 triples
-  RadixPass(R.data(), SA12.data(), text + 2, n02, K);
-  RadixPass(SA12.data(), R.data(), text + 1, n02, K);
-  RadixPass(R.data(), SA12.data(), text, n02, K);
+  ParallelRadixPass(R.data(), SA12.data(), text + 2, n02, K, num_threads);
+  ParallelRadixPass(SA12.data(), R.data(), text + 1, n02, K, num_threads);
+  ParallelRadixPass(R.data(), SA12.data(), text, n02, K, num_threads);
 
   // find lexicographic names of triples and
   // write them to correct places in R
-  T name = 0, c0 = -1, c1 = -1, c2 = -1;
-  for (T i = 0; i < n02; i++) {
-    if (text[SA12[i]] != c0 || text[SA12[i] + 1] != c1 ||
-        text[SA12[i] + 2] != c2) {
-      name++;
-      c0 = text[SA12[i]];
-      c1 = text[SA12[i] + 1];
-      c2 = text[SA12[i] + 2];
-    }
+  auto is_new_name = [&](T i) -> bool {
+    return i == 0 || text[SA12[i]] != text[SA12[i - 1]] ||
+           text[SA12[i] + 1] != text[SA12[i - 1] + 1] ||
+           text[SA12[i] + 2] != text[SA12[i - 1] + 2];
+  };
+  auto write_name = [&](T i, T name) {
     if (SA12[i] % 3 == 1) {
       R[SA12[i] / 3] = name;
     } // write to R1
     else {
       R[SA12[i] / 3 + n0] = name;
     } // write to R2
+  };
+  // names_begin[c] is the last name used before chunk c; only needed if
+  // there is more than one chunk.
+  std::vector<T> names_begin(num_chunks + 1, 0);
+  if (num_chunks > 1) {
+    ParallelFor(n02, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+      T count = 0;
+      for (T i = begin; i < end; i++)
+        count += is_new_name(i) ? 1 : 0;
+      names_begin[c + 1] = count;
+    });
+    for (int32_t c = 0; c < num_chunks; c++)
+      names_begin[c + 1] += names_begin[c];
   }
+  T name = 0; // the number of distinct names
+  ParallelFor(n02, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    T cur_name = names_begin[c];
+    for (T i = begin; i < end; i++) {
+      if (is_new_name(i))
+        cur_name++;
+      write_name(i, cur_name);
+    }
+    if (c == num_chunks - 1)
+      name = cur_name;
+  });
   // recurse if names are not yet unique
   if (name < n02) {
-    CreateSuffixArray(R.data(), n02, name, SA12.data());
+    CreateSuffixArrayDc3(R.data(), n02, name, SA12.data(), num_threads);
     // store unique names in R using the suffix array
-    for (T i = 0; i < n02; i++)
-      R[SA12[i]] = i + 1;
-  } else // generate the suffix array of R directly
-    for (T i = 0; i < n02; i++)
-      SA12[R[i] - 1] = i;
+    ParallelFor(n02, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+      for (T i = begin; i < end; i++)
+        R[SA12[i]] = i + 1;
+    });
+  } else { // generate the suffix array of R directly
+    ParallelFor(n02, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+      for (T i = begin; i < end; i++)
+        SA12[R[i] - 1] = i;
+    });
+  }
   //******* Step 2: Sort nonsample suffixes ********
   // stably sort the mod 0 suffixes from SA12 by their first character
-  for (T i = 0, j = 0; i < n02; i++)
-    if (SA12[i] < n0)
-      R0[j++] = 3 * SA12[i];
-  RadixPass(R0.data(), SA0.data(), text, n0, K);
+  ParallelFilter(
+      n02, num_chunks, [&](T i) { return SA12[i] < n0; },
+      [&](T i) { return 3 * SA12[i]; }, R0.data());
+  ParallelRadixPass(R0.data(), SA0.data(), text, n0, K, num_threads);
   //******* Step 3: Merge ********
   // merge sorted SA0 suffixes and sorted SA12 suffixes
-  for (T p = 0, t = n0 - n1, k = 0; k < n; k++) {
-    // i is pos of current offset 12 suffix
-    T i = (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2);
-    T j = SA0[p]; // pos of current offset 0 suffix
-    if (SA12[t] < n0
-            ? // different compares for mod 1 and mod 2 suffixes
-            Leq(text[i], R[SA12[t] + n0], text[j], R[j / 3])
-            : Leq(text[i], text[i + 1], R[SA12[t] - n0 + 1], text[j],
-                  text[j + 1], R[j / 3 + n0])) { // suffix from SA12 is smaller
-      SA[k] = i;
-      t++;
-      if (t == n02) // done --- only SA0 suffixes left
-        for (k++; p < n0; p++, k++)
-          SA[k] = SA0[p];
-    } else { // suffix from SA0 is smaller
-      SA[k] = j;
-      p++;
-      if (p == n0) // done --- only SA12 suffixes left
-        for (k++; t < n02; t++, k++)
-          SA[k] = (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2);
+  T t_begin = n0 - n1; // skip the dummy mod 1 suffix, if any.
+  // pos of the offset 12 suffix SA12[t]
+  auto pos12 = [&](T t) -> T {
+    return SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2;
+  };
+  // true if the suffix from SA12[t] is smaller than the one from SA0[p]
+  auto less12 = [&](T t, T p) -> bool {
+    T i = pos12(t), j = SA0[p];
+    return SA12[t] < n0
+               ? // different compares for mod 1 and mod 2 suffixes
+               Leq<T>(text[i], R[SA12[t] + n0], text[j], R[j / 3])
+               : Leq<T>(text[i], text[i + 1], R[SA12[t] - n0 + 1], text[j],
+                        text[j + 1], R[j / 3 + n0]);
+  };
+  if (num_chunks <= 1) {
+    for (T p = 0, t = t_begin, k = 0; k < n; k++) {
+      if (less12(t, p)) { // suffix from SA12 is smaller
+        SA[k] = pos12(t);
+        t++;
+        if (t == n02) // done --- only SA0 suffixes left
+          for (k++; p < n0; p++, k++)
+            SA[k] = SA0[p];
+      } else { // suffix from SA0 is smaller
+        SA[k] = SA0[p];
+        p++;
+        if (p == n0) // done --- only SA12 suffixes left
+          for (k++; t < n02; t++, k++)
+            SA[k] = pos12(t);
+      }
+    }
+    return;
+  }
+  // Each thread merges its own range of the output; it finds where to start
+  // in SA12 and SA0 by a binary search ("merge path").
+  T n12 = n02 - t_begin;
+  ParallelFor(n, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    T k = begin;
+    // find the number of SA12 suffixes among the first k outputs.
+    T lo = std::max<T>(0, k - n0), hi = std::min<T>(k, n12);
+    while (lo < hi) {
+      T mid = lo + (hi - lo) / 2;
+      if (less12(t_begin + mid, k - mid - 1))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    T t = t_begin + lo, p = k - lo;
+    for (; k < end; k++) {
+      if (p == n0 || (t < n02 && less12(t, p))) {
+        SA[k] = pos12(t);
+        t++;
+      } else {
+        SA[k] = SA0[p];
+        p++;
+      }
+    }
+  });
+}
+
+/*
+  Helper function for Sais().
+  Sets bkt[c] to the start (if end == false) or one past the end (if
+  end == true) of the bucket for symbol c in the suffix array, for
+  c in [0..K].
+*/
+template <typename S, typename T>
+static void GetBuckets(const S *s, T n, T K, bool end, T *bkt) {
+  for (T i = 0; i <= K; i++)
+    bkt[i] = 0;
+  for (T i = 0; i < n; i++)
+    bkt[s[i]]++;
+  for (T i = 0, sum = 0; i <= K; i++) {
+    sum += bkt[i];
+    bkt[i] = end ? sum : sum - bkt[i];
+  }
+}
+
+/*
+  Helper function for Sais().
+  Induces the order of the L-type suffixes from the (partially) sorted
+  S-type suffixes in SA, scanning left to right.  The virtual sentinel
+  suffix (position n) is the smallest one, so its predecessor n-1 (which is
+  always L-type) is induced first.
+*/
+template <typename S, typename T>
+static void InduceL(const S *s, const std::vector<bool> &t, T n, T K, T *SA,
+                    T *bkt) {
+  GetBuckets(s, n, K, false, bkt);
+  SA[bkt[s[n - 1]]++] = n - 1;
+  for (T i = 0; i < n; i++) {
+    T j = SA[i] - 1;
+    if (j >= 0 && !t[j])
+      SA[bkt[s[j]]++] = j;
+  }
+}
+
+/*
+  Helper function for Sais().
+  Induces the order of the S-type suffixes from the sorted L-type suffixes
+  in SA, scanning right to left.
+*/
+template <typename S, typename T>
+static void InduceS(const S *s, const std::vector<bool> &t, T n, T K, T *SA,
+                    T *bkt) {
+  GetBuckets(s, n, K, true, bkt);
+  for (T i = n - 1; i >= 0; i--) {
+    T j = SA[i] - 1;
+    if (j >= 0 && t[j])
+      SA[--bkt[s[j]]] = j;
+  }
+}
+
+/*
+  The SA-IS algorithm (see SuffixArrayAlgorithm::kSais) for a sequence
+  s[0..n-1] with symbols in [0..K].  Unlike the paper we do not require
+  s[n-1] to be a unique smallest sentinel: there is a "virtual" sentinel at
+  position n that is smaller than every symbol, which lets the recursion
+  work on the names stored at the end of SA without moving them.
+  (The termination symbol of CreateSuffixArray() is the largest symbol and
+  unique, so no suffix is a prefix of another one and the virtual sentinel
+  never decides any comparison; the result is the same as for kDc3.)
+
+  Requires T to be a signed type; SA is used as the working space for the
+  recursion and must have n elements.
+*/
+template <typename S, typename T>
+static void Sais(const S *s, T n, T K, T *SA) {
+  FTS_STATS_SCOPE(Stage::kSuffixArray);
+  if (n == 1) {
+    SA[0] = 0;
+    return;
+  }
+  // t[i] is true if suffix i is S-type, i.e. smaller than suffix i+1.
+  std::vector<bool> t(n);
+  t[n - 1] = false; // s[n-1] is larger than the virtual sentinel.
+  for (T i = n - 2; i >= 0; i--)
+    t[i] = (s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]));
+  // position i is a "leftmost S" (LMS) position.
+  auto is_lms = [&t](T i) -> bool { return i > 0 && t[i] && !t[i - 1]; };
+
+  std::vector<T> bkt(K + 1);
+  FTS_STATS_SCRATCH(Stage::kSuffixArray,
+                    static_cast<int64_t>(n) / 8 + (K + 1) * sizeof(T));
+
+  //******* Stage 1: sort the LMS substrings ********
+  GetBuckets(s, n, K, true, bkt.data());
+  for (T i = 0; i < n; i++)
+    SA[i] = -1;
+  for (T i = 1; i < n; i++)
+    if (is_lms(i))
+      SA[--bkt[s[i]]] = i;
+  InduceL(s, t, n, K, SA, bkt.data());
+  InduceS(s, t, n, K, SA, bkt.data());
+
+  // compact the sorted LMS substrings into the first n1 items of SA.
+  // No two LMS positions are adjacent so n1 <= n / 2.
+  T n1 = 0;
+  for (T i = 0; i < n; i++)
+    if (is_lms(SA[i]))
+      SA[n1++] = SA[i];
+
+  // find the lexicographic names of the LMS substrings, and
+  // write them to SA[n1 + pos / 2], which can't collide.
+  for (T i = n1; i < n; i++)
+    SA[i] = -1;
+  T name = 0, prev = -1;
+  for (T i = 0; i < n1; i++) {
+    T pos = SA[i];
+    bool diff = false;
+    for (T d = 0;; d++) {
+      // The LMS substring that ends at the virtual sentinel is unique.
+      if (prev == -1 || pos + d == n || prev + d == n ||
+          s[pos + d] != s[prev + d] || t[pos + d] != t[prev + d]) {
+        diff = true;
+        break;
+      } else if (d > 0 && (is_lms(pos + d) || is_lms(prev + d))) {
+        break;
+      }
     }
+    if (diff) {
+      name++;
+      prev = pos;
+    }
+    SA[n1 + pos / 2] = name - 1;
+  }
+  for (T i = n - 1, j = n - 1; i >= n1; i--)
+    if (SA[i] >= 0)
+      SA[j--] = SA[i];
+
+  //******* Stage 2: sort the LMS suffixes ********
+  // s1, the names in text order, is at the end of SA and SA1 at the start.
+  T *SA1 = SA, *s1 = SA + n - n1;
+  if (name < n1) // recurse if names are not yet unique
+    Sais(static_cast<const T *>(s1), n1, name - 1, SA1);
+  else // generate the suffix array of s1 directly
+    for (T i = 0; i < n1; i++)
+      SA1[s1[i]] = i;
+
+  //******* Stage 3: induce the full suffix array ********
+  for (T i = 1, j = 0; i < n; i++)
+    if (is_lms(i))
+      s1[j++] = i; // positions of the LMS suffixes in text order
+  for (T i = 0; i < n1; i++)
+    SA1[i] = s1[SA1[i]];
+  for (T i = n1; i < n; i++)
+    SA[i] = -1;
+  // put the sorted LMS suffixes at the ends of their buckets.
+  GetBuckets(s, n, K, true, bkt.data());
+  for (T i = n1 - 1; i >= 0; i--) {
+    T j = SA[i];
+    SA[i] = -1;
+    SA[--bkt[s[j]]] = j;
   }
+  InduceL(s, t, n, K, SA, bkt.data());
+  InduceS(s, t, n, K, SA, bkt.data());
 }
 
-// Instantiate template for int64_t and int32_t
-template void CreateSuffixArray(const int64_t *text, int64_t n, int64_t K,
-                                int64_t *SA);
-template void CreateSuffixArray(const int32_t *text, int32_t n, int32_t K,
-                                int32_t *SA);
+// Symbols larger than this make CreateSuffixArray() compact the alphabet
+// first, as the counter and bucket arrays have max_symbol + 1 elements.
+static constexpr int64_t kMaxUncompactedSymbol = 1 << 20;
+
+template <typename SymbolT, typename IndexT>
+IndexT CompactAlphabet(const SymbolT *text_array, IndexT seq_len,
+                       IndexT *compact_text, std::vector<SymbolT> *symbols,
+                       int32_t num_threads) {
+  assert(seq_len >= 1);
+  // The text without the termination symbol.
+  IndexT n = seq_len - 1;
+  int32_t num_chunks = NumChunks(n, num_threads, kMinChunkSize);
+  std::vector<SymbolT> chunk_max(num_chunks, 0);
+  ParallelFor(n, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    chunk_max[c] = *std::max_element(text_array + begin, text_array + end);
+  });
+  int64_t max_used =
+      n == 0 ? 0 : *std::max_element(chunk_max.begin(), chunk_max.end());
+
+  // The distinct nonzero symbols, sorted.
+  std::vector<SymbolT> used;
+  if (max_used <= 4 * static_cast<int64_t>(n) + kMaxUncompactedSymbol) {
+    // ids[s] is the id of symbol s.
+    std::vector<IndexT> ids(max_used + 1, 0);
+    for (IndexT i = 0; i < n; i++)
+      ids[text_array[i]] = 1;
+    for (int64_t s = 1; s <= max_used; s++) {
+      if (ids[s] != 0) {
+        used.push_back(static_cast<SymbolT>(s));
+        ids[s] = static_cast<IndexT>(used.size());
+      }
+    }
+    ids[0] = 0;
+    ParallelFor(n, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++)
+        compact_text[i] = ids[text_array[i]];
+    });
+  } else {
+    used.assign(text_array, text_array + n);
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    if (used[0] == 0)
+      used.erase(used.begin());
+    ParallelFor(n, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; i++) {
+        SymbolT s = text_array[i];
+        compact_text[i] =
+            s == 0 ? 0
+                   : static_cast<IndexT>(
+                         std::lower_bound(used.begin(), used.end(), s) -
+                         used.begin() + 1);
+      }
+    });
+  }
+  IndexT num_symbols = static_cast<IndexT>(used.size());
+  compact_text[n] = num_symbols + 1;
+  compact_text[n + 1] = compact_text[n + 2] = compact_text[n + 3] = 0;
+  if (symbols != nullptr) {
+    symbols->clear();
+    symbols->reserve(num_symbols + 2);
+    symbols->push_back(0);
+    symbols->insert(symbols->end(), used.begin(), used.end());
+    symbols->push_back(text_array[n]);
+  }
+  return num_symbols + 1;
+}
+
+// Runs `algorithm` on a text with symbols in [0..K].
+template <typename S, typename T>
+static void CreateSuffixArrayWith(const S *text, T n, T K, T *SA,
+                                  SuffixArrayAlgorithm algorithm,
+                                  int32_t num_threads) {
+  switch (algorithm) {
+  case SuffixArrayAlgorithm::kSais:
+    Sais(text, n, K, SA);
+    break;
+  case SuffixArrayAlgorithm::kDc3:
+  default:
+    CreateSuffixArrayDc3(text, n, K, SA, num_threads);
+  }
+}
+
+template <typename SymbolT, typename IndexT>
+void CreateSuffixArray(const SymbolT *text_array, IndexT seq_len,
+                       SymbolT max_symbol, IndexT *suffix_array,
+                       SuffixArrayAlgorithm algorithm, int32_t num_threads) {
+  FTS_STATS_SCOPE(Stage::kSuffixArray);
+  if (static_cast<int64_t>(max_symbol) > kMaxUncompactedSymbol &&
+      seq_len >= 1) {
+    std::vector<IndexT> compact_text(seq_len + 3);
+    FTS_STATS_SCRATCH(Stage::kSuffixArray,
+                      (static_cast<int64_t>(seq_len) + 3) * sizeof(IndexT));
+    IndexT K = CompactAlphabet<SymbolT, IndexT>(
+        text_array, seq_len, compact_text.data(), nullptr, num_threads);
+    CreateSuffixArrayWith<IndexT, IndexT>(compact_text.data(), seq_len, K,
+                                          suffix_array, algorithm,
+                                          num_threads);
+    return;
+  }
+  CreateSuffixArrayWith(text_array, seq_len, static_cast<IndexT>(max_symbol),
+                        suffix_array, algorithm, num_threads);
+}
+
+template <typename SymbolT, typename IndexT>
+void CreateLcpArray(const SymbolT *text_array, IndexT seq_len,
+                    const IndexT *suffix_array, IndexT *lcp,
+                    int32_t num_threads) {
+  assert(seq_len >= 0);
+  FTS_STATS_SCOPE(Stage::kLcpArray);
+  int32_t num_chunks = NumChunks(seq_len, num_threads, kMinChunkSize);
+
+  // First plcp[suffix_array[i]] = suffix_array[i-1] (the "Phi" array), or -1
+  // for i == 0, then plcp[p] is the LCP of the suffix at p and the suffix
+  // that precedes it in the suffix array.
+  std::vector<IndexT> plcp(seq_len);
+  FTS_STATS_SCRATCH(Stage::kLcpArray,
+                    static_cast<int64_t>(seq_len) * sizeof(IndexT));
+  ParallelFor(seq_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (IndexT i = begin; i < end; i++)
+      plcp[suffix_array[i]] = i == 0 ? -1 : suffix_array[i - 1];
+  });
+  // plcp[p + 1] >= plcp[p] - 1, which makes the loop below linear.  Each
+  // chunk starts from 0 instead of the previous plcp, which is correct but
+  // redoes up to one LCP's worth of comparisons.  The comparisons stop at the
+  // termination symbol, which appears only once.
+  ParallelFor(seq_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    IndexT h = 0;
+    for (IndexT p = begin; p < end; p++) {
+      IndexT q = plcp[p];
+      if (q == -1) {
+        plcp[p] = h = 0;
+        continue;
+      }
+      while (text_array[p + h] == text_array[q + h])
+        h++;
+      plcp[p] = h;
+      if (h > 0)
+        h--;
+    }
+  });
+  ParallelFor(seq_len, num_chunks, [&](int32_t, int64_t begin, int64_t end) {
+    for (IndexT i = begin; i < end; i++)
+      lcp[i] = plcp[suffix_array[i]];
+  });
+}
+
+// Instantiate template for uint8_t, uint16_t and int32_t symbols with
+// int32_t and int64_t indexes, and for int64_t symbols with int64_t indexes.
+#define FTS_INSTANTIATE_SUFFIX_ARRAY(SymbolT, IndexT)                          \
+  template IndexT CompactAlphabet(const SymbolT *text_array, IndexT seq_len,   \
+                                  IndexT *compact_text,                        \
+                                  std::vector<SymbolT> *symbols,               \
+                                  int32_t num_threads);                        \
+  template void CreateSuffixArray(const SymbolT *text_array, IndexT seq_len,   \
+                                  SymbolT max_symbol, IndexT *suffix_array,    \
+                                  SuffixArrayAlgorithm algorithm,              \
+                                  int32_t num_threads);                        \
+  template void CreateLcpArray(const SymbolT *text_array, IndexT seq_len,      \
+                               const IndexT *suffix_array, IndexT *lcp,        \
+                               int32_t num_threads);
+
+FTS_INSTANTIATE_SUFFIX_ARRAY(uint8_t, int32_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(uint8_t, int64_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(uint16_t, int32_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(uint16_t, int64_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(int32_t, int32_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(int32_t, int64_t)
+FTS_INSTANTIATE_SUFFIX_ARRAY(int64_t, int64_t)
+#undef FTS_INSTANTIATE_SUFFIX_ARRAY
 } // namespace fasttextsearch
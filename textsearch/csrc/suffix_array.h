@@ -20,13 +20,69 @@
 #ifndef TEXTSEARCH_CSRC_SUFFIX_ARRAY_H_
 #define TEXTSEARCH_CSRC_SUFFIX_ARRAY_H_
 
+#include <cstdint>
+#include <vector>
+
 namespace fasttextsearch {
+
+// The algorithms CreateSuffixArray() can use; they give identical results.
+enum class SuffixArrayAlgorithm {
+  // The DC3 (or "skew") algorithm from
+  // https://algo2.iti.kit.edu/documents/jacm05-revised.pdf,
+  // "Linear Work Suffix Array construction" by J. Karkkainen.
+  // It allocates several buffers of about (2/3 * seq_len) elements at each
+  // level of recursion.
+  kDc3 = 0,
+  // SA-IS (suffix array by induced sorting) from "Two Efficient Algorithms
+  // for Linear Time Suffix Array Construction" by G. Nong, S. Zhang and
+  // W. H. Chan.  It uses `suffix_array` itself as the working space for the
+  // recursion, so apart from `suffix_array` it only needs one bit per
+  // symbol plus a bucket array of size max_symbol + 1, which makes it the
+  // better choice for very large inputs.
+  kSais = 1,
+};
+
 /*
-  This function creates a suffix array; it is based on the
-  code in https://algo2.iti.kit.edu/documents/jacm05-revised.pdf,
-  "Linear Work Suffix Array construction" by J. Karkkainen.
+  Maps the symbols of a text to consecutive ids, keeping their order, so that
+  the alphabet is as small as possible: the distinct nonzero symbols of
+  text_array[0:seq_len-1] become 1, 2, ..., num_symbols, the termination
+  symbol text_array[seq_len-1] becomes num_symbols + 1 and 0 stays 0.  The
+  suffix array of the compacted text is that of `text_array`.
+
+  If the largest of the symbols is not much larger than seq_len, they are
+  mapped with a table indexed by symbol, else by binary search in their
+  sorted list, so the work never depends on max_symbol.
 
-  Template args: T should be a signed integer type, such as int8, int16, int32
+  Template args: as for CreateSuffixArray(), with the same instantiations.
+
+    @param [in] text_array  The text, as for CreateSuffixArray().
+    @param [in] seq_len  The length of the text including the termination
+             symbol; require seq_len >= 1.
+    @param [out] compact_text  A pre-allocated array of length seq_len + 3;
+             at exit it contains the compacted text, followed by 3 zeros.
+    @param [out] symbols  If not nullptr, at exit (*symbols)[c] is the
+             symbol of `text_array` that was mapped to c, for c in
+             [0, num_symbols + 1], for decoding the compacted text.
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+
+    @return  num_symbols + 1, i.e. the max_symbol of `compact_text`.
+ */
+template <typename SymbolT, typename IndexT>
+IndexT CompactAlphabet(const SymbolT *text_array, IndexT seq_len,
+                       IndexT *compact_text, std::vector<SymbolT> *symbols,
+                       int32_t num_threads = 1);
+
+/*
+  This function creates a suffix array, using either the DC3 or the SA-IS
+  algorithm (see SuffixArrayAlgorithm above).
+
+  Template args: SymbolT is the type of the symbols in the text, it should
+    be uint8_t, uint16_t, int32_t or int64_t.  IndexT is the type of the
+    positions in the suffix array, it should be int32_t or int64_t (int32_t
+    requires seq_len + 3 to fit in an int32_t).  The instantiated pairs are
+    {uint8_t, uint16_t, int32_t} x {int32_t, int64_t} and
+    (int64_t, int64_t).
 
     @param [in] text_array  Pointer to the input array of symbols,
            including the termination symbol ($) which must be larger
@@ -45,8 +101,11 @@ namespace fasttextsearch {
     @param [in] max_symbol  A number that must be >= the largest
              number that might be in `text_array`, including the
              termination symbol.  The work done
-             is O(seq_len + max_symbol), so it is not advisable
-             to let max_symbol be too large.
+             is O(seq_len + max_symbol); if max_symbol is larger than
+             2^20 (e.g. for Unicode code points terminated by 2^31 - 2),
+             the text is first compacted with CompactAlphabet(), which
+             makes it O(seq_len + num_symbols) at the cost of a copy of the
+             text of type IndexT.
     @param [out] suffix_array   A pre-allocated array of length
              `seq_len`.  At exit it will contain a permutation of
              the list [ 0, 1, ... seq_len  - 1 ], interpreted
@@ -57,12 +116,48 @@ namespace fasttextsearch {
              For example, as a trivial case, if seq_len = 3
              and text_array contains [ 3, 2, 1, 10, 0, 0, 0 ], then
              `suffix_array` would contain [ 2, 1, 0, 3 ] at exit.
+    @param [in] algorithm  The algorithm to use; see SuffixArrayAlgorithm.
+    @param [in] num_threads  The number of threads to use for kDc3 (kSais
+             is single-threaded and ignores it); <= 0 means to use all
+             hardware threads.  The result does not depend on num_threads.
     Caution: this function allocates memory internally (although
-    not much more than `text_array` itself).
+    not much more than `text_array` itself for kDc3, and only about
+    seq_len / 8 bytes plus the bucket array for kSais).
+ */
+template <typename SymbolT, typename IndexT>
+void CreateSuffixArray(
+    const SymbolT *text_array, IndexT seq_len, SymbolT max_symbol,
+    IndexT *suffix_array,
+    SuffixArrayAlgorithm algorithm = SuffixArrayAlgorithm::kDc3,
+    int32_t num_threads = 1);
+
+/*
+  Creates the LCP (longest common prefix) array of a suffix array, with the
+  linear-time algorithm of Kasai et al. in its "permuted LCP" form (see
+  "Permuted Longest-Common-Prefix Array" by J. Karkkainen, G. Manzini and
+  S. J. Puglisi), which processes the suffixes in text order rather than
+  in suffix-array order for better memory locality.
+
+  Template args: as for CreateSuffixArray(), with the same instantiations.
+
+    @param [in] text_array  The text the suffix array was created from, as
+             passed to CreateSuffixArray(); the termination symbol is required
+             (it stops the comparisons).
+    @param [in] seq_len  The length of the symbol sequence, including the
+             termination symbol; require seq_len >= 0.
+    @param [in] suffix_array  The suffix array created by CreateSuffixArray(),
+             of length seq_len.
+    @param [out] lcp  A pre-allocated array of length `seq_len`.  At exit,
+             lcp[0] == 0 and lcp[i] is the length of the longest common prefix
+             of the suffixes starting at suffix_array[i-1] and suffix_array[i].
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.  The result does not depend on it.
+    Caution: this function allocates a temporary array of seq_len indexes.
  */
-template <typename T>
-void CreateSuffixArray(const T *text_array, T seq_len, T max_symbol,
-                       T *suffix_array);
+template <typename SymbolT, typename IndexT>
+void CreateLcpArray(const SymbolT *text_array, IndexT seq_len,
+                    const IndexT *suffix_array, IndexT *lcp,
+                    int32_t num_threads = 1);
 
 } // namespace fasttextsearch
 #endif // TEXTSEARCH_CSRC_SUFFIX_ARRAY_H_
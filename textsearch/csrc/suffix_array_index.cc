@@ -0,0 +1,756 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/suffix_array_index.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fasttextsearch {
+
+namespace {
+
+// The file starts with this header.  All the integers are little-endian
+// (we only support little-endian machines, which `endian_check` checks).
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian_check;
+  uint32_t text_dtype;
+  uint32_t index_dtype;
+  int64_t text_length;
+  int64_t num_docs;
+  struct {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+  } sections[SuffixArrayIndex::kNumSections];
+  uint8_t reserved[112];
+  uint64_t header_checksum; // The checksum of the bytes before it.
+};
+
+static_assert(sizeof(FileHeader) == 256, "FileHeader must be 256 bytes");
+
+constexpr char kMagic[8] = {'F', 'T', 'S', 'S', 'A', 'I', 'D', 'X'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kEndianCheck = 0x01020304;
+constexpr uint64_t kAlignment = 64;
+
+/*
+  A 64-bit FNV-1a style checksum over 8-byte words (the last one zero padded),
+  to detect truncated or corrupted files; it is not cryptographic.
+  Update() may be called several times with any sizes; the result is the same
+  as for one call with all the data.
+ */
+class Checksum {
+public:
+  void Update(const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    if (num_pending_ != 0) {
+      size_t n = std::min(size, 8 - num_pending_);
+      std::memcpy(pending_ + num_pending_, p, n);
+      num_pending_ += n;
+      p += n;
+      size -= n;
+      if (num_pending_ < 8)
+        return;
+      AddWord(pending_);
+      num_pending_ = 0;
+    }
+    size_t num_words = size / 8;
+    for (size_t i = 0; i < num_words; i++)
+      AddWord(p + 8 * i);
+    num_pending_ = size % 8;
+    std::memcpy(pending_, p + 8 * num_words, num_pending_);
+  }
+
+  uint64_t Value() const {
+    if (num_pending_ == 0)
+      return value_;
+    char word[8] = {};
+    std::memcpy(word, pending_, num_pending_);
+    return (value_ ^ Load(word)) * kPrime;
+  }
+
+private:
+  static uint64_t Load(const char *p) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    return word;
+  }
+  void AddWord(const char *p) { value_ = (value_ ^ Load(p)) * kPrime; }
+
+  static constexpr uint64_t kPrime = 0x100000001b3ULL;
+  uint64_t value_ = 0xcbf29ce484222325ULL;
+  char pending_[8];
+  size_t num_pending_ = 0;
+};
+
+uint64_t ComputeChecksum(const void *data, size_t size) {
+  Checksum checksum;
+  checksum.Update(data, size);
+  return checksum.Value();
+}
+
+bool IsValidDtype(uint32_t dtype) {
+  return dtype <= static_cast<uint32_t>(IndexDtype::kInt64);
+}
+
+// Writes to a file, keeping track of the offset and throwing on errors.
+class FileWriter {
+public:
+  explicit FileWriter(const std::string &filename)
+      : filename_(filename), file_(std::fopen(filename.c_str(), "wb")) {
+    if (file_ == nullptr)
+      throw std::runtime_error("Could not open " + filename + " for writing");
+  }
+
+  ~FileWriter() {
+    if (file_ != nullptr)
+      std::fclose(file_);
+  }
+
+  void Write(const void *data, size_t size) {
+    if (size != 0 && std::fwrite(data, 1, size, file_) != size)
+      throw std::runtime_error("Error writing " + filename_);
+    offset_ += size;
+  }
+
+  // Writes zeros up to the next multiple of kAlignment.
+  void Align() {
+    static const char zeros[kAlignment] = {};
+    Write(zeros, (kAlignment - offset_ % kAlignment) % kAlignment);
+  }
+
+  void Seek(uint64_t offset) {
+#ifdef _WIN32
+    int ret = _fseeki64(file_, static_cast<int64_t>(offset), SEEK_SET);
+#else
+    int ret = fseeko(file_, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    if (ret != 0)
+      throw std::runtime_error("Error seeking in " + filename_);
+    offset_ = offset;
+  }
+
+  void Close() {
+    FILE *file = file_;
+    file_ = nullptr;
+    if (std::fclose(file) != 0)
+      throw std::runtime_error("Error writing " + filename_);
+  }
+
+  uint64_t Offset() const { return offset_; }
+
+private:
+  std::string filename_;
+  FILE *file_;
+  uint64_t offset_ = 0;
+};
+
+/*
+  Writes `n` indexes of type `src_dtype` as `dst_dtype` (the same, or int32
+  from int64, for values that fit) and returns the checksum of what was
+  written.
+ */
+uint64_t WriteIndexes(FileWriter *writer, const void *src, IndexDtype src_dtype,
+                      int64_t n, IndexDtype dst_dtype) {
+  Checksum checksum;
+  if (src_dtype == dst_dtype) {
+    size_t size = static_cast<size_t>(n) * DtypeSize(src_dtype);
+    writer->Write(src, size);
+    checksum.Update(src, size);
+    return checksum.Value();
+  }
+  const int64_t *src_data = static_cast<const int64_t *>(src);
+  const int64_t kChunkSize = 1 << 20;
+  std::vector<int32_t> buffer(std::min(n, kChunkSize));
+  for (int64_t begin = 0; begin < n; begin += kChunkSize) {
+    int64_t end = std::min(n, begin + kChunkSize);
+    for (int64_t i = begin; i < end; i++)
+      buffer[i - begin] = static_cast<int32_t>(src_data[i]);
+    writer->Write(buffer.data(), (end - begin) * sizeof(int32_t));
+    checksum.Update(buffer.data(), (end - begin) * sizeof(int32_t));
+  }
+  return checksum.Value();
+}
+
+FileHeader MakeHeader(IndexDtype text_dtype, IndexDtype index_dtype,
+                      int64_t text_length, int64_t num_docs) {
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.endian_check = kEndianCheck;
+  header.text_dtype = static_cast<uint32_t>(text_dtype);
+  header.index_dtype = static_cast<uint32_t>(index_dtype);
+  header.text_length = text_length;
+  header.num_docs = num_docs;
+  return header;
+}
+
+// Sets the checksum of `header` and writes it at the start of the file.
+void WriteHeader(FileWriter *writer, FileHeader *header) {
+  header->header_checksum =
+      ComputeChecksum(header, offsetof(FileHeader, header_checksum));
+  writer->Seek(0);
+  writer->Write(header, sizeof(*header));
+}
+
+uint64_t AlignOffset(uint64_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+int64_t IndexAt(const void *data, IndexDtype dtype, int64_t i) {
+  return dtype == IndexDtype::kInt32 ? static_cast<const int32_t *>(data)[i]
+                                     : static_cast<const int64_t *>(data)[i];
+}
+
+/*
+  Writes a section of indexes of type `dtype` starting at `offset`, from
+  int64_t values, in chunks, while other sections are being written too.
+ */
+class IndexSectionWriter {
+public:
+  IndexSectionWriter(FileWriter *writer, uint64_t offset, IndexDtype dtype)
+      : writer_(writer), offset_(offset), dtype_(dtype) {
+    buffer_.reserve(kChunkSize);
+  }
+
+  void Add(int64_t value) {
+    buffer_.push_back(value);
+    if (buffer_.size() == kChunkSize)
+      Flush();
+  }
+
+  // Writes the remaining values and returns the checksum of the section.
+  uint64_t Finish() {
+    Flush();
+    return checksum_.Value();
+  }
+
+private:
+  void Flush() {
+    if (buffer_.empty())
+      return;
+    size_t size = buffer_.size() * DtypeSize(dtype_);
+    const void *data = buffer_.data();
+    if (dtype_ == IndexDtype::kInt32) {
+      narrow_.assign(buffer_.begin(), buffer_.end());
+      data = narrow_.data();
+    }
+    writer_->Seek(offset_);
+    writer_->Write(data, size);
+    checksum_.Update(data, size);
+    offset_ += size;
+    buffer_.clear();
+  }
+
+  static constexpr size_t kChunkSize = 1 << 20;
+  FileWriter *writer_;
+  uint64_t offset_;
+  IndexDtype dtype_;
+  std::vector<int64_t> buffer_;
+  std::vector<int32_t> narrow_;
+  Checksum checksum_;
+};
+
+/*
+  Merges the suffix arrays of `shards` into the suffix array of their texts
+  concatenated (each with its termination symbol), writing it and its LCP
+  array.  Each suffix is compared only up to the termination symbol of its
+  shard, so the order and the LCPs are those of the (generalized) suffix array
+  of the shards; equal suffixes of different shards are ordered by shard.
+ */
+template <typename SymbolT>
+void MergeShards(const std::vector<std::unique_ptr<SuffixArrayIndex>> &shards,
+                 IndexSectionWriter *suffix_array, IndexSectionWriter *lcp) {
+  int32_t num_shards = static_cast<int32_t>(shards.size());
+  std::vector<const SymbolT *> texts(num_shards);
+  // The position of each shard in the merged text.
+  std::vector<int64_t> shard_offsets(num_shards + 1, 0);
+  for (int32_t s = 0; s < num_shards; s++) {
+    texts[s] = static_cast<const SymbolT *>(shards[s]->Text());
+    shard_offsets[s + 1] = shard_offsets[s] + shards[s]->SeqLen();
+  }
+  std::vector<int64_t> ranks(num_shards, 0);
+  auto position = [&](int32_t s) {
+    return IndexAt(shards[s]->SuffixArray(), shards[s]->IndexType(),
+                   ranks[s]);
+  };
+
+  // Returns true if the suffix at position `pa` of shard `a` comes before the
+  // one at `pb` of shard `b`, and sets *length to their LCP.
+  auto less = [&](int32_t a, int64_t pa, int32_t b, int64_t pb,
+                  int64_t *length) {
+    const SymbolT *x = texts[a] + pa, *y = texts[b] + pb;
+    // The offset of the nearest termination symbol; the shards' termination
+    // symbols are the same, and each occurs once in its shard.
+    int64_t end = std::min(shards[a]->SeqLen() - 1 - pa,
+                           shards[b]->SeqLen() - 1 - pb);
+    int64_t h = 0;
+    while (h < end && x[h] == y[h])
+      h++;
+    *length = h;
+    if (x[h] != y[h])
+      return x[h] < y[h];
+    return a < b; // Both suffixes end here.
+  };
+
+  // A heap of the shards, by their next suffix.
+  int64_t unused;
+  auto after = [&](int32_t a, int32_t b) {
+    return less(b, position(b), a, position(a), &unused);
+  };
+  std::vector<int32_t> heap;
+  for (int32_t s = 0; s < num_shards; s++)
+    heap.push_back(s);
+  std::make_heap(heap.begin(), heap.end(), after);
+
+  int32_t prev_shard = -1;
+  int64_t prev_pos = 0;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), after);
+    int32_t s = heap.back();
+    int64_t pos = position(s), length = 0;
+    if (prev_shard != -1)
+      less(prev_shard, prev_pos, s, pos, &length);
+    suffix_array->Add(shard_offsets[s] + pos);
+    lcp->Add(length);
+    prev_shard = s;
+    prev_pos = pos;
+    if (++ranks[s] < shards[s]->SeqLen())
+      std::push_heap(heap.begin(), heap.end(), after);
+    else
+      heap.pop_back();
+  }
+}
+
+} // namespace
+
+size_t DtypeSize(IndexDtype dtype) {
+  switch (dtype) {
+  case IndexDtype::kUint8:
+  case IndexDtype::kInt8:
+    return 1;
+  case IndexDtype::kUint16:
+  case IndexDtype::kInt16:
+    return 2;
+  case IndexDtype::kInt32:
+    return 4;
+  case IndexDtype::kInt64:
+    return 8;
+  }
+  return 0;
+}
+
+void WriteSuffixArrayIndex(const std::string &filename,
+                           const SuffixArrayIndexArrays &arrays) {
+  if (arrays.text == nullptr || arrays.text_length < 4)
+    throw std::runtime_error("The text MUST have at least 4 elements");
+  if (arrays.suffix_array == nullptr ||
+      (arrays.index_dtype != IndexDtype::kInt32 &&
+       arrays.index_dtype != IndexDtype::kInt64))
+    throw std::runtime_error("The suffix array MUST be int32 or int64");
+  if (arrays.row_splits != nullptr && arrays.num_docs < 0)
+    throw std::runtime_error("num_docs MUST be >= 0");
+
+  int64_t seq_len = arrays.text_length - 3;
+  IndexDtype index_dtype =
+      arrays.text_length <= std::numeric_limits<int32_t>::max()
+          ? IndexDtype::kInt32
+          : IndexDtype::kInt64;
+  if (index_dtype == IndexDtype::kInt64 &&
+      arrays.index_dtype != IndexDtype::kInt64)
+    throw std::runtime_error("The text is too long for an int32 suffix array");
+
+  FileHeader header =
+      MakeHeader(arrays.text_dtype, index_dtype, arrays.text_length,
+                 arrays.row_splits != nullptr ? arrays.num_docs : 0);
+
+  FileWriter writer(filename);
+  // The header is written last, when the sections are known.
+  writer.Write(&header, sizeof(header));
+
+  auto begin_section = [&](SuffixArrayIndex::SectionType s) {
+    writer.Align();
+    header.sections[s].offset = writer.Offset();
+  };
+  auto end_section = [&](SuffixArrayIndex::SectionType s, uint64_t checksum) {
+    header.sections[s].size = writer.Offset() - header.sections[s].offset;
+    header.sections[s].checksum = checksum;
+  };
+
+  begin_section(SuffixArrayIndex::kText);
+  size_t text_size = arrays.text_length * DtypeSize(arrays.text_dtype);
+  writer.Write(arrays.text, text_size);
+  end_section(SuffixArrayIndex::kText, ComputeChecksum(arrays.text, text_size));
+
+  begin_section(SuffixArrayIndex::kSuffixArray);
+  end_section(SuffixArrayIndex::kSuffixArray,
+              WriteIndexes(&writer, arrays.suffix_array, arrays.index_dtype,
+                           seq_len, index_dtype));
+
+  if (arrays.lcp != nullptr) {
+    begin_section(SuffixArrayIndex::kLcp);
+    end_section(SuffixArrayIndex::kLcp,
+                WriteIndexes(&writer, arrays.lcp, arrays.index_dtype, seq_len,
+                             index_dtype));
+  }
+
+  if (arrays.row_splits != nullptr) {
+    begin_section(SuffixArrayIndex::kRowSplits);
+    size_t size = (arrays.num_docs + 1) * sizeof(int64_t);
+    writer.Write(arrays.row_splits, size);
+    end_section(SuffixArrayIndex::kRowSplits,
+                ComputeChecksum(arrays.row_splits, size));
+  }
+
+  WriteHeader(&writer, &header);
+  writer.Close();
+}
+
+struct SuffixArrayIndexWriter::Impl {
+  Impl(const std::string &filename, IndexDtype text_dtype, int64_t text_length)
+      : writer(filename), text_dtype(text_dtype),
+        index_dtype(text_length <= std::numeric_limits<int32_t>::max()
+                        ? IndexDtype::kInt32
+                        : IndexDtype::kInt64),
+        text_length(text_length),
+        header(MakeHeader(text_dtype, index_dtype, text_length, 0)),
+        sa_offset(AlignOffset(AlignOffset(sizeof(FileHeader)) +
+                              text_length * DtypeSize(text_dtype))),
+        sa_writer(&writer, sa_offset, index_dtype) {
+    writer.Write(&header, sizeof(header));
+    writer.Align();
+    header.sections[SuffixArrayIndex::kText].offset = writer.Offset();
+  }
+
+  FileWriter writer;
+  IndexDtype text_dtype, index_dtype;
+  int64_t text_length, text_added = 0, sa_added = 0;
+  FileHeader header;
+  Checksum text_checksum;
+  uint64_t sa_offset;
+  IndexSectionWriter sa_writer;
+};
+
+SuffixArrayIndexWriter::SuffixArrayIndexWriter(const std::string &filename,
+                                               IndexDtype text_dtype,
+                                               int64_t text_length) {
+  if (text_length < 4)
+    throw std::runtime_error("The text MUST have at least 4 elements");
+  impl_.reset(new Impl(filename, text_dtype, text_length));
+}
+
+SuffixArrayIndexWriter::~SuffixArrayIndexWriter() = default;
+
+void SuffixArrayIndexWriter::AddText(const void *symbols, int64_t n) {
+  if (impl_->sa_added != 0 || impl_->text_added + n > impl_->text_length)
+    throw std::runtime_error("AddText() MUST be called before "
+                             "AddSuffixArray(), for text_length symbols");
+  size_t size = n * DtypeSize(impl_->text_dtype);
+  impl_->writer.Write(symbols, size);
+  impl_->text_checksum.Update(symbols, size);
+  impl_->text_added += n;
+}
+
+void SuffixArrayIndexWriter::AddSuffixArray(const int64_t *indexes,
+                                            int64_t n) {
+  if (impl_->text_added != impl_->text_length ||
+      impl_->sa_added + n > impl_->text_length - 3)
+    throw std::runtime_error("AddSuffixArray() MUST be called after the text "
+                             "was added, for text_length - 3 elements");
+  for (int64_t i = 0; i < n; i++)
+    impl_->sa_writer.Add(indexes[i]);
+  impl_->sa_added += n;
+}
+
+void SuffixArrayIndexWriter::Close() {
+  Impl &impl = *impl_;
+  if (impl.sa_added != impl.text_length - 3)
+    throw std::runtime_error("The suffix array index is incomplete");
+  FileHeader &header = impl.header;
+  header.sections[SuffixArrayIndex::kText].size =
+      impl.text_length * DtypeSize(impl.text_dtype);
+  header.sections[SuffixArrayIndex::kText].checksum =
+      impl.text_checksum.Value();
+  uint64_t sa_size = impl.sa_added * DtypeSize(impl.index_dtype);
+  header.sections[SuffixArrayIndex::kSuffixArray] = {impl.sa_offset, sa_size,
+                                                     impl.sa_writer.Finish()};
+  WriteHeader(&impl.writer, &header);
+  impl.writer.Close();
+}
+
+void MergeSuffixArrayIndexes(const std::vector<std::string> &filenames,
+                             const std::string &output_filename) {
+  if (filenames.empty())
+    throw std::runtime_error("There are no suffix array index files to merge");
+  std::vector<std::unique_ptr<SuffixArrayIndex>> shards;
+  for (const std::string &filename : filenames)
+    shards.emplace_back(new SuffixArrayIndex(filename));
+
+  IndexDtype text_dtype = shards[0]->TextDtype();
+  size_t symbol_size = DtypeSize(text_dtype);
+  const char *eos = static_cast<const char *>(shards[0]->Text()) +
+                    (shards[0]->SeqLen() - 1) * symbol_size;
+  int64_t seq_len = 0, num_docs = 0;
+  for (size_t s = 0; s < shards.size(); s++) {
+    const SuffixArrayIndex &shard = *shards[s];
+    const char *text = static_cast<const char *>(shard.Text());
+    if (shard.TextDtype() != text_dtype ||
+        std::memcmp(text + (shard.SeqLen() - 1) * symbol_size, eos,
+                    symbol_size) != 0)
+      throw std::runtime_error(filenames[s] +
+                               ": the shards MUST have the same dtype and "
+                               "termination symbol");
+    seq_len += shard.SeqLen();
+    num_docs += shard.RowSplits() != nullptr ? shard.NumDocs() : 1;
+  }
+  int64_t text_length = seq_len + 3;
+  IndexDtype index_dtype = text_length <= std::numeric_limits<int32_t>::max()
+                               ? IndexDtype::kInt32
+                               : IndexDtype::kInt64;
+  FileHeader header = MakeHeader(text_dtype, index_dtype, text_length,
+                                 num_docs);
+
+  FileWriter writer(output_filename);
+  writer.Write(&header, sizeof(header));
+
+  // The texts, each with its termination symbol, and 3 zeros.
+  writer.Align();
+  header.sections[SuffixArrayIndex::kText].offset = writer.Offset();
+  Checksum text_checksum;
+  for (const auto &shard : shards) {
+    writer.Write(shard->Text(), shard->SeqLen() * symbol_size);
+    text_checksum.Update(shard->Text(), shard->SeqLen() * symbol_size);
+  }
+  const char zeros[3 * sizeof(int64_t)] = {};
+  writer.Write(zeros, 3 * symbol_size);
+  text_checksum.Update(zeros, 3 * symbol_size);
+  header.sections[SuffixArrayIndex::kText].size = text_length * symbol_size;
+  header.sections[SuffixArrayIndex::kText].checksum = text_checksum.Value();
+
+  // The suffix array and the LCP array are written at the same time.
+  uint64_t index_size = seq_len * DtypeSize(index_dtype);
+  uint64_t sa_offset = AlignOffset(writer.Offset()),
+           lcp_offset = AlignOffset(sa_offset + index_size);
+  IndexSectionWriter sa_writer(&writer, sa_offset, index_dtype),
+      lcp_writer(&writer, lcp_offset, index_dtype);
+  switch (text_dtype) {
+  case IndexDtype::kUint8:
+  case IndexDtype::kInt8:
+    MergeShards<uint8_t>(shards, &sa_writer, &lcp_writer);
+    break;
+  case IndexDtype::kUint16:
+  case IndexDtype::kInt16:
+    MergeShards<uint16_t>(shards, &sa_writer, &lcp_writer);
+    break;
+  case IndexDtype::kInt32:
+    MergeShards<int32_t>(shards, &sa_writer, &lcp_writer);
+    break;
+  case IndexDtype::kInt64:
+    MergeShards<int64_t>(shards, &sa_writer, &lcp_writer);
+    break;
+  }
+  header.sections[SuffixArrayIndex::kSuffixArray] = {sa_offset, index_size,
+                                                     sa_writer.Finish()};
+  header.sections[SuffixArrayIndex::kLcp] = {lcp_offset, index_size,
+                                             lcp_writer.Finish()};
+  writer.Seek(lcp_offset + index_size);
+
+  // The documents of the shards, one per shard without row_splits.  The
+  // termination symbols of all but the last shard are in its last document.
+  std::vector<int64_t> row_splits;
+  row_splits.reserve(num_docs + 1);
+  int64_t offset = 0;
+  for (const auto &shard : shards) {
+    const int64_t *shard_splits = shard->RowSplits();
+    for (int64_t d = 0; d < (shard_splits ? shard->NumDocs() : 1); d++)
+      row_splits.push_back(offset + (shard_splits ? shard_splits[d] : 0));
+    offset += shard->SeqLen();
+  }
+  const SuffixArrayIndex &last = *shards.back();
+  row_splits.push_back(offset - last.SeqLen() +
+                       (last.RowSplits() ? last.RowSplits()[last.NumDocs()]
+                                         : last.SeqLen() - 1));
+  writer.Align();
+  size_t row_splits_size = row_splits.size() * sizeof(int64_t);
+  header.sections[SuffixArrayIndex::kRowSplits] = {
+      writer.Offset(), row_splits_size,
+      ComputeChecksum(row_splits.data(), row_splits_size)};
+  writer.Write(row_splits.data(), row_splits_size);
+
+  WriteHeader(&writer, &header);
+  writer.Close();
+}
+
+SuffixArrayIndex::SuffixArrayIndex(const std::string &filename,
+                                   bool verify_checksums) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Could not open " + filename);
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    Unmap();
+    throw std::runtime_error("Could not get the size of " + filename);
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (size_ != 0) {
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr)
+      data_ = static_cast<const char *>(
+          MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+      Unmap();
+      throw std::runtime_error("Could not map " + filename);
+    }
+  }
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw std::runtime_error("Could not open " + filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Could not get the size of " + filename);
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ != 0) {
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Could not map " + filename);
+    }
+    data_ = static_cast<const char *>(data);
+  }
+  // The mapping stays valid after closing the file.
+  close(fd);
+#endif
+
+  auto fail = [&](const std::string &message) {
+    Unmap();
+    throw std::runtime_error(filename + ": " + message);
+  };
+
+  FileHeader header;
+  if (size_ < sizeof(header))
+    fail("not a suffix array index file (too short)");
+  std::memcpy(&header, data_, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+    fail("not a suffix array index file");
+  if (header.version != kVersion)
+    fail("unsupported version " + std::to_string(header.version) +
+         ", expected " + std::to_string(kVersion));
+  if (header.endian_check != kEndianCheck)
+    fail("written on a machine of a different endianness");
+  if (header.header_checksum !=
+      ComputeChecksum(&header, offsetof(FileHeader, header_checksum)))
+    fail("the checksum of the header doesn't match");
+  if (!IsValidDtype(header.text_dtype) ||
+      (header.index_dtype != static_cast<uint32_t>(IndexDtype::kInt32) &&
+       header.index_dtype != static_cast<uint32_t>(IndexDtype::kInt64)))
+    fail("invalid dtypes");
+  if (header.text_length < 4 || header.num_docs < 0)
+    fail("invalid lengths");
+
+  text_dtype_ = static_cast<IndexDtype>(header.text_dtype);
+  index_dtype_ = static_cast<IndexDtype>(header.index_dtype);
+  text_length_ = header.text_length;
+  num_docs_ = header.num_docs;
+  // The size of each section, or of the optional ones if present.
+  uint64_t expected_sizes[kNumSections] = {
+      text_length_ * DtypeSize(text_dtype_),
+      SeqLen() * DtypeSize(index_dtype_), SeqLen() * DtypeSize(index_dtype_),
+      (num_docs_ + 1) * sizeof(int64_t)};
+  for (int32_t s = 0; s < kNumSections; s++) {
+    offsets_[s] = header.sections[s].offset;
+    sizes_[s] = header.sections[s].size;
+    checksums_[s] = header.sections[s].checksum;
+    bool optional = s == kLcp || s == kRowSplits;
+    if (!(sizes_[s] == expected_sizes[s] || (optional && sizes_[s] == 0)) ||
+        offsets_[s] % kAlignment != 0 || offsets_[s] > size_ ||
+        sizes_[s] > size_ - offsets_[s])
+      fail("invalid section " + std::to_string(s) + " (truncated file?)");
+  }
+  if (sizes_[kRowSplits] == 0)
+    num_docs_ = 0;
+
+  if (verify_checksums) {
+    try {
+      VerifyChecksums();
+    } catch (const std::runtime_error &e) {
+      fail(e.what());
+    }
+  }
+}
+
+SuffixArrayIndex::~SuffixArrayIndex() { Unmap(); }
+
+void SuffixArrayIndex::Unmap() {
+#ifdef _WIN32
+  if (data_ != nullptr)
+    UnmapViewOfFile(data_);
+  if (mapping_ != nullptr)
+    CloseHandle(mapping_);
+  if (file_ != nullptr)
+    CloseHandle(file_);
+  mapping_ = file_ = nullptr;
+#else
+  if (data_ != nullptr)
+    munmap(const_cast<char *>(data_), size_);
+#endif
+  data_ = nullptr;
+}
+
+void SuffixArrayIndex::VerifyChecksums() const {
+  for (int32_t s = 0; s < kNumSections; s++) {
+    if (sizes_[s] != 0 &&
+        ComputeChecksum(data_ + offsets_[s], sizes_[s]) != checksums_[s])
+      throw std::runtime_error("the checksum of section " + std::to_string(s) +
+                               " doesn't match");
+  }
+}
+
+const void *SuffixArrayIndex::Section(SectionType s) const {
+  return sizes_[s] == 0 ? nullptr : data_ + offsets_[s];
+}
+
+} // namespace fasttextsearch
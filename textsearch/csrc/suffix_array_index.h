@@ -0,0 +1,211 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_SUFFIX_ARRAY_INDEX_H_
+#define TEXTSEARCH_CSRC_SUFFIX_ARRAY_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+/*
+  The element types of the arrays of a suffix array index file.  The values
+  are stored in the file, so they must not change.
+ */
+enum class IndexDtype : uint32_t {
+  kUint8 = 0,
+  kInt8 = 1,
+  kUint16 = 2,
+  kInt16 = 3,
+  kInt32 = 4,
+  kInt64 = 5,
+};
+
+// Returns the size in bytes of an element of type `dtype`.
+size_t DtypeSize(IndexDtype dtype);
+
+/*
+  The arrays to write to a suffix array index file, see
+  WriteSuffixArrayIndex().  They are not owned.
+ */
+struct SuffixArrayIndexArrays {
+  // The text the suffix array was created from, as passed to
+  // CreateSuffixArray(), i.e. including the termination symbol and the 3
+  // zeros after it.
+  const void *text = nullptr;
+  IndexDtype text_dtype = IndexDtype::kInt32;
+  int64_t text_length = 0;
+
+  // The suffix array, of seq_len = text_length - 3 elements of type
+  // index_dtype, kInt32 or kInt64.
+  const void *suffix_array = nullptr;
+  IndexDtype index_dtype = IndexDtype::kInt64;
+
+  // Optional: the LCP array of the suffix array, of seq_len elements of type
+  // index_dtype, or nullptr.
+  const void *lcp = nullptr;
+
+  // Optional: the row_splits of the documents of the text (num_docs + 1
+  // elements, as for FindCandidateMatches()), or nullptr.
+  const int64_t *row_splits = nullptr;
+  int64_t num_docs = 0;
+};
+
+/*
+  Writes a suffix array index file: a versioned header followed by the text,
+  the suffix array and optionally the LCP array and the row_splits of the
+  documents, each 64-byte aligned and with a checksum, so that
+  SuffixArrayIndex can memory-map it.
+
+  The suffix array (and LCP array) are stored as int32 if seq_len + 3 fits in
+  int32, whatever arrays.index_dtype is, else as int64.
+
+  Throws std::runtime_error if the file can't be written; the file is then
+  incomplete.
+ */
+void WriteSuffixArrayIndex(const std::string &filename,
+                           const SuffixArrayIndexArrays &arrays);
+
+/*
+  Writes a suffix array index file from the text and the suffix array in
+  pieces, for arrays that don't fit in memory (see
+  CreateSuffixArrayIndexExternal()).  The whole text must be added before the
+  suffix array; the file has no LCP array or row_splits.  As for
+  WriteSuffixArrayIndex() the suffix array is stored as int32 if
+  text_length fits in int32.
+
+  The methods throw std::runtime_error if the file can't be written, or if
+  Close() is called before all the text and the suffix array were added.
+ */
+class SuffixArrayIndexWriter {
+public:
+  SuffixArrayIndexWriter(const std::string &filename, IndexDtype text_dtype,
+                         int64_t text_length);
+  ~SuffixArrayIndexWriter();
+
+  SuffixArrayIndexWriter(const SuffixArrayIndexWriter &) = delete;
+  SuffixArrayIndexWriter &operator=(const SuffixArrayIndexWriter &) = delete;
+
+  // Appends `n` symbols of the text (including the termination symbol and
+  // the 3 zeros at its end).
+  void AddText(const void *symbols, int64_t n);
+
+  // Appends `n` elements of the suffix array, of seq_len = text_length - 3
+  // elements.
+  void AddSuffixArray(const int64_t *indexes, int64_t n);
+
+  // Writes the header; the file is incomplete until it is called.
+  void Close();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/*
+  Merges suffix array index files ("shards", e.g. built separately for parts
+  of a growing reference collection) into one whose text is the concatenation
+  of their texts, each with its termination symbol (so the merged text
+  contains the termination symbol once per shard, and ends with 3 zeros).
+  Its suffix array is that of the shards' suffixes, each compared only up to
+  the end of its shard, as from a k-way merge of the shards' suffix arrays;
+  equal suffixes are ordered by shard.  It has an LCP array (of these
+  comparisons) whether or not the shards have one, and row_splits with the
+  documents of all the shards (one per shard without row_splits).
+
+  The shards are memory-mapped and the output is written as it is merged, so
+  the memory used doesn't grow with the size of the shards, apart from the
+  page cache.  The work is O(seq_len * log(num_shards) * average LCP).
+
+  Throws std::runtime_error if a shard can't be read, if the shards have
+  different text dtypes or termination symbols, or if the output can't be
+  written.
+ */
+void MergeSuffixArrayIndexes(const std::vector<std::string> &filenames,
+                             const std::string &output_filename);
+
+/*
+  A suffix array index file written by WriteSuffixArrayIndex(), memory-mapped
+  read-only: the arrays point into the mapping, so loading takes no time
+  and processes that load the same file share its pages in the page cache.
+ */
+class SuffixArrayIndex {
+public:
+  /*
+    Maps the file.  Throws std::runtime_error if it can't be opened or is not
+    a suffix array index file of a version we can read, or if
+    verify_checksums and the checksum of a section doesn't match (that reads
+    the whole file; the header is always checked).
+   */
+  explicit SuffixArrayIndex(const std::string &filename,
+                            bool verify_checksums = false);
+  ~SuffixArrayIndex();
+
+  SuffixArrayIndex(const SuffixArrayIndex &) = delete;
+  SuffixArrayIndex &operator=(const SuffixArrayIndex &) = delete;
+
+  // Throws std::runtime_error if the checksum of a section doesn't match.
+  void VerifyChecksums() const;
+
+  const void *Text() const { return Section(kText); }
+  IndexDtype TextDtype() const { return text_dtype_; }
+  int64_t TextLength() const { return text_length_; }
+
+  // The suffix array and the LCP array (nullptr if the file has none), of
+  // SeqLen() elements of type IndexDtype().
+  const void *SuffixArray() const { return Section(kSuffixArray); }
+  const void *Lcp() const { return Section(kLcp); }
+  IndexDtype IndexType() const { return index_dtype_; }
+  int64_t SeqLen() const { return text_length_ - 3; }
+
+  // The row_splits of the documents (NumDocs() + 1 elements), or nullptr if
+  // the file has none.
+  const int64_t *RowSplits() const {
+    return static_cast<const int64_t *>(Section(kRowSplits));
+  }
+  int64_t NumDocs() const { return num_docs_; }
+
+  // The sections of the file, in this order.
+  enum SectionType { kText = 0, kSuffixArray, kLcp, kRowSplits, kNumSections };
+
+private:
+  const void *Section(SectionType s) const;
+  void Unmap();
+
+  const char *data_ = nullptr; // The mapping of the whole file.
+  size_t size_ = 0;
+#ifdef _WIN32
+  void *file_ = nullptr;
+  void *mapping_ = nullptr;
+#endif
+  IndexDtype text_dtype_ = IndexDtype::kInt32;
+  IndexDtype index_dtype_ = IndexDtype::kInt64;
+  int64_t text_length_ = 0;
+  int64_t num_docs_ = 0;
+  uint64_t offsets_[kNumSections] = {};
+  uint64_t sizes_[kNumSections] = {};
+  uint64_t checksums_[kNumSections] = {};
+};
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_SUFFIX_ARRAY_INDEX_H_
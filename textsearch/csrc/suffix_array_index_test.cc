@@ -0,0 +1,221 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/suffix_array.h"
+#include "textsearch/csrc/suffix_array_index.h"
+
+namespace fasttextsearch {
+
+// Returns a random text of seq_len symbols (including the termination
+// symbol) plus 3 zeros.
+static std::vector<uint8_t> RandomText(int32_t seq_len, std::mt19937 *rng) {
+  std::uniform_int_distribution<int32_t> uni(1, 3);
+  std::vector<uint8_t> text(seq_len + 3, 0);
+  for (int32_t i = 0; i + 1 < seq_len; i++)
+    text[i] = static_cast<uint8_t>(uni(*rng));
+  text[seq_len - 1] = 4; // Termination symbol
+  return text;
+}
+
+static void ModifyFile(const std::string &filename, long offset, char c) {
+  FILE *f = std::fopen(filename.c_str(), "r+b");
+  ASSERT_NE(f, nullptr);
+  std::fseek(f, offset, SEEK_SET);
+  std::fputc(c, f);
+  std::fclose(f);
+}
+
+TEST(SuffixArrayIndexTest, TestRoundTrip) {
+  std::mt19937 rng(0);
+  std::string filename = testing::TempDir() + "suffix_array_index_test.idx";
+  for (int32_t seq_len : {1, 2, 1000}) {
+    std::vector<uint8_t> text = RandomText(seq_len, &rng);
+    std::vector<int64_t> suffix_array(seq_len), lcp(seq_len);
+    CreateSuffixArray<uint8_t, int64_t>(text.data(), seq_len, 4,
+                                        suffix_array.data());
+    for (int32_t i = 0; i < seq_len; i++)
+      lcp[i] = i % 7;
+    std::vector<int64_t> row_splits = {0, seq_len / 2, seq_len};
+
+    for (bool optional : {false, true}) {
+      SuffixArrayIndexArrays arrays;
+      arrays.text = text.data();
+      arrays.text_dtype = IndexDtype::kUint8;
+      arrays.text_length = seq_len + 3;
+      arrays.suffix_array = suffix_array.data();
+      arrays.index_dtype = IndexDtype::kInt64;
+      if (optional) {
+        arrays.lcp = lcp.data();
+        arrays.row_splits = row_splits.data();
+        arrays.num_docs = 2;
+      }
+      WriteSuffixArrayIndex(filename, arrays);
+
+      SuffixArrayIndex index(filename, true);
+      EXPECT_EQ(index.TextDtype(), IndexDtype::kUint8);
+      EXPECT_EQ(index.TextLength(), seq_len + 3);
+      EXPECT_EQ(index.SeqLen(), seq_len);
+      EXPECT_EQ(std::memcmp(index.Text(), text.data(), text.size()), 0);
+      // The suffix array is small enough to be stored as int32.
+      ASSERT_EQ(index.IndexType(), IndexDtype::kInt32);
+      const int32_t *sa = static_cast<const int32_t *>(index.SuffixArray());
+      EXPECT_EQ(std::vector<int64_t>(sa, sa + seq_len), suffix_array);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(sa) % 64, 0);
+      if (optional) {
+        const int32_t *l = static_cast<const int32_t *>(index.Lcp());
+        ASSERT_NE(l, nullptr);
+        EXPECT_EQ(std::vector<int64_t>(l, l + seq_len), lcp);
+        ASSERT_NE(index.RowSplits(), nullptr);
+        EXPECT_EQ(index.NumDocs(), 2);
+        EXPECT_EQ(std::vector<int64_t>(index.RowSplits(),
+                                       index.RowSplits() + 3),
+                  row_splits);
+      } else {
+        EXPECT_EQ(index.Lcp(), nullptr);
+        EXPECT_EQ(index.RowSplits(), nullptr);
+        EXPECT_EQ(index.NumDocs(), 0);
+      }
+    }
+  }
+  std::remove(filename.c_str());
+}
+
+TEST(SuffixArrayIndexTest, TestCorruption) {
+  std::mt19937 rng(0);
+  std::string filename = testing::TempDir() + "suffix_array_index_test2.idx";
+  int32_t seq_len = 100;
+  std::vector<uint8_t> text = RandomText(seq_len, &rng);
+  std::vector<int32_t> suffix_array(seq_len);
+  CreateSuffixArray<uint8_t, int32_t>(text.data(), seq_len, 4,
+                                      suffix_array.data());
+  SuffixArrayIndexArrays arrays;
+  arrays.text = text.data();
+  arrays.text_dtype = IndexDtype::kUint8;
+  arrays.text_length = seq_len + 3;
+  arrays.suffix_array = suffix_array.data();
+  arrays.index_dtype = IndexDtype::kInt32;
+
+  // A modified byte in a section is only found when verifying the checksums;
+  // the text starts after the 256-byte header.
+  WriteSuffixArrayIndex(filename, arrays);
+  ModifyFile(filename, 256, 9);
+  {
+    SuffixArrayIndex index(filename);
+    EXPECT_THROW(index.VerifyChecksums(), std::runtime_error);
+  }
+  EXPECT_THROW(SuffixArrayIndex(filename, true), std::runtime_error);
+
+  // A modified header is always found.
+  WriteSuffixArrayIndex(filename, arrays);
+  ModifyFile(filename, 24, 9); // The text length.
+  EXPECT_THROW(SuffixArrayIndex index(filename), std::runtime_error);
+
+  WriteSuffixArrayIndex(filename, arrays);
+  ModifyFile(filename, 0, 'X'); // The magic.
+  EXPECT_THROW(SuffixArrayIndex index(filename), std::runtime_error);
+
+  std::remove(filename.c_str());
+  EXPECT_THROW(SuffixArrayIndex index(filename), std::runtime_error);
+}
+
+TEST(SuffixArrayIndexTest, TestMerge) {
+  std::mt19937 rng(0);
+  std::string dir = testing::TempDir();
+  std::vector<int32_t> seq_lens = {50, 1, 200, 77};
+  std::vector<std::string> filenames;
+  std::vector<uint8_t> merged_text;
+  // The end (the position of the termination symbol) of the shard of each
+  // position in the merged text.
+  std::vector<int64_t> shard_ends;
+  for (size_t s = 0; s < seq_lens.size(); s++) {
+    int32_t seq_len = seq_lens[s];
+    std::vector<uint8_t> text = RandomText(seq_len, &rng);
+    std::vector<int32_t> suffix_array(seq_len);
+    CreateSuffixArray<uint8_t, int32_t>(text.data(), seq_len, 4,
+                                        suffix_array.data());
+    std::vector<int64_t> row_splits = {0, seq_len / 3, seq_len - 1};
+    SuffixArrayIndexArrays arrays;
+    arrays.text = text.data();
+    arrays.text_dtype = IndexDtype::kUint8;
+    arrays.text_length = seq_len + 3;
+    arrays.suffix_array = suffix_array.data();
+    arrays.index_dtype = IndexDtype::kInt32;
+    if (s % 2 == 0) {
+      arrays.row_splits = row_splits.data();
+      arrays.num_docs = 2;
+    }
+    filenames.push_back(dir + "suffix_array_index_shard" + std::to_string(s) +
+                        ".idx");
+    WriteSuffixArrayIndex(filenames.back(), arrays);
+    merged_text.insert(merged_text.end(), text.begin(), text.begin() + seq_len);
+    shard_ends.insert(shard_ends.end(), seq_len, merged_text.size() - 1);
+  }
+  int64_t seq_len = merged_text.size();
+  merged_text.insert(merged_text.end(), 3, 0);
+
+  std::string filename = dir + "suffix_array_index_merged.idx";
+  MergeSuffixArrayIndexes(filenames, filename);
+  SuffixArrayIndex index(filename, true);
+  ASSERT_EQ(index.SeqLen(), seq_len);
+  EXPECT_EQ(std::memcmp(index.Text(), merged_text.data(), merged_text.size()),
+            0);
+  ASSERT_EQ(index.IndexType(), IndexDtype::kInt32);
+  const int32_t *sa = static_cast<const int32_t *>(index.SuffixArray());
+  const int32_t *lcp = static_cast<const int32_t *>(index.Lcp());
+  ASSERT_NE(lcp, nullptr);
+  std::vector<bool> seen(seq_len, false);
+  for (int64_t i = 0; i < seq_len; i++) {
+    ASSERT_TRUE(sa[i] >= 0 && sa[i] < seq_len && !seen[sa[i]]);
+    seen[sa[i]] = true;
+    if (i == 0) {
+      EXPECT_EQ(lcp[i], 0);
+      continue;
+    }
+    // Compare the suffixes up to the ends of their shards.
+    int64_t a = sa[i - 1], b = sa[i], h = 0;
+    while (a + h < shard_ends[a] && b + h < shard_ends[b] &&
+           merged_text[a + h] == merged_text[b + h])
+      h++;
+    EXPECT_EQ(lcp[i], h);
+    EXPECT_TRUE(merged_text[a + h] < merged_text[b + h] ||
+                (merged_text[a + h] == merged_text[b + h] &&
+                 shard_ends[a] < shard_ends[b]));
+  }
+
+  // The shards without row_splits are one document each, and the termination
+  // symbols are in the last document of their shard.
+  ASSERT_EQ(index.NumDocs(), 6);
+  std::vector<int64_t> row_splits = {0, 16, 50, 51, 117, 251, 327};
+  EXPECT_EQ(std::vector<int64_t>(index.RowSplits(), index.RowSplits() + 7),
+            row_splits);
+
+  for (const std::string &f : filenames)
+    std::remove(f.c_str());
+  std::remove(filename.c_str());
+}
+
+} // namespace fasttextsearch
@@ -20,6 +20,7 @@
 #include "gtest/gtest.h"
 
 #include <algorithm>
+#include <limits>
 #include <random>
 #include <vector>
 
@@ -104,4 +105,187 @@ TEST(SuffixArrayTest, TestBasic) {
     }
   }
 }
+
+TEST(SuffixArrayTest, TestSais) {
+  std::mt19937 rng(RandInt(0, 1000000));
+  for (int32_t i = 0; i < 200; i++) {
+    // Small alphabets give lots of repeated substrings, and hence deep
+    // recursion.
+    int32_t array_len = RandInt(1, 2000), max_symbol = RandInt(2, 300);
+    if (i < 2)
+      array_len = i + 1;
+    if (i == 2)
+      max_symbol = 2; // all symbols except the termination symbol are 1.
+    std::uniform_int_distribution<int32_t> uni(1, max_symbol - 1);
+
+    std::vector<int32_t> array(array_len + 3, 0);
+    for (int32_t j = 0; j + 1 < array_len; j++)
+      array[j] = uni(rng);
+    array[array_len - 1] = max_symbol; // Termination symbol
+
+    std::vector<int32_t> dc3(array_len), sais(array_len + 1);
+    sais[array_len] = -10; // should not be changed.
+    CreateSuffixArray<int32_t>(array.data(), array_len, max_symbol,
+                               dc3.data(), SuffixArrayAlgorithm::kDc3);
+    CreateSuffixArray<int32_t>(array.data(), array_len, max_symbol,
+                               sais.data(), SuffixArrayAlgorithm::kSais);
+    EXPECT_EQ(sais[array_len], -10);
+    sais.resize(array_len);
+    EXPECT_EQ(sais, dc3);
+  }
+}
+
+TEST(SuffixArrayTest, TestNumThreads) {
+  std::mt19937 rng(RandInt(0, 1000000));
+  // The inputs must be large for the work to be split across threads;
+  // max_symbol > 2^16 tests the radix sort by digits.
+  for (int32_t max_symbol : {3, 1000, 100000}) {
+    int32_t array_len = RandInt(200000, 400000);
+    std::uniform_int_distribution<int32_t> uni(1, max_symbol - 1);
+    std::vector<int32_t> array(array_len + 3, 0);
+    for (int32_t j = 0; j + 1 < array_len; j++)
+      array[j] = uni(rng);
+    // a repeated region to make the recursion deeper.
+    std::copy(array.begin(), array.begin() + array_len / 4,
+              array.begin() + array_len / 2);
+    array[array_len - 1] = max_symbol; // Termination symbol
+
+    std::vector<int32_t> expected(array_len), suffix_array(array_len);
+    CreateSuffixArray<int32_t>(array.data(), array_len, max_symbol,
+                               expected.data(), SuffixArrayAlgorithm::kSais);
+    for (int32_t num_threads : {1, 2, 3, 4}) {
+      CreateSuffixArray<int32_t>(array.data(), array_len, max_symbol,
+                                 suffix_array.data(),
+                                 SuffixArrayAlgorithm::kDc3, num_threads);
+      EXPECT_EQ(suffix_array, expected);
+    }
+  }
+}
+
+// Computes the suffix array of `text` (given as int32_t, with the
+// termination symbol and padding) with the given symbol and index types.
+template <typename SymbolT, typename IndexT>
+static std::vector<int32_t>
+SuffixArrayWithTypes(const std::vector<int32_t> &text,
+                     SuffixArrayAlgorithm algorithm) {
+  std::vector<SymbolT> symbols(text.begin(), text.end());
+  IndexT seq_len = static_cast<IndexT>(text.size() - 3);
+  std::vector<IndexT> suffix_array(seq_len);
+  CreateSuffixArray(symbols.data(), seq_len, symbols[seq_len - 1],
+                    suffix_array.data(), algorithm);
+  return std::vector<int32_t>(suffix_array.begin(), suffix_array.end());
+}
+
+TEST(SuffixArrayTest, TestSymbolAndIndexTypes) {
+  std::mt19937 rng(RandInt(0, 1000000));
+  for (int32_t i = 0; i < 20; i++) {
+    int32_t array_len = RandInt(1, 5000), max_symbol = 254;
+    std::uniform_int_distribution<int32_t> uni(1, RandInt(2, max_symbol - 1));
+    std::vector<int32_t> array(array_len + 3, 0);
+    for (int32_t j = 0; j + 1 < array_len; j++)
+      array[j] = uni(rng);
+    array[array_len - 1] = max_symbol; // Termination symbol
+
+    for (auto algorithm :
+         {SuffixArrayAlgorithm::kDc3, SuffixArrayAlgorithm::kSais}) {
+      auto expected = SuffixArrayWithTypes<int64_t, int64_t>(array, algorithm);
+      EXPECT_EQ((SuffixArrayWithTypes<uint8_t, int32_t>(array, algorithm)),
+                expected);
+      EXPECT_EQ((SuffixArrayWithTypes<uint8_t, int64_t>(array, algorithm)),
+                expected);
+      EXPECT_EQ((SuffixArrayWithTypes<uint16_t, int32_t>(array, algorithm)),
+                expected);
+      EXPECT_EQ((SuffixArrayWithTypes<uint16_t, int64_t>(array, algorithm)),
+                expected);
+      EXPECT_EQ((SuffixArrayWithTypes<int32_t, int64_t>(array, algorithm)),
+                expected);
+    }
+  }
+}
+
+TEST(SuffixArrayTest, TestLcpArray) {
+  std::mt19937 rng(RandInt(0, 1000000));
+  for (int32_t i = 0; i < 30; i++) {
+    // Texts longer than 1 << 16 per thread are split across threads.
+    int32_t array_len = i < 25 ? RandInt(1, 3000) : RandInt(100000, 300000),
+            max_symbol = RandInt(2, 10);
+    std::uniform_int_distribution<int32_t> uni(1, max_symbol - 1);
+    std::vector<int32_t> array(array_len + 3, 0);
+    for (int32_t j = 0; j + 1 < array_len; j++)
+      array[j] = uni(rng);
+    // a repeated region, for long common prefixes (not too long, as the
+    // simple LCP computation below would be quadratic).
+    std::copy(array.begin(), array.begin() + std::min(array_len / 4, 1000),
+              array.begin() + array_len / 2);
+    array[array_len - 1] = max_symbol; // Termination symbol
+
+    std::vector<int64_t> suffix_array(array_len);
+    CreateSuffixArray<int32_t, int64_t>(array.data(), array_len, max_symbol,
+                                        suffix_array.data(),
+                                        SuffixArrayAlgorithm::kSais);
+    std::vector<int64_t> expected(array_len, 0);
+    for (int32_t j = 1; j < array_len; j++) {
+      int64_t a = suffix_array[j - 1], b = suffix_array[j], h = 0;
+      while (array[a + h] == array[b + h])
+        h++;
+      expected[j] = h;
+    }
+
+    for (int32_t num_threads : {1, 2, 3}) {
+      std::vector<int64_t> lcp(array_len + 1, -10);
+      CreateLcpArray<int32_t, int64_t>(array.data(), array_len,
+                                       suffix_array.data(), lcp.data(),
+                                       num_threads);
+      EXPECT_EQ(lcp.back(), -10); // should not write past the end.
+      lcp.pop_back();
+      EXPECT_EQ(lcp, expected);
+    }
+  }
+}
+
+TEST(SuffixArrayTest, TestCompactAlphabet) {
+  const int32_t eos = std::numeric_limits<int32_t>::max() - 1;
+  // Both of the ways of mapping the symbols: a table for "Unicode" symbols
+  // and a sorted list for very large ones.
+  for (int32_t scale : {1, 100000}) {
+    std::vector<int32_t> text = {50 * scale, 7 * scale, 50 * scale, 0,
+                                 9 * scale,  eos,       0,          0,
+                                 0};
+    std::vector<int32_t> compact_text(text.size(), -1), symbols;
+    EXPECT_EQ(CompactAlphabet<int32_t>(text.data(), 6, compact_text.data(),
+                                       &symbols),
+              4);
+    EXPECT_EQ(compact_text, (std::vector<int32_t>{3, 1, 3, 0, 2, 4, 0, 0, 0}));
+    EXPECT_EQ(symbols,
+              (std::vector<int32_t>{0, 7 * scale, 9 * scale, 50 * scale, eos}));
+  }
+
+  // A large max_symbol makes CreateSuffixArray() compact the alphabet; the
+  // suffix array is that of the text with the small symbols.
+  std::mt19937 rng(RandInt(0, 1000000));
+  for (int32_t array_len : {1, 2, 1000, 300000}) {
+    std::uniform_int_distribution<int32_t> uni(1, 2000);
+    std::vector<int32_t> small(array_len + 3, 0), large(array_len + 3, 0);
+    for (int32_t j = 0; j + 1 < array_len; j++) {
+      small[j] = uni(rng);
+      large[j] = small[j] * 500000;
+    }
+    small[array_len - 1] = 2001;
+    large[array_len - 1] = eos;
+
+    std::vector<int32_t> expected(array_len), suffix_array(array_len);
+    CreateSuffixArray<int32_t>(small.data(), array_len, 2001,
+                               expected.data());
+    for (auto algorithm :
+         {SuffixArrayAlgorithm::kDc3, SuffixArrayAlgorithm::kSais}) {
+      for (int32_t num_threads : {1, 3}) {
+        CreateSuffixArray<int32_t>(large.data(), array_len, eos,
+                                   suffix_array.data(), algorithm,
+                                   num_threads);
+        EXPECT_EQ(suffix_array, expected);
+      }
+    }
+  }
+}
+
 } // namespace fasttextsearch
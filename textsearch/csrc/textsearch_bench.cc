@@ -0,0 +1,446 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+  Benchmarks of the suffix array construction, the close match and candidate
+  searches and the Levenshtein engines, on synthetic and real text.  Build
+  with -DFTS_ENABLE_BENCHMARKS=ON and run e.g.
+
+    ./bin/textsearch_bench --benchmark_out=bench.json \
+        --benchmark_out_format=json
+
+  The real text is the file in the environment variable FTS_BENCH_TEXT (by
+  default README.txt of the source tree), repeated with 1% of its symbols
+  changed in each copy up to the size of the benchmark.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "textsearch/csrc/close_matches.h"
+#include "textsearch/csrc/fm_index.h"
+#include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/levenshtein_hirschberg.h"
+#include "textsearch/csrc/levenshtein_simd.h"
+#include "textsearch/csrc/minimizer_index.h"
+#include "textsearch/csrc/reference_index.h"
+#include "textsearch/csrc/suffix_array.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+enum TextKind { kRandom = 0, kRepetitive = 1, kReal = 2 };
+
+const char *TextKindName(int64_t kind) {
+  return kind == kRandom ? "random" : kind == kRepetitive ? "repetitive"
+                                                          : "real";
+}
+
+const std::string &RealText() {
+  static const std::string text = [] {
+    const char *filename = std::getenv("FTS_BENCH_TEXT");
+    std::ifstream is(filename != nullptr ? filename : FTS_BENCH_TEXT,
+                     std::ios::binary);
+    std::string s((std::istreambuf_iterator<char>(is)),
+                  std::istreambuf_iterator<char>());
+    return s.empty() ? std::string("no text") : s;
+  }();
+  return text;
+}
+
+/*
+  Returns `size` symbols in [1, alphabet_size] of the given kind: uniformly
+  random; copies of a few random blocks of 1000 symbols, with 1% of the
+  symbols changed; or the real text, with its bytes (or, for larger
+  alphabets, pairs of them) as symbols.
+ */
+template <typename SymbolT>
+std::vector<SymbolT> MakeText(int64_t size, int64_t kind,
+                              int64_t alphabet_size, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int64_t> symbol(1, alphabet_size);
+  std::vector<SymbolT> text(size);
+  if (kind == kRandom) {
+    for (auto &s : text)
+      s = static_cast<SymbolT>(symbol(rng));
+    return text;
+  }
+  std::vector<SymbolT> source;
+  if (kind == kRepetitive) {
+    source.resize(8000);
+    for (auto &s : source)
+      s = static_cast<SymbolT>(symbol(rng));
+  } else {
+    const std::string &real = RealText();
+    bool pairs = alphabet_size > 256;
+    for (size_t i = 0; i < real.size(); i += pairs ? 2 : 1) {
+      int64_t s = static_cast<unsigned char>(real[i]);
+      if (pairs && i + 1 < real.size())
+        s = s * 256 + static_cast<unsigned char>(real[i + 1]);
+      source.push_back(static_cast<SymbolT>(s % alphabet_size + 1));
+    }
+  }
+  for (int64_t i = 0; i < size;) {
+    int64_t begin = kind == kRepetitive ? rng() % 8 * 1000 : 0,
+            n = std::min<int64_t>(kind == kRepetitive ? 1000 : source.size(),
+                                  size - i);
+    std::copy(source.begin() + begin, source.begin() + begin + n,
+              text.begin() + i);
+    for (int64_t j = 0; j < n / 100; j++)
+      text[i + rng() % n] = static_cast<SymbolT>(symbol(rng));
+    i += n;
+  }
+  return text;
+}
+
+// Appends the termination symbol alphabet_size + 1 and the 3 zeros.
+template <typename SymbolT>
+void AppendEos(int64_t alphabet_size, std::vector<SymbolT> *text) {
+  text->push_back(static_cast<SymbolT>(alphabet_size + 1));
+  text->insert(text->end(), 3, 0);
+}
+
+/*
+  Args: the size of the text, its kind, the size of the alphabet and the
+  algorithm.
+ */
+template <typename SymbolT, typename IndexT>
+void BM_CreateSuffixArray(benchmark::State &state) {
+  int64_t size = state.range(0), kind = state.range(1),
+          alphabet_size = state.range(2);
+  auto algorithm = static_cast<SuffixArrayAlgorithm>(state.range(3));
+  std::vector<SymbolT> text = MakeText<SymbolT>(size, kind, alphabet_size, 0);
+  AppendEos(alphabet_size, &text);
+  IndexT seq_len = static_cast<IndexT>(size + 1);
+  std::vector<IndexT> suffix_array(seq_len);
+  for (auto _ : state) {
+    CreateSuffixArray(text.data(), seq_len,
+                      static_cast<SymbolT>(alphabet_size + 1),
+                      suffix_array.data(), algorithm);
+    benchmark::DoNotOptimize(suffix_array.data());
+  }
+  state.SetItemsProcessed(state.iterations() * seq_len);
+  state.SetLabel(std::string(TextKindName(kind)) +
+                 (algorithm == SuffixArrayAlgorithm::kSais ? " sais" : " dc3"));
+}
+
+void SuffixArrayArgs(benchmark::internal::Benchmark *b,
+                     std::vector<int64_t> alphabet_sizes) {
+  for (int64_t size : {1 << 16, 1 << 20, 1 << 23})
+    for (int64_t kind : {kRandom, kRepetitive, kReal})
+      for (int64_t alphabet_size : alphabet_sizes)
+        for (int64_t algorithm : {0, 1})
+          b->Args({size, kind, alphabet_size, algorithm});
+  b->ArgNames({"size", "kind", "alphabet", "algorithm"});
+  b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_TEMPLATE(BM_CreateSuffixArray, uint8_t, int32_t)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      SuffixArrayArgs(b, {4, 254});
+    });
+BENCHMARK_TEMPLATE(BM_CreateSuffixArray, uint8_t, int64_t)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      SuffixArrayArgs(b, {254});
+    });
+BENCHMARK_TEMPLATE(BM_CreateSuffixArray, uint16_t, int32_t)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      SuffixArrayArgs(b, {60000});
+    });
+// Large alphabets, which are compacted first.
+BENCHMARK_TEMPLATE(BM_CreateSuffixArray, int32_t, int32_t)
+    ->Apply([](benchmark::internal::Benchmark *b) {
+      SuffixArrayArgs(b, {30000, 1 << 28});
+    });
+
+/*
+  The text of the close match benchmarks: a query of query_len symbols (parts
+  of the reference with errors, like a transcript) followed by a reference of
+  ref_len symbols of the given kind, with its suffix array and LCP array.
+ */
+struct CloseMatchInput {
+  static constexpr int64_t kAlphabetSize = 254;
+  int32_t query_len;
+  int32_t seq_len;
+  std::vector<uint8_t> text;
+  std::vector<int32_t> suffix_array;
+  std::vector<int32_t> lcp;
+
+  CloseMatchInput(int64_t query_len, int64_t ref_len, int64_t kind)
+      : query_len(static_cast<int32_t>(query_len)),
+        seq_len(static_cast<int32_t>(query_len + ref_len + 1)) {
+    std::vector<uint8_t> ref = MakeText<uint8_t>(ref_len, kind, kAlphabetSize,
+                                                 1);
+    std::mt19937 rng(2);
+    for (int64_t i = 0; i < query_len; i += 1000) {
+      int64_t n = std::min<int64_t>(1000, query_len - i),
+              begin = rng() % (ref_len - n);
+      text.insert(text.end(), ref.begin() + begin, ref.begin() + begin + n);
+      for (int64_t j = 0; j < n / 10; j++)
+        text[i + rng() % n] = 1 + rng() % kAlphabetSize;
+    }
+    text.insert(text.end(), ref.begin(), ref.end());
+    AppendEos(kAlphabetSize, &text);
+    suffix_array.resize(seq_len);
+    lcp.resize(seq_len);
+    CreateSuffixArray(text.data(), seq_len,
+                      static_cast<uint8_t>(kAlphabetSize + 1),
+                      suffix_array.data(), SuffixArrayAlgorithm::kSais);
+    CreateLcpArray(text.data(), seq_len, suffix_array.data(), lcp.data());
+  }
+
+  // The reference text on its own, starting at query_len, with its suffix
+  // array.
+  int32_t RefSeqLen() const { return seq_len - query_len; }
+  std::vector<int32_t> RefSuffixArray() const {
+    std::vector<int32_t> sa;
+    for (int32_t pos : suffix_array)
+      if (pos >= query_len)
+        sa.push_back(pos - query_len);
+    return sa;
+  }
+};
+
+// Args: the query length, the reference length and the kind of reference.
+void CloseMatchArgs(benchmark::internal::Benchmark *b) {
+  for (int64_t kind : {kRandom, kReal})
+    b->Args({10000, 1 << 20, kind})->Args({100000, 1 << 23, kind});
+  b->ArgNames({"query", "ref", "kind"});
+  b->Unit(benchmark::kMicrosecond);
+}
+
+void BM_FindCloseMatches(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  std::vector<int32_t> output(2 * input.query_len);
+  for (auto _ : state) {
+    FindCloseMatches(input.suffix_array.data(), input.seq_len,
+                     input.query_len, output.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.seq_len);
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_FindCloseMatches)->Apply(CloseMatchArgs);
+
+void BM_FindCloseMatchesWithLengths(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  const int32_t k = 2;
+  std::vector<int32_t> output(2 * k * input.query_len),
+      lengths(output.size());
+  for (auto _ : state) {
+    FindCloseMatchesWithLengths(input.suffix_array.data(), input.lcp.data(),
+                                input.seq_len, input.query_len, k, 0,
+                                output.data(), lengths.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.seq_len);
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_FindCloseMatchesWithLengths)->Apply(CloseMatchArgs);
+
+void BM_FindCandidateMatches(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  std::vector<int32_t> close_matches(2 * input.query_len);
+  FindCloseMatches(input.suffix_array.data(), input.seq_len, input.query_len,
+                   close_matches.data());
+  // Query documents of 1000 symbols, and one reference document.
+  std::vector<int32_t> row_splits;
+  for (int32_t i = 0; i < input.query_len; i += 1000)
+    row_splits.push_back(i);
+  int32_t num_query_docs = static_cast<int32_t>(row_splits.size());
+  row_splits.push_back(input.query_len);
+  row_splits.push_back(input.seq_len - 1);
+  const int32_t num_candidates = 5;
+  std::vector<int64_t> candidates(num_query_docs * num_candidates * 2);
+  for (auto _ : state) {
+    FindCandidateMatches(close_matches.data(), row_splits.data(),
+                         num_query_docs + 1, num_query_docs, 2.0f,
+                         num_candidates, candidates.data());
+    benchmark::DoNotOptimize(candidates.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.query_len);
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_FindCandidateMatches)->Apply(CloseMatchArgs);
+
+// The seeders of a reference on its own: its suffix array, an FM-index with
+// a sample rate of 32 and a minimizer index with k = 12, w = 6.
+void BM_FindCloseMatchesInReference(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  const uint8_t *ref = input.text.data() + input.query_len;
+  int32_t ref_seq_len = input.RefSeqLen();
+  std::vector<int32_t> suffix_array = input.RefSuffixArray();
+  std::vector<int32_t> output(2 * input.query_len), lengths(output.size());
+  for (auto _ : state) {
+    FindCloseMatchesInReference(ref, ref_seq_len, suffix_array.data(),
+                                static_cast<const int32_t *>(nullptr),
+                                input.text.data(), input.query_len, 1, 0,
+                                output.data(), lengths.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.query_len);
+  state.counters["index_bytes"] =
+      static_cast<double>(suffix_array.size() * sizeof(int32_t));
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_FindCloseMatchesInReference)->Apply(CloseMatchArgs);
+
+void BM_FmIndexFindCloseMatches(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  const uint8_t *ref = input.text.data() + input.query_len;
+  std::vector<int32_t> suffix_array = input.RefSuffixArray();
+  FmIndex<uint8_t, int32_t> index(ref, input.RefSeqLen(),
+                                  suffix_array.data(), 32);
+  std::vector<int32_t> output(2 * input.query_len), lengths(output.size());
+  for (auto _ : state) {
+    index.FindCloseMatches(input.text.data(), input.query_len, 1, 0,
+                           output.data(), lengths.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.query_len);
+  state.counters["index_bytes"] = static_cast<double>(index.NumBytes());
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_FmIndexFindCloseMatches)->Apply(CloseMatchArgs);
+
+void BM_MinimizerIndexFindCloseMatches(benchmark::State &state) {
+  CloseMatchInput input(state.range(0), state.range(1), state.range(2));
+  const uint8_t *ref = input.text.data() + input.query_len;
+  MinimizerIndex<uint8_t, int32_t> index(ref, input.RefSeqLen(), 12, 6);
+  std::vector<int32_t> output(2 * input.query_len), lengths(output.size());
+  for (auto _ : state) {
+    index.FindCloseMatches(input.text.data(), input.query_len, 1, 0,
+                           output.data(), lengths.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.query_len);
+  state.counters["index_bytes"] = static_cast<double>(index.NumBytes());
+  state.SetLabel(TextKindName(state.range(2)));
+}
+BENCHMARK(BM_MinimizerIndexFindCloseMatches)->Apply(CloseMatchArgs);
+
+/*
+  A query of query_len symbols of the real text, and a target of 4 *
+  query_len random symbols with a copy of the query in the middle of it, with
+  error_percent percent of its symbols changed, inserted or deleted.
+ */
+void MakeLevenshteinInput(int64_t query_len, int64_t error_percent,
+                          std::vector<int32_t> *query,
+                          std::vector<int32_t> *target) {
+  *query = MakeText<int32_t>(query_len, kReal, 254, 3);
+  std::mt19937 rng(4);
+  target->clear();
+  for (int64_t i = 0; i < 2 * query_len; i++)
+    target->push_back(1 + rng() % 254);
+  for (int32_t s : *query) {
+    if (static_cast<int64_t>(rng() % 100) >= error_percent) {
+      target->push_back(s);
+      continue;
+    }
+    int32_t error = rng() % 3;
+    if (error == 0)
+      target->push_back(1 + rng() % 254); // replacement
+    else if (error == 1)
+      target->insert(target->end(), {s, static_cast<int32_t>(1 + rng() % 254)});
+    // else a deletion.
+  }
+  for (int64_t i = 0; i < 2 * query_len; i++)
+    target->push_back(1 + rng() % 254);
+}
+
+// Args: the query length, the error rate in percent and whether to get the
+// alignment; the engines are as for LevenshteinDistance(), and -1 stands
+// for LevenshteinDistanceLinearMemory().
+void BM_LevenshteinDistance(benchmark::State &state) {
+  std::vector<int32_t> query, target;
+  MakeLevenshteinInput(state.range(0), state.range(1), &query, &target);
+  bool with_alignment = state.range(2) != 0;
+  int64_t engine = state.range(3);
+  std::vector<LevenshteinElement> alignments;
+  LevenshteinElement alignment;
+  BacktraceArena arena;
+  for (auto _ : state) {
+    int32_t distance;
+    if (engine < 0) {
+      distance = LevenshteinDistanceLinearMemory(
+          query.data(), query.size(), target.data(), target.size(),
+          with_alignment ? &alignment : nullptr, &arena);
+    } else {
+      distance = LevenshteinDistance(
+          query.data(), query.size(), target.data(), target.size(),
+          with_alignment ? &alignments : nullptr, &arena, 1, 1, 1,
+          static_cast<LevenshteinEngine>(engine));
+    }
+    benchmark::DoNotOptimize(distance);
+  }
+  // Cells of the dp matrix.
+  state.SetItemsProcessed(state.iterations() * query.size() * target.size());
+  const char *names[] = {"hirschberg", "auto", "scalar", "bit_parallel",
+                         "simd"};
+  state.SetLabel(names[engine + 1]);
+}
+BENCHMARK(BM_LevenshteinDistance)
+    ->ArgsProduct({{32, 128, 512, 2048},
+                   {0, 5, 20},
+                   {0, 1},
+                   {-1, static_cast<int64_t>(LevenshteinEngine::kScalar),
+                    static_cast<int64_t>(LevenshteinEngine::kBitParallel),
+                    static_cast<int64_t>(LevenshteinEngine::kSimd)}})
+    ->ArgNames({"query", "errors", "alignment", "engine"})
+    ->Unit(benchmark::kMicrosecond);
+
+// Each vector width that the cpu supports; args as for BM_LevenshteinDistance
+// with the width instead of the engine.
+void BM_LevenshteinDistanceSimd(benchmark::State &state) {
+  std::vector<int32_t> query, target;
+  MakeLevenshteinInput(state.range(0), state.range(1), &query, &target);
+  bool with_alignment = state.range(2) != 0;
+  int32_t width = static_cast<int32_t>(state.range(3));
+  std::vector<int32_t> widths = internal::LevenshteinSimdWidths();
+  if (std::find(widths.begin(), widths.end(), width) == widths.end()) {
+    state.SkipWithError("width not supported by this cpu");
+    return;
+  }
+  std::vector<LevenshteinElement> alignments;
+  BacktraceArena arena;
+  for (auto _ : state) {
+    int32_t distance = LevenshteinDistanceSimd(
+        query.data(), query.size(), target.data(), target.size(),
+        with_alignment ? &alignments : nullptr, &arena, 1, 1, 1,
+        -1, width);
+    benchmark::DoNotOptimize(distance);
+  }
+  state.SetItemsProcessed(state.iterations() * query.size() * target.size());
+}
+BENCHMARK(BM_LevenshteinDistanceSimd)
+    ->ArgsProduct({{32, 128, 512, 2048}, {0, 5, 20}, {0, 1}, {4, 8, 16}})
+    ->ArgNames({"query", "errors", "alignment", "width"})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+} // namespace fasttextsearch
+
+BENCHMARK_MAIN();
@@ -0,0 +1,220 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/csrc/utf8.h"
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "textsearch/csrc/parallel.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+namespace {
+
+// Texts are split into chunks of at least this many bytes for the threads.
+constexpr int64_t kMinChunkSize = 1 << 16;
+
+// The top bit of each byte of a word; a word of ASCII has none of them set.
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+inline bool IsContinuation(uint8_t b) { return (b & 0xC0) == 0x80; }
+
+inline uint64_t Load64(const uint8_t *p) {
+  uint64_t word;
+  std::memcpy(&word, p, 8);
+  return word;
+}
+
+inline int32_t PopCount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return static_cast<int32_t>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/*
+  Returns the start of the chunk of the text that begins at or after `pos`:
+  `pos` moved past any continuation bytes, so that all the bytes of a code
+  point are in the same chunk.
+ */
+int64_t ChunkStart(const uint8_t *data, int64_t size, int64_t pos) {
+  if (pos == 0)
+    return 0;
+  while (pos < size && IsContinuation(data[pos]))
+    pos++;
+  return pos;
+}
+
+/*
+  Decodes the UTF-8 sequence at p[0:avail], avail >= 1.  Returns its length,
+  setting *code_point, or 0 if it is invalid.
+ */
+inline int32_t DecodeOne(const uint8_t *p, int64_t avail, int32_t *code_point) {
+  uint8_t b0 = p[0];
+  if (b0 < 0x80) {
+    *code_point = b0;
+    return 1;
+  }
+  // 0x80-0xBF are continuation bytes, 0xC0 and 0xC1 can only start overlong
+  // encodings and 0xF5-0xFF code points above U+10FFFF.
+  if (b0 < 0xC2 || b0 > 0xF4)
+    return 0;
+  int32_t length = b0 < 0xE0 ? 2 : (b0 < 0xF0 ? 3 : 4);
+  if (avail < length)
+    return 0;
+  // The second byte is restricted more to exclude overlong encodings (0xE0,
+  // 0xF0), the surrogates U+D800-U+DFFF (0xED), and code points above
+  // U+10FFFF (0xF4).
+  uint8_t lo = 0x80, hi = 0xBF, b1 = p[1];
+  if (b0 == 0xE0)
+    lo = 0xA0;
+  else if (b0 == 0xED)
+    hi = 0x9F;
+  else if (b0 == 0xF0)
+    lo = 0x90;
+  else if (b0 == 0xF4)
+    hi = 0x8F;
+  if (b1 < lo || b1 > hi)
+    return 0;
+  if (length == 2) {
+    *code_point = ((b0 & 0x1F) << 6) | (b1 & 0x3F);
+  } else if (length == 3) {
+    if (!IsContinuation(p[2]))
+      return 0;
+    *code_point = ((b0 & 0x0F) << 12) | ((b1 & 0x3F) << 6) | (p[2] & 0x3F);
+  } else {
+    if (!IsContinuation(p[2]) || !IsContinuation(p[3]))
+      return 0;
+    *code_point = ((b0 & 0x07) << 18) | ((b1 & 0x3F) << 12) |
+                  ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+  }
+  return length;
+}
+
+// Returns the number of bytes in data[begin:end] that are not continuation
+// bytes, i.e. of code points if it is valid UTF-8.
+int64_t CountCodePoints(const uint8_t *data, int64_t begin, int64_t end) {
+  int64_t num_continuations = 0, i = begin;
+  for (; i + 8 <= end; i += 8) {
+    // A continuation byte has its top bit set and the next one clear.
+    uint64_t word = Load64(data + i);
+    num_continuations += PopCount(word & ~(word << 1) & kHighBits);
+  }
+  for (; i < end; i++)
+    num_continuations += IsContinuation(data[i]);
+  return (end - begin) - num_continuations;
+}
+
+} // namespace
+
+int64_t ValidateUtf8(const uint8_t *data, int64_t size,
+                     int64_t *num_code_points, int32_t num_threads) {
+  assert(size >= 0);
+  FTS_STATS_SCOPE(Stage::kUtf8);
+  int32_t num_chunks = NumChunks(size, num_threads, kMinChunkSize);
+  std::vector<int64_t> errors(num_chunks, -1), counts(num_chunks, 0);
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    begin = ChunkStart(data, size, begin);
+    end = ChunkStart(data, size, end);
+    int64_t i = begin, count = 0;
+    int32_t code_point;
+    while (i < end) {
+      if (i + 8 <= end && (Load64(data + i) & kHighBits) == 0) {
+        i += 8;
+        count += 8;
+        continue;
+      }
+      int32_t length = DecodeOne(data + i, size - i, &code_point);
+      if (length == 0) {
+        errors[c] = i;
+        return;
+      }
+      i += length;
+      count++;
+    }
+    counts[c] = count;
+  });
+
+  int64_t total = 0;
+  for (int32_t c = 0; c < num_chunks; c++) {
+    if (errors[c] != -1)
+      return errors[c];
+    total += counts[c];
+  }
+  if (num_code_points != nullptr)
+    *num_code_points = total;
+  return -1;
+}
+
+template <typename OffsetT>
+void DecodeUtf8(const uint8_t *data, int64_t size, int32_t *code_points,
+                OffsetT *byte_offsets, int32_t num_threads) {
+  assert(size >= 0);
+  FTS_STATS_SCOPE(Stage::kUtf8);
+  int32_t num_chunks = NumChunks(size, num_threads, kMinChunkSize);
+  // The index of the first code point of each chunk.
+  std::vector<int64_t> starts(num_chunks + 1, 0);
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    starts[c + 1] = CountCodePoints(data, ChunkStart(data, size, begin),
+                                    ChunkStart(data, size, end));
+  });
+  for (int32_t c = 0; c < num_chunks; c++)
+    starts[c + 1] += starts[c];
+
+  ParallelFor(size, num_chunks, [&](int32_t c, int64_t begin, int64_t end) {
+    begin = ChunkStart(data, size, begin);
+    end = ChunkStart(data, size, end);
+    int32_t *out = code_points + starts[c];
+    OffsetT *offsets = byte_offsets ? byte_offsets + starts[c] : nullptr;
+    for (int64_t i = begin; i < end;) {
+      if (i + 8 <= end && (Load64(data + i) & kHighBits) == 0) {
+        for (int32_t j = 0; j < 8; j++)
+          out[j] = data[i + j];
+        out += 8;
+        if (offsets != nullptr) {
+          for (int32_t j = 0; j < 8; j++)
+            offsets[j] = static_cast<OffsetT>(i + j);
+          offsets += 8;
+        }
+        i += 8;
+        continue;
+      }
+      int32_t length = DecodeOne(data + i, size - i, out++);
+      assert(length != 0);
+      if (offsets != nullptr)
+        *offsets++ = static_cast<OffsetT>(i);
+      i += length;
+    }
+  });
+}
+
+template void DecodeUtf8(const uint8_t *data, int64_t size,
+                         int32_t *code_points, uint32_t *byte_offsets,
+                         int32_t num_threads);
+template void DecodeUtf8(const uint8_t *data, int64_t size,
+                         int32_t *code_points, uint64_t *byte_offsets,
+                         int32_t num_threads);
+
+} // namespace fasttextsearch
@@ -0,0 +1,67 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXTSEARCH_CSRC_UTF8_H_
+#define TEXTSEARCH_CSRC_UTF8_H_
+
+#include <cstdint>
+
+namespace fasttextsearch {
+
+/*
+  Checks that data[0:size] is valid UTF-8 (RFC 3629: no overlong encodings,
+  surrogates, code points above U+10FFFF or truncated sequences) and counts
+  its code points.  Runs of ASCII are processed 8 bytes at a time, and the
+  text is split into chunks that are processed in parallel.
+
+    @param [in] data  The UTF-8 bytes.
+    @param [in] size  The number of bytes; require size >= 0.
+    @param [out] num_code_points  If not nullptr, at exit it is the number of
+             code points if the text is valid.
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+
+    @return  -1 if the text is valid, else the offset of the first byte of the
+             first invalid sequence.
+ */
+int64_t ValidateUtf8(const uint8_t *data, int64_t size,
+                     int64_t *num_code_points, int32_t num_threads = 1);
+
+/*
+  Decodes valid UTF-8 (see ValidateUtf8()) into code points, and optionally
+  finds the byte offset of each code point.
+
+  Template args: OffsetT is uint32_t, for size <= 2^32, or uint64_t.
+
+    @param [in] data  The UTF-8 bytes, which must be valid.
+    @param [in] size  The number of bytes; require size >= 0.
+    @param [out] code_points  A pre-allocated array with one element per
+             code point (see ValidateUtf8()); at exit it contains them.
+    @param [out] byte_offsets  nullptr, or a pre-allocated array of the size
+             of `code_points`; at exit byte_offsets[i] is the offset in
+             `data` of the first byte of code point i.
+    @param [in] num_threads  The number of threads to use; <= 0 means to use
+             all hardware threads.
+ */
+template <typename OffsetT>
+void DecodeUtf8(const uint8_t *data, int64_t size, int32_t *code_points,
+                OffsetT *byte_offsets, int32_t num_threads = 1);
+
+} // namespace fasttextsearch
+
+#endif // TEXTSEARCH_CSRC_UTF8_H_
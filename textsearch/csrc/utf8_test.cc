@@ -0,0 +1,135 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "textsearch/csrc/utf8.h"
+
+namespace fasttextsearch {
+
+static void Encode(int32_t c, std::vector<uint8_t> *out) {
+  if (c < 0x80) {
+    out->push_back(c);
+  } else if (c < 0x800) {
+    out->push_back(0xC0 | (c >> 6));
+    out->push_back(0x80 | (c & 0x3F));
+  } else if (c < 0x10000) {
+    out->push_back(0xE0 | (c >> 12));
+    out->push_back(0x80 | ((c >> 6) & 0x3F));
+    out->push_back(0x80 | (c & 0x3F));
+  } else {
+    out->push_back(0xF0 | (c >> 18));
+    out->push_back(0x80 | ((c >> 12) & 0x3F));
+    out->push_back(0x80 | ((c >> 6) & 0x3F));
+    out->push_back(0x80 | (c & 0x3F));
+  }
+}
+
+static int64_t Validate(const std::string &s) {
+  return ValidateUtf8(reinterpret_cast<const uint8_t *>(s.data()), s.size(),
+                      nullptr);
+}
+
+TEST(Utf8Test, TestBasic) {
+  // "zażółć 你好" followed by U+1F600.
+  std::string s = "za\xC5\xBC\xC3\xB3\xC5\x82\xC4\x87 \xE4\xBD\xA0\xE5\xA5\xBD"
+                  "\xF0\x9F\x98\x80";
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(s.data());
+  int64_t n = 0;
+  EXPECT_EQ(ValidateUtf8(data, s.size(), &n), -1);
+  ASSERT_EQ(n, 10);
+  std::vector<int32_t> code_points(n);
+  std::vector<uint32_t> offsets(n);
+  DecodeUtf8(data, s.size(), code_points.data(), offsets.data());
+  EXPECT_EQ(code_points,
+            (std::vector<int32_t>{'z', 'a', 0x17C, 0xF3, 0x142, 0x107, ' ',
+                                  0x4F60, 0x597D, 0x1F600}));
+  EXPECT_EQ(offsets,
+            (std::vector<uint32_t>{0, 1, 2, 4, 6, 8, 10, 11, 14, 17}));
+
+  EXPECT_EQ(ValidateUtf8(data, 0, &n), -1);
+  EXPECT_EQ(n, 0);
+}
+
+TEST(Utf8Test, TestInvalid) {
+  EXPECT_EQ(Validate("abc\x80"), 3);          // Stray continuation byte
+  EXPECT_EQ(Validate("ab\xC3"), 2);           // Truncated
+  EXPECT_EQ(Validate("ab\xE4\xBD"), 2);       // Truncated
+  EXPECT_EQ(Validate("a\xC3(b"), 1);          // Missing continuation byte
+  EXPECT_EQ(Validate("\xC0\xAF"), 0);         // Overlong '/'
+  EXPECT_EQ(Validate("x\xE0\x80\xAF"), 1);    // Overlong '/'
+  EXPECT_EQ(Validate("\xF0\x80\x80\xAF"), 0); // Overlong '/'
+  EXPECT_EQ(Validate("12\xED\xA0\x80"), 2);   // Surrogate U+D800
+  EXPECT_EQ(Validate("\xF4\x90\x80\x80"), 0); // U+110000
+  EXPECT_EQ(Validate("\xF8\x88\x80\x80\x80"), 0);
+  EXPECT_EQ(Validate("\xFF"), 0);
+  EXPECT_EQ(Validate("\xED\x9F\xBF\xF4\x8F\xBF\xBF"), -1); // U+D7FF U+10FFFF
+
+  // The first error is found whatever the number of threads.
+  std::string s(1 << 20, 'a');
+  s[700000] = '\xC3';
+  s[900000] = '\x80';
+  for (int32_t num_threads : {1, 3, 8})
+    EXPECT_EQ(ValidateUtf8(reinterpret_cast<const uint8_t *>(s.data()),
+                           s.size(), nullptr, num_threads),
+              700000);
+}
+
+TEST(Utf8Test, TestRandom) {
+  std::mt19937 rng(0);
+  for (int32_t num_code_points : {1, 10, 100, 300000}) {
+    for (int32_t max_code_point : {0x7F, 0x7FF, 0x10FFFF}) {
+      std::uniform_int_distribution<int32_t> uni(0, max_code_point);
+      std::vector<int32_t> expected;
+      std::vector<uint64_t> expected_offsets;
+      std::vector<uint8_t> bytes;
+      while (static_cast<int32_t>(expected.size()) < num_code_points) {
+        int32_t c = uni(rng);
+        // Mostly ASCII, with runs of long code points.
+        if (rng() % 4 == 0)
+          c %= 0x80;
+        if (c >= 0xD800 && c < 0xE000)
+          continue;
+        expected.push_back(c);
+        expected_offsets.push_back(bytes.size());
+        Encode(c, &bytes);
+      }
+      for (int32_t num_threads : {1, 4}) {
+        int64_t n = 0;
+        ASSERT_EQ(ValidateUtf8(bytes.data(), bytes.size(), &n, num_threads),
+                  -1);
+        ASSERT_EQ(n, num_code_points);
+        std::vector<int32_t> code_points(n);
+        std::vector<uint64_t> offsets(n);
+        DecodeUtf8(bytes.data(), bytes.size(), code_points.data(),
+                   offsets.data(), num_threads);
+        EXPECT_EQ(code_points, expected);
+        EXPECT_EQ(offsets, expected_offsets);
+        DecodeUtf8<uint32_t>(bytes.data(), bytes.size(), code_points.data(),
+                             nullptr, num_threads);
+        EXPECT_EQ(code_points, expected);
+      }
+    }
+  }
+}
+
+} // namespace fasttextsearch
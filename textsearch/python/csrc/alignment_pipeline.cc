@@ -0,0 +1,214 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/alignment_pipeline.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/alignment_pipeline.h"
+#include "textsearch/python/csrc/levenshtein.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace fasttextsearch {
+
+template <typename T> using Array = py::array_t<T, py::array::c_style>;
+
+template <typename SymbolT, typename IndexT>
+static std::unique_ptr<AlignmentPipeline<SymbolT, IndexT>>
+CreateAlignmentPipelineHelper(Array<SymbolT> &text,
+                              Array<IndexT> &suffix_array, py::object lcp,
+                              Array<int64_t> &row_splits,
+                              const AlignmentPipelineOptions &options) {
+  if (text.ndim() != 1 || text.size() < 5)
+    throw std::runtime_error(
+        "text MUST be a one dimension array with at least 5 elements");
+  IndexT seq_len = static_cast<IndexT>(text.size() - 3);
+  if (suffix_array.ndim() != 1 || suffix_array.size() != seq_len)
+    throw std::runtime_error(
+        "suffix_array MUST be a one dimension array of size text.size - 3");
+  if (row_splits.ndim() != 1 || row_splits.size() < 1 ||
+      row_splits.data()[0] != 0 ||
+      row_splits.data()[row_splits.size() - 1] > seq_len)
+    throw std::runtime_error("row_splits MUST start with 0 and end at most "
+                             "at text.size - 3");
+  if (options.num_close_matches <= 0 || options.num_candidates <= 0)
+    throw std::runtime_error(
+        "num_close_matches and num_candidates MUST be positive");
+  if (options.engine == LevenshteinEngine::kBitParallel &&
+      (options.insert_cost != 1 || options.delete_cost != 1 ||
+       options.replace_cost != 1))
+    throw std::runtime_error(
+        "The bit_parallel engine requires all the costs to be 1");
+
+  const IndexT *lcp_data = nullptr;
+  if (!lcp.is_none()) {
+    auto lcp_array = lcp.cast<Array<IndexT>>();
+    // The pipeline keeps `lcp` alive, so it must not be a converted copy.
+    if (lcp_array.ptr() != lcp.ptr())
+      throw std::runtime_error("lcp MUST be contiguous, of the dtype of "
+                               "suffix_array");
+    if (lcp_array.ndim() != 1 || lcp_array.size() != seq_len)
+      throw std::runtime_error("lcp MUST be of the same shape as suffix_array");
+    lcp_data = lcp_array.data();
+  } else if (options.num_close_matches != 1) {
+    throw std::runtime_error("num_close_matches MUST be 1 without lcp");
+  }
+
+  return std::unique_ptr<AlignmentPipeline<SymbolT, IndexT>>(
+      new AlignmentPipeline<SymbolT, IndexT>(
+          text.data(), seq_len, suffix_array.data(), lcp_data,
+          row_splits.data(), row_splits.size() - 1, options));
+}
+
+template <typename SymbolT, typename IndexT>
+static bool PushHelper(AlignmentPipeline<SymbolT, IndexT> &self,
+                       int64_t query_id, Array<SymbolT> &query,
+                       py::object times) {
+  if (query.ndim() != 1)
+    throw std::runtime_error("query MUST be a one dimension array");
+  AlignmentQuery<SymbolT> q;
+  q.id = query_id;
+  q.symbols.assign(query.data(), query.data() + query.size());
+  if (!times.is_none()) {
+    auto times_array = times.cast<Array<float>>();
+    if (times_array.ndim() != 1 || times_array.size() != query.size())
+      throw std::runtime_error("times MUST be of the same shape as query");
+    q.times.assign(times_array.data(),
+                   times_array.data() + times_array.size());
+  }
+  py::gil_scoped_release release;
+  return self.Push(std::move(q));
+}
+
+// Returns the next result as a dict (see AlignmentPipeline in
+// alignment_pipeline.py), or None when there are no more.
+template <typename SymbolT, typename IndexT>
+static py::object PopHelper(AlignmentPipeline<SymbolT, IndexT> &self) {
+  AlignmentResult r;
+  bool ok;
+  {
+    py::gil_scoped_release release;
+    ok = self.Pop(&r);
+  }
+  if (!ok)
+    return py::none();
+
+  py::ssize_t num_ops = r.ops.size(), num_segments = r.segments.size();
+  Array<int8_t> ops(num_ops);
+  std::copy(r.ops.begin(), r.ops.end(),
+            reinterpret_cast<AlignmentOp *>(ops.mutable_data()));
+  Array<int32_t> query_positions(num_ops, r.query_positions.data()),
+      ref_positions(num_ops, r.ref_positions.data());
+
+  // As for find_segments().
+  Array<int32_t> positions({num_segments, py::ssize_t(6)});
+  Array<float> segment_times({num_segments, py::ssize_t(2)});
+  Array<float> scores(num_segments);
+  int32_t *p = positions.mutable_data();
+  float *t = segment_times.mutable_data(), *score = scores.mutable_data();
+  for (const Segment &segment : r.segments) {
+    *p++ = segment.begin;
+    *p++ = segment.end;
+    *p++ = segment.query_begin;
+    *p++ = segment.query_end;
+    *p++ = segment.ref_begin;
+    *p++ = segment.ref_end;
+    *t++ = segment.begin_time;
+    *t++ = segment.end_time;
+    *score++ = segment.score;
+  }
+
+  py::dict ans;
+  ans["query_id"] = r.query_id;
+  ans["candidate"] = r.candidate;
+  ans["num_candidates"] = r.num_candidates;
+  ans["ref_begin"] = r.ref_begin;
+  ans["ref_end"] = r.ref_end;
+  ans["distance"] = r.distance;
+  ans["ops"] = ops;
+  ans["query_positions"] = query_positions;
+  ans["ref_positions"] = ref_positions;
+  ans["segments"] = py::make_tuple(positions, segment_times, scores);
+  return ans;
+}
+
+template <typename SymbolT, typename IndexT>
+static void PybindAlignmentPipelineImpl(py::module &m,
+                                        const std::string &name) {
+  using PyClass = AlignmentPipeline<SymbolT, IndexT>;
+  py::class_<PyClass>(m, name.c_str())
+      .def("push", &PushHelper<SymbolT, IndexT>, py::arg("query_id"),
+           py::arg("query").noconvert(), py::arg("times") = py::none())
+      .def("close", &PyClass::Close,
+           py::call_guard<py::gil_scoped_release>())
+      .def("pop", &PopHelper<SymbolT, IndexT>);
+
+  // The pipeline keeps the arrays alive, as it points into them.
+  m.def("create_alignment_pipeline",
+        &CreateAlignmentPipelineHelper<SymbolT, IndexT>,
+        py::arg("text").noconvert(), py::arg("suffix_array").noconvert(),
+        py::arg("lcp"), py::arg("row_splits"), py::arg("options"),
+        py::keep_alive<0, 1>(), py::keep_alive<0, 2>(),
+        py::keep_alive<0, 3>(), py::keep_alive<0, 4>());
+}
+
+void PybindAlignmentPipeline(py::module &m) {
+  using PyClass = AlignmentPipelineOptions;
+  py::class_<PyClass>(m, "AlignmentPipelineOptions")
+      .def(py::init<>())
+      .def_readwrite("num_close_matches", &PyClass::num_close_matches)
+      .def_readwrite("min_match_length", &PyClass::min_match_length)
+      .def_readwrite("length_ratio", &PyClass::length_ratio)
+      .def_readwrite("num_candidates", &PyClass::num_candidates)
+      .def_readwrite("span_extension", &PyClass::span_extension)
+      .def_readwrite("insert_cost", &PyClass::insert_cost)
+      .def_readwrite("delete_cost", &PyClass::delete_cost)
+      .def_readwrite("replace_cost", &PyClass::replace_cost)
+      .def_property(
+          "engine",
+          [](const PyClass &self) {
+            return LevenshteinEngineName(self.engine);
+          },
+          [](PyClass &self, const std::string &engine) {
+            self.engine = ToLevenshteinEngine(engine);
+          })
+      .def_readwrite("max_distance", &PyClass::max_distance)
+      .def_readwrite("segmenter_options", &PyClass::segmenter_options)
+      .def_readwrite("num_seed_threads", &PyClass::num_seed_threads)
+      .def_readwrite("num_align_threads", &PyClass::num_align_threads)
+      .def_readwrite("queue_capacity", &PyClass::queue_capacity);
+
+  // As for create_suffix_array(), the arrays are never converted.
+  PybindAlignmentPipelineImpl<uint8_t, int32_t>(
+      m, "AlignmentPipelineUint8Int32");
+  PybindAlignmentPipelineImpl<uint8_t, int64_t>(
+      m, "AlignmentPipelineUint8Int64");
+  PybindAlignmentPipelineImpl<uint16_t, int32_t>(
+      m, "AlignmentPipelineUint16Int32");
+  PybindAlignmentPipelineImpl<uint16_t, int64_t>(
+      m, "AlignmentPipelineUint16Int64");
+  PybindAlignmentPipelineImpl<int32_t, int32_t>(
+      m, "AlignmentPipelineInt32Int32");
+  PybindAlignmentPipelineImpl<int32_t, int64_t>(
+      m, "AlignmentPipelineInt32Int64");
+  PybindAlignmentPipelineImpl<int64_t, int64_t>(
+      m, "AlignmentPipelineInt64Int64");
+}
+
+} // namespace fasttextsearch
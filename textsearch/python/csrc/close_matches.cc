@@ -0,0 +1,171 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/close_matches.h"
+#include "pybind11/numpy.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/close_matches.h"
+
+namespace fasttextsearch {
+
+template <typename IndexT>
+static py::array_t<IndexT> PybindFindCloseMatchesHelper(
+    py::array_t<IndexT, py::array::c_style> &suffix_array, IndexT query_len,
+    int32_t num_threads) {
+  if (suffix_array.ndim() != 1)
+    throw std::runtime_error("suffix_array MUST be a one dimension array");
+
+  IndexT seq_len = static_cast<IndexT>(suffix_array.size());
+  if (query_len < 0 || query_len >= seq_len)
+    throw std::runtime_error(
+        "query_len MUST satisfy 0 <= query_len < seq_len");
+
+  py::array_t<IndexT> output(2 * static_cast<py::ssize_t>(query_len));
+  const IndexT *sa_data = suffix_array.data();
+  IndexT *output_data = output.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    FindCloseMatches(sa_data, seq_len, query_len, output_data, num_threads);
+  }
+  return output;
+}
+
+template <typename IndexT>
+static std::pair<py::array_t<IndexT>, py::array_t<IndexT>>
+PybindFindCloseMatchesWithLengthsHelper(
+    py::array_t<IndexT, py::array::c_style> &suffix_array,
+    py::array_t<IndexT, py::array::c_style> &lcp, IndexT query_len,
+    int32_t num_close_matches, IndexT min_match_length, int32_t num_threads) {
+  if (suffix_array.ndim() != 1 || lcp.ndim() != 1 ||
+      lcp.size() != suffix_array.size())
+    throw std::runtime_error("suffix_array and lcp MUST be one dimension "
+                             "arrays of the same size");
+
+  IndexT seq_len = static_cast<IndexT>(suffix_array.size());
+  if (query_len < 0 || query_len >= seq_len)
+    throw std::runtime_error(
+        "query_len MUST satisfy 0 <= query_len < seq_len");
+  if (num_close_matches <= 0)
+    throw std::runtime_error("num_close_matches MUST be positive");
+
+  py::ssize_t size = 2 * static_cast<py::ssize_t>(num_close_matches) *
+                     static_cast<py::ssize_t>(query_len);
+  py::array_t<IndexT> output(size), lengths(size);
+  const IndexT *sa_data = suffix_array.data(), *lcp_data = lcp.data();
+  IndexT *output_data = output.mutable_data(),
+         *lengths_data = lengths.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    FindCloseMatchesWithLengths(sa_data, lcp_data, seq_len, query_len,
+                                num_close_matches, min_match_length,
+                                output_data, lengths_data, num_threads);
+  }
+  return std::make_pair(output, lengths);
+}
+
+template <typename IndexT>
+static py::array_t<int64_t> PybindFindCandidateMatchesHelper(
+    py::array_t<IndexT, py::array::c_style> &close_matches,
+    py::array_t<IndexT, py::array::c_style> &row_splits,
+    int32_t num_query_docs, float length_ratio, int32_t num_candidates,
+    int32_t num_threads, py::object match_lengths, int32_t num_close_matches) {
+  if (close_matches.ndim() != 1 || row_splits.ndim() != 1)
+    throw std::runtime_error(
+        "close_matches and row_splits MUST be one dimension arrays");
+
+  int32_t num_docs = static_cast<int32_t>(row_splits.size()) - 1;
+  if (num_query_docs < 0 || num_query_docs > num_docs)
+    throw std::runtime_error(
+        "num_query_docs MUST satisfy 0 <= num_query_docs < row_splits.size");
+
+  if (num_close_matches <= 0)
+    throw std::runtime_error("num_close_matches MUST be positive");
+
+  const IndexT *row_splits_data = row_splits.data();
+  if (row_splits_data[0] != 0 ||
+      close_matches.size() !=
+          2 * static_cast<py::ssize_t>(num_close_matches) *
+              row_splits_data[num_query_docs])
+    throw std::runtime_error("close_matches.size MUST equal "
+                             "2 * num_close_matches * "
+                             "row_splits[num_query_docs]");
+
+  py::array_t<IndexT, py::array::c_style> lengths;
+  if (!match_lengths.is_none()) {
+    lengths = match_lengths.cast<py::array_t<IndexT, py::array::c_style>>();
+    if (lengths.ndim() != 1 || lengths.size() != close_matches.size())
+      throw std::runtime_error(
+          "match_lengths MUST be of the same shape as close_matches");
+  } else if (num_close_matches != 1) {
+    throw std::runtime_error("num_close_matches MUST be 1 without "
+                             "match_lengths");
+  }
+
+  if (num_candidates <= 0 || length_ratio <= 0)
+    throw std::runtime_error(
+        "num_candidates and length_ratio MUST be positive");
+
+  py::array_t<int64_t> candidates(
+      {static_cast<py::ssize_t>(num_query_docs),
+       static_cast<py::ssize_t>(num_candidates), static_cast<py::ssize_t>(2)});
+  const IndexT *close_matches_data = close_matches.data();
+  const IndexT *lengths_data =
+      match_lengths.is_none() ? nullptr : lengths.data();
+  int64_t *candidates_data = candidates.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    if (lengths_data == nullptr)
+      FindCandidateMatches(close_matches_data, row_splits_data, num_docs,
+                           num_query_docs, length_ratio, num_candidates,
+                           candidates_data, num_threads);
+    else
+      FindCandidateMatchesWithLengths(
+          close_matches_data, lengths_data, num_close_matches,
+          row_splits_data, num_docs, num_query_docs, length_ratio,
+          num_candidates, candidates_data, num_threads);
+  }
+  return candidates;
+}
+
+template <typename IndexT>
+static void PybindCloseMatchesImpl(py::module &m) {
+  m.def("find_close_matches", &PybindFindCloseMatchesHelper<IndexT>,
+        py::arg("suffix_array").noconvert(), py::arg("query_len"),
+        py::arg("num_threads") = 1);
+  m.def("find_close_matches_with_lengths",
+        &PybindFindCloseMatchesWithLengthsHelper<IndexT>,
+        py::arg("suffix_array").noconvert(), py::arg("lcp").noconvert(),
+        py::arg("query_len"), py::arg("num_close_matches") = 1,
+        py::arg("min_match_length") = 0, py::arg("num_threads") = 1);
+  m.def("find_candidate_matches", &PybindFindCandidateMatchesHelper<IndexT>,
+        py::arg("close_matches").noconvert(),
+        py::arg("row_splits").noconvert(), py::arg("num_query_docs"),
+        py::arg("length_ratio") = 2.0f, py::arg("num_candidates") = 5,
+        py::arg("num_threads") = 1, py::arg("match_lengths") = py::none(),
+        py::arg("num_close_matches") = 1);
+}
+
+void PybindCloseMatches(py::module &m) {
+  // The arrays are never converted, so callers must pass int32 or int64.
+  PybindCloseMatchesImpl<int32_t>(m);
+  PybindCloseMatchesImpl<int64_t>(m);
+}
+} // namespace fasttextsearch
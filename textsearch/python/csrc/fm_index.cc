@@ -0,0 +1,113 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/fm_index.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/fm_index.h"
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace fasttextsearch {
+
+template <typename SymbolT, typename IndexT>
+static std::unique_ptr<FmIndex<SymbolT, IndexT>>
+CreateFmIndexHelper(py::array_t<SymbolT, py::array::c_style> &text,
+                    py::array_t<IndexT, py::array::c_style> &suffix_array,
+                    int32_t sample_rate, int32_t num_threads) {
+  if (text.ndim() != 1 || text.size() < 4)
+    throw std::runtime_error(
+        "text MUST be a one dimension array with at least 4 elements");
+  IndexT seq_len = static_cast<IndexT>(text.size() - 3);
+  if (suffix_array.ndim() != 1 || suffix_array.size() != seq_len)
+    throw std::runtime_error(
+        "suffix_array MUST be a one dimension array of size text.size - 3");
+  if (sample_rate <= 0)
+    throw std::runtime_error("sample_rate MUST be positive");
+
+  const SymbolT *text_data = text.data();
+  const IndexT *sa_data = suffix_array.data();
+  py::gil_scoped_release release;
+  return std::unique_ptr<FmIndex<SymbolT, IndexT>>(new FmIndex<SymbolT, IndexT>(
+      text_data, seq_len, sa_data, sample_rate, num_threads));
+}
+
+template <typename SymbolT, typename IndexT>
+static std::pair<py::array_t<IndexT>, py::array_t<IndexT>>
+FindCloseMatchesHelper(const FmIndex<SymbolT, IndexT> &index,
+                       py::array_t<SymbolT, py::array::c_style> &query,
+                       int32_t num_close_matches, IndexT min_match_length,
+                       int32_t num_threads) {
+  if (query.ndim() != 1)
+    throw std::runtime_error("query MUST be a one dimension array");
+  if (num_close_matches <= 0)
+    throw std::runtime_error("num_close_matches MUST be positive");
+
+  IndexT query_len = static_cast<IndexT>(query.size());
+  py::ssize_t size = 2 * static_cast<py::ssize_t>(num_close_matches) *
+                     static_cast<py::ssize_t>(query_len);
+  py::array_t<IndexT> output(size), lengths(size);
+  const SymbolT *query_data = query.data();
+  IndexT *output_data = output.mutable_data(),
+         *lengths_data = lengths.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    index.FindCloseMatches(query_data, query_len, num_close_matches,
+                           min_match_length, output_data, lengths_data,
+                           num_threads);
+  }
+  return std::make_pair(output, lengths);
+}
+
+template <typename SymbolT, typename IndexT>
+static void PybindFmIndexImpl(py::module &m, const std::string &name) {
+  using PyClass = FmIndex<SymbolT, IndexT>;
+  py::class_<PyClass>(m, name.c_str())
+      .def_property_readonly("seq_len", &PyClass::SeqLen)
+      .def_property_readonly("sample_rate", &PyClass::SampleRate)
+      .def_property_readonly("num_bytes", &PyClass::NumBytes)
+      .def("locate",
+           [](const PyClass &self, IndexT rank) {
+             if (rank < 0 || rank >= self.SeqLen())
+               throw std::runtime_error("rank MUST be in [0, seq_len)");
+             return self.Locate(rank);
+           })
+      .def("find_close_matches", &FindCloseMatchesHelper<SymbolT, IndexT>,
+           py::arg("query").noconvert(), py::arg("num_close_matches") = 1,
+           py::arg("min_match_length") = 0, py::arg("num_threads") = 1);
+
+  // The index keeps the text alive, as it points into it.
+  m.def("create_fm_index", &CreateFmIndexHelper<SymbolT, IndexT>,
+        py::arg("text").noconvert(), py::arg("suffix_array").noconvert(),
+        py::arg("sample_rate") = 32, py::arg("num_threads") = 1,
+        py::keep_alive<0, 1>());
+}
+
+void PybindFmIndex(py::module &m) {
+  // As for create_suffix_array(), the arrays are never converted.
+  PybindFmIndexImpl<uint8_t, int32_t>(m, "FmIndexUint8Int32");
+  PybindFmIndexImpl<uint8_t, int64_t>(m, "FmIndexUint8Int64");
+  PybindFmIndexImpl<uint16_t, int32_t>(m, "FmIndexUint16Int32");
+  PybindFmIndexImpl<uint16_t, int64_t>(m, "FmIndexUint16Int64");
+  PybindFmIndexImpl<int32_t, int32_t>(m, "FmIndexInt32Int32");
+  PybindFmIndexImpl<int32_t, int64_t>(m, "FmIndexInt32Int64");
+  PybindFmIndexImpl<int64_t, int64_t>(m, "FmIndexInt64Int64");
+}
+
+} // namespace fasttextsearch
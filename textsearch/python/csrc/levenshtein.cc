@@ -20,8 +20,11 @@
 #include "pybind11/numpy.h"
 #include "pybind11/stl.h"
 #include "textsearch/csrc/levenshtein.h"
+#include "textsearch/csrc/levenshtein_batch.h"
+#include "textsearch/csrc/levenshtein_hirschberg.h"
 #include <iostream>
 #include <limits>
+#include <string>
 
 namespace fasttextsearch {
 
@@ -37,8 +40,9 @@ Note:
 
 Args:
   query:
-    The query sequence, it is a one dimension numpy ndarray, only np.int32 is
-    supported now.
+    The query sequence, a one dimension numpy ndarray of np.uint8, np.uint16,
+    np.int32 or np.int64, used as is (others, e.g. lists, are converted to
+    np.int32).
   target:
     The target sequence, it is a one dimension numpy ndarray with same dtype as
     query sequence.
@@ -48,6 +52,46 @@ Args:
     The cost of deletion error, default 1.
   replace_cost:
     The cost of replacement error, default 1.
+  engine:
+    The algorithm to use, "auto" (default), "scalar", "bit_parallel" or
+    "simd".  "bit_parallel" is Myers' bit-vector algorithm, which is much
+    faster but requires all the costs to be 1; "simd" is the plain dynamic
+    programming of "scalar" vectorized with AVX-512, AVX2 or SSE2/NEON
+    (whichever the cpu supports), for any costs.  "auto" uses "bit_parallel"
+    when all the costs are 1, else "simd", or "scalar" if max_distance or
+    band_width is given.  They all give the same result.
+  max_distance:
+    If >= 0, matches with a larger distance are not of interest, which makes
+    the computation much faster when it is small compared to the query length;
+    if there is no match within it, the returned distance is -1 and the list
+    of alignments is empty.  Otherwise the result does not depend on it.
+  band_width:
+    If >= 0, only the alignments staying within this many target positions of
+    the diagonal from the start of both sequences to the end of both
+    sequences are considered, for when the query and target are known to
+    roughly correspond to each other; this may give a larger distance, or -1
+    if no such alignment exists.  It is not supported by "bit_parallel" or
+    "simd".
+  linear_memory:
+    If True, only the alignment of the first best end position is returned,
+    computed with Hirschberg's algorithm in memory linear in the lengths of
+    the sequences instead of growing with their product, for very long
+    sequences (e.g. a whole chapter against its transcript).  If there are
+    several equally good alignments for that end it may not be the one
+    returned otherwise, and with costs other than 1 the distance is the true
+    minimum of the sum of the costs, which may be smaller than the default
+    one.  `engine` is ignored and `band_width` is not supported.
+  num_threads:
+    The number of threads to use if linear_memory is True, <= 0 means to use
+    all hardware threads; default 1.
+  alignment_format:
+    "string" (default) for the backtraces as '0'/'1' strings (see below), or
+    "numpy" for each alignment as numpy arrays decoded in C++: a tuple of
+    `end_position`, `ops` (np.int8: 0 for equal, 1 for replacement, 2 for
+    insertion, 3 for deletion, from the start of the segment to its end),
+    `query_positions` and `target_positions` (np.int32, the index of the
+    symbol of each op, -1 for the deletions and insertions respectively).
+    `get_nice_alignments` accepts both.
 
 Returns:
   Return a tuple which has two elements, the first element is the levenshtein
@@ -75,43 +119,344 @@ target); if we meet a '1', it means insertion; if we meet a '0', it means
 deletion. So the alignment of first segment is [equal, replacement, equal, equal],
 the alignment of the second segment is [equal, equal, insertion, equal]. We can
 distinct equal and replacement with the help of query and target sequences.
+
+>>> distance, alignments = levenshtein_distance(query, target, alignment_format="numpy")
+>>> end_position, ops, query_positions, target_positions = alignments[1]
+>>> print (end_position, ops, query_positions, target_positions)
+8 [0 0 2 0] [0 1 2 3] [ 6  7 -1  8]
 )doc";
 
+// The alignment decoded by GetAlignment().
+struct DecodedAlignment {
+  int64_t end_position;
+  std::vector<AlignmentOp> ops;
+  std::vector<int32_t> query_positions;
+  std::vector<int32_t> target_positions;
+};
+
+template <typename T>
+static py::array_t<T> ToNumpy(const std::vector<T> &v) {
+  return py::array_t<T>(static_cast<py::ssize_t>(v.size()), v.data());
+}
+
+LevenshteinEngine ToLevenshteinEngine(const std::string &name) {
+  if (name == "auto")
+    return LevenshteinEngine::kAuto;
+  else if (name == "scalar")
+    return LevenshteinEngine::kScalar;
+  else if (name == "bit_parallel")
+    return LevenshteinEngine::kBitParallel;
+  else if (name == "simd")
+    return LevenshteinEngine::kSimd;
+  throw std::runtime_error(
+      "Unknown levenshtein engine: '" + name +
+      "', expected 'auto', 'scalar', 'bit_parallel' or 'simd'");
+}
+
+const char *LevenshteinEngineName(LevenshteinEngine engine) {
+  switch (engine) {
+  case LevenshteinEngine::kScalar:
+    return "scalar";
+  case LevenshteinEngine::kBitParallel:
+    return "bit_parallel";
+  case LevenshteinEngine::kSimd:
+    return "simd";
+  default:
+    return "auto";
+  }
+}
+
 template <typename T>
-static std::pair<int32_t, std::vector<std::pair<int64_t, std::string>>>
-PybindLevenshteinHelper(py::array_t<T, py::array::c_style> &query,
-                        py::array_t<T, py::array::c_style> &target,
-                        int32_t insert_cost, int32_t delete_cost,
-                        int32_t replace_cost) {
+static py::tuple PybindLevenshteinHelper(
+    py::array_t<T, py::array::c_style> &query,
+    py::array_t<T, py::array::c_style> &target, int32_t insert_cost,
+    int32_t delete_cost, int32_t replace_cost, const std::string &engine,
+    int32_t max_distance, int32_t band_width, bool linear_memory,
+    int32_t num_threads, const std::string &alignment_format) {
+  if (alignment_format != "string" && alignment_format != "numpy")
+    throw std::runtime_error("Unknown alignment_format: '" + alignment_format +
+                             "', expected 'string' or 'numpy'");
+  bool numpy_format = alignment_format == "numpy";
+
+  LevenshteinEngine levenshtein_engine = ToLevenshteinEngine(engine);
+  if (levenshtein_engine == LevenshteinEngine::kBitParallel &&
+      (insert_cost != 1 || delete_cost != 1 || replace_cost != 1))
+    throw std::runtime_error(
+        "The bit_parallel engine requires all the costs to be 1");
+  if (levenshtein_engine == LevenshteinEngine::kBitParallel && band_width >= 0)
+    throw std::runtime_error(
+        "The bit_parallel engine does not support band_width");
+  if (levenshtein_engine == LevenshteinEngine::kSimd && band_width >= 0)
+    throw std::runtime_error("The simd engine does not support band_width");
+
+  if (linear_memory && band_width >= 0)
+    throw std::runtime_error("linear_memory does not support band_width");
+
   if (query.ndim() != 1)
     throw std::runtime_error("Query MUST be a one dimension array");
 
   if (target.ndim() != 1)
     throw std::runtime_error("Target MUST be a one dimension array");
 
+  if (numpy_format && target.size() > std::numeric_limits<int32_t>::max())
+    throw std::runtime_error(
+        "Target is too long for the int32 positions of alignment_format "
+        "'numpy'");
+
   auto query_data = query.data();
   auto target_data = target.data();
 
   std::vector<LevenshteinElement> alignments;
+  BacktraceArena arena;
+
+  int32_t distance;
+  std::vector<DecodedAlignment> decoded;
+  {
+    py::gil_scoped_release release;
+    if (linear_memory) {
+      LevenshteinElement alignment;
+      distance = LevenshteinDistanceLinearMemory(
+          query_data, query.size(), target_data, target.size(), &alignment,
+          &arena, insert_cost, delete_cost, replace_cost, max_distance,
+          num_threads);
+      if (distance != -1 && query.size() != 0)
+        alignments.push_back(alignment);
+    } else {
+      distance = LevenshteinDistance(
+          query_data, query.size(), target_data, target.size(), &alignments,
+          &arena, insert_cost, delete_cost, replace_cost, levenshtein_engine,
+          max_distance, band_width);
+    }
+    if (numpy_format) {
+      decoded.resize(alignments.size());
+      for (size_t i = 0; i < alignments.size(); i++) {
+        decoded[i].end_position = alignments[i].position;
+        GetAlignment(query_data, target_data, alignments[i], arena,
+                     &decoded[i].ops, &decoded[i].query_positions,
+                     &decoded[i].target_positions);
+      }
+    }
+  }
+
+  py::list trace;
+  if (numpy_format) {
+    for (const auto &d : decoded) {
+      // AlignmentOp has the values of the op codes.
+      py::array_t<int8_t> ops(static_cast<py::ssize_t>(d.ops.size()),
+                              reinterpret_cast<const int8_t *>(d.ops.data()));
+      trace.append(py::make_tuple(d.end_position, ops,
+                                  ToNumpy(d.query_positions),
+                                  ToNumpy(d.target_positions)));
+    }
+  } else {
+    for (const auto &align : alignments) {
+      trace.append(
+          py::make_tuple(align.position, align.backtrace.ToString(arena)));
+    }
+  }
+  return py::make_tuple(distance, trace);
+}
+
+static constexpr const char *kLevenshteinDistanceBatchDoc = R"doc(
+Calculate the levenshtein distance between one query and many segments
+(spans) of a reference sequence, e.g. the candidate regions returned by
+`find_candidate_matches`, with the same infix search as
+`levenshtein_distance`.  The spans are processed in parallel with the GIL
+released.
+
+Args:
+  query:
+    The query sequence, a one dimension array of np.uint8, np.uint16,
+    np.int32 or np.int64 (others are converted to np.int32).
+  reference:
+    The reference sequence, a one dimension array of the dtype of query.
+  spans:
+    An np.int64 array of shape (..., 2), each [begin, end) a span of
+    `reference`.  Spans with begin < 0 (like the unused candidates of
+    `find_candidate_matches`) are skipped; otherwise they must satisfy
+    0 <= begin < end <= len(reference).
+  insert_cost, delete_cost, replace_cost, engine, max_distance:
+    As for `levenshtein_distance`.
+  num_threads:
+    The number of threads to use, <= 0 means to use all hardware threads;
+    default 1.
+
+Returns:
+  Return a tuple of two arrays of shape spans.shape[:-1]: the distances
+  (np.int32) and the first best end positions as indexes into `reference`
+  (np.int64).  Both are -1 for the skipped spans and those without a match
+  within max_distance.
+
+>>> from textsearch import levenshtein_distance_batch
+>>> import numpy as np
+>>> query = np.array([1, 2, 3, 4], dtype=np.int32)
+>>> reference = np.array([1, 5, 3, 4, 6, 7, 1, 2, 4], dtype=np.int32)
+>>> spans = np.array([[0, 4], [4, 9], [-1, -1]], dtype=np.int64)
+>>> levenshtein_distance_batch(query, reference, spans)
+(array([ 1,  1, -1], dtype=int32), array([ 3,  8, -1]))
+)doc";
 
-  int32_t distance = LevenshteinDistance(
-      query_data, query.size(), target_data, target.size(), &alignments,
-      insert_cost, delete_cost, replace_cost);
+static constexpr const char *kLevenshteinBatchBestAlignmentDoc = R"doc(
+Recover the alignment of the query with the best span of a
+`levenshtein_distance_batch`, i.e. the first span with the smallest distance,
+without aligning the other spans again: with unit costs only a window of that
+span before its end position is searched again, otherwise the span up to its
+end position.
+
+Args:
+  query, reference, spans, insert_cost, delete_cost, replace_cost:
+    As given to `levenshtein_distance_batch`.
+  distances, end_positions:
+    As returned by `levenshtein_distance_batch`.
+
+Returns:
+  None if there is no match (all the distances are -1) or the query is
+  empty; else a tuple (index, distance, (position, trace)) where index is the
+  index of the best span in the flattened spans, and (position, trace) its
+  alignment as in the "string" alignment format of `levenshtein_distance`,
+  with position an index into `reference`.
+)doc";
 
-  std::vector<std::pair<int64_t, std::string>> trace;
-  trace.reserve(alignments.size());
+void CheckSpans(const py::array_t<int64_t, py::array::c_style> &spans,
+                int64_t reference_length) {
+  if (spans.ndim() < 1 || spans.shape(spans.ndim() - 1) != 2)
+    throw std::runtime_error("Spans MUST have shape (..., 2)");
 
-  for (const auto &align : alignments) {
-    trace.emplace_back(align.position, align.backtrace.ToString());
+  int64_t num_spans = spans.size() / 2;
+  const int64_t *spans_data = spans.data();
+  for (int64_t i = 0; i < num_spans; i++) {
+    int64_t begin = spans_data[2 * i], end = spans_data[2 * i + 1];
+    if (begin >= 0 && !(begin < end && end <= reference_length))
+      throw std::runtime_error("Span " + std::to_string(i) +
+                               " is invalid: [" + std::to_string(begin) +
+                               ", " + std::to_string(end) + ")");
   }
+}
+
+template <typename T>
+static std::pair<py::array_t<int32_t>, py::array_t<int64_t>>
+PybindLevenshteinBatchHelper(py::array_t<T, py::array::c_style> &query,
+                             py::array_t<T, py::array::c_style> &reference,
+                             py::array_t<int64_t, py::array::c_style> &spans,
+                             int32_t insert_cost, int32_t delete_cost,
+                             int32_t replace_cost, const std::string &engine,
+                             int32_t max_distance, int32_t num_threads) {
+  LevenshteinEngine levenshtein_engine = ToLevenshteinEngine(engine);
+  if (levenshtein_engine == LevenshteinEngine::kBitParallel &&
+      (insert_cost != 1 || delete_cost != 1 || replace_cost != 1))
+    throw std::runtime_error(
+        "The bit_parallel engine requires all the costs to be 1");
+
+  if (query.ndim() != 1 || reference.ndim() != 1)
+    throw std::runtime_error(
+        "Query and reference MUST be one dimension arrays");
 
-  return std::make_pair(distance, trace);
+  CheckSpans(spans, reference.size());
+
+  int64_t num_spans = spans.size() / 2;
+  std::vector<py::ssize_t> shape(spans.shape(), spans.shape() + spans.ndim());
+  shape.pop_back();
+  py::array_t<int32_t> distances(shape);
+  py::array_t<int64_t> end_positions(shape);
+  const T *query_data = query.data();
+  const T *reference_data = reference.data();
+  const int64_t *spans_data = spans.data();
+  int32_t *distances_data = distances.mutable_data();
+  int64_t *end_positions_data = end_positions.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    LevenshteinDistanceBatch(query_data, query.size(), reference_data,
+                             reference.size(), spans_data, num_spans,
+                             insert_cost, delete_cost, replace_cost,
+                             levenshtein_engine, max_distance, distances_data,
+                             end_positions_data, num_threads);
+  }
+  return std::make_pair(distances, end_positions);
 }
 
-void PybindLevenshtein(py::module &m) {
-  m.def("levenshtein_distance", &PybindLevenshteinHelper<int32_t>,
+template <typename T>
+static py::object PybindLevenshteinBatchBestAlignmentHelper(
+    py::array_t<T, py::array::c_style> &query,
+    py::array_t<T, py::array::c_style> &reference,
+    py::array_t<int64_t, py::array::c_style> &spans,
+    py::array_t<int32_t, py::array::c_style> &distances,
+    py::array_t<int64_t, py::array::c_style> &end_positions,
+    int32_t insert_cost, int32_t delete_cost, int32_t replace_cost) {
+  if (insert_cost < 0 || delete_cost < 0 || replace_cost < 0)
+    throw std::runtime_error("The costs MUST be >= 0");
+  if (query.ndim() != 1 || reference.ndim() != 1)
+    throw std::runtime_error(
+        "Query and reference MUST be one dimension arrays");
+  CheckSpans(spans, reference.size());
+  int64_t num_spans = spans.size() / 2;
+  if (distances.size() != num_spans || end_positions.size() != num_spans)
+    throw std::runtime_error("distances and end_positions MUST have one "
+                             "element per span");
+  const int64_t *spans_data = spans.data();
+  const int32_t *distances_data = distances.data();
+  const int64_t *end_positions_data = end_positions.data();
+  for (int64_t i = 0; i < num_spans; i++) {
+    int64_t begin = spans_data[2 * i], end = spans_data[2 * i + 1];
+    if (distances_data[i] != -1 &&
+        (begin < 0 || end_positions_data[i] < begin ||
+         end_positions_data[i] >= end))
+      throw std::runtime_error("The end position of span " +
+                               std::to_string(i) + " is not in it");
+  }
+
+  LevenshteinElement alignment;
+  BacktraceArena arena;
+  int64_t best;
+  {
+    py::gil_scoped_release release;
+    best = LevenshteinBatchBestAlignment(
+        query.data(), query.size(), reference.data(), spans_data, num_spans,
+        distances_data, end_positions_data, &alignment, &arena, insert_cost,
+        delete_cost, replace_cost);
+  }
+  if (best == -1)
+    return py::none();
+  return py::make_tuple(
+      best, alignment.cost,
+      py::make_tuple(alignment.position, alignment.backtrace.ToString(arena)));
+}
+
+/*
+ * Registers the functions of the sequences of symbols of type T, with the
+ * docs only if `docs` (i.e. for the first of the overloads).  The overloads
+ * of the other types are picked for arrays of exactly their dtype; others
+ * (e.g. lists) are converted to the first one registered.
+ */
+template <typename T>
+static void PybindLevenshteinOverloads(py::module &m, bool docs) {
+  m.def("levenshtein_distance", &PybindLevenshteinHelper<T>,
         py::arg("query"), py::arg("target"), py::arg("insert_cost") = 1,
         py::arg("delete_cost") = 1, py::arg("replace_cost") = 1,
-        kLevenshteinDistanceDoc);
+        py::arg("engine") = "auto", py::arg("max_distance") = -1,
+        py::arg("band_width") = -1, py::arg("linear_memory") = false,
+        py::arg("num_threads") = 1, py::arg("alignment_format") = "string",
+        docs ? kLevenshteinDistanceDoc : "");
+  m.def("levenshtein_distance_batch", &PybindLevenshteinBatchHelper<T>,
+        py::arg("query"), py::arg("reference"), py::arg("spans"),
+        py::arg("insert_cost") = 1, py::arg("delete_cost") = 1,
+        py::arg("replace_cost") = 1, py::arg("engine") = "auto",
+        py::arg("max_distance") = -1, py::arg("num_threads") = 1,
+        docs ? kLevenshteinDistanceBatchDoc : "");
+  m.def("levenshtein_batch_best_alignment",
+        &PybindLevenshteinBatchBestAlignmentHelper<T>, py::arg("query"),
+        py::arg("reference"), py::arg("spans"), py::arg("distances"),
+        py::arg("end_positions"), py::arg("insert_cost") = 1,
+        py::arg("delete_cost") = 1, py::arg("replace_cost") = 1,
+        docs ? kLevenshteinBatchBestAlignmentDoc : "");
+}
+
+void PybindLevenshtein(py::module &m) {
+  // int32 first, so that it is what other inputs are converted to, as before
+  // there were the other overloads.
+  PybindLevenshteinOverloads<int32_t>(m, true);
+  PybindLevenshteinOverloads<uint8_t>(m, false);
+  PybindLevenshteinOverloads<uint16_t>(m, false);
+  PybindLevenshteinOverloads<int64_t>(m, false);
 }
 } // namespace fasttextsearch
@@ -19,10 +19,27 @@
 #ifndef TEXTSEARCH_PYTHON_CSRC_LEVENSHTEIN_H_
 #define TEXTSEARCH_PYTHON_CSRC_LEVENSHTEIN_H_
 
+#include <cstdint>
+#include <string>
+
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/levenshtein.h"
 #include "textsearch/python/csrc/text_search.h"
 
 namespace fasttextsearch {
 
+// Returns the engine named `name` ("auto", "scalar", "bit_parallel" or
+// "simd"); throws std::runtime_error if there is none.
+LevenshteinEngine ToLevenshteinEngine(const std::string &name);
+
+// The inverse of ToLevenshteinEngine().
+const char *LevenshteinEngineName(LevenshteinEngine engine);
+
+// Checks that spans has shape (..., 2) and that its spans are valid for a
+// reference of length reference_length; throws std::runtime_error if not.
+void CheckSpans(const py::array_t<int64_t, py::array::c_style> &spans,
+                int64_t reference_length);
+
 void PybindLevenshtein(py::module &m);
 
 } // namespace fasttextsearch
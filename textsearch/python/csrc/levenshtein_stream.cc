@@ -0,0 +1,136 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/levenshtein_stream.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/levenshtein_stream.h"
+#include "textsearch/python/csrc/levenshtein.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+template <typename T> using Array = py::array_t<T, py::array::c_style>;
+
+static constexpr const char *kStreamingAlignerDoc = R"doc(
+Aligns a query that arrives in pieces (e.g. the transcript of a recording of
+many hours) with a target, with the same infix search as
+`levenshtein_distance`, returning the edit operations as they are known.
+
+The query is aligned in overlapping chunks of `options.chunk_length`
+symbols, each one in a window of the target around where the previous one
+got to, and consecutive chunks are stitched where they agree in their
+overlap; so the memory and the time to the first operations depend on the
+chunk length, not on the query length.  See StreamingAligner in
+textsearch/csrc/levenshtein_stream.h.
+
+>>> aligner = StreamingAligner(target, StreamingAlignerOptions())
+>>> for piece in pieces:
+...     aligner.push(piece)
+...     ops, query_positions, target_positions = aligner.pull()
+>>> aligner.finish()
+>>> ops, query_positions, target_positions = aligner.pull()
+
+`pull` returns the operations that are final since its last call, as with
+alignment_format="numpy" in `levenshtein_distance` but with np.int64
+positions into the whole query and target.
+)doc";
+
+static void CheckOptions(const StreamingAlignerOptions &options) {
+  if (options.chunk_length <= 0 || options.overlap < 0 ||
+      options.overlap >= options.chunk_length)
+    throw std::runtime_error(
+        "chunk_length MUST be positive and 0 <= overlap < chunk_length");
+  if (options.window_slack < 0)
+    throw std::runtime_error("window_slack MUST be >= 0");
+  if (options.insert_cost < 0 || options.delete_cost < 0 ||
+      options.replace_cost < 0)
+    throw std::runtime_error("The costs MUST be >= 0");
+  if (options.engine == LevenshteinEngine::kBitParallel &&
+      (options.insert_cost != 1 || options.delete_cost != 1 ||
+       options.replace_cost != 1))
+    throw std::runtime_error(
+        "The bit_parallel engine requires all the costs to be 1");
+}
+
+static py::tuple PullHelper(StreamingAligner<int32_t> &self) {
+  std::vector<AlignmentOp> ops;
+  std::vector<int64_t> query_positions, target_positions;
+  self.Pull(&ops, &query_positions, &target_positions);
+  py::ssize_t n = ops.size();
+  Array<int8_t> ops_array(n);
+  std::copy(ops.begin(), ops.end(),
+            reinterpret_cast<AlignmentOp *>(ops_array.mutable_data()));
+  return py::make_tuple(ops_array, Array<int64_t>(n, query_positions.data()),
+                        Array<int64_t>(n, target_positions.data()));
+}
+
+void PybindLevenshteinStream(py::module &m) {
+  using PyOptions = StreamingAlignerOptions;
+  py::class_<PyOptions>(m, "StreamingAlignerOptions")
+      .def(py::init<>())
+      .def_readwrite("chunk_length", &PyOptions::chunk_length)
+      .def_readwrite("overlap", &PyOptions::overlap)
+      .def_readwrite("window_slack", &PyOptions::window_slack)
+      .def_readwrite("first_window", &PyOptions::first_window)
+      .def_readwrite("insert_cost", &PyOptions::insert_cost)
+      .def_readwrite("delete_cost", &PyOptions::delete_cost)
+      .def_readwrite("replace_cost", &PyOptions::replace_cost)
+      .def_property(
+          "engine",
+          [](const PyOptions &self) {
+            return LevenshteinEngineName(self.engine);
+          },
+          [](PyOptions &self, const std::string &engine) {
+            self.engine = ToLevenshteinEngine(engine);
+          });
+
+  using PyClass = StreamingAligner<int32_t>;
+  // The aligner points into `target`, so it keeps it alive.
+  py::class_<PyClass>(m, "StreamingAligner", kStreamingAlignerDoc)
+      .def(py::init([](Array<int32_t> &target, const PyOptions &options) {
+             if (target.ndim() != 1 || target.size() == 0)
+               throw std::runtime_error(
+                   "target MUST be a non-empty one dimension array");
+             CheckOptions(options);
+             return std::unique_ptr<PyClass>(
+                 new PyClass(target.data(), target.size(), options));
+           }),
+           py::arg("target").noconvert(), py::arg("options"),
+           py::keep_alive<1, 2>())
+      .def(
+          "push",
+          [](PyClass &self, Array<int32_t> &query) {
+            if (query.ndim() != 1)
+              throw std::runtime_error("query MUST be a one dimension array");
+            const int32_t *data = query.data();
+            size_t size = query.size();
+            py::gil_scoped_release release;
+            self.Push(data, size);
+          },
+          py::arg("query"))
+      .def("finish", &PyClass::Finish,
+           py::call_guard<py::gil_scoped_release>())
+      .def("pull", &PullHelper)
+      .def_property_readonly("cost", &PyClass::Cost)
+      .def_property_readonly("num_query_symbols", &PyClass::NumQuerySymbols);
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,153 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/minimizer_index.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/minimizer_index.h"
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace fasttextsearch {
+
+template <typename SymbolT, typename IndexT>
+static py::object CreateMinimizerIndex(const SymbolT *text, int64_t seq_len,
+                                       int32_t k, int32_t w,
+                                       int32_t num_threads) {
+  std::unique_ptr<MinimizerIndex<SymbolT, IndexT>> index;
+  {
+    py::gil_scoped_release release;
+    index.reset(new MinimizerIndex<SymbolT, IndexT>(
+        text, static_cast<IndexT>(seq_len), k, w, num_threads));
+  }
+  return py::cast(std::move(index));
+}
+
+// Positions of np.int32; there are none for np.int64 symbols.
+template <typename SymbolT>
+static py::object CreateMinimizerIndexInt32(const SymbolT *text,
+                                            int64_t seq_len, int32_t k,
+                                            int32_t w, int32_t num_threads) {
+  return CreateMinimizerIndex<SymbolT, int32_t>(text, seq_len, k, w,
+                                                num_threads);
+}
+
+static py::object CreateMinimizerIndexInt32(const int64_t *, int64_t, int32_t,
+                                            int32_t, int32_t) {
+  throw std::runtime_error("index_dtype MUST be np.int64 for np.int64 text");
+}
+
+// The positions are of type index_dtype, np.int32 or np.int64 (np.int64 for
+// np.int64 symbols).
+template <typename SymbolT>
+static py::object
+CreateMinimizerIndexHelper(py::array_t<SymbolT, py::array::c_style> &text,
+                           int32_t k, int32_t w, py::dtype index_dtype,
+                           int32_t num_threads) {
+  if (text.ndim() != 1 || text.size() < 4)
+    throw std::runtime_error(
+        "text MUST be a one dimension array with at least 4 elements");
+  if (k <= 0 || w <= 0)
+    throw std::runtime_error("k and w MUST be positive");
+
+  int64_t seq_len = static_cast<int64_t>(text.size() - 3);
+  if (index_dtype.kind() != 'i' ||
+      (index_dtype.itemsize() != 4 && index_dtype.itemsize() != 8))
+    throw std::runtime_error("index_dtype MUST be np.int32 or np.int64");
+  if (index_dtype.itemsize() == 8)
+    return CreateMinimizerIndex<SymbolT, int64_t>(text.data(), seq_len, k, w,
+                                                  num_threads);
+  if (text.size() > std::numeric_limits<int32_t>::max())
+    throw std::runtime_error("The text is too long for np.int32 positions");
+  return CreateMinimizerIndexInt32(text.data(), seq_len, k, w, num_threads);
+}
+
+template <typename SymbolT, typename IndexT>
+static std::pair<py::array_t<IndexT>, py::array_t<IndexT>>
+FindCloseMatchesHelper(const MinimizerIndex<SymbolT, IndexT> &index,
+                       py::array_t<SymbolT, py::array::c_style> &query,
+                       int32_t num_close_matches, IndexT min_match_length,
+                       int32_t num_threads) {
+  if (query.ndim() != 1)
+    throw std::runtime_error("query MUST be a one dimension array");
+  if (num_close_matches <= 0)
+    throw std::runtime_error("num_close_matches MUST be positive");
+
+  IndexT query_len = static_cast<IndexT>(query.size());
+  py::ssize_t size = 2 * static_cast<py::ssize_t>(num_close_matches) *
+                     static_cast<py::ssize_t>(query_len);
+  py::array_t<IndexT> output(size), lengths(size);
+  const SymbolT *query_data = query.data();
+  IndexT *output_data = output.mutable_data(),
+         *lengths_data = lengths.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    index.FindCloseMatches(query_data, query_len, num_close_matches,
+                           min_match_length, output_data, lengths_data,
+                           num_threads);
+  }
+  return std::make_pair(output, lengths);
+}
+
+template <typename SymbolT, typename IndexT>
+static void PybindMinimizerIndexClass(py::module &m, const std::string &name) {
+  using PyClass = MinimizerIndex<SymbolT, IndexT>;
+  py::class_<PyClass>(m, name.c_str())
+      .def_property_readonly("seq_len", &PyClass::SeqLen)
+      .def_property_readonly("k", &PyClass::K)
+      .def_property_readonly("w", &PyClass::W)
+      .def_property_readonly("num_minimizers", &PyClass::NumMinimizers)
+      .def_property_readonly("num_positions", &PyClass::NumPositions)
+      .def_property_readonly("num_bytes", &PyClass::NumBytes)
+      .def("find_close_matches", &FindCloseMatchesHelper<SymbolT, IndexT>,
+           py::arg("query").noconvert(), py::arg("num_close_matches") = 1,
+           py::arg("min_match_length") = 0, py::arg("num_threads") = 1);
+}
+
+template <typename SymbolT>
+static void PybindMinimizerIndexClasses(py::module &m,
+                                        const std::string &name) {
+  PybindMinimizerIndexClass<SymbolT, int32_t>(m, name + "Int32");
+  PybindMinimizerIndexClass<SymbolT, int64_t>(m, name + "Int64");
+}
+
+template <>
+void PybindMinimizerIndexClasses<int64_t>(py::module &m,
+                                          const std::string &name) {
+  PybindMinimizerIndexClass<int64_t, int64_t>(m, name + "Int64");
+}
+
+template <typename SymbolT>
+static void PybindMinimizerIndexImpl(py::module &m, const std::string &name) {
+  PybindMinimizerIndexClasses<SymbolT>(m, name);
+  m.def("create_minimizer_index", &CreateMinimizerIndexHelper<SymbolT>,
+        py::arg("text").noconvert(), py::arg("k"), py::arg("w"),
+        py::arg("index_dtype"), py::arg("num_threads") = 1);
+}
+
+void PybindMinimizerIndex(py::module &m) {
+  // As for create_suffix_array(), the arrays are never converted.
+  PybindMinimizerIndexImpl<uint8_t>(m, "MinimizerIndexUint8");
+  PybindMinimizerIndexImpl<uint16_t>(m, "MinimizerIndexUint16");
+  PybindMinimizerIndexImpl<int32_t>(m, "MinimizerIndexInt32");
+  PybindMinimizerIndexImpl<int64_t>(m, "MinimizerIndexInt64");
+}
+
+} // namespace fasttextsearch
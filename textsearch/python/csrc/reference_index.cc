@@ -0,0 +1,96 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/reference_index.h"
+#include "pybind11/numpy.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/reference_index.h"
+#include <utility>
+
+namespace fasttextsearch {
+
+template <typename SymbolT, typename IndexT>
+static std::pair<py::array_t<IndexT>, py::array_t<IndexT>>
+PybindFindCloseMatchesInReferenceHelper(
+    py::array_t<SymbolT, py::array::c_style> &text,
+    py::array_t<IndexT, py::array::c_style> &suffix_array, py::object lcp,
+    py::array_t<SymbolT, py::array::c_style> &query,
+    int32_t num_close_matches, IndexT min_match_length, int32_t num_threads) {
+  if (text.ndim() != 1 || text.size() < 4)
+    throw std::runtime_error(
+        "text MUST be a one dimension array with at least 4 elements");
+  IndexT seq_len = static_cast<IndexT>(text.size() - 3);
+  if (suffix_array.ndim() != 1 || suffix_array.size() != seq_len)
+    throw std::runtime_error(
+        "suffix_array MUST be a one dimension array of size text.size - 3");
+  if (query.ndim() != 1)
+    throw std::runtime_error("query MUST be a one dimension array");
+  if (num_close_matches <= 0)
+    throw std::runtime_error("num_close_matches MUST be positive");
+
+  py::array_t<IndexT, py::array::c_style> lcp_array;
+  if (!lcp.is_none()) {
+    lcp_array = lcp.cast<py::array_t<IndexT, py::array::c_style>>();
+    if (lcp_array.ndim() != 1 || lcp_array.size() != seq_len)
+      throw std::runtime_error("lcp MUST be of the same shape as suffix_array");
+  } else if (num_close_matches != 1) {
+    throw std::runtime_error("num_close_matches MUST be 1 without lcp");
+  }
+
+  IndexT query_len = static_cast<IndexT>(query.size());
+  py::ssize_t size = 2 * static_cast<py::ssize_t>(num_close_matches) *
+                     static_cast<py::ssize_t>(query_len);
+  py::array_t<IndexT> output(size), lengths(size);
+  const SymbolT *text_data = text.data(), *query_data = query.data();
+  const IndexT *sa_data = suffix_array.data(),
+               *lcp_data = lcp.is_none() ? nullptr : lcp_array.data();
+  IndexT *output_data = output.mutable_data(),
+         *lengths_data = lengths.mutable_data();
+
+  {
+    py::gil_scoped_release release;
+    FindCloseMatchesInReference(text_data, seq_len, sa_data, lcp_data,
+                                query_data, query_len, num_close_matches,
+                                min_match_length, output_data, lengths_data,
+                                num_threads);
+  }
+  return std::make_pair(output, lengths);
+}
+
+template <typename SymbolT, typename IndexT>
+static void PybindReferenceIndexImpl(py::module &m) {
+  m.def("find_close_matches_in_reference",
+        &PybindFindCloseMatchesInReferenceHelper<SymbolT, IndexT>,
+        py::arg("text").noconvert(), py::arg("suffix_array").noconvert(),
+        py::arg("lcp"), py::arg("query").noconvert(),
+        py::arg("num_close_matches") = 1, py::arg("min_match_length") = 0,
+        py::arg("num_threads") = 1);
+}
+
+void PybindReferenceIndex(py::module &m) {
+  // As for create_suffix_array(), the arrays are never converted.
+  PybindReferenceIndexImpl<uint8_t, int32_t>(m);
+  PybindReferenceIndexImpl<uint8_t, int64_t>(m);
+  PybindReferenceIndexImpl<uint16_t, int32_t>(m);
+  PybindReferenceIndexImpl<uint16_t, int64_t>(m);
+  PybindReferenceIndexImpl<int32_t, int32_t>(m);
+  PybindReferenceIndexImpl<int32_t, int64_t>(m);
+  PybindReferenceIndexImpl<int64_t, int64_t>(m);
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,162 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/segmenter.h"
+#include "pybind11/numpy.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/segmenter.h"
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+template <typename T> using Array = py::array_t<T, py::array::c_style>;
+
+// Checks that `array` is a one dimension array whose elements are in
+// [min_value, max_value).
+template <typename T>
+static void CheckArray(const Array<T> &array, int64_t min_value,
+                       int64_t max_value, const char *name) {
+  if (array.ndim() != 1)
+    throw std::runtime_error(std::string(name) +
+                             " MUST be one dimension arrays");
+  const T *data = array.data();
+  for (py::ssize_t i = 0; i < array.size(); i++)
+    if (data[i] < min_value || data[i] >= max_value)
+      throw std::runtime_error(std::string(name) + " MUST be in [" +
+                               std::to_string(min_value) + ", " +
+                               std::to_string(max_value) + ")");
+}
+
+/*
+  Returns a list with, for each alignment, a tuple (positions, times,
+  scores) of np.int32 of shape (num_segments, 6), np.float32 of shape
+  (num_segments, 2) and np.float32 of shape (num_segments,); see
+  find_segments() in segmenter.py.
+ */
+static py::list FindSegmentsHelper(
+    const std::vector<Array<int8_t>> &ops,
+    const std::vector<Array<int32_t>> &query_positions,
+    const std::vector<Array<int32_t>> &target_positions,
+    const std::vector<Array<float>> &times,
+    const std::vector<Array<int32_t>> &references,
+    const SegmenterOptions &options, int32_t num_threads) {
+  size_t num_inputs = ops.size();
+  if (query_positions.size() != num_inputs ||
+      target_positions.size() != num_inputs || times.size() != num_inputs ||
+      references.size() != num_inputs)
+    throw std::runtime_error("The lists MUST have one element per alignment");
+
+  std::vector<SegmenterInput> inputs(num_inputs);
+  for (size_t i = 0; i < num_inputs; i++) {
+    py::ssize_t num_ops = ops[i].size();
+    if (query_positions[i].size() != num_ops ||
+        target_positions[i].size() != num_ops)
+      throw std::runtime_error(
+          "query_positions and target_positions MUST have the size of ops");
+    if (num_ops > std::numeric_limits<int32_t>::max() ||
+        times[i].size() > std::numeric_limits<int32_t>::max() ||
+        references[i].size() > std::numeric_limits<int32_t>::max())
+      throw std::runtime_error("The arrays MUST have less than 2^31 elements");
+    CheckArray(ops[i], 0, 4, "ops");
+    CheckArray(query_positions[i], -1, times[i].size(), "query_positions");
+    CheckArray(target_positions[i], -1, references[i].size(),
+               "target_positions");
+    if (times[i].ndim() != 1 || references[i].ndim() != 1)
+      throw std::runtime_error(
+          "times and references MUST be one dimension arrays");
+
+    SegmenterInput &input = inputs[i];
+    input.ops = reinterpret_cast<const AlignmentOp *>(ops[i].data());
+    input.num_ops = static_cast<int32_t>(num_ops);
+    input.query_positions = query_positions[i].data();
+    input.target_positions = target_positions[i].data();
+    input.times = times[i].data();
+    input.query_len = static_cast<int32_t>(times[i].size());
+    input.ref_text = references[i].data();
+    input.ref_len = static_cast<int32_t>(references[i].size());
+  }
+
+  std::vector<std::vector<Segment>> segments;
+  {
+    py::gil_scoped_release release;
+    FindSegmentsBatch(inputs, options, &segments, num_threads);
+  }
+
+  py::list ans;
+  for (const std::vector<Segment> &s : segments) {
+    py::ssize_t num_segments = s.size();
+    Array<int32_t> positions({num_segments, py::ssize_t(6)});
+    Array<float> segment_times({num_segments, py::ssize_t(2)});
+    Array<float> scores(num_segments);
+    int32_t *p = positions.mutable_data();
+    float *t = segment_times.mutable_data(), *score = scores.mutable_data();
+    for (const Segment &segment : s) {
+      *p++ = segment.begin;
+      *p++ = segment.end;
+      *p++ = segment.query_begin;
+      *p++ = segment.query_end;
+      *p++ = segment.ref_begin;
+      *p++ = segment.ref_end;
+      *t++ = segment.begin_time;
+      *t++ = segment.end_time;
+      *score++ = segment.score;
+    }
+    ans.append(py::make_tuple(positions, segment_times, scores));
+  }
+  return ans;
+}
+
+void PybindSegmenter(py::module &m) {
+  using PyClass = SegmenterOptions;
+  py::class_<PyClass>(m, "SegmenterOptions")
+      .def(py::init<>())
+      .def_readwrite("frame_duration", &PyClass::frame_duration)
+      .def_readwrite("max_silence", &PyClass::max_silence)
+      .def_readwrite("silence_weight", &PyClass::silence_weight)
+      .def_readwrite("error_window", &PyClass::error_window)
+      .def_readwrite("error_density_weight", &PyClass::error_density_weight)
+      .def_readwrite("whitespace_bonus", &PyClass::whitespace_bonus)
+      .def_readwrite("punctuation_bonus", &PyClass::punctuation_bonus)
+      .def_readwrite("max_boundary_silence", &PyClass::max_boundary_silence)
+      .def_readwrite("min_duration", &PyClass::min_duration)
+      .def_readwrite("max_duration", &PyClass::max_duration)
+      .def_readwrite("preferred_min_duration",
+                     &PyClass::preferred_min_duration)
+      .def_readwrite("preferred_max_duration",
+                     &PyClass::preferred_max_duration)
+      .def_readwrite("duration_weight", &PyClass::duration_weight)
+      .def_readwrite("max_internal_silence", &PyClass::max_internal_silence)
+      .def_readwrite("internal_silence_weight",
+                     &PyClass::internal_silence_weight)
+      .def_readwrite("match_bonus", &PyClass::match_bonus)
+      .def_readwrite("error_penalty", &PyClass::error_penalty)
+      .def_readwrite("candidate_fraction", &PyClass::candidate_fraction)
+      .def_readwrite("num_candidates_per_position",
+                     &PyClass::num_candidates_per_position)
+      .def_readwrite("whitespace", &PyClass::whitespace)
+      .def_readwrite("punctuation", &PyClass::punctuation);
+
+  m.def("find_segments", &FindSegmentsHelper, py::arg("ops"),
+        py::arg("query_positions"), py::arg("target_positions"),
+        py::arg("times"), py::arg("references"), py::arg("options"),
+        py::arg("num_threads") = 1);
+}
+
+} // namespace fasttextsearch
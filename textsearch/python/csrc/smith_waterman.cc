@@ -0,0 +1,280 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/smith_waterman.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/smith_waterman.h"
+#include "textsearch/python/csrc/levenshtein.h"
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+template <typename T> using Array = py::array_t<T, py::array::c_style>;
+
+static constexpr const char *kSmithWatermanAlignDoc = R"doc(
+Align query with target with affine gap penalties (Gotoh's algorithm): each
+aligned pair of symbols scores match_score or mismatch_score, and each run of
+k consecutive insertions or deletions scores gap_open + k * gap_extend, so a
+long deletion (e.g. a passage of the reference the audio skips) costs little
+more than a short one.  The score is maximized.  Only the score is computed
+over the whole target; the backtrace is only computed for the region of the
+best alignment.
+
+Args:
+  query:
+    The query sequence, a one dimension numpy ndarray of np.uint8, np.uint16,
+    np.int32 or np.int64, used as is (others are converted to np.int32).
+  target:
+    The target sequence, a one dimension array of the dtype of query.
+  match_score:
+    The score of an aligned pair of equal symbols, must be > 0; default 2.
+  mismatch_score:
+    The score of an aligned pair of different symbols, must be <=
+    match_score; default -2.
+  gap_open:
+    The score of opening a gap, must be <= 0; default -3.
+  gap_extend:
+    The score of each symbol of a gap, must be < 0; default -1.
+  mode:
+    "semi_global" (default) to align all of the query with a segment of the
+    target, as the infix search of `levenshtein_distance`; or "local"
+    (Smith-Waterman) for the best scoring pair of segments of both, whose
+    score is never negative.
+
+Returns:
+  A tuple (score, query_begin, query_end, target_begin, target_end,
+  (position, trace)): query[query_begin:query_end] is aligned with
+  target[target_begin:target_end], the first best alignment (the one with the
+  smallest target_end).  (position, trace) is the alignment as in the
+  "string" alignment format of `levenshtein_distance`, with position =
+  target_end - 1; `get_nice_alignments([(position, trace)],
+  query[query_begin:], target)` formats it.  In "local" mode, if the score is
+  0 the alignment is empty: the begins and ends are 0 and the trace is "".
+
+>>> from textsearch import smith_waterman_align
+>>> import numpy as np
+>>> query = np.array([1, 2, 3, 4], dtype=np.int32)
+>>> target = np.array([5, 1, 2, 6, 3, 4, 7], dtype=np.int32)
+>>> smith_waterman_align(query, target)
+(4, 0, 4, 1, 6, (5, '010100101'))
+)doc";
+
+static constexpr const char *kSmithWatermanBatchDoc = R"doc(
+Calculate the scores of `smith_waterman_align` between one query and many
+segments (spans) of a reference sequence, e.g. the candidate regions returned
+by `find_candidate_matches`, without any backtraces.  The spans are processed
+in parallel with the GIL released.  `smith_waterman_batch_best_alignment`
+then aligns the query with the best one.
+
+Args:
+  query:
+    The query sequence, a one dimension array of np.uint8, np.uint16,
+    np.int32 or np.int64 (others are converted to np.int32).
+  reference:
+    The reference sequence, a one dimension array of the dtype of query.
+  spans:
+    An np.int64 array of shape (..., 2), as for `levenshtein_distance_batch`.
+  match_score, mismatch_score, gap_open, gap_extend, mode:
+    As for `smith_waterman_align`.
+  num_threads:
+    The number of threads to use, <= 0 means to use all hardware threads;
+    default 1.
+
+Returns:
+  Return a tuple of two arrays of shape spans.shape[:-1]: the scores
+  (np.int32, np.iinfo(np.int32).min for the skipped spans) and the positions
+  of the last target symbol of the first best alignments, as indexes into
+  `reference` (np.int64, -1 for the skipped spans and the alignments without
+  target symbols).
+)doc";
+
+static constexpr const char *kSmithWatermanBatchBestAlignmentDoc = R"doc(
+Align the query with the best span of a `smith_waterman_batch`, i.e. the
+first span with the largest score, computing the backtrace for that span
+only.
+
+Args:
+  query, reference, spans, match_score, mismatch_score, gap_open, gap_extend,
+  mode:
+    As given to `smith_waterman_batch`.
+  scores:
+    The scores returned by `smith_waterman_batch`.
+
+Returns:
+  None if all the spans were skipped; else a tuple (index, alignment) where
+  index is the index of the best span in the flattened spans, and alignment
+  is as returned by `smith_waterman_align`, with the target positions indexes
+  into `reference`.
+)doc";
+
+static SmithWatermanOptions ToSmithWatermanOptions(int32_t match_score,
+                                                   int32_t mismatch_score,
+                                                   int32_t gap_open,
+                                                   int32_t gap_extend,
+                                                   const std::string &mode) {
+  if (match_score <= 0)
+    throw std::runtime_error("match_score MUST be > 0");
+  if (mismatch_score > match_score)
+    throw std::runtime_error("mismatch_score MUST be <= match_score");
+  if (gap_open > 0)
+    throw std::runtime_error("gap_open MUST be <= 0");
+  if (gap_extend >= 0)
+    throw std::runtime_error("gap_extend MUST be < 0");
+
+  SmithWatermanOptions options;
+  options.match_score = match_score;
+  options.mismatch_score = mismatch_score;
+  options.gap_open = gap_open;
+  options.gap_extend = gap_extend;
+  if (mode == "semi_global")
+    options.mode = SmithWatermanMode::kSemiGlobal;
+  else if (mode == "local")
+    options.mode = SmithWatermanMode::kLocal;
+  else
+    throw std::runtime_error("Unknown mode: '" + mode +
+                             "', expected 'semi_global' or 'local'");
+  return options;
+}
+
+static py::tuple ToTuple(const SmithWatermanAlignment &alignment,
+                         const BacktraceArena &arena) {
+  return py::make_tuple(alignment.score, alignment.query_begin,
+                        alignment.query_end, alignment.target_begin,
+                        alignment.target_end,
+                        py::make_tuple(alignment.element.position,
+                                       alignment.element.backtrace.ToString(
+                                           arena)));
+}
+
+template <typename T>
+static py::tuple
+PybindSmithWatermanAlignHelper(Array<T> &query, Array<T> &target,
+                               int32_t match_score, int32_t mismatch_score,
+                               int32_t gap_open, int32_t gap_extend,
+                               const std::string &mode) {
+  SmithWatermanOptions options = ToSmithWatermanOptions(
+      match_score, mismatch_score, gap_open, gap_extend, mode);
+  if (query.ndim() != 1 || target.ndim() != 1)
+    throw std::runtime_error("Query and target MUST be one dimension arrays");
+
+  SmithWatermanAlignment alignment;
+  BacktraceArena arena;
+  {
+    py::gil_scoped_release release;
+    SmithWatermanAlign(query.data(), query.size(), target.data(),
+                       target.size(), options, &alignment, &arena);
+  }
+  return ToTuple(alignment, arena);
+}
+
+template <typename T>
+static std::pair<py::array_t<int32_t>, py::array_t<int64_t>>
+PybindSmithWatermanBatchHelper(Array<T> &query, Array<T> &reference,
+                               Array<int64_t> &spans, int32_t match_score,
+                               int32_t mismatch_score, int32_t gap_open,
+                               int32_t gap_extend, const std::string &mode,
+                               int32_t num_threads) {
+  SmithWatermanOptions options = ToSmithWatermanOptions(
+      match_score, mismatch_score, gap_open, gap_extend, mode);
+  if (query.ndim() != 1 || reference.ndim() != 1)
+    throw std::runtime_error(
+        "Query and reference MUST be one dimension arrays");
+  CheckSpans(spans, reference.size());
+
+  std::vector<py::ssize_t> shape(spans.shape(), spans.shape() + spans.ndim());
+  shape.pop_back();
+  py::array_t<int32_t> scores(shape);
+  py::array_t<int64_t> end_positions(shape);
+  const T *query_data = query.data();
+  const T *reference_data = reference.data();
+  const int64_t *spans_data = spans.data();
+  int32_t *scores_data = scores.mutable_data();
+  int64_t *end_positions_data = end_positions.mutable_data();
+  {
+    py::gil_scoped_release release;
+    SmithWatermanBatch(query_data, query.size(), reference_data,
+                       reference.size(), spans_data, spans.size() / 2, options,
+                       scores_data, end_positions_data, num_threads);
+  }
+  return std::make_pair(scores, end_positions);
+}
+
+template <typename T>
+static py::object PybindSmithWatermanBatchBestAlignmentHelper(
+    Array<T> &query, Array<T> &reference, Array<int64_t> &spans,
+    Array<int32_t> &scores, int32_t match_score, int32_t mismatch_score,
+    int32_t gap_open, int32_t gap_extend, const std::string &mode) {
+  SmithWatermanOptions options = ToSmithWatermanOptions(
+      match_score, mismatch_score, gap_open, gap_extend, mode);
+  if (query.ndim() != 1 || reference.ndim() != 1)
+    throw std::runtime_error(
+        "Query and reference MUST be one dimension arrays");
+  CheckSpans(spans, reference.size());
+  int64_t num_spans = spans.size() / 2;
+  if (scores.size() != num_spans)
+    throw std::runtime_error("scores MUST have one element per span");
+
+  SmithWatermanAlignment alignment;
+  BacktraceArena arena;
+  int64_t best;
+  {
+    py::gil_scoped_release release;
+    best = SmithWatermanBatchBestAlignment(
+        query.data(), query.size(), reference.data(), spans.data(), num_spans,
+        options, scores.data(), &alignment, &arena);
+  }
+  if (best == -1)
+    return py::none();
+  return py::make_tuple(best, ToTuple(alignment, arena));
+}
+
+/*
+ * Registers the functions of the sequences of symbols of type T, with the
+ * docs only if `docs`, as PybindLevenshteinOverloads() in levenshtein.cc.
+ */
+template <typename T>
+static void PybindSmithWatermanOverloads(py::module &m, bool docs) {
+  m.def("smith_waterman_align", &PybindSmithWatermanAlignHelper<T>,
+        py::arg("query"), py::arg("target"), py::arg("match_score") = 2,
+        py::arg("mismatch_score") = -2, py::arg("gap_open") = -3,
+        py::arg("gap_extend") = -1, py::arg("mode") = "semi_global",
+        docs ? kSmithWatermanAlignDoc : "");
+  m.def("smith_waterman_batch", &PybindSmithWatermanBatchHelper<T>,
+        py::arg("query"), py::arg("reference"), py::arg("spans"),
+        py::arg("match_score") = 2, py::arg("mismatch_score") = -2,
+        py::arg("gap_open") = -3, py::arg("gap_extend") = -1,
+        py::arg("mode") = "semi_global", py::arg("num_threads") = 1,
+        docs ? kSmithWatermanBatchDoc : "");
+  m.def("smith_waterman_batch_best_alignment",
+        &PybindSmithWatermanBatchBestAlignmentHelper<T>, py::arg("query"),
+        py::arg("reference"), py::arg("spans"), py::arg("scores"),
+        py::arg("match_score") = 2, py::arg("mismatch_score") = -2,
+        py::arg("gap_open") = -3, py::arg("gap_extend") = -1,
+        py::arg("mode") = "semi_global",
+        docs ? kSmithWatermanBatchBestAlignmentDoc : "");
+}
+
+void PybindSmithWaterman(py::module &m) {
+  PybindSmithWatermanOverloads<int32_t>(m, true);
+  PybindSmithWatermanOverloads<uint8_t>(m, false);
+  PybindSmithWatermanOverloads<uint16_t>(m, false);
+  PybindSmithWatermanOverloads<int64_t>(m, false);
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,178 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/sourced_text.h"
+#include "pybind11/numpy.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/sourced_text.h"
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+using Uint32Array = py::array_t<uint32_t, py::array::c_style>;
+
+// Returns the data of `obj`, which must be None (for nullptr) or a
+// contiguous np.uint32 array of size `size`.
+static const uint32_t *GetUint32Data(const py::handle &obj, int64_t size,
+                                     const char *name) {
+  if (obj.is_none())
+    return nullptr;
+  if (!py::isinstance<Uint32Array>(obj))
+    throw std::runtime_error(std::string(name) +
+                             " MUST be None or contiguous np.uint32 arrays");
+  Uint32Array array = py::reinterpret_borrow<Uint32Array>(obj);
+  if (array.ndim() != 1 || array.size() != size)
+    throw std::runtime_error(std::string(name) +
+                             " MUST have the shape of the texts");
+  return array.data();
+}
+
+// The termination symbol of create_suffix_array(): the second largest value.
+template <typename SymbolT> static SymbolT Eos() {
+  return static_cast<SymbolT>(std::numeric_limits<SymbolT>::max() - 1);
+}
+
+/*
+  Returns (text, pos, doc, doc_splits), where `text` has 4 more elements
+  than the others if add_eos.  pos[i] and docs[i] are None or np.uint32
+  arrays of the size of texts[i]; if docs[i] is None, all the symbols of
+  texts[i] are in document doc_ids[i].
+ */
+template <typename SymbolT>
+static py::tuple ConcatenateTextsHelper(
+    const std::vector<py::array_t<SymbolT, py::array::c_style>> &texts,
+    const py::list &pos, const py::list &docs,
+    const std::vector<uint32_t> &doc_ids, int64_t num_docs, bool add_eos,
+    int32_t num_threads) {
+  int64_t num_pieces = texts.size();
+  if (static_cast<int64_t>(pos.size()) != num_pieces ||
+      static_cast<int64_t>(docs.size()) != num_pieces ||
+      static_cast<int64_t>(doc_ids.size()) != num_pieces)
+    throw std::runtime_error("pos, docs and doc_ids MUST have one element "
+                             "per text");
+  if (num_docs < 0)
+    throw std::runtime_error("num_docs MUST be >= 0");
+
+  std::vector<TextPiece<SymbolT>> pieces(num_pieces);
+  int64_t total_size = 0;
+  for (int64_t p = 0; p < num_pieces; p++) {
+    if (texts[p].ndim() != 1)
+      throw std::runtime_error("texts MUST be one dimension arrays");
+    TextPiece<SymbolT> &piece = pieces[p];
+    piece.text = texts[p].data();
+    piece.size = texts[p].size();
+    piece.pos = GetUint32Data(py::object(pos[p]), piece.size, "pos");
+    piece.doc = GetUint32Data(py::object(docs[p]), piece.size, "docs");
+    piece.doc_id = doc_ids[p];
+    total_size += piece.size;
+  }
+  if (total_size > (int64_t(1) << 32))
+    throw std::runtime_error("The texts MUST have at most 2^32 symbols in "
+                             "total");
+
+  py::array_t<SymbolT> text(total_size + (add_eos ? 4 : 0));
+  Uint32Array pos_out(total_size), doc_out(total_size);
+  py::array_t<int64_t> doc_splits(num_docs + 1);
+  SymbolT *text_data = text.mutable_data();
+  uint32_t *pos_data = pos_out.mutable_data(),
+           *doc_data = doc_out.mutable_data();
+  int64_t *doc_splits_data = doc_splits.mutable_data();
+  bool ok;
+  {
+    py::gil_scoped_release release;
+    ok = ConcatenateTexts(pieces, Eos<SymbolT>(), add_eos, num_docs,
+                          text_data, pos_data, doc_data, doc_splits_data,
+                          num_threads);
+  }
+  if (!ok)
+    throw std::runtime_error("The document ids MUST be non-decreasing and "
+                             "less than num_docs");
+  return py::make_tuple(text, pos_out, doc_out, doc_splits);
+}
+
+// Returns (text, pos, doc, doc_splits) as for ConcatenateTextsHelper(), with
+// only the symbols for which `keep` is true.
+template <typename SymbolT>
+static py::tuple
+RemoveFromTextHelper(py::array_t<SymbolT, py::array::c_style> &text,
+                     Uint32Array &pos, Uint32Array &doc,
+                     py::array_t<bool, py::array::c_style> &keep,
+                     int64_t num_docs, bool add_eos, int32_t num_threads) {
+  if (text.ndim() != 1)
+    throw std::runtime_error("text MUST be a one dimension array");
+  int64_t size = text.size();
+  if (pos.ndim() != 1 || pos.size() != size || doc.ndim() != 1 ||
+      doc.size() != size || keep.ndim() != 1 || keep.size() != size)
+    throw std::runtime_error("pos, doc and keep MUST have the shape of text");
+  if (num_docs < 0)
+    throw std::runtime_error("num_docs MUST be >= 0");
+
+  const SymbolT *text_data = text.data();
+  const uint32_t *pos_data = pos.data(), *doc_data = doc.data();
+  const bool *keep_data = keep.data();
+  int64_t num_kept = 0;
+  {
+    py::gil_scoped_release release;
+    for (int64_t i = 0; i < size; i++)
+      num_kept += keep_data[i];
+  }
+
+  py::array_t<SymbolT> text_out(num_kept + (add_eos ? 4 : 0));
+  Uint32Array pos_out(num_kept), doc_out(num_kept);
+  py::array_t<int64_t> doc_splits(num_docs + 1);
+  SymbolT *text_out_data = text_out.mutable_data();
+  uint32_t *pos_out_data = pos_out.mutable_data(),
+           *doc_out_data = doc_out.mutable_data();
+  int64_t *doc_splits_data = doc_splits.mutable_data();
+  int64_t ans;
+  {
+    py::gil_scoped_release release;
+    ans = RemoveFromText(text_data, pos_data, doc_data, size, keep_data,
+                         Eos<SymbolT>(), add_eos, num_docs, text_out_data,
+                         pos_out_data, doc_out_data, doc_splits_data,
+                         num_threads);
+  }
+  if (ans == -1)
+    throw std::runtime_error("The document ids MUST be non-decreasing and "
+                             "less than num_docs");
+  return py::make_tuple(text_out, pos_out, doc_out, doc_splits);
+}
+
+template <typename SymbolT> static void PybindSourcedTextImpl(py::module &m) {
+  m.def("concatenate_texts", &ConcatenateTextsHelper<SymbolT>,
+        py::arg("texts").noconvert(), py::arg("pos"), py::arg("docs"),
+        py::arg("doc_ids"), py::arg("num_docs"), py::arg("add_eos") = false,
+        py::arg("num_threads") = 1);
+  m.def("remove_from_text", &RemoveFromTextHelper<SymbolT>,
+        py::arg("text").noconvert(), py::arg("pos").noconvert(),
+        py::arg("doc").noconvert(), py::arg("keep").noconvert(),
+        py::arg("num_docs"), py::arg("add_eos") = false,
+        py::arg("num_threads") = 1);
+}
+
+void PybindSourcedText(py::module &m) {
+  // The texts are never converted, so they must all have one of these
+  // dtypes; the terminator of add_eos is the second largest value of it.
+  PybindSourcedTextImpl<uint8_t>(m);
+  PybindSourcedTextImpl<uint16_t>(m);
+  PybindSourcedTextImpl<int32_t>(m);
+}
+
+} // namespace fasttextsearch
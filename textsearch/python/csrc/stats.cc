@@ -0,0 +1,50 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/stats.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/stats.h"
+
+namespace fasttextsearch {
+
+// Returns a dict from the name of each stage to a dict of its counters.
+static py::dict GetStatsHelper() {
+  py::dict ans;
+  for (int32_t s = 0; s < static_cast<int32_t>(Stage::kNumStages); s++) {
+    Stage stage = static_cast<Stage>(s);
+    StageStats stats = GetStats(stage);
+    py::dict d;
+    d["calls"] = stats.calls;
+    d["wall_ns"] = stats.wall_ns;
+    d["bytes_allocated"] = stats.bytes_allocated;
+    d["peak_scratch_bytes"] = stats.peak_scratch_bytes;
+    d["dp_cells"] = stats.dp_cells;
+    d["max_depth"] = stats.max_depth;
+    d["wall_ns_by_depth"] = stats.wall_ns_by_depth;
+    ans[StageName(stage)] = d;
+  }
+  return ans;
+}
+
+void PybindStats(py::module &m) {
+  m.def("get_stats", &GetStatsHelper);
+  m.def("reset_stats", &ResetStats);
+  m.def("stats_enabled", &StatsEnabled);
+}
+
+} // namespace fasttextsearch
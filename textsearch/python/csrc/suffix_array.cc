@@ -22,31 +22,94 @@
 #include "textsearch/csrc/suffix_array.h"
 #include <iostream>
 #include <limits>
+#include <string>
 
 namespace fasttextsearch {
 
-static py::array_t<int64_t>
-PybindSuffixArrayHelper(py::array_t<int64_t, py::array::c_style> &input) {
+static SuffixArrayAlgorithm ToSuffixArrayAlgorithm(const std::string &name) {
+  if (name == "dc3")
+    return SuffixArrayAlgorithm::kDc3;
+  else if (name == "sais")
+    return SuffixArrayAlgorithm::kSais;
+  throw std::runtime_error("Unknown suffix array algorithm: '" + name +
+                           "', expected 'dc3' or 'sais'");
+}
 
-  py::buffer_info input_buf = input.request();
+template <typename SymbolT, typename IndexT>
+static void
+PybindSuffixArrayHelper(py::array_t<SymbolT, py::array::c_style> &input,
+                        py::array_t<IndexT, py::array::c_style> &output,
+                        const std::string &algorithm, int32_t num_threads) {
+  SuffixArrayAlgorithm algo = ToSuffixArrayAlgorithm(algorithm);
 
-  if (input_buf.ndim != 1)
+  if (input.ndim() != 1)
     throw std::runtime_error("Input MUST be a one dimension array");
 
-  int64_t seq_len = input_buf.size - 3;
-  int64_t *input_data = static_cast<int64_t *>(input_buf.ptr);
+  if (input.size() < 4)
+    throw std::runtime_error("Input MUST have at least 4 elements");
+
+  if (input.size() - 3 > std::numeric_limits<IndexT>::max() - 3)
+    throw std::runtime_error("Input is too long for the index type");
+
+  IndexT seq_len = static_cast<IndexT>(input.size() - 3);
 
-  auto suffix_array = py::array_t<int64_t>(seq_len);
-  py::buffer_info sa_buf = suffix_array.request();
-  int64_t *sa_data = static_cast<int64_t *>(sa_buf.ptr);
+  if (output.ndim() != 1 || output.size() != seq_len)
+    throw std::runtime_error(
+        "Output MUST be a one dimension array of size input.size - 3");
 
-  int64_t max_symbol = input_data[seq_len - 1];
+  const SymbolT *input_data = input.data();
+  IndexT *sa_data = output.mutable_data();
+
+  SymbolT max_symbol = input_data[seq_len - 1];
+
+  py::gil_scoped_release release;
+  CreateSuffixArray(input_data, seq_len, max_symbol, sa_data, algo,
+                    num_threads);
+}
+
+template <typename SymbolT, typename IndexT>
+static void
+PybindLcpArrayHelper(py::array_t<SymbolT, py::array::c_style> &input,
+                     py::array_t<IndexT, py::array::c_style> &suffix_array,
+                     py::array_t<IndexT, py::array::c_style> &output,
+                     int32_t num_threads) {
+  if (input.ndim() != 1 || input.size() < 4)
+    throw std::runtime_error(
+        "Input MUST be a one dimension array with at least 4 elements");
+
+  IndexT seq_len = static_cast<IndexT>(input.size() - 3);
+  if (suffix_array.ndim() != 1 || suffix_array.size() != seq_len ||
+      output.ndim() != 1 || output.size() != seq_len)
+    throw std::runtime_error("suffix_array and output MUST be one dimension "
+                             "arrays of size input.size - 3");
+
+  const SymbolT *input_data = input.data();
+  const IndexT *sa_data = suffix_array.data();
+  IndexT *lcp_data = output.mutable_data();
+
+  py::gil_scoped_release release;
+  CreateLcpArray(input_data, seq_len, sa_data, lcp_data, num_threads);
+}
 
-  CreateSuffixArray<int64_t>(input_data, seq_len, max_symbol, sa_data);
-  return suffix_array;
+template <typename SymbolT, typename IndexT>
+static void PybindSuffixArrayImpl(py::module &m) {
+  m.def("create_suffix_array", &PybindSuffixArrayHelper<SymbolT, IndexT>,
+        py::arg("input").noconvert(), py::arg("output").noconvert(),
+        py::arg("algorithm") = "dc3", py::arg("num_threads") = 1);
+  m.def("create_lcp_array", &PybindLcpArrayHelper<SymbolT, IndexT>,
+        py::arg("input").noconvert(), py::arg("suffix_array").noconvert(),
+        py::arg("output").noconvert(), py::arg("num_threads") = 1);
 }
 
 void PybindSuffixArray(py::module &m) {
-  m.def("create_suffix_array", &PybindSuffixArrayHelper, py::arg("input"));
+  // The input and output arrays are never converted, so callers must pass
+  // exactly one of these dtype combinations.
+  PybindSuffixArrayImpl<uint8_t, int32_t>(m);
+  PybindSuffixArrayImpl<uint8_t, int64_t>(m);
+  PybindSuffixArrayImpl<uint16_t, int32_t>(m);
+  PybindSuffixArrayImpl<uint16_t, int64_t>(m);
+  PybindSuffixArrayImpl<int32_t, int32_t>(m);
+  PybindSuffixArrayImpl<int32_t, int64_t>(m);
+  PybindSuffixArrayImpl<int64_t, int64_t>(m);
 }
 } // namespace fasttextsearch
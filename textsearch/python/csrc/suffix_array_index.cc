@@ -0,0 +1,197 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/suffix_array_index.h"
+#include "pybind11/numpy.h"
+#include "pybind11/stl.h"
+#include "textsearch/csrc/external_suffix_array.h"
+#include "textsearch/csrc/suffix_array_index.h"
+#include <string>
+#include <vector>
+
+namespace fasttextsearch {
+
+static py::dtype ToNumpyDtype(IndexDtype dtype) {
+  switch (dtype) {
+  case IndexDtype::kUint8:
+    return py::dtype::of<uint8_t>();
+  case IndexDtype::kInt8:
+    return py::dtype::of<int8_t>();
+  case IndexDtype::kUint16:
+    return py::dtype::of<uint16_t>();
+  case IndexDtype::kInt16:
+    return py::dtype::of<int16_t>();
+  case IndexDtype::kInt32:
+    return py::dtype::of<int32_t>();
+  case IndexDtype::kInt64:
+    return py::dtype::of<int64_t>();
+  }
+  throw std::runtime_error("Unknown dtype");
+}
+
+static IndexDtype FromNumpyDtype(const py::dtype &dtype,
+                                 const std::string &name) {
+  char kind = dtype.kind();
+  py::ssize_t itemsize = dtype.itemsize();
+  if (kind == 'u' && itemsize == 1)
+    return IndexDtype::kUint8;
+  if (kind == 'i' && itemsize == 1)
+    return IndexDtype::kInt8;
+  if (kind == 'u' && itemsize == 2)
+    return IndexDtype::kUint16;
+  if (kind == 'i' && itemsize == 2)
+    return IndexDtype::kInt16;
+  if (kind == 'i' && itemsize == 4)
+    return IndexDtype::kInt32;
+  if (kind == 'i' && itemsize == 8)
+    return IndexDtype::kInt64;
+  throw std::runtime_error(name + " MUST be of dtype uint8, int8, uint16, "
+                                  "int16, int32 or int64");
+}
+
+static void CheckArray(const py::array &array, const std::string &name) {
+  if (array.ndim() != 1)
+    throw std::runtime_error(name + " MUST be a one dimension array");
+  if (!(array.flags() & py::array::c_style))
+    throw std::runtime_error(name + " MUST be contiguous");
+}
+
+// Returns a read-only array of `size` elements at `data`, which keeps `owner`
+// (the SuffixArrayIndex object, hence the mapping) alive.
+static py::object ToNumpy(const void *data, IndexDtype dtype, int64_t size,
+                          py::handle owner) {
+  if (data == nullptr)
+    return py::none();
+  py::array array(ToNumpyDtype(dtype), {static_cast<py::ssize_t>(size)}, {},
+                  data, owner);
+  array.attr("flags").attr("writeable") = false;
+  return std::move(array);
+}
+
+static void WriteSuffixArrayIndexHelper(const std::string &filename,
+                                        py::array text, py::array suffix_array,
+                                        py::object lcp,
+                                        py::object row_splits) {
+  SuffixArrayIndexArrays arrays;
+  CheckArray(text, "text");
+  arrays.text = text.data();
+  arrays.text_dtype = FromNumpyDtype(text.dtype(), "text");
+  arrays.text_length = text.size();
+  if (arrays.text_length < 4)
+    throw std::runtime_error("text MUST have at least 4 elements");
+  int64_t seq_len = arrays.text_length - 3;
+
+  CheckArray(suffix_array, "suffix_array");
+  arrays.suffix_array = suffix_array.data();
+  arrays.index_dtype = FromNumpyDtype(suffix_array.dtype(), "suffix_array");
+  if (arrays.index_dtype != IndexDtype::kInt32 &&
+      arrays.index_dtype != IndexDtype::kInt64)
+    throw std::runtime_error("suffix_array MUST be of dtype int32 or int64");
+  if (suffix_array.size() != seq_len)
+    throw std::runtime_error("suffix_array MUST have text.size - 3 elements");
+
+  py::array lcp_array, row_splits_array;
+  if (!lcp.is_none()) {
+    lcp_array = lcp.cast<py::array>();
+    CheckArray(lcp_array, "lcp");
+    if (lcp_array.dtype().kind() != suffix_array.dtype().kind() ||
+        lcp_array.dtype().itemsize() != suffix_array.dtype().itemsize() ||
+        lcp_array.size() != seq_len)
+      throw std::runtime_error(
+          "lcp MUST have the dtype and size of suffix_array");
+    arrays.lcp = lcp_array.data();
+  }
+  if (!row_splits.is_none()) {
+    row_splits_array = row_splits.cast<py::array>();
+    CheckArray(row_splits_array, "row_splits");
+    if (FromNumpyDtype(row_splits_array.dtype(), "row_splits") !=
+            IndexDtype::kInt64 ||
+        row_splits_array.size() < 1)
+      throw std::runtime_error(
+          "row_splits MUST be a nonempty array of dtype int64");
+    arrays.row_splits = static_cast<const int64_t *>(row_splits_array.data());
+    arrays.num_docs = row_splits_array.size() - 1;
+  }
+
+  py::gil_scoped_release release;
+  WriteSuffixArrayIndex(filename, arrays);
+}
+
+static void CreateSuffixArrayIndexExternalHelper(
+    const std::string &text_filename, py::object dtype,
+    const std::string &output_filename, int64_t memory_budget,
+    const std::string &temp_dir, int32_t num_threads) {
+  ExternalSuffixArrayOptions options;
+  options.memory_budget = memory_budget;
+  options.temp_dir = temp_dir;
+  options.num_threads = num_threads;
+  IndexDtype text_dtype =
+      FromNumpyDtype(py::dtype::from_args(dtype), "dtype");
+  py::gil_scoped_release release;
+  CreateSuffixArrayIndexExternal(text_filename, text_dtype, output_filename,
+                                 options);
+}
+
+void PybindSuffixArrayIndex(py::module &m) {
+  m.def("write_suffix_array_index", &WriteSuffixArrayIndexHelper,
+        py::arg("filename"), py::arg("text"), py::arg("suffix_array"),
+        py::arg("lcp") = py::none(), py::arg("row_splits") = py::none());
+
+  m.def("create_suffix_array_index_external",
+        &CreateSuffixArrayIndexExternalHelper, py::arg("text_filename"),
+        py::arg("dtype"), py::arg("output_filename"),
+        py::arg("memory_budget") = int64_t(1) << 30,
+        py::arg("temp_dir") = "", py::arg("num_threads") = 1);
+
+  m.def("merge_suffix_array_indexes", &MergeSuffixArrayIndexes,
+        py::arg("filenames"), py::arg("output_filename"),
+        py::call_guard<py::gil_scoped_release>());
+
+  using PyClass = SuffixArrayIndex;
+  py::class_<PyClass>(m, "SuffixArrayIndex")
+      .def(py::init<const std::string &, bool>(), py::arg("filename"),
+           py::arg("verify_checksums") = false,
+           py::call_guard<py::gil_scoped_release>())
+      .def("verify_checksums", &PyClass::VerifyChecksums,
+           py::call_guard<py::gil_scoped_release>())
+      .def_property_readonly("text",
+                             [](py::object self) {
+                               const PyClass &i = self.cast<const PyClass &>();
+                               return ToNumpy(i.Text(), i.TextDtype(),
+                                              i.TextLength(), self);
+                             })
+      .def_property_readonly("suffix_array",
+                             [](py::object self) {
+                               const PyClass &i = self.cast<const PyClass &>();
+                               return ToNumpy(i.SuffixArray(), i.IndexType(),
+                                              i.SeqLen(), self);
+                             })
+      .def_property_readonly("lcp",
+                             [](py::object self) {
+                               const PyClass &i = self.cast<const PyClass &>();
+                               return ToNumpy(i.Lcp(), i.IndexType(),
+                                              i.SeqLen(), self);
+                             })
+      .def_property_readonly("row_splits", [](py::object self) {
+        const PyClass &i = self.cast<const PyClass &>();
+        return ToNumpy(i.RowSplits(), IndexDtype::kInt64, i.NumDocs() + 1,
+                       self);
+      });
+}
+
+} // namespace fasttextsearch
@@ -4,16 +4,40 @@
 
 #include "textsearch/python/csrc/text_search.h"
 
+#include "textsearch/python/csrc/alignment_pipeline.h"
+#include "textsearch/python/csrc/close_matches.h"
+#include "textsearch/python/csrc/fm_index.h"
 #include "textsearch/python/csrc/levenshtein.h"
+#include "textsearch/python/csrc/levenshtein_stream.h"
+#include "textsearch/python/csrc/minimizer_index.h"
+#include "textsearch/python/csrc/reference_index.h"
+#include "textsearch/python/csrc/segmenter.h"
+#include "textsearch/python/csrc/smith_waterman.h"
+#include "textsearch/python/csrc/sourced_text.h"
+#include "textsearch/python/csrc/stats.h"
 #include "textsearch/python/csrc/suffix_array.h"
+#include "textsearch/python/csrc/suffix_array_index.h"
+#include "textsearch/python/csrc/utf8.h"
 
 namespace fasttextsearch {
 
 PYBIND11_MODULE(_fasttextsearch, m) {
   m.doc() = "Python wrapper for textsearch";
 
+  PybindAlignmentPipeline(m);
+  PybindCloseMatches(m);
+  PybindFmIndex(m);
   PybindLevenshtein(m);
+  PybindLevenshteinStream(m);
+  PybindMinimizerIndex(m);
+  PybindReferenceIndex(m);
+  PybindSegmenter(m);
+  PybindSmithWaterman(m);
+  PybindSourcedText(m);
+  PybindStats(m);
   PybindSuffixArray(m);
+  PybindSuffixArrayIndex(m);
+  PybindUtf8(m);
 }
 
 } // namespace fasttextsearch
@@ -0,0 +1,93 @@
+/**
+ * Copyright      2023     Xiaomi Corporation
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "textsearch/python/csrc/utf8.h"
+#include "pybind11/numpy.h"
+#include "textsearch/csrc/utf8.h"
+#include <string>
+
+namespace fasttextsearch {
+
+static void CheckData(const py::array_t<uint8_t> &data) {
+  if (data.ndim() != 1)
+    throw std::runtime_error("data MUST be a one dimension array");
+  if (!(data.flags() & py::array::c_style))
+    throw std::runtime_error("data MUST be contiguous");
+}
+
+// Returns -1 if `data` is valid UTF-8, else the offset of the first invalid
+// byte sequence.
+static int64_t ValidateUtf8Helper(py::array_t<uint8_t> data,
+                                  int32_t num_threads) {
+  CheckData(data);
+  py::gil_scoped_release release;
+  return ValidateUtf8(data.data(), data.size(), nullptr, num_threads);
+}
+
+// Returns (code_points, byte_offsets), byte_offsets being None if not
+// return_offsets.
+static py::tuple DecodeUtf8Helper(py::array_t<uint8_t> data,
+                                  bool return_offsets, int32_t num_threads) {
+  CheckData(data);
+  const uint8_t *p = data.data();
+  int64_t size = data.size();
+
+  int64_t num_code_points = 0, error;
+  {
+    py::gil_scoped_release release;
+    error = ValidateUtf8(p, size, &num_code_points, num_threads);
+  }
+  if (error != -1)
+    throw std::runtime_error("Invalid UTF-8 at byte offset " +
+                             std::to_string(error));
+
+  py::array_t<int32_t> code_points(num_code_points);
+  int32_t *code_points_data = code_points.mutable_data();
+  py::object offsets = py::none();
+  // Byte offsets of 4 GB or more need 64 bits.
+  if (!return_offsets) {
+    py::gil_scoped_release release;
+    DecodeUtf8<uint32_t>(p, size, code_points_data, nullptr, num_threads);
+  } else if (size <= (int64_t(1) << 32)) {
+    py::array_t<uint32_t> array(num_code_points);
+    uint32_t *offsets_data = array.mutable_data();
+    {
+      py::gil_scoped_release release;
+      DecodeUtf8(p, size, code_points_data, offsets_data, num_threads);
+    }
+    offsets = array;
+  } else {
+    py::array_t<uint64_t> array(num_code_points);
+    uint64_t *offsets_data = array.mutable_data();
+    {
+      py::gil_scoped_release release;
+      DecodeUtf8(p, size, code_points_data, offsets_data, num_threads);
+    }
+    offsets = array;
+  }
+  return py::make_tuple(code_points, offsets);
+}
+
+void PybindUtf8(py::module &m) {
+  m.def("validate_utf8", &ValidateUtf8Helper, py::arg("data"),
+        py::arg("num_threads") = 1);
+  m.def("decode_utf8", &DecodeUtf8Helper, py::arg("data"),
+        py::arg("return_offsets") = true, py::arg("num_threads") = 1);
+}
+
+} // namespace fasttextsearch
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+# Copyright      2023  Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# To run this single test, use
+#
+#  ctest --verbose -R alignment_pipeline_test_py
+
+import unittest
+import numpy as np
+
+from textsearch import (
+    AlignmentPipeline,
+    AlignmentPipelineOptions,
+    ReferenceIndex,
+    align_queries,
+)
+
+
+class TestAlignmentPipeline(unittest.TestCase):
+    def test_align_queries(self):
+        rng = np.random.default_rng(0)
+        doc_len, query_len = 2000, 100
+        text = rng.integers(1, 20, size=2 * doc_len + 4).astype(np.int32)
+        text[2 * doc_len] = 20
+        text[-3:] = 0
+        row_splits = np.array([0, doc_len, 2 * doc_len], dtype=np.int64)
+        options = AlignmentPipelineOptions()
+        options.num_candidates = 2
+        options.num_close_matches = 2
+        options.num_align_threads = 2
+        options.queue_capacity = 2
+        options.segmenter_options.min_duration = 0.5
+        for dtype in [np.uint8, np.int32]:
+            index = ReferenceIndex(text.astype(dtype), row_splits=row_splits)
+            begins = rng.integers(0, doc_len - query_len, size=10)
+            begins[1::2] += doc_len
+
+            def queries():
+                for i, begin in enumerate(begins):
+                    query = text[begin : begin + query_len].copy()
+                    query[rng.integers(0, query_len, size=2)] = 1
+                    times = np.arange(query_len) * 0.05 if i % 2 == 0 else None
+                    yield i, query, times
+
+            seen = set()
+            for result in align_queries(index, queries(), options):
+                i = result["query_id"]
+                seen.add(i)
+                self.assertGreaterEqual(result["num_candidates"], 1)
+                if result["candidate"] != 0:
+                    continue
+                self.assertLessEqual(result["distance"], 2)
+                self.assertLessEqual(result["ref_begin"], begins[i])
+                self.assertGreaterEqual(result["ref_end"], begins[i] + query_len)
+                num_ops = result["ops"].size
+                self.assertEqual(result["query_positions"].shape, (num_ops,))
+                self.assertEqual(result["ref_positions"].shape, (num_ops,))
+                positions, times, scores = result["segments"]
+                self.assertEqual(positions.shape[0] > 0, i % 2 == 0)
+            self.assertEqual(seen, set(range(10)))
+
+    def test_no_candidates(self):
+        text = np.array([1, 2, 3, 1, 2, 4, 5, 0, 0, 0], dtype=np.int32)
+        pipeline = AlignmentPipeline(ReferenceIndex(text))
+        self.assertTrue(pipeline.push(7, np.array([0, 0, 0], dtype=np.int32)))
+        pipeline.close()
+        self.assertFalse(pipeline.push(8, np.array([1, 2], dtype=np.int32)))
+        results = list(pipeline.results())
+        self.assertEqual(len(results), 1)
+        self.assertEqual(results[0]["query_id"], 7)
+        self.assertEqual(results[0]["candidate"], -1)
+        self.assertEqual(results[0]["distance"], -1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -23,7 +23,14 @@
 import unittest
 import numpy as np
 
-from textsearch import get_nice_alignments, levenshtein_distance
+from textsearch import (
+    get_nice_alignments,
+    levenshtein_batch_best_alignment,
+    levenshtein_distance,
+    levenshtein_distance_batch,
+    StreamingAligner,
+    StreamingAlignerOptions,
+)
 
 
 class TestLevenshtein(unittest.TestCase):
@@ -36,6 +43,138 @@ class TestLevenshtein(unittest.TestCase):
         self.assertTrue(alignments[0] == (3, "01010101"))
         self.assertTrue(alignments[1] == (8, "0101101"))
 
+    def test_levenshtein_distance_engines(self):
+        for query_len in [1, 10, 64, 65, 200]:
+            query = np.random.randint(0, 4, size=query_len).astype(np.int32)
+            target = np.random.randint(0, 4, size=3 * query_len).astype(np.int32)
+            expected = levenshtein_distance(query, target, engine="scalar")
+            for engine in ["auto", "bit_parallel", "simd"]:
+                self.assertEqual(levenshtein_distance(query, target, engine=engine), expected)
+            costs = dict(insert_cost=1, delete_cost=2, replace_cost=3)
+            expected = levenshtein_distance(query, target, engine="scalar", **costs)
+            for engine in ["auto", "simd"]:
+                self.assertEqual(levenshtein_distance(query, target, engine=engine, **costs), expected)
+        with self.assertRaises(RuntimeError):
+            levenshtein_distance(query, target, replace_cost=2, engine="bit_parallel")
+
+    def test_levenshtein_distance_max_distance(self):
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        target = np.array([1, 5, 3, 4, 6, 7, 1, 2, 4], dtype=np.int32)
+        expected = levenshtein_distance(query, target)
+        for engine in ["scalar", "bit_parallel"]:
+            self.assertEqual(levenshtein_distance(query, target, engine=engine, max_distance=0), (-1, []))
+            self.assertEqual(levenshtein_distance(query, target, engine=engine, max_distance=1), expected)
+
+    def test_levenshtein_distance_band_width(self):
+        query = np.array([1, 2, 3, 4, 5, 6], dtype=np.int32)
+        target = np.array([1, 2, 7, 4, 5, 6], dtype=np.int32)
+        expected = levenshtein_distance(query, target)
+        self.assertEqual(expected[0], 1)
+        self.assertEqual(levenshtein_distance(query, target, band_width=1), expected)
+
+    def test_levenshtein_distance_linear_memory(self):
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        target = np.array([1, 5, 3, 4, 6, 7, 1, 2, 4], dtype=np.int32)
+        # Only the alignment of the first best end position.
+        for num_threads in [1, 2]:
+            self.assertEqual(
+                levenshtein_distance(query, target, linear_memory=True, num_threads=num_threads),
+                (1, [(3, "01010101")]),
+            )
+        self.assertEqual(levenshtein_distance(query, target, linear_memory=True, max_distance=0), (-1, []))
+
+    def test_levenshtein_distance_dtypes(self):
+        query = np.random.randint(0, 10, size=30)
+        target = np.random.randint(0, 10, size=200)
+        spans = np.array([[0, 100], [50, 200]], dtype=np.int64)
+        for costs in [dict(), dict(insert_cost=1, delete_cost=2, replace_cost=2)]:
+            expected = levenshtein_distance(query.astype(np.int32), target.astype(np.int32), **costs)
+            expected_batch = levenshtein_distance_batch(
+                query.astype(np.int32), target.astype(np.int32), spans, **costs
+            )
+            for dtype, offset in [(np.uint8, 200), (np.uint16, 60000), (np.int64, 1 << 40)]:
+                q = query.astype(dtype) + dtype(offset)
+                t = target.astype(dtype) + dtype(offset)
+                for engine in ["auto", "scalar", "simd"]:
+                    self.assertEqual(levenshtein_distance(q, t, engine=engine, **costs), expected)
+                distances, ends = levenshtein_distance_batch(q, t, spans, **costs)
+                np.testing.assert_array_equal(distances, expected_batch[0])
+                np.testing.assert_array_equal(ends, expected_batch[1])
+        # Lists are converted to np.int32.
+        self.assertEqual(levenshtein_distance([1, 2, 3], [1, 2, 3, 4]), (0, [(2, "010101")]))
+
+    def test_levenshtein_distance_batch(self):
+        query = np.random.randint(0, 4, size=20).astype(np.int32)
+        reference = np.random.randint(0, 4, size=500).astype(np.int32)
+        begins = np.random.randint(0, 400, size=(3, 5))
+        spans = np.stack([begins, begins + np.random.randint(1, 100, size=(3, 5))], axis=-1)
+        spans[0, 0] = -1
+        for costs in [dict(), dict(insert_cost=1, delete_cost=2, replace_cost=3)]:
+            for num_threads in [1, 4]:
+                distances, ends = levenshtein_distance_batch(
+                    query, reference, spans, num_threads=num_threads, **costs
+                )
+                self.assertEqual(distances.shape, (3, 5))
+                self.assertEqual(ends.shape, (3, 5))
+                self.assertEqual((distances[0, 0], ends[0, 0]), (-1, -1))
+                for i in range(3):
+                    for j in range(5):
+                        if spans[i, j, 0] < 0:
+                            continue
+                        begin, end = spans[i, j]
+                        distance, alignments = levenshtein_distance(query, reference[begin:end], **costs)
+                        self.assertEqual(distances[i, j], distance)
+                        self.assertEqual(ends[i, j], begin + alignments[0][0])
+        with self.assertRaises(RuntimeError):
+            levenshtein_distance_batch(query, reference, np.array([[0, 501]], dtype=np.int64))
+
+    def test_levenshtein_batch_best_alignment(self):
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        reference = np.array([1, 5, 3, 4, 6, 7, 1, 2, 3, 4, 9], dtype=np.int32)
+        spans = np.array([[0, 5], [5, 11], [-1, -1]], dtype=np.int64)
+        distances, ends = levenshtein_distance_batch(query, reference, spans)
+        self.assertEqual(distances.tolist(), [1, 0, -1])
+        best = levenshtein_batch_best_alignment(query, reference, spans, distances, ends)
+        self.assertEqual(best, (1, 0, (9, "01010101")))
+        distances, ends = levenshtein_distance_batch(query, reference, spans, replace_cost=2)
+        best = levenshtein_batch_best_alignment(query, reference, spans, distances, ends, replace_cost=2)
+        self.assertEqual(best, (1, 0, (9, "01010101")))
+        distances[:] = -1
+        self.assertIsNone(levenshtein_batch_best_alignment(query, reference, spans, distances, ends))
+
+    def test_streaming_aligner(self):
+        target = np.random.randint(0, 20, size=5000).astype(np.int32)
+        query = target[1000:4000].copy()
+        query[1::97] = 20  # replacements
+        options = StreamingAlignerOptions()
+        options.chunk_length = 200
+        options.overlap = 40
+        aligner = StreamingAligner(target, options)
+        ops, query_positions, target_positions = [], [], []
+        for begin in range(0, query.size, 250):
+            aligner.push(query[begin : begin + 250])
+            o, q, t = aligner.pull()
+            ops.append(o)
+            query_positions.append(q)
+            target_positions.append(t)
+        self.assertGreater(sum(o.size for o in ops), 0)
+        aligner.finish()
+        o, q, t = aligner.pull()
+        ops = np.concatenate(ops + [o])
+        query_positions = np.concatenate(query_positions + [q])
+        target_positions = np.concatenate(target_positions + [t])
+
+        self.assertEqual(aligner.num_query_symbols, query.size)
+        self.assertEqual(aligner.cost, query[1::97].size)
+        self.assertEqual(aligner.cost, levenshtein_distance(query, target)[0])
+        np.testing.assert_array_equal(query_positions, np.arange(query.size))
+        np.testing.assert_array_equal(target_positions, np.arange(1000, 4000))
+        self.assertEqual(int((ops == 1).sum()), aligner.cost)
+
+        options.overlap = 200
+        with self.assertRaises(RuntimeError):
+            StreamingAligner(target, options)
+
     def test_get_nice_alignments(self):
         query = np.array([10, 234, 98745, 14, 8], dtype=np.int32)
         target = np.array([7, 10, 134, 9, 98745, 8], dtype=np.int32)
@@ -47,6 +186,33 @@ class TestLevenshtein(unittest.TestCase):
         self.assertTrue(len(align_str) == 1)
         self.assertTrue(align_str[0] == expected_align)
 
+        distance, alignments = levenshtein_distance(query, target, alignment_format="numpy")
+        self.assertEqual(get_nice_alignments(alignments, query, target), [expected_align])
+
+    def test_levenshtein_distance_numpy_format(self):
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        target = np.array([1, 5, 3, 4, 6, 7, 1, 2, 4], dtype=np.int32)
+        distance, alignments = levenshtein_distance(query, target, alignment_format="numpy")
+        self.assertEqual(distance, 1)
+        self.assertEqual(len(alignments), 2)
+        end_position, ops, query_positions, target_positions = alignments[1]
+        self.assertEqual(end_position, 8)
+        self.assertEqual(ops.dtype, np.int8)
+        self.assertEqual(query_positions.dtype, np.int32)
+        np.testing.assert_equal(ops, [0, 0, 2, 0])
+        np.testing.assert_equal(query_positions, [0, 1, 2, 3])
+        np.testing.assert_equal(target_positions, [6, 7, -1, 8])
+
+        for _ in range(10):
+            query = np.random.randint(0, 20, size=30).astype(np.int32)
+            target = np.random.randint(0, 20, size=100).astype(np.int32)
+            _, string_alignments = levenshtein_distance(query, target)
+            _, numpy_alignments = levenshtein_distance(query, target, alignment_format="numpy")
+            self.assertEqual(
+                get_nice_alignments(numpy_alignments, query, target),
+                get_nice_alignments(string_alignments, query, target),
+            )
+
 
 if __name__ == "__main__":
     unittest.main()
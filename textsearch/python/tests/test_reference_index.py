@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+#
+# Copyright      2023  Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# To run this single test, use
+#
+#  ctest --verbose -R reference_index_test_py
+
+import os
+import tempfile
+import unittest
+import numpy as np
+
+from textsearch import (
+    MinimizerIndex,
+    ReferenceIndex,
+    ShardedReferenceIndex,
+    merge_suffix_array_indexes,
+)
+
+
+def _to_array(s: str, dtype=np.uint8) -> np.ndarray:
+    return np.array([ord(x) for x in s], dtype=dtype)
+
+
+def _reference_text(documents, dtype=np.uint8) -> np.ndarray:
+    text = _to_array("".join(documents), dtype)
+    eos = np.iinfo(dtype).max - 1
+    return np.concatenate([text, np.array([eos, 0, 0, 0], dtype=dtype)])
+
+
+class TestReferenceIndex(unittest.TestCase):
+    def test_find_close_matches(self):
+        # See also test_find_close_matches() in test_suffix_array.py, which
+        # has the same texts with the query and reference combined.
+        documents = ["iholloyou", "youhellome"]
+        row_splits = np.array([0, 9, 19], dtype=np.int64)
+        index = ReferenceIndex(_reference_text(documents), row_splits=row_splits)
+        self.assertEqual(index.seq_len, 20)
+        self.assertEqual(index.num_docs, 2)
+
+        query = _to_array("hellohallo")
+        close_matches, lengths = index.find_close_matches(query)
+        expected = np.array(
+            [18, 12, 18, 13, 0, 14, 3, 15, 17, 2, 18, 12, 18, 13, 0, 14, 3, 15, 17, 2]
+        )
+        np.testing.assert_equal(close_matches, expected)
+        # "hello" matches all of "hellome" at 12.
+        self.assertEqual(lengths[1], 5)
+
+        close_matches, lengths = index.find_close_matches(
+            query, num_close_matches=2, min_match_length=3
+        )
+        self.assertEqual(close_matches.shape, (40,))
+        text = "".join(documents)
+        for i in range(query.size):
+            for pos, length in zip(close_matches[4 * i : 4 * i + 4], lengths[4 * i : 4 * i + 4]):
+                if length > 0:
+                    self.assertGreaterEqual(length, 3)
+                    self.assertEqual(text[pos : pos + length], "hellohallo"[i : i + length])
+
+        candidates = index.find_candidate_matches(
+            close_matches,
+            np.array([0, 5, 10]),
+            match_lengths=lengths,
+            num_close_matches=2,
+            num_candidates=2,
+        )
+        # "hello" is best matched by "hello" in "youhellome".
+        self.assertEqual(candidates.shape, (2, 2, 2))
+        self.assertEqual(tuple(candidates[0, 0]), (12, 15))
+
+    def test_random(self):
+        seq_len = 5000
+        text = np.random.randint(1, 4, size=seq_len + 3).astype(np.int16)
+        text[seq_len - 1] = np.iinfo(np.int16).max - 1
+        text[seq_len:] = 0
+        index = ReferenceIndex(text)
+        query = text[1000:1200].copy()
+        close_matches, lengths = index.find_close_matches(query, num_threads=2)
+        # Each query suffix is a prefix of the reference suffix it was copied
+        # from, so the reference suffix that follows it matches fully.
+        np.testing.assert_equal(lengths[1::2], 200 - np.arange(200))
+        self.assertTrue((lengths[0::2] < 200 - np.arange(200)).all())
+        candidates = index.find_candidate_matches(close_matches, np.array([0, 200]))
+        self.assertLess(candidates[0, 0, 0], 1200)
+        self.assertGreater(candidates[0, 0, 1], 1000)
+
+    def test_save_load(self):
+        text = _reference_text(["iholloyou", "youhellome"])
+        index = ReferenceIndex(text)
+        query = _to_array("hellohallo")
+        expected = index.find_close_matches(query, num_close_matches=2)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            filename = os.path.join(tmp_dir, "reference.idx")
+            index.save(filename)
+            loaded = ReferenceIndex.load(filename, verify_checksums=True)
+            np.testing.assert_equal(loaded.text, text)
+            np.testing.assert_equal(loaded.row_splits, index.row_splits)
+            self.assertEqual(loaded.suffix_array.dtype, np.int32)
+            close_matches, lengths = loaded.find_close_matches(
+                query, num_close_matches=2
+            )
+            np.testing.assert_equal(close_matches, expected[0])
+            np.testing.assert_equal(lengths, expected[1])
+            del loaded
+
+    def test_compress(self):
+        seq_len = 3000
+        text = np.random.randint(1, 5, size=seq_len + 3).astype(np.uint8)
+        text[seq_len - 1] = np.iinfo(np.uint8).max - 1
+        text[seq_len:] = 0
+        query = np.concatenate(
+            [text[500:700], np.random.randint(1, 6, size=300).astype(np.uint8)]
+        )
+        index = ReferenceIndex(text)
+        expected = [
+            index.find_close_matches(query, num_close_matches=k, min_match_length=m)
+            for k, m in ((1, 0), (3, 4))
+        ]
+        for sample_rate in (1, 8, 64):
+            compressed = ReferenceIndex(text, sample_rate=sample_rate)
+            self.assertIsNone(compressed.suffix_array)
+            if sample_rate > 1:
+                self.assertLess(
+                    compressed.fm_index.num_bytes, index.suffix_array.nbytes
+                )
+            for (k, m), (close_matches, lengths) in zip(((1, 0), (3, 4)), expected):
+                output = compressed.find_close_matches(
+                    query, num_close_matches=k, min_match_length=m, num_threads=2
+                )
+                np.testing.assert_equal(output[0], close_matches)
+                np.testing.assert_equal(output[1], lengths)
+
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            filename = os.path.join(tmp_dir, "reference.idx")
+            index.save(filename)
+            loaded = ReferenceIndex.load(filename, sample_rate=16)
+            close_matches, lengths = loaded.find_close_matches(query)
+            np.testing.assert_equal(close_matches, expected[0][0])
+            np.testing.assert_equal(lengths, expected[0][1])
+            del loaded
+
+    def test_minimizer_index(self):
+        seq_len = 20000
+        text = np.random.randint(1, 5, size=seq_len + 3).astype(np.uint8)
+        text[seq_len - 1] = np.iinfo(np.uint8).max - 1
+        text[seq_len:] = 0
+        k, w = 12, 6
+        index = MinimizerIndex(text, k=k, w=w, num_threads=2)
+        self.assertEqual(index.seq_len, seq_len)
+        self.assertEqual(index.index_dtype, np.int32)
+
+        query = text[5000:5400].copy()
+        close_matches, lengths = index.find_close_matches(query, num_close_matches=2)
+        self.assertEqual(close_matches.shape, (4 * query.size,))
+        hits = np.nonzero(lengths)[0]
+        self.assertGreater(hits.size, 0)
+        self.assertTrue((lengths[hits] == k).all())
+        for i in hits:
+            pos = close_matches[i]
+            np.testing.assert_equal(text[pos : pos + k], query[i // 4 : i // 4 + k])
+        # The query is in the reference, so its minimizers hit their own
+        # positions (unless they are repeats).
+        self.assertIn(5000 + hits[0] // 4, close_matches[hits])
+
+        candidates = index.find_candidate_matches(
+            close_matches,
+            np.array([0, query.size]),
+            match_lengths=lengths,
+            num_close_matches=2,
+        )
+        self.assertLessEqual(5000, candidates[0, 0, 0])
+        self.assertLessEqual(candidates[0, 0, 1], 5400)
+
+        # A minimizer index can be a shard.
+        sharded = ShardedReferenceIndex([index, MinimizerIndex(text, k=k, w=w)])
+        close_matches, lengths = sharded.find_close_matches(
+            query, num_close_matches=2
+        )
+        self.assertEqual(sharded.seq_len, 2 * seq_len)
+        self.assertIn(5000 + hits[0] // 4, close_matches)
+
+    def test_sharded(self):
+        eos = np.iinfo(np.uint8).max - 1
+        shards = []
+        for seq_len in (300, 1, 500):
+            text = np.random.randint(1, 4, size=seq_len + 3).astype(np.uint8)
+            text[seq_len - 1] = eos
+            text[seq_len:] = 0
+            shards.append(ReferenceIndex(text))
+        sharded = ShardedReferenceIndex(shards[:2])
+        sharded.add(shards[2])
+        self.assertEqual(sharded.seq_len, 801)
+        np.testing.assert_equal(sharded.row_splits, [0, 300, 301, 800])
+
+        text = np.concatenate([s.text[: s.seq_len] for s in shards])
+        query = np.random.randint(1, 4, size=100).astype(np.uint8)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            filenames = [os.path.join(tmp_dir, f"shard{i}.idx") for i in range(3)]
+            for shard, filename in zip(shards, filenames):
+                shard.save(filename)
+            output = os.path.join(tmp_dir, "merged.idx")
+            merge_suffix_array_indexes(filenames, output)
+            merged = ReferenceIndex.load(output, verify_checksums=True)
+            np.testing.assert_equal(merged.text[: merged.seq_len], text)
+            np.testing.assert_equal(merged.row_splits, sharded.row_splits)
+
+            for k in (1, 3):
+                expected = merged.find_close_matches(
+                    query, num_close_matches=k, min_match_length=1
+                )
+                close_matches, lengths = sharded.find_close_matches(
+                    query, num_close_matches=k, min_match_length=1, num_threads=2
+                )
+                # The matches can only differ in the order of equal lengths.
+                np.testing.assert_equal(lengths, expected[1])
+                for pos, length in zip(close_matches, lengths):
+                    if length == 0:
+                        self.assertEqual(pos, 799)
+                    else:
+                        self.assertNotIn(eos, text[pos : pos + length])
+                candidates = sharded.find_candidate_matches(
+                    close_matches,
+                    np.array([0, 50, 100]),
+                    match_lengths=lengths,
+                    num_close_matches=k,
+                )
+                self.assertEqual(candidates.shape, (2, 5, 2))
+            del merged
+
+
+if __name__ == "__main__":
+    unittest.main()
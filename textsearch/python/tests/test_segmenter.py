@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+import unittest
+
+import numpy as np
+
+from textsearch import SegmenterOptions, find_segments, levenshtein_distance
+
+
+def _make_recording(num_sentences: int, seed: int):
+    """Returns (text, times) for sentences read at 0.06 seconds per symbol,
+    with a pause after each sentence."""
+    rng = np.random.default_rng(seed)
+    text, times = [], []
+    time = 0.0
+    for s in range(num_sentences):
+        if s > 0:
+            time += 1.0
+        words = [
+            "".join(chr(c) for c in rng.integers(ord("a"), ord("z") + 1, size=5))
+            for _ in range(rng.integers(8, 16))
+        ]
+        sentence = (" " if s > 0 else "") + " ".join(words).capitalize() + "."
+        for c in sentence:
+            text.append(ord(c))
+            times.append(time)
+            time += 0.06
+    return np.array(text, dtype=np.int32), np.array(times, dtype=np.float32)
+
+
+class TestSegmenter(unittest.TestCase):
+    def test_find_segments(self):
+        recordings = [_make_recording(n, seed) for seed, n in enumerate([30, 5, 60])]
+        alignments, times, references = [], [], []
+        for text, t in recordings:
+            query = text.copy()
+            query[::97] = ord("#")  # some recognition errors
+            _, aligns = levenshtein_distance(query, text, alignment_format="numpy")
+            alignments.append(aligns[0])
+            times.append(t)
+            references.append(text)
+
+        options = SegmenterOptions()
+        self.assertEqual(options.max_duration, 30.0)
+        results = find_segments(alignments, times, references, options)
+        self.assertEqual(len(results), len(recordings))
+        for (text, _), (positions, segment_times, scores) in zip(recordings, results):
+            self.assertTrue(positions.dtype == np.int32)
+            self.assertEqual(positions.shape[1], 6)
+            self.assertEqual(segment_times.shape, (positions.shape[0], 2))
+            self.assertEqual(scores.shape, (positions.shape[0],))
+            self.assertGreater(positions.shape[0], 0)
+            # In order and not overlapping.
+            self.assertTrue((positions[1:, 0] >= positions[:-1, 1]).all())
+            durations = segment_times[:, 1] - segment_times[:, 0]
+            self.assertTrue((durations >= options.min_duration).all())
+            self.assertTrue((durations <= options.max_duration).all())
+            for ref_begin, ref_end in positions[:, 4:]:
+                segment = "".join(chr(c) for c in text[ref_begin:ref_end]).strip()
+                self.assertTrue(segment.endswith("."), segment)
+
+        for num_threads in [2, 0]:
+            other = find_segments(
+                alignments, times, references, options, num_threads=num_threads
+            )
+            for a, b in zip(results, other):
+                for x, y in zip(a, b):
+                    np.testing.assert_equal(x, y)
+
+
+if __name__ == "__main__":
+    unittest.main()
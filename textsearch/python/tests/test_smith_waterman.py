@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Copyright      2023  Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# To run this single test, use
+#
+#  ctest --verbose -R test_smith_waterman_py
+
+import unittest
+import numpy as np
+
+from textsearch import (
+    get_nice_alignments,
+    smith_waterman_align,
+    smith_waterman_batch,
+    smith_waterman_batch_best_alignment,
+)
+
+
+class TestSmithWaterman(unittest.TestCase):
+    def test_smith_waterman_align(self):
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        target = np.array([5, 1, 2, 6, 3, 4, 7], dtype=np.int32)
+        score, query_begin, query_end, target_begin, target_end, alignment = smith_waterman_align(
+            query, target
+        )
+        self.assertEqual(score, 4)
+        self.assertEqual((query_begin, query_end), (0, 4))
+        self.assertEqual((target_begin, target_end), (1, 6))
+        self.assertEqual(alignment, (5, "010100101"))
+        self.assertEqual(len(get_nice_alignments([alignment], query, target)), 1)
+
+        result = smith_waterman_align(query, target, gap_open=-10, mode="local")
+        self.assertEqual(result[:5], (4, 0, 2, 1, 3))
+
+        # The same result for the other dtypes.
+        for dtype in (np.uint8, np.uint16, np.int64):
+            self.assertEqual(
+                smith_waterman_align(query.astype(dtype), target.astype(dtype)),
+                (4, 0, 4, 1, 6, (5, "010100101")),
+            )
+
+        with self.assertRaises(RuntimeError):
+            smith_waterman_align(query, target, mode="global")
+        with self.assertRaises(RuntimeError):
+            smith_waterman_align(query, target, gap_extend=0)
+
+    def test_long_deletion(self):
+        rng = np.random.default_rng(1357)
+        target = rng.integers(0, 50, size=1000).astype(np.int32)
+        # A query that skips target[300:500].
+        query = np.concatenate([target[100:300], target[500:700]])
+        score, _, _, target_begin, target_end, _ = smith_waterman_align(query, target)
+        self.assertEqual(score, 400 * 2 - 3 - 200)
+        self.assertEqual((target_begin, target_end), (100, 700))
+
+    def test_smith_waterman_batch(self):
+        rng = np.random.default_rng(2468)
+        reference = rng.integers(0, 30, size=2000).astype(np.int32)
+        query = reference[1200:1300].copy()
+        query[70] = 31
+        spans = np.array([[0, 200], [-1, -1], [1150, 1350], [1500, 1700]], dtype=np.int64)
+        scores, end_positions = smith_waterman_batch(query, reference, spans, num_threads=2)
+        self.assertEqual(scores.dtype, np.int32)
+        self.assertEqual(scores[1], np.iinfo(np.int32).min)
+        self.assertEqual(end_positions[1], -1)
+        self.assertEqual(scores[2], 99 * 2 - 2)
+        self.assertEqual(end_positions[2], 1299)
+        for i in (0, 2, 3):
+            begin, end = spans[i]
+            self.assertEqual(smith_waterman_align(query, reference[begin:end])[0], scores[i])
+
+        index, alignment = smith_waterman_batch_best_alignment(query, reference, spans, scores)
+        self.assertEqual(index, 2)
+        self.assertEqual(alignment[:5], (scores[2], 0, 100, 1200, 1300))
+        self.assertEqual(alignment[5][0], 1299)
+
+        spans = np.array([[-1, -1]], dtype=np.int64)
+        scores, _ = smith_waterman_batch(query, reference, spans)
+        self.assertIsNone(smith_waterman_batch_best_alignment(query, reference, spans, scores))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+import unittest
+
+import numpy as np
+
+from textsearch import TextSource, create_suffix_array
+from textsearch.datatypes import (
+    append_texts,
+    remove,
+    sources_to_sourced_text,
+    texts_to_sourced_texts,
+)
+
+
+class TestSourcedText(unittest.TestCase):
+    def test_append_texts(self):
+        strings = ["hello", "", "world!", "zażółć"]
+        for use_utf8 in [True, False]:
+            sources = [
+                TextSource.from_str(name=str(i), s=s, use_utf8=use_utf8)
+                for i, s in enumerate(strings)
+            ]
+            expected_text = np.concatenate([s.binary_text for s in sources])
+            sizes = [s.binary_text.size for s in sources]
+            expected_doc = np.repeat(np.arange(len(sources)), sizes)
+            expected_pos = np.concatenate([np.arange(n) for n in sizes])
+            expected_splits = np.cumsum([0] + sizes)
+
+            for num_threads in [1, 2]:
+                texts = [
+                    append_texts(
+                        texts_to_sourced_texts(sources), num_threads=num_threads
+                    ),
+                    sources_to_sourced_text(sources, num_threads=num_threads),
+                ]
+                for text in texts:
+                    np.testing.assert_equal(text.binary_text, expected_text)
+                    self.assertTrue(text.pos.dtype == np.uint32)
+                    np.testing.assert_equal(text.pos, expected_pos)
+                    self.assertTrue(text.doc.dtype == np.uint32)
+                    np.testing.assert_equal(text.doc, expected_doc)
+                    np.testing.assert_equal(text.doc_splits, expected_splits)
+                    self.assertIsNone(text.suffix_array_input)
+                    self.assertEqual(len(text.sources), len(sources))
+
+            # Appending a SourcedText with a doc array.
+            query = texts_to_sourced_texts(sources)[:2]
+            ref = sources_to_sourced_text(sources)
+            ref.doc = ref.doc + 2
+            text = append_texts(query + [ref])
+            np.testing.assert_equal(
+                text.binary_text, np.concatenate([sources[0].binary_text, expected_text])
+            )
+            np.testing.assert_equal(
+                text.doc_splits, np.concatenate([[0, 5], 5 + expected_splits])
+            )
+
+            # Documents must not go backwards.
+            with self.assertRaises(RuntimeError):
+                append_texts(texts_to_sourced_texts(sources)[::-1])
+
+    def test_add_eos(self):
+        sources = [
+            TextSource.from_str(name="q", s="hello", use_utf8=True),
+            TextSource.from_str(name="r", s="iholloyou", use_utf8=True),
+        ]
+        text = sources_to_sourced_text(sources, add_eos=True)
+        array = text.suffix_array_input
+        self.assertEqual(array.size, 14 + 4)
+        self.assertEqual(array[14], np.iinfo(np.uint8).max - 1)
+        np.testing.assert_equal(array[15:], 0)
+        self.assertTrue(np.shares_memory(array, text.binary_text))
+        suffix_array = create_suffix_array(array)
+        self.assertEqual(sorted(suffix_array), list(range(15)))
+
+    def test_remove(self):
+        sources = [
+            TextSource.from_str(name=str(i), s=s, use_utf8=False)
+            for i, s in enumerate(["a b c", "de", "f  g"])
+        ]
+        text = sources_to_sourced_text(sources)
+        for num_threads in [1, 2]:
+            keep = text.binary_text != ord(" ")
+            removed = remove(text, keep, add_eos=True, num_threads=num_threads)
+            self.assertEqual("".join(chr(c) for c in removed.binary_text), "abcdefg")
+            np.testing.assert_equal(removed.pos, [0, 2, 4, 0, 1, 0, 3])
+            np.testing.assert_equal(removed.doc, [0, 0, 0, 1, 1, 2, 2])
+            np.testing.assert_equal(removed.doc_splits, [0, 3, 5, 7])
+            self.assertEqual(
+                removed.suffix_array_input[7], np.iinfo(np.int32).max - 1
+            )
+
+            # Removing a whole document leaves it empty.
+            keep = text.doc != 1
+            removed = remove(text, keep, num_threads=num_threads)
+            np.testing.assert_equal(removed.doc_splits, [0, 5, 5, 9])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+# Copyright      2023  Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# To run this single test, use
+#
+#  ctest --verbose -R test_stats_py
+
+import unittest
+import numpy as np
+
+from textsearch import (
+    create_suffix_array,
+    get_stats,
+    levenshtein_distance,
+    reset_stats,
+    stats_enabled,
+)
+
+
+class TestStats(unittest.TestCase):
+    def test_get_stats(self):
+        if not stats_enabled():
+            self.skipTest("FTS_ENABLE_STATS is not defined")
+        reset_stats()
+        array = np.random.randint(1, 4, size=1003).astype(np.int16)
+        array[999] = np.iinfo(np.int16).max - 1
+        array[1000:] = 0
+        create_suffix_array(array, algorithm="sais")
+        query = np.array([1, 2, 3, 4], dtype=np.int32)
+        target = np.array([5, 1, 2, 4, 6, 7], dtype=np.int32)
+        levenshtein_distance(query, target)
+        stats = get_stats()
+        self.assertEqual(stats["suffix_array"]["calls"], 1)
+        self.assertGreater(stats["suffix_array"]["wall_ns"], 0)
+        self.assertGreater(stats["suffix_array"]["peak_scratch_bytes"], 0)
+        self.assertEqual(stats["levenshtein"]["calls"], 1)
+        self.assertGreater(stats["levenshtein"]["dp_cells"], 0)
+        self.assertEqual(stats["lcp_array"]["calls"], 0)
+        reset_stats()
+        self.assertEqual(get_stats()["suffix_array"]["calls"], 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -20,10 +20,22 @@
 #
 #  ctest --verbose -R suffix_array_test_py
 
+import os
+import tempfile
 import unittest
 import numpy as np
 
-from textsearch import create_suffix_array, find_close_matches
+from textsearch import (
+    SourcedText,
+    SuffixArrayIndex,
+    create_lcp_array,
+    create_suffix_array,
+    create_suffix_array_index_external,
+    find_candidate_matches,
+    find_close_matches,
+    find_close_matches_with_lengths,
+    write_suffix_array_index,
+)
 
 
 class TestSuffixArray(unittest.TestCase):
@@ -35,6 +47,41 @@ class TestSuffixArray(unittest.TestCase):
             self.assertTrue((suffix_array == expected_array).all())
             self.assertTrue(suffix_array.dtype == np.int64)
 
+    def test_create_suffix_array_sais(self):
+        for seq_len in [1, 2, 10, 1000]:
+            array = np.random.randint(1, 4, size=seq_len + 3).astype(np.int16)
+            array[seq_len - 1] = np.iinfo(np.int16).max - 1
+            array[seq_len:] = 0
+            dc3 = create_suffix_array(array, algorithm="dc3")
+            sais = create_suffix_array(array, algorithm="sais")
+            self.assertTrue(sais.dtype == np.int64)
+            np.testing.assert_equal(sais, dc3)
+
+    def test_create_suffix_array_num_threads(self):
+        seq_len = 300000
+        array = np.random.randint(1, 200, size=seq_len + 3).astype(np.uint8)
+        array[seq_len - 1] = np.iinfo(np.uint8).max - 1
+        array[seq_len:] = 0
+        expected = create_suffix_array(array)
+        for num_threads in [2, 4]:
+            suffix_array = create_suffix_array(array, num_threads=num_threads)
+            np.testing.assert_equal(suffix_array, expected)
+
+    def test_create_suffix_array_dtypes(self):
+        seq_len = 1000
+        text = np.random.randint(1, 100, size=seq_len + 3)
+        text[seq_len:] = 0
+        expected = None
+        for dtype in [np.uint8, np.int8, np.uint16, np.int16]:
+            array = text.astype(dtype)
+            array[seq_len - 1] = np.iinfo(dtype).max - 1
+            for index_dtype in [np.int32, np.int64]:
+                suffix_array = create_suffix_array(array, index_dtype=index_dtype)
+                self.assertTrue(suffix_array.dtype == index_dtype)
+                if expected is None:
+                    expected = suffix_array
+                np.testing.assert_equal(suffix_array, expected)
+
     def test_find_close_matches(self):
         """
         The suffix array contains the information below, the first column is
@@ -105,6 +152,179 @@ class TestSuffixArray(unittest.TestCase):
         # fmt: on
         self.assertTrue((output == expected_output).all())
 
+        for index_dtype in [np.int32, np.int64]:
+            suffix_array = create_suffix_array(texts_array, index_dtype=index_dtype)
+            output = find_close_matches(suffix_array, query_len, num_threads=2)
+            self.assertTrue(output.dtype == index_dtype)
+            np.testing.assert_equal(output, expected_output)
+
+    def test_find_candidate_matches(self):
+        queries = ["hello", "hallo"]
+        documents = ["iholloyou", "youhellome"]
+        texts = "".join(queries) + "".join(documents)
+        texts_array = np.array(
+            [ord(x) for x in texts] + [np.iinfo(np.int8).max - 1, 0, 0, 0],
+            dtype=np.int8,
+        )
+        suffix_array = create_suffix_array(texts_array)
+        query_len = len("".join(queries))
+        close_matches = find_close_matches(suffix_array, query_len)
+
+        doc = np.concatenate(
+            [np.full(len(s), i, dtype=np.uint32) for i, s in enumerate(queries + documents)]
+        )
+        text = SourcedText(
+            binary_text=texts_array[: len(texts)],
+            pos=np.arange(len(texts), dtype=np.uint32),
+            doc=doc,
+            sources=[],
+        )
+        # Both queries have the close matches [10, 12, 13] in "iholloyou"
+        # and [22, 23, 24, 25, 27, 28, 28] in "youhellome" (see
+        # test_find_close_matches()).
+        expected = np.array([[[22, 29], [10, 14], [-1, -1]]] * 2, dtype=np.int64)
+        for num_threads in [1, 2]:
+            candidates = find_candidate_matches(
+                close_matches, text, num_candidates=3, num_threads=num_threads
+            )
+            self.assertTrue(candidates.dtype == np.int64)
+            np.testing.assert_equal(candidates, expected)
+
+    def test_create_lcp_array(self):
+        for seq_len in [1, 2, 10, 1000]:
+            array = np.random.randint(1, 4, size=seq_len + 3).astype(np.uint8)
+            array[seq_len - 1] = np.iinfo(np.uint8).max - 1
+            array[seq_len:] = 0
+            for index_dtype in [np.int32, np.int64]:
+                suffix_array = create_suffix_array(array, index_dtype=index_dtype)
+                lcp = create_lcp_array(array, suffix_array)
+                self.assertTrue(lcp.dtype == index_dtype)
+                self.assertEqual(lcp.shape, (seq_len,))
+                self.assertEqual(lcp[0], 0)
+                for i in range(1, seq_len):
+                    a = array[suffix_array[i - 1] :]
+                    b = array[suffix_array[i] :]
+                    n = min(a.size, b.size)
+                    expected = np.argmax(a[:n] != b[:n])
+                    self.assertEqual(lcp[i], expected)
+
+    def test_find_close_matches_with_lengths(self):
+        queries = ["hello", "hallo"]
+        documents = ["iholloyou", "youhellome"]
+        texts = "".join(queries + documents)
+        texts_array = np.array(
+            [ord(x) for x in texts] + [np.iinfo(np.int8).max - 1, 0, 0, 0],
+            dtype=np.int8,
+        )
+        suffix_array = create_suffix_array(texts_array)
+        lcp = create_lcp_array(texts_array, suffix_array)
+        query_len = len("".join(queries))
+
+        close_matches, lengths = find_close_matches_with_lengths(
+            suffix_array, lcp, query_len
+        )
+        np.testing.assert_equal(
+            close_matches, find_close_matches(suffix_array, query_len)
+        )
+        # "hello" at 0 matches "hellome" at 22 fully and "hollo..." at 11
+        # on the first letter.
+        self.assertEqual(close_matches[1], 22)
+        self.assertEqual(lengths[1], 5)
+
+        # Matches of at least 3 symbols, up to 2 on each side.
+        close_matches, lengths = find_close_matches_with_lengths(
+            suffix_array, lcp, query_len, num_close_matches=2, min_match_length=3
+        )
+        self.assertEqual(close_matches.shape, (query_len * 4,))
+        self.assertTrue((lengths[lengths > 0] >= 3).all())
+        seq_len = suffix_array.size
+        self.assertTrue((close_matches[lengths == 0] == seq_len - 2).all())
+        for i in range(query_len):
+            for pos, length in zip(close_matches[4 * i : 4 * i + 4], lengths[4 * i : 4 * i + 4]):
+                if length > 0:
+                    self.assertEqual(texts[pos : pos + length], texts[i : i + length])
+
+        doc = np.concatenate(
+            [np.full(len(s), i, dtype=np.uint32) for i, s in enumerate(queries + documents)]
+        )
+        text = SourcedText(
+            binary_text=texts_array[: len(texts)],
+            pos=np.arange(len(texts), dtype=np.uint32),
+            doc=doc,
+            sources=[],
+        )
+        candidates = find_candidate_matches(
+            close_matches,
+            text,
+            num_candidates=2,
+            match_lengths=lengths,
+            num_close_matches=2,
+        )
+        # The long matches are of "hello" in "youhellome" and "llo" in
+        # "iholloyou".
+        self.assertEqual(tuple(candidates[0, 0]), (22, 25))
+
+    def test_suffix_array_index(self):
+        seq_len = 1000
+        text = np.random.randint(1, 100, size=seq_len + 3).astype(np.uint16)
+        text[seq_len - 1] = np.iinfo(np.uint16).max - 1
+        text[seq_len:] = 0
+        suffix_array = create_suffix_array(text)
+        lcp = np.arange(seq_len, dtype=np.int64) % 7
+        row_splits = np.array([0, 400, seq_len], dtype=np.int64)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            filename = os.path.join(tmp_dir, "index.bin")
+            write_suffix_array_index(filename, text, suffix_array)
+            index = SuffixArrayIndex(filename, verify_checksums=True)
+            self.assertTrue(index.text.dtype == np.uint16)
+            np.testing.assert_equal(index.text, text)
+            # Stored as np.int32 since the text is short.
+            self.assertTrue(index.suffix_array.dtype == np.int32)
+            np.testing.assert_equal(index.suffix_array, suffix_array)
+            self.assertFalse(index.suffix_array.flags.writeable)
+            self.assertIsNone(index.lcp)
+            self.assertIsNone(index.row_splits)
+            del index
+
+            write_suffix_array_index(
+                filename, text, suffix_array, lcp=lcp, row_splits=row_splits
+            )
+            index = SuffixArrayIndex(filename)
+            index.verify_checksums()
+            np.testing.assert_equal(index.lcp, lcp)
+            np.testing.assert_equal(index.row_splits, row_splits)
+            # The arrays keep the mapping alive.
+            suffix_array2 = index.suffix_array
+            del index
+            np.testing.assert_equal(suffix_array2, suffix_array)
+            del suffix_array2
+
+            with open(filename, "r+b") as f:
+                f.write(b"X")
+            with self.assertRaises(RuntimeError):
+                SuffixArrayIndex(filename)
+
+    def test_suffix_array_index_external(self):
+        for dtype in (np.uint8, np.int16, np.int32):
+            seq_len = 3000
+            text = np.random.randint(1, 4, size=seq_len + 3).astype(dtype)
+            text[seq_len - 1] = np.iinfo(dtype).max - 1
+            text[seq_len:] = 0
+            expected = create_suffix_array(text)
+            with tempfile.TemporaryDirectory() as tmp_dir:
+                text_filename = os.path.join(tmp_dir, "text.bin")
+                filename = os.path.join(tmp_dir, "index.bin")
+                text.tofile(text_filename)
+                # A small budget, to use temporary files.
+                create_suffix_array_index_external(
+                    text_filename, dtype, filename, memory_budget=4096
+                )
+                index = SuffixArrayIndex(filename, verify_checksums=True)
+                self.assertTrue(index.text.dtype == dtype)
+                np.testing.assert_equal(index.text, text)
+                np.testing.assert_equal(index.suffix_array, expected)
+                del index
+
 
 if __name__ == "__main__":
     unittest.main()
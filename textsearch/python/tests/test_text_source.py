@@ -1,5 +1,7 @@
 #!/usr/bin/env python3
 
+import os
+import tempfile
 import unittest
 
 import numpy as np
@@ -56,6 +58,28 @@ class TestTextSource(unittest.TestCase):
         )
         # fmt: on
 
+    def test_from_file(self):
+        s = "zażółć gęślą jaźń\n你好Hallo\U0001F600"
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            filename = os.path.join(tmp_dir, "text.txt")
+            with open(filename, "wb") as f:
+                f.write(s.encode("utf-8"))
+            for use_utf8 in (True, False):
+                source = TextSource.from_file(filename, use_utf8=use_utf8)
+                assert source.name == filename, source.name
+                assert source.text == s, (source.text, s)
+                expected = TextSource.from_str(name="test", s=s, use_utf8=use_utf8)
+                np.testing.assert_equal(source.binary_text, expected.binary_text)
+            assert source.pos.dtype == np.uint32, source.pos.dtype
+            assert source.pos[-1] == len(s.encode("utf-8")) - 4, source.pos
+
+    def test_invalid_utf8(self):
+        # A truncated 2-byte sequence at byte offset 3.
+        data = np.frombuffer(b"abc\xc3", dtype=np.uint8)
+        for use_utf8 in (True, False):
+            with self.assertRaisesRegex(RuntimeError, "offset 3"):
+                TextSource.from_utf8("test", data, use_utf8=use_utf8)
+
 
 if __name__ == "__main__":
     unittest.main()
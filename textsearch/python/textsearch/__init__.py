@@ -1,8 +1,34 @@
+from _fasttextsearch import AlignmentPipelineOptions
+from _fasttextsearch import get_stats
+from _fasttextsearch import levenshtein_batch_best_alignment
 from _fasttextsearch import levenshtein_distance
+from _fasttextsearch import levenshtein_distance_batch
+from _fasttextsearch import reset_stats
+from _fasttextsearch import SegmenterOptions
+from _fasttextsearch import smith_waterman_align
+from _fasttextsearch import smith_waterman_batch
+from _fasttextsearch import smith_waterman_batch_best_alignment
+from _fasttextsearch import stats_enabled
+from _fasttextsearch import StreamingAligner
+from _fasttextsearch import StreamingAlignerOptions
+from _fasttextsearch import SuffixArrayIndex
 
+from .datatypes import SourcedText
 from .datatypes import TextSource
 from .datatypes import Transcript
 
+from .alignment_pipeline import AlignmentPipeline
+from .alignment_pipeline import align_queries
 from .levenshtein import get_nice_alignments
+from .reference_index import MinimizerIndex
+from .reference_index import ReferenceIndex
+from .reference_index import ShardedReferenceIndex
+from .segmenter import find_segments
+from .suffix_array import create_lcp_array
+from .suffix_array import create_suffix_array_index_external
 from .suffix_array import create_suffix_array
+from .suffix_array import find_candidate_matches
 from .suffix_array import find_close_matches
+from .suffix_array import find_close_matches_with_lengths
+from .suffix_array import merge_suffix_array_indexes
+from .suffix_array import write_suffix_array_index
@@ -0,0 +1,172 @@
+# Copyright      2023   Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import threading
+from typing import Any, Dict, Iterable, Iterator, Optional, Tuple
+
+import _fasttextsearch
+import numpy as np
+from _fasttextsearch import AlignmentPipelineOptions
+
+from .reference_index import ReferenceIndex
+
+
+class AlignmentPipeline:
+    """
+    Aligns a stream of query documents with a ReferenceIndex in C++, with the
+    stages (close matches, candidate regions, Levenshtein alignment and, for
+    queries with times, segments) running concurrently in threads connected
+    by bounded queues, without the GIL.  So the candidates of a query are
+    found while the previous ones are being aligned, and more queries can be
+    pushed meanwhile; each candidate region is aligned as a separate task.
+
+    push() and results() block while the input queue is full and while no
+    result is ready, so push the queries from another thread (as
+    align_queries() does) unless there are only a few of them.
+
+    Each result is a dict with:
+
+      - query_id: the query_id passed to push().
+      - candidate: the rank of the candidate region, 0 for the best one, or
+        -1 for the one result of a query that has no candidate.
+      - num_candidates: the number of candidate regions of the query, i.e.
+        of its results (0 if it has none).
+      - ref_begin, ref_end: the span of the reference text that the query
+        was aligned with, i.e. the candidate region extended by
+        span_extension times the query length on each side.
+      - distance: the Levenshtein distance, or -1 if there was no match
+        within max_distance (or no candidate).
+      - ops, query_positions, ref_positions: the alignment, as with
+        alignment_format="numpy" in levenshtein_distance(), with the
+        reference positions relative to ref_begin.
+      - segments: (positions, times, scores) as returned by find_segments(),
+        with the reference positions relative to ref_begin; empty if the
+        query has no times.
+
+    The results come in the order they complete, not that of the queries.
+    """
+
+    def __init__(
+        self,
+        reference: ReferenceIndex,
+        options: Optional[AlignmentPipelineOptions] = None,
+    ):
+        """
+        Args:
+          reference: the reference, which must not be compressed (it needs
+            the suffix array), and needs the LCP array if
+            options.num_close_matches > 1.
+          options: the options; see AlignmentPipelineOptions in
+            textsearch/csrc/alignment_pipeline.h for its fields and their
+            defaults.  `engine` is one of "auto", "scalar", "bit_parallel"
+            and "simd", as for levenshtein_distance().
+        """
+        assert reference.fm_index is None, "The reference is compressed"
+        if options is None:
+            options = AlignmentPipelineOptions()
+        self.reference = reference
+        self.pipeline = _fasttextsearch.create_alignment_pipeline(
+            reference.text,
+            reference.suffix_array,
+            reference.lcp,
+            reference.row_splits,
+            options,
+        )
+
+    def push(
+        self, query_id: int, query: np.ndarray, times: Optional[np.ndarray] = None
+    ) -> bool:
+        """
+        Adds a query, waiting while the input queue is full.
+
+        Args:
+          query_id: any number that identifies the query in the results.
+          query: the query text, a 1-D integer np.ndarray; its symbols must be
+            less than the EOS symbol of the reference.
+          times: optional: the time of each query symbol, non-decreasing,
+            e.g. the `times` of its Transcript; if given, the alignments are
+            split into segments.
+        Returns:
+          False if the pipeline was closed, in which case the query is not
+          added.
+        """
+        assert query.ndim == 1, query.ndim
+        text = self.reference.text
+        eos = text[self.reference.seq_len - 1]
+        if query.size > 0:
+            assert query.min() >= 0 and query.max() < eos, (query.min(), query.max())
+        query = np.ascontiguousarray(query, dtype=text.dtype)
+        if times is not None:
+            times = np.ascontiguousarray(times, dtype=np.float32)
+            assert times.shape == query.shape, (times.shape, query.shape)
+        return self.pipeline.push(query_id, query, times)
+
+    def close(self) -> None:
+        """Ends the input; the queries pushed before are still processed."""
+        self.pipeline.close()
+
+    def results(self) -> Iterator[Dict[str, Any]]:
+        """
+        Yields the results as they complete, until all those of the queries
+        pushed before close() were returned.
+        """
+        while True:
+            result = self.pipeline.pop()
+            if result is None:
+                return
+            yield result
+
+
+def align_queries(
+    reference: ReferenceIndex,
+    queries: Iterable[Tuple[int, np.ndarray, Optional[np.ndarray]]],
+    options: Optional[AlignmentPipelineOptions] = None,
+) -> Iterator[Dict[str, Any]]:
+    """
+    Aligns queries with a reference with an AlignmentPipeline, pushing them
+    from a thread as they are needed, so that e.g. loading the next queries
+    overlaps with the alignment of the previous ones.
+
+    Args:
+      reference, options: as for AlignmentPipeline.
+      queries: tuples (query_id, query, times), as for AlignmentPipeline.push();
+        times may be None.  It is iterated in a separate thread.
+    Returns:
+      An iterator over the results, see AlignmentPipeline.
+    """
+    pipeline = AlignmentPipeline(reference, options)
+    error = []
+
+    def feed():
+        try:
+            for query_id, query, times in queries:
+                if not pipeline.push(query_id, query, times):
+                    break
+        except BaseException as e:
+            error.append(e)
+        finally:
+            pipeline.close()
+
+    thread = threading.Thread(target=feed, daemon=True)
+    thread.start()
+    try:
+        yield from pipeline.results()
+    finally:
+        # If the caller stopped early, this stops the feeding.
+        pipeline.close()
+        thread.join()
+    if error:
+        raise error[0]
@@ -4,6 +4,7 @@ from itertools import chain
 from pathlib import Path
 from typing import List, Optional, Union
 
+import _fasttextsearch
 import numpy as np
 
 
@@ -28,7 +29,8 @@ class TextSource:
     # Only used when binary_text.dtype is np.int32.
     # It contains the mapping from utf-8 character position to byte position.
     # That is pos[i] contains the byte position in binary_text for the i-th
-    # utf-8 character
+    # utf-8 character.  Its dtype is np.uint32, or np.uint64 if the utf-8
+    # encoded text has more than 2**32 bytes.
     pos: Optional[np.ndarray] = None
 
     @property
@@ -53,61 +55,66 @@ class TextSource:
             True to encode the text with utf-8.
             False to save the Unicode codepoint of the text.
         """
-        if use_utf8:
-            binary_text = s.encode("utf-8")
-            return TextSource(
-                name=name,
-                binary_text=np.frombuffer(binary_text, dtype=np.uint8),
-                pos=None,
-            )
-        else:
-            binary_text = np.fromiter((ord(i) for i in s), dtype=np.int32, count=len(s))
-            pos = _find_byte_offsets_for_utf8_symbols(binary_text)
-
-            return TextSource(
-                name=name,
-                binary_text=binary_text,
-                pos=pos,
-            )
-
+        binary_text = np.frombuffer(s.encode("utf-8"), dtype=np.uint8)
+        return TextSource.from_utf8(name, binary_text, use_utf8)
 
-def _find_byte_offsets_for_utf8_symbols(binary_text: np.ndarray) -> np.ndarray:
-    """
-    Args:
-      binary_text:
-        A 1-D int32 array containing Unicode codepoint of characters.
-    Returns:
-      Return a np.uint32 1-D array. Its length equals to the number of
-      characters contained in binary_text before encoding. ans[i]
-      contains the byte position in binary_text for the i-th character.
-    """
-    byte_offsets = []
-
-    # Iterate over each byte in the binary text
-    byte_index = 0
-    for i in binary_text:
-        if i < 0x80:
-            # Single-byte UTF-8 symbol
-            symbol_length = 1
-        elif i < 0x800:
-            # Two-byte UTF-8 symbol
-            symbol_length = 2
-        elif i < 0x10000:
-            # Three-byte UTF-8 symbol
-            symbol_length = 3
-        else:
-            # Four-byte UTF-8 symbol
-            symbol_length = 4
+    @staticmethod
+    def from_utf8(
+        name: str, data: np.ndarray, use_utf8: bool, num_threads: int = 1
+    ) -> "TextSource":
+        """Construct an instance of TextSource from utf-8 encoded bytes.
 
-        # Add the byte index to the list of offsets
-        byte_offsets.append(byte_index)
+        Args:
+          name:
+            Name of the returned instance. It can be either a filename or an ID.
+          data:
+            A 1-D np.uint8 array with the utf-8 encoded text.
+          use_utf8:
+            True to keep the utf-8 encoded bytes (they are still checked).
+            False to save the Unicode codepoint of the text.
+          num_threads:
+            The number of threads to decode with; <= 0 means to use all CPUs.
+        Raises:
+          RuntimeError if `data` is not valid utf-8; the message contains the
+          byte offset of the first invalid byte sequence.
+        """
+        assert data.ndim == 1 and data.dtype == np.uint8, (data.shape, data.dtype)
+        data = np.ascontiguousarray(data)
+        if use_utf8:
+            error = _fasttextsearch.validate_utf8(data, num_threads=num_threads)
+            if error != -1:
+                raise RuntimeError(f"Invalid UTF-8 at byte offset {error}")
+            return TextSource(name=name, binary_text=data, pos=None)
+        code_points, pos = _fasttextsearch.decode_utf8(data, num_threads=num_threads)
+        return TextSource(name=name, binary_text=code_points, pos=pos)
 
-        # Move the byte index to the start of the next symbol
-        byte_index += symbol_length
+    @staticmethod
+    def from_file(
+        filename: Union[str, Path],
+        use_utf8: bool,
+        name: Optional[str] = None,
+        num_threads: int = 1,
+    ) -> "TextSource":
+        """Construct an instance of TextSource from a utf-8 encoded file, without
+        decoding it into a Python string.
 
-    # Note: uint32 should be sufficient for 4GB of text,
-    # I don't expect we'd deal with such large documents here.
-    return np.asarray(byte_offsets, dtype=np.uint32)
+        Args:
+          filename:
+            The file to read.
+          use_utf8:
+            As for from_utf8().
+          name:
+            Name of the returned instance; if None, `filename`.
+          num_threads:
+            As for from_utf8().
+        """
+        data = np.fromfile(str(filename), dtype=np.uint8)
+        return TextSource.from_utf8(
+            str(filename) if name is None else name,
+            data,
+            use_utf8,
+            num_threads=num_threads,
+        )
 
 
 @dataclass
@@ -219,7 +226,6 @@ class SourcedText:
     texts it came.
 
     # TODO(pzelasko): if I understand correctly this class hides whether the text came from TextSource or Transcript
-    # TODO(pzelasko): test it
     """
 
     # A 1-d array, probably a sequence of bytes of UTF-8 encoded text.
@@ -241,18 +247,18 @@ class SourcedText:
     # the row-ids.
     doc_splits: Optional[np.ndarray] = None
 
+    # Optional: binary_text followed by the EOS symbol (the second largest
+    # value of its dtype) and 3 zeros, i.e. an input of create_suffix_array();
+    # binary_text is then a view of its first binary_text.size elements.
+    suffix_array_input: Optional[np.ndarray] = None
+
 
 def texts_to_sourced_texts(sources: List[TextSource]) -> List[SourcedText]:
-    # TODO(pzelasko): test it
     return [
         SourcedText(
             binary_text=s.binary_text,
-            # TODO(pzelasko): not sure if 'pos' here has the same meaning as in
-            #  TextSource (byte offset for each UTF-8 symbol start)
-            #  or as suggested by docstring in SourcedText
-            #  (text position in the original source for each element of the text).
-            #  For now I am assuming the latter but if that's right we should find a new name
-            #  to avoid ambiguity.
+            # The position of each element in its source, i.e. the index of
+            # the byte or code point; not the byte offsets of TextSource.pos.
             pos=np.arange(len(s.binary_text), dtype=np.uint32),
             doc=doc_idx,
             sources=[s],
@@ -262,40 +268,163 @@ def texts_to_sourced_texts(sources: List[TextSource]) -> List[SourcedText]:
     ]
 
 
-def append_texts(texts: List[SourcedText]) -> SourcedText:
-    # TODO(pzelasko): ensure this is right; my interpretation here is that
-    #   the resulting SourcedText is similar to k2 Fsa / ragged tensors
-    #   in that it's actually a batch of texts with varying sizes,
-    #   and doc + doc_splits let us recover the individual items.
-    # TODO(pzelasko): test it
+def _concatenate_texts(
+    texts: List[np.ndarray],
+    pos: List[Optional[np.ndarray]],
+    docs: List[Union[int, np.ndarray]],
+    sources: List[TextSource],
+    add_eos: bool,
+    num_threads: int,
+) -> SourcedText:
+    """Concatenates texts with C++ into a SourcedText, writing each of its arrays
+    once; see append_texts().  A None in `pos` means positions 0, 1, ...
+    """
+    dtypes = set(t.dtype for t in texts)
+    assert len(dtypes) <= 1, dtypes
+    if not texts:
+        texts, pos, docs = [np.zeros(0, dtype=np.uint8)], [None], [0]
+    assert texts[0].dtype in (np.uint8, np.uint16, np.int32), texts[0].dtype
+
+    num_docs = 0
+    doc_arrays, doc_ids = [], []
+    for d in docs:
+        if isinstance(d, np.ndarray):
+            if d.size > 0:
+                num_docs = max(num_docs, int(d[-1]) + 1)
+            doc_arrays.append(np.ascontiguousarray(d, dtype=np.uint32))
+            doc_ids.append(0)
+        else:
+            num_docs = max(num_docs, d + 1)
+            doc_arrays.append(None)
+            doc_ids.append(d)
+
+    text, pos, doc, doc_splits = _fasttextsearch.concatenate_texts(
+        [np.ascontiguousarray(t) for t in texts],
+        [None if p is None else np.ascontiguousarray(p, dtype=np.uint32) for p in pos],
+        doc_arrays,
+        doc_ids,
+        num_docs,
+        add_eos=add_eos,
+        num_threads=num_threads,
+    )
     return SourcedText(
-        binary_text=np.concatenate([t.binary_text for t in texts], axis=0),
-        pos=np.concatenate([t.pos for t in texts], axis=0),
-        doc=np.array(
-            [
-                item
-                for t in texts
-                for item in (t.doc if isinstance(t.doc, np.ndarray) else [t.doc])
-            ]
-        ),
-        sources=[s for t in texts for s in t.sources],
-        doc_splits=np.cumsum([0] + [t.binary_text.shape[0] for t in texts[:-1]]),
+        binary_text=text[: pos.size],
+        pos=pos,
+        doc=doc,
+        sources=sources,
+        doc_splits=doc_splits,
+        suffix_array_input=text if add_eos else None,
+    )
+
+
+def sources_to_sourced_text(
+    sources: List[Union[TextSource, Transcript]],
+    add_eos: bool = False,
+    num_threads: int = 1,
+) -> SourcedText:
+    """Returns a SourcedText that contains all the `sources`, document i being
+    sources[i]; it is append_texts(texts_to_sourced_texts(sources)), without the
+    intermediate arrays.
+
+    Args:
+      sources:
+        The text sources; their binary_text must all have the same dtype.
+      add_eos:
+        As for append_texts().
+      num_threads:
+        As for append_texts().
+    """
+    return _concatenate_texts(
+        [s.binary_text for s in sources],
+        [None] * len(sources),
+        list(range(len(sources))),
+        list(sources),
+        add_eos,
+        num_threads,
+    )
+
+
+def append_texts(
+    texts: List[SourcedText], add_eos: bool = False, num_threads: int = 1
+) -> SourcedText:
+    """Concatenates SourcedTexts, e.g. the query and reference texts.  The total
+    size is computed first, and each array of the result (text, pos, doc and
+    doc_splits) is written once, in parallel, by C++ code.
+
+    Args:
+      texts:
+        The texts to concatenate.  Their binary_text must all have dtype
+        np.uint8, np.uint16 or np.int32, and their document indexes must be
+        non-decreasing over the concatenation.
+      add_eos:
+        If True, the returned `suffix_array_input` is the text followed by the
+        EOS symbol (the second largest value of its dtype) and 3 zeros, which
+        can be passed to create_suffix_array() without any copying.  The EOS
+        symbol must not appear in the texts.
+      num_threads:
+        The number of threads to use; <= 0 means to use all CPUs.
+    Returns:
+      A SourcedText whose `sources` are those of `texts` concatenated, and whose
+      doc_splits are the row splits of `doc`, of shape (num_docs + 1,), so that
+      document d is at positions [doc_splits[d], doc_splits[d+1]), num_docs being
+      the largest document index plus 1.  The arrays do not share memory with
+      those of `texts`.
+    """
+    return _concatenate_texts(
+        [t.binary_text for t in texts],
+        [t.pos for t in texts],
+        [t.doc for t in texts],
+        [s for t in texts for s in t.sources],
+        add_eos,
+        num_threads,
     )
 
 
-'''
-TODO
-def remove(t: SourcedText, keep: np.ndarray) -> SourcedText:
+def remove(
+    t: SourcedText, keep: np.ndarray, add_eos: bool = False, num_threads: int = 1
+) -> SourcedText:
     """
     Removes some positions from a SourcedText (out-of-place).
     Args:
-        t: the text to remove some positions of
+        t: the text to remove some positions of; its binary_text must have dtype
+          np.uint8, np.uint16 or np.int32 and its document indexes must be
+          non-decreasing.
         keep: an np.ndarray with dtype == np.bool, that is True
           for positions that should be kept; must have the same shape
-          as t.text.
+          as t.binary_text.
+        add_eos: as for append_texts().
+        num_threads: the number of threads to use; <= 0 means to use all CPUs.
     Returns:
-        A SourcedText with some positions removed.
+        A SourcedText with some positions removed, with doc_splits as for
+        append_texts().  num_docs is kept, so removed documents are empty.
     """
-    pass
-
-'''
+    assert keep.dtype == np.bool_, keep.dtype
+    assert keep.shape == t.binary_text.shape, (keep.shape, t.binary_text.shape)
+    assert t.binary_text.dtype in (np.uint8, np.uint16, np.int32), t.binary_text.dtype
+    size = t.binary_text.size
+    doc = t.doc
+    if not isinstance(doc, np.ndarray):
+        doc = np.full(size, doc, dtype=np.uint32)
+    doc = np.ascontiguousarray(doc, dtype=np.uint32)
+    if t.doc_splits is not None:
+        num_docs = t.doc_splits.size - 1
+    else:
+        num_docs = int(doc[-1]) + 1 if size > 0 else 0
+
+    text, pos, doc, doc_splits = _fasttextsearch.remove_from_text(
+        np.ascontiguousarray(t.binary_text),
+        np.ascontiguousarray(t.pos, dtype=np.uint32),
+        doc,
+        np.ascontiguousarray(keep),
+        num_docs,
+        add_eos=add_eos,
+        num_threads=num_threads,
+    )
+    return SourcedText(
+        binary_text=text[: pos.size],
+        pos=pos,
+        doc=doc,
+        sources=t.sources,
+        doc_splits=doc_splits,
+        suffix_array_input=text if add_eos else None,
+    )
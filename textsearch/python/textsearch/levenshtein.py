@@ -15,18 +15,61 @@
 # limitations under the License.
 
 import numpy as np
-from typing import List, Tuple
+from typing import List, Tuple, Union
+
+# The symbols of the op codes of alignment_format="numpy" (see
+# `levenshtein_distance`): equal, replacement, insertion, deletion.
+_OP_SYMBOLS = np.array(["|", "#", "+", "-"])
+
+
+def _justify(strs: np.ndarray, widths: np.ndarray) -> str:
+    # np.char.ljust() takes one width, so do it once per distinct width.
+    out = strs.astype(object)
+    for width in np.unique(widths):
+        mask = widths == width
+        out[mask] = np.char.ljust(strs[mask], int(width))
+    return "".join(out)
+
+
+def _get_nice_alignment_numpy(
+    ops: np.ndarray,
+    query_positions: np.ndarray,
+    target_positions: np.ndarray,
+    query: np.ndarray,
+    target: np.ndarray,
+) -> str:
+    query_strs = np.where(
+        query_positions >= 0, query[query_positions].astype(str), "*"
+    )
+    target_strs = np.where(
+        target_positions >= 0, target[target_positions].astype(str), "*"
+    )
+    # Each column is as wide as its longest symbol plus a space.
+    widths = (
+        np.maximum(np.char.str_len(query_strs), np.char.str_len(target_strs)) + 1
+    )
+    return "\n".join(
+        [
+            _justify(query_strs, widths),
+            _justify(_OP_SYMBOLS[ops], widths),
+            _justify(target_strs, widths),
+        ]
+    )
 
 
 def get_nice_alignments(
-    alignments: List[Tuple[int, str]], query: np.ndarray, target: np.ndarray
+    alignments: List[Union[Tuple[int, str], Tuple[int, np.ndarray, np.ndarray, np.ndarray]]],
+    query: np.ndarray,
+    target: np.ndarray,
 ) -> List[str]:
     """
     Get the alignment of the matched segments.
 
     Args:
       alignments:
-        The alignments information returned by the `levenshtein_distance`.
+        The alignments information returned by the `levenshtein_distance`,
+        with either alignment_format; for "numpy" they are formatted with
+        vectorized numpy operations instead of symbol by symbol.
       query:
         The query sequence.
       target:
@@ -56,6 +99,14 @@ def get_nice_alignments(
     """
     results = []
     for align in alignments:
+        if len(align) == 4:
+            _, ops, query_positions, target_positions = align
+            results.append(
+                _get_nice_alignment_numpy(
+                    ops, query_positions, target_positions, query, target
+                )
+            )
+            continue
         j = align[0]
         i = len(query) - 1
         k = len(align[1]) - 1
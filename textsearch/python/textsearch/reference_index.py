@@ -0,0 +1,597 @@
+# Copyright      2023   Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from concurrent.futures import ThreadPoolExecutor
+from typing import List, Optional, Tuple
+
+import _fasttextsearch
+import numpy as np
+
+from .suffix_array import (
+    create_lcp_array,
+    create_suffix_array,
+    write_suffix_array_index,
+)
+
+
+def _to_symbol_dtype(array: np.ndarray) -> np.ndarray:
+    """
+    Returns `array` with a dtype that the C++ code is instantiated for, like
+    create_suffix_array() does with its input.
+    """
+    array = np.ascontiguousarray(array)
+    if array.dtype == np.int8:
+        return array.view(np.uint8)
+    elif array.dtype == np.int16:
+        return array.view(np.uint16)
+    elif array.dtype not in (np.uint8, np.uint16, np.int32, np.int64):
+        return array.astype(np.int64)
+    return array
+
+
+class ReferenceIndex:
+    """
+    The suffix array (and LCP array) of a reference text on its own, which can
+    find the close matches of any number of query texts without rebuilding it,
+    unlike find_close_matches() which needs the suffix array of the query and
+    reference texts combined.  Each query suffix is found by binary search in
+    the suffix array, so a query of length n costs O(n log(seq_len)) rather than
+    a rebuild that is linear in the (usually much larger) reference.
+
+    The index can be saved with save() and memory-mapped with
+    ReferenceIndex.load(), see write_suffix_array_index().
+
+    For serving with less memory, compress() replaces the suffix array and
+    the LCP array with an FM-index (the Burrows-Wheeler transform of the text
+    and a sample of the suffix array), which finds the same matches.
+    """
+
+    def __init__(
+        self,
+        text: np.ndarray,
+        suffix_array: Optional[np.ndarray] = None,
+        lcp: Optional[np.ndarray] = None,
+        row_splits: Optional[np.ndarray] = None,
+        num_threads: int = 1,
+        sample_rate: Optional[int] = None,
+    ):
+        """
+        Args:
+          text: the reference text, as for the input of create_suffix_array(),
+            i.e. of shape (seq_len + 3,), with the EOS symbol at seq_len - 1
+            followed by 3 zeros.
+          suffix_array: the suffix array of `text`; if None it is created with
+            create_suffix_array().
+          lcp: the LCP array of `suffix_array`; if None it is created with
+            create_lcp_array().
+          row_splits: the start of each reference document in `text` plus the
+            end of the last one, of dtype np.int64 (like the row_splits of a
+            ragged tensor); if None the reference is one document,
+            [0, seq_len - 1).
+          num_threads: the number of threads used to create the arrays; <= 0
+            means to use all CPUs.
+          sample_rate: if not None, the index is compressed with compress()
+            with this sample_rate (and the LCP array is not created).
+        """
+        assert text.ndim == 1, text.ndim
+        seq_len = text.size - 3
+        assert seq_len >= 1, seq_len
+        text = _to_symbol_dtype(text)
+        if suffix_array is None:
+            suffix_array = create_suffix_array(
+                text, algorithm="sais", num_threads=num_threads
+            )
+        assert suffix_array.shape == (seq_len,), (suffix_array.shape, seq_len)
+        assert suffix_array.dtype in (np.int32, np.int64), suffix_array.dtype
+        if lcp is None and sample_rate is None:
+            lcp = create_lcp_array(text, suffix_array, num_threads=num_threads)
+        # There is no C++ version for np.int64 symbols with np.int32 indexes.
+        index_dtype = np.int64 if text.dtype == np.int64 else suffix_array.dtype
+        if row_splits is None:
+            row_splits = np.array([0, seq_len - 1], dtype=np.int64)
+        assert row_splits.ndim == 1 and row_splits.size >= 1, row_splits.shape
+        assert row_splits[0] == 0 and row_splits[-1] <= seq_len, row_splits
+
+        self.text = text
+        self.index_dtype = index_dtype
+        self.suffix_array = np.ascontiguousarray(suffix_array, dtype=index_dtype)
+        self.lcp = (
+            None if lcp is None else np.ascontiguousarray(lcp, dtype=index_dtype)
+        )
+        self.row_splits = np.ascontiguousarray(row_splits, dtype=np.int64)
+        self.fm_index = None
+        if sample_rate is not None:
+            self.compress(sample_rate, num_threads=num_threads)
+
+    def compress(self, sample_rate: int = 32, num_threads: int = 1) -> None:
+        """
+        Replaces the suffix array and the LCP array with an FM-index of the
+        text, which uses about 1.13 * (ceil(log2(num_symbols)) + 1) / 8 bytes
+        per symbol plus itemsize / sample_rate for the sampled suffix array (e.g.
+        1.5 bytes for np.uint8 symbols, np.int64 indexes and a sample_rate of
+        32, instead of 16 bytes for the arrays).  find_close_matches() returns
+        the same matches, but locating each match takes up to sample_rate - 1
+        steps, so a larger sample_rate is slower.  The text is kept, and the
+        index can no longer be saved.
+
+        Args:
+          sample_rate: the suffix array is kept at the text positions that
+            are multiples of it, >= 1.
+          num_threads: the number of threads to use; <= 0 means to use all
+            CPUs.
+        """
+        assert sample_rate >= 1, sample_rate
+        assert self.fm_index is None, "The index is already compressed"
+        self.fm_index = _fasttextsearch.create_fm_index(
+            self.text,
+            self.suffix_array,
+            sample_rate=sample_rate,
+            num_threads=num_threads,
+        )
+        self.suffix_array = None
+        self.lcp = None
+
+    @property
+    def seq_len(self) -> int:
+        """The length of the reference text, including the EOS symbol."""
+        return self.text.size - 3
+
+    @property
+    def num_docs(self) -> int:
+        return self.row_splits.size - 1
+
+    @staticmethod
+    def load(
+        filename: str,
+        verify_checksums: bool = False,
+        sample_rate: Optional[int] = None,
+    ) -> "ReferenceIndex":
+        """
+        Memory-maps an index written by save() (or by write_suffix_array_index(),
+        in which case the LCP array is created if the file has none).  If
+        sample_rate is not None the index is compressed, see compress(), and
+        only the text of the file stays in use.
+        """
+        index = _fasttextsearch.SuffixArrayIndex(
+            filename, verify_checksums=verify_checksums
+        )
+        # The arrays keep the mapping alive.
+        return ReferenceIndex(
+            index.text,
+            index.suffix_array,
+            index.lcp,
+            index.row_splits,
+            sample_rate=sample_rate,
+        )
+
+    def save(self, filename: str) -> None:
+        assert self.fm_index is None, "A compressed index can't be saved"
+        write_suffix_array_index(
+            filename,
+            self.text,
+            self.suffix_array,
+            lcp=self.lcp,
+            row_splits=self.row_splits,
+        )
+
+    def find_close_matches(
+        self,
+        query: np.ndarray,
+        num_close_matches: int = 1,
+        min_match_length: int = 0,
+        num_threads: int = 1,
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Finds the close matches in the reference of each suffix of `query`, like
+        find_close_matches_with_lengths() for the query and reference combined
+        (the query suffixes end at the end of `query`).
+
+        Args:
+          query: the query text, a 1-D integer np.ndarray of length query_len
+            (no EOS symbol is needed).  Its symbols must be less than the EOS
+            symbol of the reference.
+          num_close_matches: the maximum number of matches on each side of
+            each query suffix in the suffix array, >= 1.
+          min_match_length: the minimum length of a match.
+          num_threads: the number of threads to use; <= 0 means to use all
+            CPUs.  The result does not depend on it.
+        Returns (close_matches, match_lengths), as for
+          find_close_matches_with_lengths() but with positions in the
+          reference text rather than in the combined text.
+        """
+        assert query.ndim == 1, query.ndim
+        assert num_close_matches >= 1, num_close_matches
+        eos = self.text[self.seq_len - 1]
+        if query.size > 0:
+            assert query.min() >= 0 and query.max() < eos, (query.min(), query.max())
+        query = np.ascontiguousarray(query, dtype=self.text.dtype)
+        if self.fm_index is not None:
+            return self.fm_index.find_close_matches(
+                query,
+                num_close_matches=num_close_matches,
+                min_match_length=min_match_length,
+                num_threads=num_threads,
+            )
+        return _fasttextsearch.find_close_matches_in_reference(
+            self.text,
+            self.suffix_array,
+            self.lcp,
+            query,
+            num_close_matches=num_close_matches,
+            min_match_length=min_match_length,
+            num_threads=num_threads,
+        )
+
+    def find_candidate_matches(
+        self,
+        close_matches: np.ndarray,
+        query_row_splits: np.ndarray,
+        match_lengths: Optional[np.ndarray] = None,
+        num_close_matches: int = 1,
+        length_ratio: float = 2.0,
+        num_candidates: int = 5,
+        num_threads: int = 1,
+    ) -> np.ndarray:
+        """
+        Like find_candidate_matches(), for the output of find_close_matches().
+
+        Args:
+          close_matches: the close matches returned by find_close_matches().
+          query_row_splits: the start of each query document in the query text
+            plus the end of the last one (i.e. the length of the query), like
+            the row_splits of a ragged tensor.
+          match_lengths: optional: the match lengths returned by
+            find_close_matches(); if given, regions are scored by the total
+            length of their close matches rather than by their number.
+          num_close_matches: the num_close_matches passed to
+            find_close_matches(); requires match_lengths if not 1.
+          length_ratio, num_candidates, num_threads: as for
+            find_candidate_matches().
+        Returns:
+          An np.ndarray of dtype np.int64 and shape
+          (num_query_docs, num_candidates, 2), as for find_candidate_matches()
+          but with positions in the reference text.  Unused slots are -1.
+        """
+        return _find_candidate_matches_in_reference(
+            self.row_splits,
+            self.index_dtype,
+            close_matches,
+            query_row_splits,
+            match_lengths=match_lengths,
+            num_close_matches=num_close_matches,
+            length_ratio=length_ratio,
+            num_candidates=num_candidates,
+            num_threads=num_threads,
+        )
+
+
+class MinimizerIndex:
+    """
+    A hash table of the minimizers of a reference text, as an alternative to
+    ReferenceIndex for finding candidate regions of short queries: of each
+    window of w consecutive k-mers, the one with the smallest hash is a
+    minimizer, so building and searching the index take far less memory and
+    memory traffic than a suffix array.  It has the interface of
+    ReferenceIndex for queries, and can be a shard of a ShardedReferenceIndex,
+    so the two can be swapped to compare them.
+
+    The hits are exact matches of length k, at the query positions that are
+    minimizers of the query; a query that shares w + k - 1 symbols with the
+    reference has at least one hit there.  Choose k so that a k-mer is rarely
+    found by chance (e.g. about 12 for characters, or 4 for word pieces), and
+    w to trade the number of hits for speed and memory.
+    """
+
+    def __init__(
+        self,
+        text: np.ndarray,
+        row_splits: Optional[np.ndarray] = None,
+        k: int = 12,
+        w: int = 6,
+        num_threads: int = 1,
+    ):
+        """
+        Args:
+          text: the reference text, as for ReferenceIndex; the k-mers with EOS
+            symbols are not indexed.
+          row_splits: the documents of the reference, as for ReferenceIndex.
+          k: the length of the k-mers, >= 1.
+          w: the number of k-mers in a window, >= 1.
+          num_threads: the number of threads used to build the index; <= 0
+            means to use all CPUs.
+        """
+        assert text.ndim == 1, text.ndim
+        seq_len = text.size - 3
+        assert seq_len >= 1, seq_len
+        assert k >= 1 and w >= 1, (k, w)
+        text = _to_symbol_dtype(text)
+        if row_splits is None:
+            row_splits = np.array([0, seq_len - 1], dtype=np.int64)
+        assert row_splits.ndim == 1 and row_splits.size >= 1, row_splits.shape
+        assert row_splits[0] == 0 and row_splits[-1] <= seq_len, row_splits
+
+        self.text = text
+        self.index_dtype = (
+            np.int32
+            if text.dtype != np.int64 and text.size <= np.iinfo(np.int32).max
+            else np.int64
+        )
+        self.row_splits = np.ascontiguousarray(row_splits, dtype=np.int64)
+        self.index = _fasttextsearch.create_minimizer_index(
+            text, k=k, w=w, index_dtype=self.index_dtype, num_threads=num_threads
+        )
+
+    @property
+    def seq_len(self) -> int:
+        """The length of the reference text, including the EOS symbol."""
+        return self.text.size - 3
+
+    @property
+    def num_docs(self) -> int:
+        return self.row_splits.size - 1
+
+    def find_close_matches(
+        self,
+        query: np.ndarray,
+        num_close_matches: int = 1,
+        min_match_length: int = 0,
+        num_threads: int = 1,
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Finds the positions in the reference of the minimizers of `query`, in
+        the format of ReferenceIndex.find_close_matches(): the
+        2 * num_close_matches elements of a query position whose k-mer is a
+        minimizer are the positions of that k-mer in the reference, with
+        match lengths of k, and the other elements are unused (seq_len - 2,
+        with a match length of 0).  Minimizers with more than
+        2 * num_close_matches positions in the reference are ignored, as
+        repeats.  If min_match_length > k there are no matches.
+        """
+        assert query.ndim == 1, query.ndim
+        assert num_close_matches >= 1, num_close_matches
+        eos = self.text[self.seq_len - 1]
+        if query.size > 0:
+            assert query.min() >= 0 and query.max() < eos, (query.min(), query.max())
+        query = np.ascontiguousarray(query, dtype=self.text.dtype)
+        return self.index.find_close_matches(
+            query,
+            num_close_matches=num_close_matches,
+            min_match_length=min_match_length,
+            num_threads=num_threads,
+        )
+
+    def find_candidate_matches(
+        self,
+        close_matches: np.ndarray,
+        query_row_splits: np.ndarray,
+        match_lengths: Optional[np.ndarray] = None,
+        num_close_matches: int = 1,
+        length_ratio: float = 2.0,
+        num_candidates: int = 5,
+        num_threads: int = 1,
+    ) -> np.ndarray:
+        """As ReferenceIndex.find_candidate_matches()."""
+        return _find_candidate_matches_in_reference(
+            self.row_splits,
+            self.index_dtype,
+            close_matches,
+            query_row_splits,
+            match_lengths=match_lengths,
+            num_close_matches=num_close_matches,
+            length_ratio=length_ratio,
+            num_candidates=num_candidates,
+            num_threads=num_threads,
+        )
+
+
+class ShardedReferenceIndex:
+    """
+    A reference collection made of ReferenceIndex (or MinimizerIndex) shards
+    that are built independently, so that a growing collection only needs an
+    index for each new part (see add()) rather than a rebuild of the whole
+    suffix array.  Queries are run on every shard (in parallel) and the
+    results are merged, with positions and row_splits in the concatenation of
+    the shards' texts, like those of the index written by
+    merge_suffix_array_indexes() for the same shards.  With ReferenceIndex
+    shards the matches are the same as those of the merged index, except for
+    the order among matches of the same length.
+    """
+
+    def __init__(self, shards: List[ReferenceIndex]):
+        assert len(shards) >= 1, len(shards)
+        self.shards = []
+        self.offsets = [0]
+        for shard in shards:
+            self.add(shard)
+
+    def add(self, shard: ReferenceIndex) -> None:
+        """Appends a shard, whose positions start at the current seq_len."""
+        if self.shards:
+            first = self.shards[0]
+            assert shard.text.dtype == first.text.dtype, (
+                shard.text.dtype,
+                first.text.dtype,
+            )
+            assert (
+                shard.text[shard.seq_len - 1] == first.text[first.seq_len - 1]
+            ), "The shards must have the same EOS symbol"
+        self.shards.append(shard)
+        self.offsets.append(self.offsets[-1] + shard.seq_len)
+
+    @staticmethod
+    def load(
+        filenames: List[str],
+        verify_checksums: bool = False,
+        sample_rate: Optional[int] = None,
+    ) -> "ShardedReferenceIndex":
+        """Memory-maps the shards, see ReferenceIndex.load()."""
+        return ShardedReferenceIndex(
+            [ReferenceIndex.load(f, verify_checksums, sample_rate) for f in filenames]
+        )
+
+    @property
+    def seq_len(self) -> int:
+        """The total length of the shards' texts, including the EOS symbols."""
+        return self.offsets[-1]
+
+    @property
+    def row_splits(self) -> np.ndarray:
+        """
+        The documents of all the shards; the EOS symbol of a shard is in its
+        last document.
+        """
+        splits = [s.row_splits[:-1] + o for s, o in zip(self.shards, self.offsets)]
+        end = self.shards[-1].row_splits[-1] + self.offsets[-2]
+        return np.concatenate(splits + [np.array([end], dtype=np.int64)])
+
+    @property
+    def _dtype(self):
+        if self.seq_len + 3 <= np.iinfo(np.int32).max and all(
+            s.index_dtype == np.int32 for s in self.shards
+        ):
+            return np.int32
+        return np.int64
+
+    def find_close_matches(
+        self,
+        query: np.ndarray,
+        num_close_matches: int = 1,
+        min_match_length: int = 0,
+        num_threads: int = 1,
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Like ReferenceIndex.find_close_matches(): for each side of each query
+        suffix, the num_close_matches longest of the matches in all the shards,
+        longest first, with positions in the concatenated texts.  Unused
+        elements are seq_len - 2 with a match length of 0.
+
+        Args:
+          num_threads: the number of shards to query at the same time; <= 0
+            means one thread per shard.
+        """
+        assert query.ndim == 1, query.ndim
+        assert num_close_matches >= 1, num_close_matches
+        num_shards = len(self.shards)
+        if num_threads <= 0:
+            num_threads = num_shards
+
+        def find(s: int) -> Tuple[np.ndarray, np.ndarray]:
+            return self.shards[s].find_close_matches(
+                query,
+                num_close_matches=num_close_matches,
+                min_match_length=min_match_length,
+            )
+
+        # The C++ code releases the GIL, so the shards run in parallel.
+        with ThreadPoolExecutor(max_workers=min(num_threads, num_shards)) as pool:
+            results = list(pool.map(find, range(num_shards)))
+
+        dtype = self._dtype
+        shape = (query.size, 2, num_close_matches)
+        positions, keys = [], []
+        for s, (close_matches, match_lengths) in enumerate(results):
+            close_matches = close_matches.reshape(shape).astype(np.int64)
+            match_lengths = match_lengths.reshape(shape).astype(np.int64)
+            unused = (match_lengths == 0) & (
+                close_matches == self.shards[s].seq_len - 2
+            )
+            positions.append(close_matches + self.offsets[s])
+            keys.append(np.where(unused, -1, match_lengths))
+        positions = np.concatenate(positions, axis=2)
+        keys = np.concatenate(keys, axis=2)
+
+        # A stable sort keeps the order of each shard's matches of the same
+        # length, nearest first.
+        order = np.argsort(-keys, axis=2, kind="stable")[:, :, :num_close_matches]
+        positions = np.take_along_axis(positions, order, axis=2)
+        keys = np.take_along_axis(keys, order, axis=2)
+        unused = keys == -1
+        positions[unused] = self.seq_len - 2
+        keys[unused] = 0
+        return positions.reshape(-1).astype(dtype), keys.reshape(-1).astype(dtype)
+
+    def find_candidate_matches(
+        self,
+        close_matches: np.ndarray,
+        query_row_splits: np.ndarray,
+        match_lengths: Optional[np.ndarray] = None,
+        num_close_matches: int = 1,
+        length_ratio: float = 2.0,
+        num_candidates: int = 5,
+        num_threads: int = 1,
+    ) -> np.ndarray:
+        """
+        Like ReferenceIndex.find_candidate_matches(), for the output of
+        find_close_matches(); the candidates can span the documents of
+        different shards, with positions in the concatenated texts.
+        """
+        return _find_candidate_matches_in_reference(
+            self.row_splits,
+            self._dtype,
+            close_matches,
+            query_row_splits,
+            match_lengths=match_lengths,
+            num_close_matches=num_close_matches,
+            length_ratio=length_ratio,
+            num_candidates=num_candidates,
+            num_threads=num_threads,
+        )
+
+
+def _find_candidate_matches_in_reference(
+    row_splits: np.ndarray,
+    dtype,
+    close_matches: np.ndarray,
+    query_row_splits: np.ndarray,
+    match_lengths: Optional[np.ndarray],
+    num_close_matches: int,
+    length_ratio: float,
+    num_candidates: int,
+    num_threads: int,
+) -> np.ndarray:
+    """
+    Runs find_candidate_matches() for close matches in a reference text with
+    the given `row_splits`, whose positions are of `dtype`; see
+    ReferenceIndex.find_candidate_matches().
+    """
+    query_row_splits = np.asarray(query_row_splits)
+    assert query_row_splits.ndim == 1, query_row_splits.shape
+    assert query_row_splits.size >= 1 and query_row_splits[0] == 0, query_row_splits
+    assert match_lengths is not None or num_close_matches == 1, num_close_matches
+    query_len = int(query_row_splits[-1])
+    assert close_matches.size == 2 * num_close_matches * query_len, (
+        close_matches.size,
+        query_len,
+    )
+    # Put the query first, as find_candidate_matches() expects.
+    row_splits = np.concatenate(
+        [query_row_splits, row_splits[1:] + query_len]
+    ).astype(dtype)
+    close_matches = np.ascontiguousarray(close_matches, dtype=dtype) + query_len
+    if match_lengths is not None:
+        match_lengths = np.ascontiguousarray(match_lengths, dtype=dtype)
+    candidates = _fasttextsearch.find_candidate_matches(
+        close_matches,
+        row_splits,
+        query_row_splits.size - 1,
+        length_ratio=length_ratio,
+        num_candidates=num_candidates,
+        num_threads=num_threads,
+        match_lengths=match_lengths,
+        num_close_matches=num_close_matches,
+    )
+    candidates[candidates != -1] -= query_len
+    return candidates
@@ -0,0 +1,87 @@
+# Copyright      2023   Xiaomi Corp.
+#
+# See ../../../LICENSE for clarification regarding multiple authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from typing import List, Optional, Tuple
+
+import _fasttextsearch
+import numpy as np
+from _fasttextsearch import SegmenterOptions
+
+
+def find_segments(
+    alignments: List[Tuple[int, np.ndarray, np.ndarray, np.ndarray]],
+    times: List[np.ndarray],
+    references: List[np.ndarray],
+    options: Optional[SegmenterOptions] = None,
+    num_threads: int = 1,
+) -> List[Tuple[np.ndarray, np.ndarray, np.ndarray]]:
+    """
+    Splits alignments of long recordings with their reference texts into
+    segments, as described in README.txt: every alignment position is scored
+    as the beginning and as the end of a segment (silence from the times,
+    density of errors around it, whitespace and punctuation of the reference),
+    segments are scored from their ends, duration, longest internal silence
+    and numbers of matches and errors, and the best non-overlapping ones are
+    chosen greedily among the best candidates.  This is done in C++, with the
+    recordings processed in parallel.
+
+    Args:
+      alignments:
+        For each recording, an alignment returned by levenshtein_distance()
+        with alignment_format="numpy", i.e. a tuple (end_position, ops,
+        query_positions, target_positions).
+      times:
+        For each recording, the time in seconds of each query symbol, e.g. the
+        `times` of its Transcript; non-decreasing.
+      references:
+        For each recording, the reference text that the query was aligned
+        with, i.e. the target of levenshtein_distance(); target_positions
+        index it.
+      options:
+        The weights and limits of the segmentation; see the SegmenterOptions
+        in textsearch/csrc/segmenter.h for its fields and their defaults.
+      num_threads:
+        The number of threads to use; <= 0 means to use all CPUs.  The
+        result does not depend on it.
+
+    Returns:
+      A list with, for each recording, a tuple (positions, times, scores)
+      describing its segments, in order:
+
+        - positions: np.int32 of shape (num_segments, 6), each row being
+          (begin, end, query_begin, query_end, ref_begin, ref_end): the
+          segment's ranges of alignment positions, of query symbols and of
+          reference symbols, with `end` one past the last position.
+        - times: np.float32 of shape (num_segments, 2), the begin and end
+          times of the segments.
+        - scores: np.float32 of shape (num_segments,).
+    """
+    assert len(alignments) == len(times) == len(references), (
+        len(alignments),
+        len(times),
+        len(references),
+    )
+    if options is None:
+        options = SegmenterOptions()
+    return _fasttextsearch.find_segments(
+        [np.ascontiguousarray(a[1], dtype=np.int8) for a in alignments],
+        [np.ascontiguousarray(a[2], dtype=np.int32) for a in alignments],
+        [np.ascontiguousarray(a[3], dtype=np.int32) for a in alignments],
+        [np.ascontiguousarray(t, dtype=np.float32) for t in times],
+        [np.ascontiguousarray(r, dtype=np.int32) for r in references],
+        options,
+        num_threads=num_threads,
+    )
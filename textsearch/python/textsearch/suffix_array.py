@@ -14,11 +14,20 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+from typing import List, Optional, Tuple
+
 import _fasttextsearch
 import numpy as np
 
+from .datatypes import SourcedText
+
 
-def create_suffix_array(input: np.ndarray) -> np.ndarray:
+def create_suffix_array(
+    input: np.ndarray,
+    algorithm: str = "dc3",
+    num_threads: int = 1,
+    index_dtype=np.int64,
+) -> np.ndarray:
     """
     Creates a suffix array from the input text and returns it as a NumPy array.  Read
     the usage carefully as it has some special requirements that will require careful data
@@ -33,10 +42,27 @@ def create_suffix_array(input: np.ndarray) -> np.ndarray:
           must appear nowhere else in `input` (you may have to map the input
           symbols somehow to achieve this).  It must be followed by 3 zeros, for reasons
           related to how the algorithm works.
+       algorithm: the construction algorithm, either "dc3" (the skew algorithm of
+          Karkkainen & Sanders) or "sais" (induced sorting, Nong et al.).  Both
+          give the same result; "sais" is faster and needs much less memory,
+          so it is preferable for large inputs.
+       num_threads: the number of threads to use for "dc3" ("sais" is
+          single-threaded); <= 0 means to use all CPUs.  The result does not
+          depend on it.
+       index_dtype: the dtype of the returned suffix array, np.int64 or np.int32
+          (np.int32 halves the memory but requires seq_len + 3 < 2^31).
     Returns:
-          Returns a suffix array of type np.int64,
+          Returns a suffix array of type `index_dtype` (np.int64 by default),
           of shape (seq_len,).  This will consist of some permutation of the elements
           0 .. seq_len - 1.
+
+    Inputs of dtype np.uint8, np.uint16, np.int32 and np.int64 are used without
+    copying if they are contiguous, and so are np.int8 and np.int16 (which are
+    viewed as unsigned, since all the symbols are non-negative); other dtypes are
+    converted to np.int64.  For np.int32 and np.int64 inputs, whose EOS symbol is
+    huge, the symbols are first mapped to consecutive ids internally, so the
+    work does not depend on the EOS value (this needs a temporary copy of the
+    input of type `index_dtype`).
     """
     assert input.ndim == 1, input.ndim
     seq_len = input.size - 3
@@ -44,13 +70,76 @@ def create_suffix_array(input: np.ndarray) -> np.ndarray:
     max_symbol = input[seq_len - 1]
     assert max_symbol == np.iinfo(input.dtype).max - 1, max_symbol
     assert bool(input[seq_len:].any()) is False, input[seq_len:]
+    assert algorithm in ("dc3", "sais"), algorithm
+    index_dtype = np.dtype(index_dtype)
+    assert index_dtype in (np.int32, np.int64), index_dtype
+    assert seq_len + 3 <= np.iinfo(index_dtype).max, (seq_len, index_dtype)
 
     # The C++ code requires the input array to be contiguous.
-    input64 = np.ascontiguousarray(input, dtype=np.int64)
-    return _fasttextsearch.create_suffix_array(input64)
+    input = np.ascontiguousarray(input)
+    if input.dtype == np.int8:
+        input = input.view(np.uint8)
+    elif input.dtype == np.int16:
+        input = input.view(np.uint16)
+    elif input.dtype not in (np.uint8, np.uint16, np.int32, np.int64):
+        input = input.astype(np.int64)
+
+    suffix_array = np.empty(seq_len, dtype=index_dtype)
+    _fasttextsearch.create_suffix_array(
+        input, suffix_array, algorithm=algorithm, num_threads=num_threads
+    )
+    return suffix_array
+
+
+def create_lcp_array(
+    input: np.ndarray, suffix_array: np.ndarray, num_threads: int = 1
+) -> np.ndarray:
+    """
+    Creates the LCP (longest common prefix) array of a suffix array, in linear
+    time (this is Kasai's algorithm, in the "permuted LCP" form that visits the
+    suffixes in text order).
+
+    Args:
+       input: the input of create_suffix_array(), of shape (seq_len + 3,).
+       suffix_array: the output of create_suffix_array() for `input`, of dtype
+          np.int32 or np.int64 and shape (seq_len,).
+       num_threads: the number of threads to use; <= 0 means to use all CPUs.
+          The result does not depend on it.
+    Returns:
+       An np.ndarray of the dtype and shape of `suffix_array`, in which element
+       0 is 0 and element i > 0 is the length of the longest common prefix of
+       the suffixes of `input` starting at suffix_array[i-1] and suffix_array[i].
+    """
+    assert input.ndim == 1, input.ndim
+    seq_len = input.size - 3
+    assert seq_len >= 1, seq_len
+    assert suffix_array.shape == (seq_len,), (suffix_array.shape, seq_len)
+    assert suffix_array.dtype in (np.int32, np.int64), suffix_array.dtype
+
+    # As in create_suffix_array().
+    input = np.ascontiguousarray(input)
+    if input.dtype == np.int8:
+        input = input.view(np.uint8)
+    elif input.dtype == np.int16:
+        input = input.view(np.uint16)
+    elif input.dtype not in (np.uint8, np.uint16, np.int32, np.int64):
+        input = input.astype(np.int64)
+    index_dtype = suffix_array.dtype
+    # There is no C++ version for np.int64 symbols with np.int32 indexes.
+    if index_dtype == np.int32 and input.dtype == np.int64:
+        suffix_array = suffix_array.astype(np.int64)
+
+    suffix_array = np.ascontiguousarray(suffix_array)
+    lcp = np.empty(seq_len, dtype=suffix_array.dtype)
+    _fasttextsearch.create_lcp_array(
+        input, suffix_array, lcp, num_threads=num_threads
+    )
+    return lcp.astype(index_dtype, copy=False)
 
 
-def find_close_matches(suffix_array: np.ndarray, query_len: int) -> np.ndarray:
+def find_close_matches(
+    suffix_array: np.ndarray, query_len: int, num_threads: int = 1
+) -> np.ndarray:
     """
     Assuming the suffix array was created from a text where the first `query_len`
     positions represent the query text and the remaining positions represent
@@ -67,11 +156,14 @@ def find_close_matches(suffix_array: np.ndarray, query_len: int) -> np.ndarray:
 
     Args:
      suffix_array: A suffix array as created by create_suffix_array(), of dtype
-        np.int64 and shape (seq_len,).
+        np.int32 or np.int64 and shape (seq_len,).
 
       query_len: A number 0 <= query_len < seq_len, indicating the length in symbols
        (likely bytes) of the query part of the text that was used to create `suffix_array`.
 
+      num_threads: the number of threads to use; <= 0 means to use all CPUs.
+       The result does not depend on it.
+
     Returns an np.ndarray of shape (query_len * 2,), of the same dtype as suffix_array,
       in which positions 2*i and 2*i + 1 represent the two positions in the original
       text that are within the reference portion, and which immediately follow and
@@ -85,23 +177,271 @@ def find_close_matches(suffix_array: np.ndarray, query_len: int) -> np.ndarray:
     """
     assert query_len >= 0, query_len
     assert suffix_array.ndim == 1, suffix_array.ndim
-    assert suffix_array.dtype == np.int64, suffix_array.dtype
+    assert suffix_array.dtype in (np.int32, np.int64), suffix_array.dtype
     seq_len = suffix_array.size
     assert query_len < seq_len, (query_len, seq_len)
 
-    output = np.empty(query_len * 2, dtype=suffix_array.dtype)
-
-    last_pos = -1
-    for i in range(seq_len):
-        text_pos = suffix_array[i]
-        if text_pos >= query_len:
-            for j in range(last_pos + 1, i):
-                query_pos = suffix_array[j]
-                if query_pos < query_len:
-                    pre_ref_pos = (
-                        seq_len - 2 if last_pos == -1 else suffix_array[last_pos]
-                    )
-                    output[2 * query_pos] = pre_ref_pos
-                    output[2 * query_pos + 1] = text_pos
-            last_pos = i
-    return output
+    # The C++ code requires the suffix array to be contiguous.
+    suffix_array = np.ascontiguousarray(suffix_array)
+    return _fasttextsearch.find_close_matches(
+        suffix_array, query_len, num_threads=num_threads
+    )
+
+
+def find_close_matches_with_lengths(
+    suffix_array: np.ndarray,
+    lcp: np.ndarray,
+    query_len: int,
+    num_close_matches: int = 1,
+    min_match_length: int = 0,
+    num_threads: int = 1,
+) -> Tuple[np.ndarray, np.ndarray]:
+    """
+    Like find_close_matches(), but it can return up to `num_close_matches`
+    reference positions on each side of each query position in the suffix array,
+    and it also returns the lengths of the matches, i.e. the lengths of the
+    common prefixes of their suffixes with the query suffix (from the LCP array).
+    Matches shorter than `min_match_length` are not returned; since the lengths
+    decrease as we move away from the query position in the suffix array, each
+    side stops at the first one.
+
+    Args:
+      suffix_array: as for find_close_matches().
+      lcp: the LCP array of `suffix_array`, as returned by create_lcp_array().
+      query_len: as for find_close_matches().
+      num_close_matches: the maximum number of matches on each side, >= 1.
+      min_match_length: the minimum length of a match.
+      num_threads: the number of threads to use; <= 0 means to use all CPUs.
+       The result does not depend on it.
+
+    Returns (close_matches, match_lengths), np.ndarrays of shape
+      (query_len * 2 * num_close_matches,) and of the same dtype as
+      suffix_array.  With k = num_close_matches, elements [2*k*i, 2*k*i + k) of
+      close_matches are the reference positions preceding query position i in
+      the suffix array, nearest first, and elements [2*k*i + k, 2*k*(i+1)) those
+      that follow it.  Unused elements are seq_len - 2, with a match length of
+      0.  With num_close_matches=1 and min_match_length=0, close_matches is the
+      output of find_close_matches().
+    """
+    assert query_len >= 0, query_len
+    assert suffix_array.ndim == 1, suffix_array.ndim
+    assert suffix_array.dtype in (np.int32, np.int64), suffix_array.dtype
+    assert lcp.shape == suffix_array.shape, (lcp.shape, suffix_array.shape)
+    seq_len = suffix_array.size
+    assert query_len < seq_len, (query_len, seq_len)
+    assert num_close_matches >= 1, num_close_matches
+
+    suffix_array = np.ascontiguousarray(suffix_array)
+    lcp = np.ascontiguousarray(lcp, dtype=suffix_array.dtype)
+    return _fasttextsearch.find_close_matches_with_lengths(
+        suffix_array,
+        lcp,
+        query_len,
+        num_close_matches=num_close_matches,
+        min_match_length=min_match_length,
+        num_threads=num_threads,
+    )
+
+
+def find_candidate_matches(
+    close_matches: np.ndarray,
+    text: SourcedText,
+    length_ratio: float = 2.0,
+    num_candidates: int = 5,
+    num_threads: int = 1,
+    match_lengths: Optional[np.ndarray] = None,
+    num_close_matches: int = 1,
+) -> np.ndarray:
+    """
+    Find candidate regions in reference document that could be good matches for
+    each query document.
+
+    For each query document we look for the up-to-`num_candidates` non-overlapping
+    pieces of one reference document, of length at most
+    (this_query_len * length_ratio), that contain the largest number of "hits" in
+    the output of find_close_matches().  This is a sliding-window scan over the
+    sorted close matches of each query document; the "non-overlapping"
+    constraint is handled greedily, so the solution is approximate.
+
+    Args:
+       close_matches: an np.ndarray of shape (2*tot_query_symbols,) as returned by
+          find_close_matches(), indicating two close matches within the reference
+          text for each symbol in the query documents.
+       text:  The SourcedText corresponding to the query and reference documents
+          combined; needed for its `doc` member which must be an np.ndarray
+          with non-decreasing document indexes 0, 1, ..., with the query
+          documents first.
+       length_ratio: indicates the maximum candidate-region length, which will be reduced
+          if the matching reference document was shorter than this.
+       num_candidates:  the number of candidate regions to find for each query
+          document.
+       num_threads: the number of threads to use; query documents are processed
+          in parallel.  <= 0 means to use all CPUs.  The result does not depend
+          on it.
+       match_lengths: optional: the match lengths returned with `close_matches`
+          by find_close_matches_with_lengths().  If given, the regions are
+          scored by the total length of their close matches instead of by
+          their number, so that long matches count for more than short,
+          probably spurious ones, and matches of length 0 are ignored.
+       num_close_matches: the num_close_matches that was passed to
+          find_close_matches_with_lengths(); with it, close_matches has
+          2 * num_close_matches elements per query symbol.  Requires
+          match_lengths if not 1.
+    Returns:
+       An np.ndarray of dtype np.int64 and shape (num_query_docs, num_candidates, 2),
+       in which [q, k] is the (begin, end) position within `text` of the k'th best
+       candidate region for query document q (best first), with `end` one past the
+       last close match in the region.  Unused slots are filled with -1.
+    """
+    assert close_matches.ndim == 1, close_matches.ndim
+    assert close_matches.dtype in (np.int32, np.int64), close_matches.dtype
+    assert isinstance(text.doc, np.ndarray), type(text.doc)
+    doc = text.doc
+    assert num_close_matches >= 1, num_close_matches
+    assert match_lengths is not None or num_close_matches == 1, num_close_matches
+    tot_query_symbols = close_matches.size // (2 * num_close_matches)
+    assert close_matches.size == 2 * num_close_matches * tot_query_symbols, (
+        close_matches.size,
+        num_close_matches,
+    )
+    assert tot_query_symbols <= doc.size, (tot_query_symbols, doc.size)
+
+    num_docs = int(doc[-1]) + 1 if doc.size > 0 else 0
+    num_query_docs = int(doc[tot_query_symbols - 1]) + 1 if tot_query_symbols > 0 else 0
+    row_splits = np.searchsorted(doc, np.arange(num_docs + 1), side="left")
+    row_splits = row_splits.astype(close_matches.dtype)
+    assert row_splits[num_query_docs] == tot_query_symbols, (
+        row_splits[num_query_docs],
+        tot_query_symbols,
+    )
+
+    close_matches = np.ascontiguousarray(close_matches)
+    if match_lengths is not None:
+        assert match_lengths.shape == close_matches.shape, (
+            match_lengths.shape,
+            close_matches.shape,
+        )
+        match_lengths = np.ascontiguousarray(match_lengths, dtype=close_matches.dtype)
+    return _fasttextsearch.find_candidate_matches(
+        close_matches,
+        row_splits,
+        num_query_docs,
+        length_ratio=length_ratio,
+        num_candidates=num_candidates,
+        num_threads=num_threads,
+        match_lengths=match_lengths,
+        num_close_matches=num_close_matches,
+    )
+
+
+def write_suffix_array_index(
+    filename: str,
+    text: np.ndarray,
+    suffix_array: np.ndarray,
+    lcp: Optional[np.ndarray] = None,
+    row_splits: Optional[np.ndarray] = None,
+) -> None:
+    """
+    Writes a suffix array and the text it was created from to a file that can be
+    loaded with SuffixArrayIndex(filename), which memory-maps it so that loading
+    a large index takes milliseconds and several processes share its memory.
+
+    Args:
+      filename: the file to write.
+      text: the input of create_suffix_array(), of shape (seq_len + 3,), i.e.
+         including the EOS symbol and the 3 zeros after it; it is stored with its
+         dtype (any integer type of at most 64 bits).
+      suffix_array: the suffix array created from `text`, of dtype np.int32 or
+         np.int64 and shape (seq_len,).  It is stored as np.int32 if seq_len + 3
+         fits in np.int32.
+      lcp: optional: the LCP array of `suffix_array`, of its dtype and shape.
+      row_splits: optional: the start of each document in `text`, plus its end,
+         e.g. for find_candidate_matches(); it is stored as np.int64.
+
+    SuffixArrayIndex(filename, verify_checksums=False) has the read-only arrays
+    `text`, `suffix_array`, `lcp` and `row_splits` (None if they were not
+    written) which point into the mapping.  The header of the file is always
+    checked when loading it; verify_checksums=True (or index.verify_checksums())
+    also checks the checksums of the arrays, which reads the whole file.
+    """
+    assert text.ndim == 1, text.ndim
+    assert text.size >= 4, text.size
+    assert suffix_array.shape == (text.size - 3,), (suffix_array.shape, text.shape)
+    assert suffix_array.dtype in (np.int32, np.int64), suffix_array.dtype
+    if lcp is not None:
+        assert lcp.shape == suffix_array.shape, (lcp.shape, suffix_array.shape)
+        lcp = np.ascontiguousarray(lcp, dtype=suffix_array.dtype)
+    if row_splits is not None:
+        assert row_splits.ndim == 1 and row_splits.size >= 1, row_splits.shape
+        row_splits = np.ascontiguousarray(row_splits, dtype=np.int64)
+
+    _fasttextsearch.write_suffix_array_index(
+        filename,
+        np.ascontiguousarray(text),
+        np.ascontiguousarray(suffix_array),
+        lcp=lcp,
+        row_splits=row_splits,
+    )
+
+
+def create_suffix_array_index_external(
+    text_filename: str,
+    dtype,
+    output_filename: str,
+    memory_budget: int = 2**30,
+    temp_dir: Optional[str] = None,
+    num_threads: int = 1,
+) -> None:
+    """
+    Creates the suffix array of a text in a file, using a bounded amount of
+    memory whatever the size of the text, and writes it as an index file that
+    can be loaded with SuffixArrayIndex or ReferenceIndex.load().  The suffix
+    array is the same as that of create_suffix_array(), but it is built with
+    external merge sorts on temporary files, so it is slower; use it for texts
+    whose suffix array doesn't fit in memory.
+
+    Args:
+      text_filename: a file with the input of create_suffix_array(), i.e. the
+        text, its EOS symbol and 3 zeros, as raw symbols of type `dtype`, e.g.
+        written with np.ndarray.tofile().  The symbols must be >= 0, and the EOS
+        symbol larger than the others.
+      dtype: the dtype of the symbols, any integer type of at most 64 bits.
+      output_filename: the index file to write; it has no LCP array.
+      memory_budget: the memory to use for sorting, in bytes.
+      temp_dir: the directory of the temporary files, which need about 64 bytes
+        per symbol; if None, that of `output_filename`.
+      num_threads: the number of threads sorting in memory; <= 0 means to use
+        all CPUs.
+    """
+    assert memory_budget > 0, memory_budget
+    _fasttextsearch.create_suffix_array_index_external(
+        text_filename,
+        np.dtype(dtype),
+        output_filename,
+        memory_budget=memory_budget,
+        temp_dir=temp_dir if temp_dir is not None else "",
+        num_threads=num_threads,
+    )
+
+
+def merge_suffix_array_indexes(filenames: List[str], output_filename: str) -> None:
+    """
+    Merges index files written by write_suffix_array_index() ("shards", e.g.
+    built separately for the parts of a growing reference collection) into one
+    index, without loading them into memory or rebuilding a suffix array.
+
+    The text of the output is the concatenation of the texts of the shards, each
+    with its EOS symbol (which therefore occurs once per shard), followed by 3
+    zeros.  Its suffix array orders the suffixes of the shards, each compared
+    only up to the end of its shard, and it has an LCP array and row_splits
+    (with one document for each shard that has no row_splits; the EOS symbol of
+    a shard is in its last document).  It can be loaded with
+    ReferenceIndex.load(), whose matches never include the EOS symbols.
+
+    Args:
+      filenames: the shards, which must have the same text dtype and EOS symbol.
+      output_filename: the file to write.
+    """
+    assert len(filenames) >= 1, filenames
+    _fasttextsearch.merge_suffix_array_indexes(list(filenames), output_filename)
+